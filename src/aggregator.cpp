@@ -0,0 +1,172 @@
+#include "aggregator.hpp"
+#include "predicate.hpp"
+#include "result_sorter.hpp"
+#include <algorithm>
+#include <json.hpp>
+
+using namespace nosqlite;
+using json = nlohmann::json;
+
+/**
+ * @brief Collects the values of a group field, each one once. Arrays give their elements at any depth, like in the indexes.
+ */
+static void collect_group_values(const json &value, std::vector<json> &values) {
+    if (value.is_array()) {
+        for (const json &element : value) collect_group_values(element, values);
+    }
+    else if (std::find(values.begin(), values.end(), value) == values.end()) values.push_back(value);
+}
+
+/**
+ * @brief Gets the values of a group field of a document, null for missing fields and empty arrays.
+ */
+static std::vector<json> group_values(const json &document, const field_type &field) {
+    const json *value = predicate::resolve(document, field);
+    std::vector<json> values;
+    if (value != nullptr) collect_group_values(*value, values);
+    if (values.empty()) values.push_back(json());
+    return values;
+}
+
+/**
+ * @brief Puts a value in a row at the path of its field.
+ */
+static void set_nested(json &row, const field_type &field, const json &value) {
+    json *current = &row;
+    for (size_t i = 0; i + 1 < field.size(); i++) {
+        if (!(*current)[field[i]].is_object()) (*current)[field[i]] = json::object();
+        current = &(*current)[field[i]];
+    }
+    (*current)[field.back()] = value;
+}
+
+
+std::string aggregator::aggregate_name(const aggregate_type &aggregate) {
+    if (!aggregate.name.empty()) return aggregate.name;
+    static const std::string names[] = {"count", "sum", "avg", "min", "max"};
+    std::string name = names[aggregate.op];
+    for (size_t i = 0; i < aggregate.field.size(); i++) name += (i == 0 ? "_" : ".") + aggregate.field[i];
+    return name;
+}
+
+aggregator::aggregator(const std::vector<aggregate_type> &aggregates, const std::vector<field_type> &group_by)
+    : aggregates(aggregates), group_by(group_by), groups(get_max_threads()) {}
+
+std::vector<field_type> aggregator::get_fields() const {
+    std::vector<field_type> fields = this->group_by;
+    for (const aggregate_type &aggregate : this->aggregates) {
+        if (!aggregate.field.empty()) fields.push_back(aggregate.field);
+    }
+    return fields;
+}
+
+void aggregator::merge(partial &merged, const partial &other) {
+    merged.count += other.count;
+    merged.numbers += other.numbers;
+    merged.sum += other.sum;
+    if (!other.min.is_null() && (merged.min.is_null() || result_sorter::compare(other.min, merged.min) < 0)) merged.min = other.min;
+    if (!other.max.is_null() && (merged.max.is_null() || result_sorter::compare(other.max, merged.max) > 0)) merged.max = other.max;
+}
+
+void aggregator::add(const json &document, int thread_num) {
+    // Every combination of the values of the group fields.
+    std::vector<json> combinations = {json::array()};
+    for (const field_type &field : this->group_by) {
+        std::vector<json> values = group_values(document, field), extended;
+        for (const json &combination : combinations) {
+            for (const json &value : values) {
+                extended.push_back(combination);
+                extended.back().push_back(value);
+            }
+        }
+        combinations.swap(extended);
+    }
+
+    // Groups are keyed by the values in the form the indexes use, so equal numbers (e.g.: 1 and 1.0) are in the same group.
+    std::unordered_map<std::string, group> &thread_groups = this->groups[thread_num];
+    for (const json &values : combinations) {
+        std::string key = "[";
+        for (size_t i = 0; i < values.size(); i++) key += (i == 0 ? "" : ",") + canonical_dump(values[i]);
+        key += "]";
+        group &found = thread_groups[key];
+        if (found.values.is_null()) {
+            found.values = json::parse(key);
+            found.partials.resize(this->aggregates.size());
+        }
+
+        for (size_t i = 0; i < this->aggregates.size(); i++) {
+            const aggregate_type &aggregate = this->aggregates[i];
+            partial &current = found.partials[i];
+            if (aggregate.field.empty()) {
+                current.count++;
+                continue;
+            }
+            const json *value = predicate::resolve(document, aggregate.field);
+            if (value == nullptr || value->is_null()) continue;
+            current.count++;
+            if (value->is_number()) {
+                current.numbers++;
+                current.sum += value->get<double>();
+            }
+            if (aggregate.op == MIN_AGGREGATE && (current.min.is_null() || result_sorter::compare(*value, current.min) < 0)) current.min = *value;
+            if (aggregate.op == MAX_AGGREGATE && (current.max.is_null() || result_sorter::compare(*value, current.max) > 0)) current.max = *value;
+        }
+    }
+}
+
+std::vector<json> aggregator::results() {
+    std::unordered_map<std::string, group> merged;
+    for (std::unordered_map<std::string, group> &thread_groups : this->groups) {
+        for (auto &[key, thread_group] : thread_groups) {
+            auto found = merged.find(key);
+            if (found == merged.end()) merged.emplace(key, std::move(thread_group));
+            else {
+                for (size_t i = 0; i < this->aggregates.size(); i++) merge(found->second.partials[i], thread_group.partials[i]);
+            }
+        }
+        thread_groups.clear();
+    }
+
+    // Without group fields every document is in the same group, which exists even if there are none.
+    if (this->group_by.empty() && merged.empty()) merged["[]"] = {json::array(), std::vector<partial>(this->aggregates.size())};
+
+    std::vector<group*> ordered;
+    for (auto &[key, merged_group] : merged) ordered.push_back(&merged_group);
+    std::sort(ordered.begin(), ordered.end(), [](const group *a, const group *b) {
+        for (size_t i = 0; i < a->values.size(); i++) {
+            int comparison = result_sorter::compare(a->values[i], b->values[i]);
+            if (comparison != 0) return comparison < 0;
+        }
+        return false;
+    });
+
+    std::vector<json> rows;
+    for (const group *current : ordered) {
+        json row = json::object();
+        for (size_t i = 0; i < this->group_by.size(); i++) set_nested(row, this->group_by[i], current->values[i]);
+        for (size_t i = 0; i < this->aggregates.size(); i++) {
+            const partial &result = current->partials[i];
+            json value;
+            switch (this->aggregates[i].op) {
+                case COUNT_AGGREGATE:
+                    value = result.count;
+                    break;
+                case SUM_AGGREGATE:
+                    value = result.sum;
+                    break;
+                case AVG_AGGREGATE:
+                    if (result.numbers > 0) value = result.sum / result.numbers;
+                    break;
+                case MIN_AGGREGATE:
+                    value = result.min;
+                    break;
+                case MAX_AGGREGATE:
+                    value = result.max;
+                    break;
+            }
+            row[aggregate_name(this->aggregates[i])] = value;
+        }
+        rows.push_back(row);
+    }
+    return rows;
+}
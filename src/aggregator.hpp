@@ -0,0 +1,100 @@
+/**
+ * @file aggregator.hpp
+ */
+#ifndef AGGREGATOR_CLASS_H
+#define AGGREGATOR_CLASS_H
+
+#include "auxiliary.hpp"
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <json.hpp>
+using json = nlohmann::json;
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @class aggregator
+     * @brief Computes aggregates over groups of documents as the threads of a read add them, without keeping the documents. Each thread has its own table of groups with the partial aggregates of its documents, which are merged at the end.
+     * A document is in the group of the values of the group fields (null for missing fields). A group field with an array puts the document in the group of each of its elements, at any depth like in the indexes.
+     */
+    class aggregator {
+    private:
+
+        /**
+         * @brief Partial aggregate of the documents of a group added by a thread: the documents counted, the sum of the numbers and how many there were, and the smallest and largest values.
+         */
+        struct partial {
+            unsigned long long count = 0;
+            unsigned long long numbers = 0;
+            double sum = 0;
+            json min, max;
+        };
+
+        /**
+         * @brief Values of the group fields of a group and its partial aggregates.
+         */
+        struct group {
+            json values;
+            std::vector<partial> partials;
+        };
+
+        /**
+         * @brief Aggregates computed and fields the documents are grouped by.
+         */
+        std::vector<aggregate_type> aggregates;
+        std::vector<field_type> group_by;
+
+        /**
+         * @brief Groups of each thread, by the text of their values.
+         */
+        std::vector<std::unordered_map<std::string, group>> groups;
+
+        /**
+         * @param merged Partial aggregate merged into.
+         * @param other Partial aggregate of the same group from another thread.
+         * @brief Merges two partial aggregates.
+         */
+        static void merge(partial &merged, const partial &other);
+
+    public:
+
+        /**
+         * @param aggregate Aggregate.
+         * @brief Gets the name of the result of an aggregate: its name or, if it has none, the function and the field (e.g.: "count", "avg_imdb.rating").
+         */
+        static std::string aggregate_name(const aggregate_type &aggregate);
+
+        /**
+         * @param aggregates Aggregates computed over each group.
+         * @param group_by Fields the documents are grouped by, none for a single group of every document.
+         * @brief Constructor for the aggregator class.
+         */
+        aggregator(const std::vector<aggregate_type> &aggregates, const std::vector<field_type> &group_by);
+
+        /**
+         * @brief Gets the fields the aggregates and the groups read, so documents can be read with just them.
+         */
+        std::vector<field_type> get_fields() const;
+
+        /**
+         * @param document Document.
+         * @param thread_num Number of the thread that adds it.
+         * @brief Adds a document to its groups. Threads can add documents at the same time, each with its own number.
+         */
+        void add(const json &document, int thread_num);
+
+        /**
+         * @brief Merges the groups of the threads and gets a row for each one, with the values of the group fields (nested like the fields) and the result of each aggregate, ordered by the values of the group fields.
+         * Without group fields there is always one row. Sums of no numbers are 0, averages, minimums and maximums of no values are null.
+         */
+        std::vector<json> results();
+    };
+
+}
+
+#endif
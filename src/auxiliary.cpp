@@ -1,8 +1,22 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <cmath>
+#include <regex>
 #include "auxiliary.hpp"
 
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+#ifdef _WIN32
+    #include <io.h>
+    #include <fcntl.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
 namespace nosqlite {
     
     std::string get_last_dir(const std::string &path) {
@@ -21,23 +35,64 @@ namespace nosqlite {
         return 0;
     }
 
-    std::string hash_string(const std::string &str) {
-        std::hash<std::string> hash_func;
-        size_t hash = hash_func(str);
+    std::string storage_type_to_string(storage_type storage) {
+        return storage == SEGMENT_STORAGE ? "segment" : "hashed";
+    }
+
+    storage_type storage_type_from_string(const std::string &name) {
+        return name == "segment" ? SEGMENT_STORAGE : HASHED_STORAGE;
+    }
+
+    std::string index_type_to_string(index_type type) {
+        if (type == BITMAP_INDEX) return "bitmap";
+        if (type == TEXT_INDEX) return "text";
+        if (type == TRIGRAM_INDEX) return "trigram";
+        if (type == GEO_INDEX) return "geo";
+        if (type == VECTOR_INDEX) return "vector";
+        return type == BTREE_INDEX ? "btree" : "hash";
+    }
 
+    index_type index_type_from_string(const std::string &name) {
+        if (name == "bitmap") return BITMAP_INDEX;
+        if (name == "text") return TEXT_INDEX;
+        if (name == "trigram") return TRIGRAM_INDEX;
+        if (name == "geo") return GEO_INDEX;
+        if (name == "vector") return VECTOR_INDEX;
+        return name == "btree" ? BTREE_INDEX : HASH_INDEX;
+    }
+
+    std::string to_hex(unsigned long long value) {
         std::stringstream stream;
-        stream << std::hex << hash;
+        stream << std::hex << value;
         return stream.str();
     }
 
+    std::string hash_string(const std::string &str) {
+        std::hash<std::string> hash_func;
+        return to_hex(hash_func(str));
+    }
+
+    unsigned long long hash_integer_value(unsigned long long num) {
+        std::hash<std::string> hash_func;
+        return hash_func(std::to_string(num));
+    }
+
     std::string hash_integer(unsigned long long num) {
-        return hash_string(std::to_string(num));
+        return to_hex(hash_integer_value(num));
     }
 
     std::string hash_json(const json &object) {
         return hash_string(object.dump());
     }
 
+    std::string canonical_dump(const json &value) {
+        if (value.is_number_float()) {
+            double number = value.get<double>();
+            if (number == std::floor(number) && std::fabs(number) < 9.0e15) return json((long long) number).dump();
+        }
+        return value.dump();
+    }
+
     void throw_failed_to_open_file(fs::path path) {
         std::cerr << "Error: Failed to open file: " << path << "." << std::endl;
     }
@@ -136,32 +191,27 @@ namespace nosqlite {
         return index_names;
     }
 
-    std::string build_index_name(const field_type &fields) {
-        std::string name = "hash";
+    std::string build_index_name(const std::vector<field_type> &fields, index_type type) {
+        std::string name = index_type_to_string(type) + "_";
 
-        for (const std::string &field : fields) {
-            name +=  "_" + field;
+        for (size_t i = 0; i < fields.size(); i++) {
+            if (i > 0) name += "-";
+            for (size_t j = 0; j < fields[i].size(); j++) {
+                if (j > 0) name += "_";
+                name += fields[i][j];
+            }
         }
  
         return name;
     }
     
-    bool compare(const json &value1, const std::string &op, const json &value2) {
-        if (value1.is_array()) {
-            for (const auto &val : value1) {
-                if (compare(val, op, value2)) return true;
-            }
+    bool valid_regex(const std::string &pattern) {
+        try {
+            std::regex expression(pattern);
+        } catch (const std::regex_error &error) {
             return false;
         }
-
-        if (op == "==") return value1 == value2;
-        if (op == "!=") return value1 != value2;
-        if (op == ">")  return value1.is_number() && value2.is_number() && value1 > value2;
-        if (op == "<")  return value1.is_number() && value2.is_number() && value1 < value2;
-        if (op == ">=") return value1.is_number() && value2.is_number() && value1 >= value2;
-        if (op == "<=") return value1.is_number() && value2.is_number() && value1 <= value2;
-    
-        return false;
+        return true;
     }
 
     void pool_results(const std::vector<std::vector<json>> &all_results, std::vector<json> &results) {
@@ -171,12 +221,45 @@ namespace nosqlite {
         }
     }
 
+    int get_max_threads() {
+        #ifdef _OPENMP
+            return omp_get_max_threads();
+        #else
+            return 1;
+        #endif
+    }
+
     void collect_paths(const std::string &collection_path, std::vector<fs::path> &paths) {
-        for (const fs::path &file_path : fs::recursive_directory_iterator(collection_path)) {
-            if (file_path.extension() != ".json" || file_path.filename() == "header.json" || file_path.filename() == "index.json") continue; 
+        for (auto it = fs::recursive_directory_iterator(collection_path); it != fs::recursive_directory_iterator(); ++it) {
+            const fs::path &file_path = it->path();
+            // The index files are not documents.
+            if (it->is_directory() && file_path.filename() == "indexes") {
+                it.disable_recursion_pending();
+                continue;
+            }
+            if (file_path.extension() != ".json" || file_path.filename() == "header.json" || file_path.filename() == "statistics.json") continue;
             paths.push_back(file_path);
         }
     }
 
+    int sync_file(const fs::path &path) {
+        #ifdef _WIN32
+            // Directories can't be opened as files on Windows, the file system journals their changes.
+            if (fs::is_directory(path)) return 0;
+            int fd = _open(path.string().c_str(), _O_RDWR | _O_BINARY);
+            bool ok = fd >= 0 && _commit(fd) == 0;
+            if (fd >= 0) _close(fd);
+        #else
+            int fd = ::open(path.c_str(), O_RDONLY);
+            bool ok = fd >= 0 && ::fsync(fd) == 0;
+            if (fd >= 0) ::close(fd);
+        #endif
+        if (!ok) {
+            std::cerr << "Error: Failed to write file: " << path << " to disk." << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
 
 }
@@ -34,6 +34,89 @@ namespace nosqlite {
 
     static condition_type empty_condition = {{}, "", {}};
 
+    /**
+     * @brief Key the results of a read are sorted by: a field and the direction.
+     */
+    struct sort_key {
+        field_type field;
+        bool descending = false;
+    };
+
+    /**
+     * @brief Which part of the results of a read is returned and in which order: the number of documents skipped, the most documents returned (0 for all of them), the fields kept in each one (all of them if there are none),
+     * the keys they are sorted by (none keeps the order of the read) and the bytes of documents a sort keeps in memory before it writes them to temporary files.
+     */
+    struct read_options {
+        size_t skip = 0;
+        size_t limit = 0;
+        std::vector<field_type> fields;
+        std::vector<sort_key> order;
+        size_t sort_memory = 256 * 1024 * 1024;
+    };
+
+    /**
+     * @brief Function of an aggregate: the number of documents (with the field, if it has one), the sum and average of the numbers of a field and the smallest and largest of its values.
+     */
+    enum aggregate_op {COUNT_AGGREGATE, SUM_AGGREGATE, AVG_AGGREGATE, MIN_AGGREGATE, MAX_AGGREGATE};
+
+    /**
+     * @brief Aggregate computed over the documents of each group: the function, the field it reads (none to count every document) and the name of the result, by default the function and the field (e.g.: "avg_imdb.rating").
+     */
+    struct aggregate_type {
+        aggregate_op op;
+        field_type field;
+        std::string name;
+    };
+
+    /**
+     * @brief Layout used to store the documents of a collection.
+     * HASHED_STORAGE keeps every document in a file named after the hash of its id.
+     * SEGMENT_STORAGE appends the documents to a few large segment files.
+     */
+    enum storage_type {HASHED_STORAGE, SEGMENT_STORAGE};
+
+    /**
+     * @param storage Storage layout.
+     * @brief Gets the name of the storage layout as written in the collection header.
+     */
+    std::string storage_type_to_string(storage_type storage);
+
+    /**
+     * @param name Name of the storage layout as written in the collection header.
+     * @brief Gets the storage layout with the given name. Unknown names default to HASHED_STORAGE.
+     */
+    storage_type storage_type_from_string(const std::string &name);
+
+    /**
+     * @brief Structure of a secondary index.
+     * HASH_INDEX answers equality conditions.
+     * BTREE_INDEX keeps the numeric values in order and answers equality conditions and range conditions on numbers.
+     * BITMAP_INDEX keeps a bitmap of documents per value and answers equality and inequality conditions on fields with few distinct values.
+     * TEXT_INDEX keeps the words of string fields and answers "text" conditions, ranking the documents.
+     * TRIGRAM_INDEX keeps the sequences of three characters of string fields and narrows down "contains", "prefix" and "regex" conditions.
+     * GEO_INDEX keeps the points of coordinate fields by geohash and answers "near" and "within_box" conditions.
+     * VECTOR_INDEX keeps the embeddings of array fields in a float matrix and answers nearest neighbour searches.
+     */
+    enum index_type {HASH_INDEX, BTREE_INDEX, BITMAP_INDEX, TEXT_INDEX, TRIGRAM_INDEX, GEO_INDEX, VECTOR_INDEX};
+
+    /**
+     * @brief Similarity of two vectors in nearest neighbour searches.
+     * DOT_PRODUCT ranks by the dot product, COSINE_SIMILARITY by the cosine of the angle between the vectors and L2_DISTANCE by the euclidean distance, the closest first.
+     */
+    enum vector_metric {DOT_PRODUCT, COSINE_SIMILARITY, L2_DISTANCE};
+
+    /**
+     * @param type Index structure.
+     * @brief Gets the name of the index structure as used in the index names and files.
+     */
+    std::string index_type_to_string(index_type type);
+
+    /**
+     * @param name Name of the index structure.
+     * @brief Gets the index structure with the given name. Unknown names default to HASH_INDEX.
+     */
+    index_type index_type_from_string(const std::string &name);
+
     /**
      * @param path File path with to a directory without trailing /.
      * @brief Extracts the last directory in a file path.
@@ -54,6 +137,18 @@ namespace nosqlite {
      */
     std::string hash_string(const std::string &str);
 
+    /**
+     * @param value Value to be written.
+     * @brief Writes a value as a hexadecimal string.
+     */
+    std::string to_hex(unsigned long long value);
+
+    /**
+     * @param num Integer to be hashed.
+     * @brief Hashes an Integer.
+     */
+    unsigned long long hash_integer_value(unsigned long long num);
+
     /**
      * @param num Integer to be hashed.
      * @brief Hashes an Integer and returns a hexadecimal string.
@@ -66,6 +161,12 @@ namespace nosqlite {
      */
     std::string hash_json(const json &object);
 
+    /**
+     * @param value JSON value.
+     * @brief Serializes a value so that values equal for the conditions have the same text, e.g. 2 and 2.0.
+     */
+    std::string canonical_dump(const json &value);
+
     /**
      * @param path Path to file.
      * @brief Prints out an error message saying the file didn't open properly.
@@ -134,19 +235,17 @@ namespace nosqlite {
     std::vector<std::string> build_possible_index_names(const json &data, const std::string &prefix = "hash_");
 
     /**
-     * @param fields List of fields
-     * @brief Builds the name of the hash index
+     * @param fields Indexed fields, more than one for compound indexes.
+     * @param type Structure of the index.
+     * @brief Builds the name of the index. Nested fields are joined by '_' and the fields of a compound index by '-'.
      */
-    std::string build_index_name(const field_type &fields);
+    std::string build_index_name(const std::vector<field_type> &fields, index_type type);
 
     /**
-     * @param value1 The first value.
-     * @param op The operation
-     * @param value2 The second value.
-     * @brief Compares the too values according to the operation.
-     * @return The boolean result of the comparison.
+     * @param pattern Regular expression.
+     * @brief Checks if a regular expression (ECMAScript syntax) is valid.
      */
-    bool compare(const json &value1, const std::string &op, const json &value2);
+    bool valid_regex(const std::string &pattern);
 
     /**
      * @param all_results Vector of vectors with the results.
@@ -155,6 +254,11 @@ namespace nosqlite {
      */
     void pool_results(const std::vector<std::vector<json>> &all_results, std::vector<json> &results);
 
+    /**
+     * @brief Gets the maximum number of threads a parallel section can use.
+     */
+    int get_max_threads();
+
     /**
      * @param collection_path Path to the directory.
      * @param paths Vector where the paths will be collected.
@@ -162,6 +266,13 @@ namespace nosqlite {
      */
     void collect_paths(const std::string &collection_path, std::vector<fs::path> &paths);
 
+    /**
+     * @param path Path to a file or directory.
+     * @brief Forces the contents of a file to the disk (fsync). A directory has to be synced for the files created, renamed or removed in it to survive a crash.
+     * @return 0 on success and 1 otherwise.
+     */
+    int sync_file(const fs::path &path);
+
 }
 
 #endif
@@ -0,0 +1,219 @@
+#include "bitmap_index.hpp"
+#include "auxiliary.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <mutex>
+#include <json.hpp>
+
+using namespace nosqlite;
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+// The file has the magic number and the number of values, then the length and key of each value followed by its bitmap.
+static const char bitmap_magic[8] = {'N', 'S', 'Q', 'B', 'M', 'A', 'P', '1'};
+
+
+bitmap_index::bitmap_index(const std::string &path, const std::vector<field_type> &fields) : secondary_index(path, fields), dirty(false) {}
+
+index_type bitmap_index::get_type() const {
+    return BITMAP_INDEX;
+}
+
+bool bitmap_index::supports(const std::string &op, const json &value) const {
+    return (op == "==" || op == "!=") && !value.is_array();
+}
+
+void bitmap_index::collect_keys(const json &value, std::vector<std::string> &keys) {
+    // Conditions on an array match any of its elements, at any depth.
+    if (value.is_array()) {
+        for (const json &element : value) collect_keys(element, keys);
+    }
+    else keys.push_back(canonical_dump(value));
+}
+
+int bitmap_index::write_file() {
+    std::string buffer(bitmap_magic, sizeof(bitmap_magic));
+    unsigned long long count = this->bitmaps.size();
+    buffer.append(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (const auto &[key, bitmap] : this->bitmaps) {
+        unsigned int length = key.size();
+        buffer.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        buffer.append(key);
+        bitmap.serialize(buffer);
+    }
+
+    // The new file replaces the old one in a single rename so a crash leaves one of them whole.
+    fs::path path_to_index(this->path);
+    fs::path temporary = path_to_index / "index.bin.tmp";
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw_failed_to_create_file(temporary);
+        return 1;
+    }
+    file.write(buffer.data(), buffer.size());
+    file.close();
+    if (file.fail()) return 1;
+
+    fs::rename(temporary, path_to_index / "index.bin");
+    this->dirty = false;
+    return 0;
+}
+
+int bitmap_index::open() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+
+    fs::path path_to_file = fs::path(this->path) / "index.bin";
+    if (!fs::exists(path_to_file)) return 1;
+
+    std::ifstream file(path_to_file, std::ios::binary);
+    if (!file.is_open()) {
+        throw_failed_to_open_file(path_to_file);
+        return 1;
+    }
+    std::string buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+
+    const char *at = buffer.data(), *end = buffer.data() + buffer.size();
+    unsigned long long count = 0;
+    bool valid = buffer.size() >= sizeof(bitmap_magic) + sizeof(count) && std::memcmp(at, bitmap_magic, sizeof(bitmap_magic)) == 0;
+    if (valid) {
+        std::memcpy(&count, at + sizeof(bitmap_magic), sizeof(count));
+        at += sizeof(bitmap_magic) + sizeof(count);
+    }
+
+    this->bitmaps.clear();
+    for (unsigned long long i = 0; valid && i < count; i++) {
+        unsigned int length;
+        if (end - at < (long) sizeof(length)) valid = false;
+        else {
+            std::memcpy(&length, at, sizeof(length));
+            at += sizeof(length);
+            if ((size_t) (end - at) < length) valid = false;
+            else {
+                std::string key(at, length);
+                at += length;
+                valid = this->bitmaps[key].deserialize(at, end) == 0;
+            }
+        }
+    }
+
+    if (!valid) {
+        std::cerr << "Error: Invalid bitmap index file: " << path_to_file << "." << std::endl;
+        this->bitmaps.clear();
+        return 1;
+    }
+    this->dirty = false;
+    return 0;
+}
+
+int bitmap_index::build_index(const std::vector<std::pair<json, unsigned long long>> &entries) {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+
+    fs::path path_to_index(this->path);
+    if (this->reset_directory() != 0) {
+        fs::remove_all(path_to_index);
+        return 1;
+    }
+
+    // The ids of each value are sorted first so they are appended to the containers.
+    std::map<std::string, std::vector<unsigned long long>> ids_by_key;
+    std::vector<std::string> keys;
+    for (const auto &[indexee, id] : entries) {
+        keys.clear();
+        collect_keys(indexee, keys);
+        for (const std::string &key : keys) ids_by_key[key].push_back(id);
+    }
+
+    this->bitmaps.clear();
+    for (auto &[key, ids] : ids_by_key) {
+        std::sort(ids.begin(), ids.end());
+        roaring_bitmap &bitmap = this->bitmaps[key];
+        for (unsigned long long id : ids) bitmap.add(id);
+    }
+
+    if (this->write_file() != 0) {
+        std::cerr << "Error: Failed to write bitmap index: " << path_to_index / "index.bin" << "." << std::endl;
+        fs::remove_all(path_to_index);
+        return 1;
+    }
+    return 0;
+}
+
+std::vector<unsigned long long> bitmap_index::consult(const json &value) const {
+    return this->lookup({value}).to_vector();
+}
+
+roaring_bitmap bitmap_index::lookup(const std::vector<json> &values) const {
+    std::shared_lock<std::shared_mutex> shared(this->lock);
+
+    roaring_bitmap result;
+    for (const json &value : values) {
+        auto it = this->bitmaps.find(canonical_dump(value));
+        if (it != this->bitmaps.end()) result = result.unite(it->second);
+    }
+    return result;
+}
+
+roaring_bitmap bitmap_index::lookup_except(const json &value) const {
+    std::shared_lock<std::shared_mutex> shared(this->lock);
+
+    // A document matches if any of its values is different, so it is the union of the bitmaps of every other value.
+    std::string excluded = canonical_dump(value);
+    roaring_bitmap result;
+    for (const auto &[key, bitmap] : this->bitmaps) {
+        if (key != excluded) result = result.unite(bitmap);
+    }
+    return result;
+}
+
+std::vector<json> bitmap_index::values(const std::vector<unsigned long long> &ignored) const {
+    std::shared_lock<std::shared_mutex> shared(this->lock);
+
+    // A value is kept if its bitmap has more documents than the ones left out it contains.
+    std::vector<json> found;
+    for (const auto &[key, bitmap] : this->bitmaps) {
+        unsigned long long left_out = 0;
+        for (unsigned long long id : ignored) left_out += bitmap.contains(id);
+        if (bitmap.cardinality() > left_out) found.push_back(json::parse(key));
+    }
+    return found;
+}
+
+void bitmap_index::update_index(const json &new_value, unsigned long long id) {
+    std::vector<std::string> keys;
+    collect_keys(new_value, keys);
+
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    for (const std::string &key : keys) this->bitmaps[key].add(id);
+    this->dirty = true;
+}
+
+void bitmap_index::remove_from_index(const json &value, unsigned long long id) {
+    std::vector<std::string> keys;
+    collect_keys(value, keys);
+
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    for (const std::string &key : keys) {
+        auto it = this->bitmaps.find(key);
+        if (it == this->bitmaps.end()) continue;
+        it->second.remove(id);
+        if (it->second.empty()) this->bitmaps.erase(it);
+    }
+    this->dirty = true;
+}
+
+int bitmap_index::sync() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    if (!this->dirty) return 0;
+    return this->write_file();
+}
+
+void bitmap_index::delete_index() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    this->bitmaps.clear();
+    this->dirty = false;
+    fs::remove_all(this->get_path());
+}
@@ -0,0 +1,146 @@
+/**
+ * @file bitmap_index.hpp
+ */
+#ifndef BITMAP_INDEX_CLASS_H
+#define BITMAP_INDEX_CLASS_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <shared_mutex>
+#include <json.hpp>
+#include "auxiliary.hpp"
+#include "roaring_bitmap.hpp"
+#include "secondary_index.hpp"
+using json = nlohmann::json;
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @class bitmap_index
+     * @brief Bitmap index for fields with few distinct values. Every value has a compressed bitmap of the ids of the documents with it.
+     * Arrays get the document in the bitmap of each element. The bitmaps are kept in memory and written to index.bin inside the index directory when the index is synced.
+     */
+    class bitmap_index : public secondary_index {
+    private:
+
+        /**
+         * @brief Bitmap of every value, by the key of the value.
+         */
+        std::map<std::string, roaring_bitmap> bitmaps;
+
+        /**
+         * @brief Indicates whether the bitmaps changed since they were last written.
+         */
+        bool dirty;
+
+        /**
+         * @brief Lookups run in parallel, changes to the index need exclusive access.
+         */
+        mutable std::shared_mutex lock;
+
+        /**
+         * @param value Value of the field.
+         * @param keys Destination of the keys.
+         * @brief Collects the keys of a value, one per element for arrays.
+         */
+        static void collect_keys(const json &value, std::vector<std::string> &keys);
+
+        /**
+         * @brief Writes the bitmaps to the index file, replacing it at once.
+         * @return 0 on success and 1 otherwise.
+         */
+        int write_file();
+
+    public:
+
+        /**
+         * @param path Path to the index.
+         * @param fields Indexed field, bitmap indexes have a single one.
+         * @brief Constructor for the bitmap_index class.
+         */
+        bitmap_index(const std::string &path, const std::vector<field_type> &fields);
+
+        /**
+         * @brief Gets the structure of the index.
+         */
+        index_type get_type() const override;
+
+        /**
+         * @brief Opens an index that already exists in the file system.
+         * @return 0 on success and 1 otherwise.
+         */
+        int open() override;
+
+        /**
+         * @param entries Pairs of indexed value and id of the document with that value.
+         * @brief Builds the bitmaps and writes them.
+         * @return 0 on success and 1 otherwise.
+         */
+        int build_index(const std::vector<std::pair<json, unsigned long long>> &entries) override;
+
+        /**
+         * @param op Comparison operator.
+         * @param value Value compared against.
+         * @brief Bitmap indexes answer equality and inequality conditions.
+         */
+        bool supports(const std::string &op, const json &value) const override;
+
+        /**
+         * @param value Value of the indexed field.
+         * @brief Gets the ids of the documents with the value.
+         */
+        std::vector<unsigned long long> consult(const json &value) const override;
+
+        /**
+         * @param values Values of the indexed field.
+         * @brief Gets the documents with any of the values.
+         */
+        roaring_bitmap lookup(const std::vector<json> &values) const;
+
+        /**
+         * @param value Value of the indexed field.
+         * @brief Gets the documents with a value other than the given one, including any element of an array.
+         */
+        roaring_bitmap lookup_except(const json &value) const;
+
+        /**
+         * @param ignored Ids of documents left out.
+         * @brief Gets the distinct indexed values, each element of arrays, that a document other than the ones left out has.
+         */
+        std::vector<json> values(const std::vector<unsigned long long> &ignored) const;
+
+        /**
+         * @param new_value New indexed value.
+         * @param id Id of the document.
+         * @brief Adds the document to the bitmaps of its values.
+         */
+        void update_index(const json &new_value, unsigned long long id) override;
+
+        /**
+         * @param value Indexed value.
+         * @param id Id of the document.
+         * @brief Removes the document from the bitmaps of its values.
+         */
+        void remove_from_index(const json &value, unsigned long long id) override;
+
+        /**
+         * @brief Writes the bitmaps to the disk if they changed.
+         * @return 0 on success and 1 otherwise.
+         */
+        int sync() override;
+
+        /**
+         * @brief Deletes this index.
+         */
+        void delete_index() override;
+
+    };
+
+}
+
+#endif
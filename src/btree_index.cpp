@@ -0,0 +1,476 @@
+#include "btree_index.hpp"
+#include "auxiliary.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <filesystem>
+#include <limits>
+#include <mutex>
+#include <unordered_set>
+#include <json.hpp>
+
+using namespace nosqlite;
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+// The file is split in pages. Page 0 is the header: magic number, root page, height of the tree, pages in use, number of key components, number of entries and the components that had an array.
+// Every other page is a node with a small header (leaf or internal, number of keys and, for leaves, the next leaf).
+// Leaves hold sorted entries. Internal nodes hold n sorted separator keys and n + 1 children, child i has the entries smaller than key i.
+// An entry in the file is its key components followed by the document id.
+static const char btree_magic[8] = {'N', 'S', 'Q', 'B', 'T', 'R', 'E', '3'};
+static const size_t btree_page_size = 4096;
+static const size_t btree_root_offset = 8;
+static const size_t btree_height_offset = 12;
+static const size_t btree_page_count_offset = 16;
+static const size_t btree_components_offset = 20;
+static const size_t btree_entries_offset = 24;
+static const size_t btree_multikey_offset = 32;
+
+static const unsigned int btree_leaf = 1;
+static const unsigned int btree_internal = 2;
+static const size_t btree_node_count_offset = 4;
+static const size_t btree_node_next_offset = 8;
+static const size_t btree_node_header_size = 16;
+
+template <typename T> static T load(const char *at) {
+    T value;
+    std::memcpy(&value, at, sizeof(T));
+    return value;
+}
+
+template <typename T> static void store(char *at, T value) {
+    std::memcpy(at, &value, sizeof(T));
+}
+
+btree_index::btree_index(const std::string &path, const std::vector<field_type> &fields) : secondary_index(path, fields), file((fs::path(path) / "index.bin").string()) {
+    // Internal nodes fit as many keys as possible with one more child than keys.
+    this->components = std::min<size_t>(std::max<size_t>(fields.size(), 1), max_components);
+    this->entry_size = (this->components + 1) * sizeof(unsigned long long);
+    this->leaf_capacity = (btree_page_size - btree_node_header_size) / this->entry_size;
+    this->internal_capacity = (btree_page_size - btree_node_header_size - sizeof(unsigned int)) / (this->entry_size + sizeof(unsigned int));
+}
+
+index_type btree_index::get_type() const {
+    return BTREE_INDEX;
+}
+
+bool btree_index::supports(const std::string &op, const json &value) const {
+    return op == "==" || (value.is_number() && (op == "<" || op == "<=" || op == ">" || op == ">="));
+}
+
+unsigned long long btree_index::encode(const json &value) {
+    if (!value.is_number()) return std::hash<std::string>{}(value.dump());
+
+    // 0.0 and -0.0 are the same number.
+    double number = value.get<double>();
+    if (number == 0) number = 0;
+    unsigned long long bits;
+    std::memcpy(&bits, &number, sizeof(bits));
+    // Negative numbers have every bit flipped so larger magnitudes come first, positive numbers get the sign bit so they come after them.
+    return (bits >> 63) ? ~bits : bits | (1ULL << 63);
+}
+
+void btree_index::collect_keys(const json &value, std::vector<unsigned long long> &keys) {
+    // Conditions on an array match any of its elements, at any depth.
+    if (value.is_array()) {
+        for (const json &element : value) collect_keys(element, keys);
+    }
+    else keys.push_back(encode(value));
+}
+
+unsigned int btree_index::array_components(const json &value) const {
+    unsigned int components = 0;
+    for (unsigned int i = 0; i < this->components; i++) {
+        const json &field_value = this->components == 1 ? value : value[i];
+        if (field_value.is_array()) components |= 1U << i;
+    }
+    return components;
+}
+
+std::vector<btree_index::entry> btree_index::document_entries(const json &value, unsigned long long id) const {
+    // The keys of each field, an empty array keeps a key of its own so the document is still found through the other fields.
+    std::vector<std::vector<unsigned long long>> keys(this->components);
+    for (unsigned int i = 0; i < this->components; i++) {
+        const json &field_value = this->components == 1 ? value : value[i];
+        collect_keys(field_value, keys[i]);
+        if (keys[i].empty()) keys[i].push_back(encode(field_value));
+        std::sort(keys[i].begin(), keys[i].end());
+        keys[i].erase(std::unique(keys[i].begin(), keys[i].end()), keys[i].end());
+    }
+
+    // One entry per combination of keys.
+    std::vector<entry> entries(1, entry{{}, id});
+    for (unsigned int i = 0; i < this->components; i++) {
+        std::vector<entry> combined;
+        combined.reserve(entries.size() * keys[i].size());
+        for (const entry &partial : entries) {
+            for (unsigned long long key : keys[i]) {
+                combined.push_back(partial);
+                combined.back().key[i] = key;
+            }
+        }
+        entries.swap(combined);
+    }
+    return entries;
+}
+
+char *btree_index::page(unsigned int page_number) const {
+    return this->file.get_data() + (size_t) page_number * btree_page_size;
+}
+
+char *btree_index::node_entry(char *node, unsigned int i) const {
+    return node + btree_node_header_size + (size_t) i * this->entry_size;
+}
+
+char *btree_index::node_child(char *node, unsigned int i) const {
+    return node + btree_node_header_size + (size_t) this->internal_capacity * this->entry_size + (size_t) i * sizeof(unsigned int);
+}
+
+btree_index::entry btree_index::read_entry(const char *at) const {
+    entry e = {};
+    std::memcpy(e.key, at, this->components * sizeof(unsigned long long));
+    e.id = load<unsigned long long>(at + this->components * sizeof(unsigned long long));
+    return e;
+}
+
+void btree_index::write_entry(char *at, const entry &e) const {
+    std::memcpy(at, e.key, this->components * sizeof(unsigned long long));
+    store<unsigned long long>(at + this->components * sizeof(unsigned long long), e.id);
+}
+
+unsigned int btree_index::search_node(char *node, unsigned int count, const entry &e, bool upper) const {
+    unsigned int low = 0, high = count;
+    while (low < high) {
+        unsigned int middle = (low + high) / 2;
+        entry current = this->read_entry(this->node_entry(node, middle));
+        if (upper ? !(e < current) : current < e) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+unsigned int btree_index::allocate_page() {
+    unsigned int page_number = load<unsigned int>(this->page(0) + btree_page_count_offset);
+    size_t needed = ((size_t) page_number + 1) * btree_page_size;
+
+    // The file grows geometrically so appending pages doesn't remap it every time.
+    if (needed > this->file.get_size()) {
+        if (this->file.resize(std::max(needed, this->file.get_size() * 2)) != 0) return 0;
+    }
+
+    store<unsigned int>(this->page(0) + btree_page_count_offset, page_number + 1);
+    std::memset(this->page(page_number), 0, btree_page_size);
+    return page_number;
+}
+
+unsigned int btree_index::find_leaf(const entry &key, std::vector<std::pair<unsigned int, unsigned int>> *path) const {
+    unsigned int page_number = load<unsigned int>(this->page(0) + btree_root_offset);
+    unsigned int height = load<unsigned int>(this->page(0) + btree_height_offset);
+
+    for (unsigned int level = height; level > 1; level--) {
+        char *node = this->page(page_number);
+        unsigned int child = this->search_node(node, load<unsigned int>(node + btree_node_count_offset), key, true);
+        if (path != nullptr) path->push_back({page_number, child});
+        page_number = load<unsigned int>(this->node_child(node, child));
+    }
+    return page_number;
+}
+
+int btree_index::insert(const entry &key) {
+    std::vector<std::pair<unsigned int, unsigned int>> path;
+    unsigned int leaf = this->find_leaf(key, &path);
+
+    char *node = this->page(leaf);
+    unsigned int count = load<unsigned int>(node + btree_node_count_offset);
+    unsigned int position = this->search_node(node, count, key, false);
+    if (position < count && this->read_entry(this->node_entry(node, position)) == key) return 0;
+
+    store<unsigned long long>(this->page(0) + btree_entries_offset, load<unsigned long long>(this->page(0) + btree_entries_offset) + 1);
+
+    if (count < this->leaf_capacity) {
+        std::memmove(this->node_entry(node, position + 1), this->node_entry(node, position), (size_t) (count - position) * this->entry_size);
+        this->write_entry(this->node_entry(node, position), key);
+        store<unsigned int>(node + btree_node_count_offset, count + 1);
+        return 0;
+    }
+
+    // Split the full leaf in two halves, the first entry of the new leaf separates them in the parent.
+    std::vector<entry> entries;
+    entries.reserve(count + 1);
+    for (unsigned int i = 0; i < count; i++) entries.push_back(this->read_entry(this->node_entry(node, i)));
+    entries.insert(entries.begin() + position, key);
+
+    unsigned int right = this->allocate_page();
+    if (right == 0) return 1;
+    node = this->page(leaf);
+    char *right_node = this->page(right);
+
+    unsigned int middle = entries.size() / 2;
+    for (unsigned int i = 0; i < middle; i++) this->write_entry(this->node_entry(node, i), entries[i]);
+    for (unsigned int i = middle; i < entries.size(); i++) this->write_entry(this->node_entry(right_node, i - middle), entries[i]);
+    store<unsigned int>(right_node, btree_leaf);
+    store<unsigned int>(right_node + btree_node_count_offset, entries.size() - middle);
+    store<unsigned int>(right_node + btree_node_next_offset, load<unsigned int>(node + btree_node_next_offset));
+    store<unsigned int>(node + btree_node_count_offset, middle);
+    store<unsigned int>(node + btree_node_next_offset, right);
+
+    entry separator = entries[middle];
+    unsigned int new_child = right;
+
+    // Add the separator to the parents, splitting them while they are full.
+    while (!path.empty()) {
+        auto [parent, child] = path.back();
+        path.pop_back();
+
+        node = this->page(parent);
+        count = load<unsigned int>(node + btree_node_count_offset);
+        if (count < this->internal_capacity) {
+            std::memmove(this->node_entry(node, child + 1), this->node_entry(node, child), (size_t) (count - child) * this->entry_size);
+            std::memmove(this->node_child(node, child + 2), this->node_child(node, child + 1), (size_t) (count - child) * sizeof(unsigned int));
+            this->write_entry(this->node_entry(node, child), separator);
+            store<unsigned int>(this->node_child(node, child + 1), new_child);
+            store<unsigned int>(node + btree_node_count_offset, count + 1);
+            return 0;
+        }
+
+        std::vector<entry> keys;
+        std::vector<unsigned int> children;
+        for (unsigned int i = 0; i < count; i++) keys.push_back(this->read_entry(this->node_entry(node, i)));
+        for (unsigned int i = 0; i <= count; i++) children.push_back(load<unsigned int>(this->node_child(node, i)));
+        keys.insert(keys.begin() + child, separator);
+        children.insert(children.begin() + child + 1, new_child);
+
+        right = this->allocate_page();
+        if (right == 0) return 1;
+        node = this->page(parent);
+        right_node = this->page(right);
+
+        // The middle key moves up to the parent.
+        middle = keys.size() / 2;
+        for (unsigned int i = 0; i < middle; i++) this->write_entry(this->node_entry(node, i), keys[i]);
+        for (unsigned int i = 0; i <= middle; i++) store<unsigned int>(this->node_child(node, i), children[i]);
+        store<unsigned int>(node + btree_node_count_offset, middle);
+
+        for (unsigned int i = middle + 1; i < keys.size(); i++) this->write_entry(this->node_entry(right_node, i - middle - 1), keys[i]);
+        for (unsigned int i = middle + 1; i < children.size(); i++) store<unsigned int>(this->node_child(right_node, i - middle - 1), children[i]);
+        store<unsigned int>(right_node, btree_internal);
+        store<unsigned int>(right_node + btree_node_count_offset, keys.size() - middle - 1);
+
+        separator = keys[middle];
+        new_child = right;
+    }
+
+    // The root was split, the tree grows a level.
+    unsigned int old_root = load<unsigned int>(this->page(0) + btree_root_offset);
+    unsigned int root = this->allocate_page();
+    if (root == 0) return 1;
+    char *root_node = this->page(root);
+    store<unsigned int>(root_node, btree_internal);
+    store<unsigned int>(root_node + btree_node_count_offset, 1);
+    this->write_entry(this->node_entry(root_node, 0), separator);
+    store<unsigned int>(this->node_child(root_node, 0), old_root);
+    store<unsigned int>(this->node_child(root_node, 1), new_child);
+
+    store<unsigned int>(this->page(0) + btree_root_offset, root);
+    store<unsigned int>(this->page(0) + btree_height_offset, load<unsigned int>(this->page(0) + btree_height_offset) + 1);
+    return 0;
+}
+
+void btree_index::erase(const entry &key) {
+    char *node = this->page(this->find_leaf(key, nullptr));
+    unsigned int count = load<unsigned int>(node + btree_node_count_offset);
+    unsigned int position = this->search_node(node, count, key, false);
+    if (position == count || !(this->read_entry(this->node_entry(node, position)) == key)) return;
+
+    std::memmove(this->node_entry(node, position), this->node_entry(node, position + 1), (size_t) (count - position - 1) * this->entry_size);
+    store<unsigned int>(node + btree_node_count_offset, count - 1);
+    store<unsigned long long>(this->page(0) + btree_entries_offset, load<unsigned long long>(this->page(0) + btree_entries_offset) - 1);
+}
+
+int btree_index::open() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+
+    fs::path path_to_index(this->path);
+    if (!fs::exists(path_to_index / "index.bin")) return 1;
+
+    if (this->file.open(btree_page_size) != 0) return 1;
+    if (std::memcmp(this->page(0), btree_magic, sizeof(btree_magic) - 1) != 0) {
+        std::cerr << "Error: Invalid B+tree index file: " << path_to_index / "index.bin" << "." << std::endl;
+        this->file.close();
+        return 1;
+    }
+
+    // Files from an older version of the layout or with another number of fields are rebuilt.
+    if (std::memcmp(this->page(0), btree_magic, sizeof(btree_magic)) != 0 || load<unsigned int>(this->page(0) + btree_components_offset) != this->components) {
+        this->file.close();
+        return 1;
+    }
+    return 0;
+}
+
+int btree_index::build_index(const std::vector<std::pair<json, unsigned long long>> &entries) {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+
+    fs::path path_to_index(this->path);
+    this->file.close();
+    if (this->reset_directory() != 0) {
+        fs::remove_all(path_to_index);
+        return 1;
+    }
+
+    std::vector<entry> sorted;
+    unsigned int multikey = 0;
+    for (const auto &[indexee, id] : entries) {
+        multikey |= this->array_components(indexee);
+        std::vector<entry> document = this->document_entries(indexee, id);
+        sorted.insert(sorted.end(), document.begin(), document.end());
+    }
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    if (this->file.open(btree_page_size) != 0) {
+        fs::remove_all(path_to_index);
+        return 1;
+    }
+    std::memcpy(this->page(0), btree_magic, sizeof(btree_magic));
+    store<unsigned int>(this->page(0) + btree_page_count_offset, 1);
+    store<unsigned int>(this->page(0) + btree_components_offset, this->components);
+
+    auto fail = [&]() {
+        std::cerr << "Error: Failed to write B+tree index: " << path_to_index / "index.bin" << "." << std::endl;
+        this->file.close();
+        fs::remove_all(path_to_index);
+        return 1;
+    };
+
+    // Fill the leaves in order, then build each level of internal nodes over the one below until a single root is left.
+    // Each node of a level is kept with its smallest entry, which becomes its separator in the level above.
+    std::vector<std::pair<entry, unsigned int>> level;
+    unsigned int previous = 0;
+    size_t next = 0;
+    do {
+        unsigned int leaf = this->allocate_page();
+        if (leaf == 0) return fail();
+        char *node = this->page(leaf);
+
+        unsigned int count = std::min<size_t>(this->leaf_capacity, sorted.size() - next);
+        for (unsigned int i = 0; i < count; i++) this->write_entry(this->node_entry(node, i), sorted[next + i]);
+        store<unsigned int>(node, btree_leaf);
+        store<unsigned int>(node + btree_node_count_offset, count);
+        if (previous != 0) store<unsigned int>(this->page(previous) + btree_node_next_offset, leaf);
+
+        level.push_back({count > 0 ? sorted[next] : entry{}, leaf});
+        previous = leaf;
+        next += count;
+    } while (next < sorted.size());
+
+    unsigned int height = 1;
+    while (level.size() > 1) {
+        std::vector<std::pair<entry, unsigned int>> upper_level;
+        for (size_t first = 0; first < level.size(); first += this->internal_capacity + 1) {
+            unsigned int internal = this->allocate_page();
+            if (internal == 0) return fail();
+            char *node = this->page(internal);
+
+            unsigned int children = std::min<size_t>(this->internal_capacity + 1, level.size() - first);
+            for (unsigned int i = 0; i < children; i++) {
+                store<unsigned int>(this->node_child(node, i), level[first + i].second);
+                if (i > 0) this->write_entry(this->node_entry(node, i - 1), level[first + i].first);
+            }
+            store<unsigned int>(node, btree_internal);
+            store<unsigned int>(node + btree_node_count_offset, children - 1);
+
+            upper_level.push_back({level[first].first, internal});
+        }
+        level = upper_level;
+        height++;
+    }
+
+    store<unsigned int>(this->page(0) + btree_root_offset, level[0].second);
+    store<unsigned int>(this->page(0) + btree_height_offset, height);
+    store<unsigned long long>(this->page(0) + btree_entries_offset, sorted.size());
+    store<unsigned int>(this->page(0) + btree_multikey_offset, multikey);
+    return this->file.sync();
+}
+
+std::vector<unsigned long long> btree_index::range(const std::vector<json> &prefix, const json &lower, const json &upper) const {
+    std::shared_lock<std::shared_mutex> shared(this->lock);
+
+    std::vector<unsigned long long> ids;
+    if (!this->file.is_open() || prefix.size() > this->components) return ids;
+    if (prefix.size() == this->components && (!lower.is_null() || !upper.is_null())) return ids;
+
+    // The entries between the prefix followed by the smallest possible key and the prefix followed by the largest one.
+    const unsigned long long max = std::numeric_limits<unsigned long long>::max();
+    entry start = {}, end = {};
+    for (size_t i = 0; i < prefix.size(); i++) start.key[i] = end.key[i] = encode(prefix[i]);
+    for (size_t i = prefix.size(); i < this->components; i++) end.key[i] = max;
+    end.id = max;
+    if (prefix.size() < this->components) {
+        start.key[prefix.size()] = lower.is_number() ? encode(lower) : 0;
+        end.key[prefix.size()] = upper.is_number() ? encode(upper) : max;
+        if (end.key[prefix.size()] < start.key[prefix.size()]) return ids;
+    }
+
+    // Documents with an array can have several entries in the range.
+    std::unordered_set<unsigned long long> seen;
+    for (unsigned int leaf = this->find_leaf(start, nullptr); leaf != 0; leaf = load<unsigned int>(this->page(leaf) + btree_node_next_offset)) {
+        char *node = this->page(leaf);
+        unsigned int count = load<unsigned int>(node + btree_node_count_offset);
+        for (unsigned int i = this->search_node(node, count, start, false); i < count; i++) {
+            entry e = this->read_entry(this->node_entry(node, i));
+            if (end < e) return ids;
+            if (seen.insert(e.id).second) ids.push_back(e.id);
+        }
+    }
+    return ids;
+}
+
+bool btree_index::multikey(size_t field) const {
+    std::shared_lock<std::shared_mutex> shared(this->lock);
+    if (!this->file.is_open() || field >= this->components) return false;
+    return (load<unsigned int>(this->page(0) + btree_multikey_offset) >> field) & 1;
+}
+
+std::vector<unsigned long long> btree_index::consult(const json &value) const {
+    return this->range({value}, nullptr, nullptr);
+}
+
+void btree_index::update_index(const json &new_value, unsigned long long id) {
+    std::vector<entry> entries = this->document_entries(new_value, id);
+
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    if (!this->file.is_open()) return;
+
+    // Removing the document doesn't clear the flags, the index is only known to have no arrays again once it is rebuilt.
+    unsigned int multikey = this->array_components(new_value);
+    if (multikey != 0) store<unsigned int>(this->page(0) + btree_multikey_offset, load<unsigned int>(this->page(0) + btree_multikey_offset) | multikey);
+
+    for (const entry &e : entries) {
+        if (this->insert(e) != 0) {
+            std::cerr << "Error: Failed to add the document with ID \"" << id << "\" to the B+tree index: \"" << this->get_field() << "\"." << std::endl;
+            return;
+        }
+    }
+}
+
+void btree_index::remove_from_index(const json &value, unsigned long long id) {
+    std::vector<entry> entries = this->document_entries(value, id);
+
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    if (!this->file.is_open()) return;
+
+    for (const entry &e : entries) this->erase(e);
+}
+
+int btree_index::sync() {
+    std::shared_lock<std::shared_mutex> shared(this->lock);
+    if (!this->file.is_open()) return 0;
+    return this->file.sync();
+}
+
+void btree_index::delete_index() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    this->file.close();
+    fs::remove_all(this->get_path());
+}
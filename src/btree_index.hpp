@@ -0,0 +1,266 @@
+/**
+ * @file btree_index.hpp
+ */
+#ifndef BTREE_INDEX_CLASS_H
+#define BTREE_INDEX_CLASS_H
+
+#include <string>
+#include <vector>
+#include <shared_mutex>
+#include <json.hpp>
+#include "auxiliary.hpp"
+#include "mapped_file.hpp"
+#include "secondary_index.hpp"
+using json = nlohmann::json;
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @class btree_index
+     * @brief B+tree index stored in a single memory-mapped file (index.bin inside the index directory).
+     * The key of an entry has one 64 bit component per indexed field followed by the document id, so every entry is unique.
+     * Numbers are encoded so the components keep their order, any other value is hashed. Arrays get one entry per element (every combination of elements for compound indexes).
+     * Leaves are linked in key order, which makes a condition on a prefix of the fields a descent followed by a sequential walk of the leaves.
+     */
+    class btree_index : public secondary_index {
+    public:
+
+        /**
+         * @brief Maximum number of fields in a compound index.
+         */
+        static const unsigned int max_components = 8;
+
+        /**
+         * @brief Entry of the tree: encoded value of each field and id of the document. Components past the number of fields are 0.
+         */
+        struct entry {
+            unsigned long long key[max_components];
+            unsigned long long id;
+
+            bool operator<(const entry &other) const {
+                for (unsigned int i = 0; i < max_components; i++) {
+                    if (key[i] != other.key[i]) return key[i] < other.key[i];
+                }
+                return id < other.id;
+            }
+
+            bool operator==(const entry &other) const {
+                return !(*this < other) && !(other < *this);
+            }
+        };
+
+    private:
+
+        /**
+         * @brief The index file.
+         */
+        mapped_file file;
+
+        /**
+         * @brief Lookups run in parallel, changes to the index need exclusive access.
+         */
+        mutable std::shared_mutex lock;
+
+        /**
+         * @brief Number of components of the keys, one per indexed field.
+         */
+        unsigned int components;
+
+        /**
+         * @brief Size in bytes of an entry in the file.
+         */
+        size_t entry_size;
+
+        /**
+         * @brief Maximum number of entries in a leaf.
+         */
+        unsigned int leaf_capacity;
+
+        /**
+         * @brief Maximum number of keys in an internal node.
+         */
+        unsigned int internal_capacity;
+
+        /**
+         * @param page_number Number of the page.
+         * @brief Gets a pointer to the start of a page. Invalidated when the file grows.
+         */
+        char *page(unsigned int page_number) const;
+
+        /**
+         * @param node Start of the node.
+         * @param i Position of the entry.
+         * @brief Gets a pointer to entry i of a leaf or key i of an internal node.
+         */
+        char *node_entry(char *node, unsigned int i) const;
+
+        /**
+         * @param node Start of the internal node.
+         * @param i Position of the child.
+         * @brief Gets a pointer to child i of an internal node.
+         */
+        char *node_child(char *node, unsigned int i) const;
+
+        /**
+         * @param at Position of the entry in the file.
+         * @brief Reads an entry.
+         */
+        entry read_entry(const char *at) const;
+
+        /**
+         * @param at Position of the entry in the file.
+         * @param e Entry to write.
+         * @brief Writes an entry.
+         */
+        void write_entry(char *at, const entry &e) const;
+
+        /**
+         * @param node Start of the node.
+         * @param count Number of entries or keys in the node.
+         * @param e Entry to look for.
+         * @param upper Indicates whether the first entry greater than e is wanted instead of the first one not smaller.
+         * @brief Binary search in a node.
+         */
+        unsigned int search_node(char *node, unsigned int count, const entry &e, bool upper) const;
+
+        /**
+         * @brief Allocates an empty page at the end of the file, growing it if needed.
+         * @return Number of the page or 0 if the file couldn't grow.
+         */
+        unsigned int allocate_page();
+
+        /**
+         * @param key Entry to look for.
+         * @param path Destination of the internal pages visited and the child followed in each, from the root down.
+         * @brief Descends from the root to the leaf where the entry belongs.
+         * @return Number of the leaf page.
+         */
+        unsigned int find_leaf(const entry &key, std::vector<std::pair<unsigned int, unsigned int>> *path) const;
+
+        /**
+         * @param key Entry to add.
+         * @brief Adds an entry, splitting the full pages on the way back up. Needs exclusive access.
+         * @return 0 on success and 1 otherwise.
+         */
+        int insert(const entry &key);
+
+        /**
+         * @param key Entry to remove.
+         * @brief Removes an entry from its leaf. Pages are not merged, underfull leaves are reclaimed when the index is rebuilt. Needs exclusive access.
+         */
+        void erase(const entry &key);
+
+        /**
+         * @param value Indexed value.
+         * @param id Id of the document.
+         * @brief Builds the entries of a document.
+         */
+        std::vector<entry> document_entries(const json &value, unsigned long long id) const;
+
+        /**
+         * @param value Indexed value.
+         * @brief Gets the components whose value is an array, one bit per component.
+         */
+        unsigned int array_components(const json &value) const;
+
+        /**
+         * @param value Value to encode.
+         * @brief Encodes a value as a key component. Numbers keep their order.
+         */
+        static unsigned long long encode(const json &value);
+
+        /**
+         * @param value Value of a field.
+         * @param keys Destination of the encoded keys.
+         * @brief Collects the key components of a value, one per element for arrays.
+         */
+        static void collect_keys(const json &value, std::vector<unsigned long long> &keys);
+
+    public:
+
+        /**
+         * @param path Path to the index.
+         * @param fields Indexed fields, more than one for a compound index.
+         * @brief Constructor for the btree_index class.
+         */
+        btree_index(const std::string &path, const std::vector<field_type> &fields);
+
+        /**
+         * @brief Gets the structure of the index.
+         */
+        index_type get_type() const override;
+
+        /**
+         * @brief Opens an index that already exists in the file system.
+         * @return 0 on success and 1 otherwise.
+         */
+        int open() override;
+
+        /**
+         * @param entries Pairs of indexed value and id of the document with that value.
+         * @brief Builds the tree bottom up from the sorted entries.
+         * @return 0 on success and 1 otherwise.
+         */
+        int build_index(const std::vector<std::pair<json, unsigned long long>> &entries) override;
+
+        /**
+         * @param op Comparison operator.
+         * @param value Value compared against.
+         * @brief B+tree indexes answer equality conditions and range conditions on numbers.
+         */
+        bool supports(const std::string &op, const json &value) const override;
+
+        /**
+         * @param field Position of the field in the index.
+         * @brief Checks if a document had an array in the field since the index was built. Each range condition on such a field can be met by a different element, so they can't be merged into one range.
+         */
+        bool multikey(size_t field) const;
+
+        /**
+         * @param value Value of the first indexed field.
+         * @brief Gets the ids of the documents with the value.
+         */
+        std::vector<unsigned long long> consult(const json &value) const override;
+
+        /**
+         * @param prefix Values of the first fields, matched by equality.
+         * @param lower Smallest number for the field after the prefix, null for no lower bound.
+         * @param upper Largest number for the field after the prefix, null for no upper bound.
+         * @brief Gets the ids of the documents in the range, ordered by the indexed values. A document with several entries in the range appears once, at its first one.
+         */
+        std::vector<unsigned long long> range(const std::vector<json> &prefix, const json &lower, const json &upper) const;
+
+        /**
+         * @param new_value New indexed value.
+         * @param id Id of the document.
+         * @brief Adds the entries of the document to the index.
+         */
+        void update_index(const json &new_value, unsigned long long id) override;
+
+        /**
+         * @param value Indexed value.
+         * @param id Id of the document.
+         * @brief Removes the entries of the document from the index.
+         */
+        void remove_from_index(const json &value, unsigned long long id) override;
+
+        /**
+         * @brief Writes the index to the disk.
+         * @return 0 on success and 1 otherwise.
+         */
+        int sync() override;
+
+        /**
+         * @brief Deletes this index.
+         */
+        void delete_index() override;
+
+    };
+
+}
+
+#endif
@@ -1,21 +1,214 @@
 #include "collection.hpp"
 #include "auxiliary.hpp"
+#include "lazy_json.hpp"
+#include "result_sorter.hpp"
+#include "aggregator.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
 #include <filesystem>
 #include <fstream>
+#include <memory>
 #include <json.hpp>
 #include <omp.h>
+#include <optional>
 #include <sstream>
+#include <unordered_set>
 
 using namespace nosqlite;
 using json = nlohmann::json;
 
+/**
+ * @brief Checks if a document satisfies the compiled conditions. The conditions checked are counted in the profile, if there is one.
+ */
+static bool satisfies_conditions(const json &document, const predicate &conditions, query_profile *profile = nullptr) {
+    if (profile == nullptr) return conditions.matches(document);
+    size_t evaluated = 0;
+    bool satisfied = conditions.matches(document, &evaluated);
+    profile->predicate_evaluations += evaluated;
+    return satisfied;
+}
+
+/**
+ * @brief Visits a document read in a scan from its text. With a filter, the fields it reads are picked out of the text and only the documents that satisfy it are parsed and visited.
+ * With a projection, only the fields it keeps are parsed. The documents parsed and the conditions checked are counted in the profile, if there is one.
+ */
+static void visit_text(const char *begin, const char *end, int thread_num, const std::function<void(const json &document, int thread_num)> &visit, const lazy_filter *lazy, const predicate *filter, const field_projector *projection, query_profile *profile) {
+    size_t evaluated = 0;
+    int decided = lazy != nullptr ? lazy->matches(begin, end, &evaluated) : 1;
+    if (decided != 0) {
+        json document;
+        if (profile != nullptr) profile->documents_parsed++;
+        if (decided == 1 && projection != nullptr && projection->project(begin, end, document)) visit(document, thread_num);
+        else {
+            document = read_and_parse_json(std::string(begin, end));
+            if (!document.empty() && (decided == 1 || filter->matches(document, &evaluated))) visit(projection != nullptr ? projection->project(document) : document, thread_num);
+        }
+    }
+    if (profile != nullptr) profile->predicate_evaluations += evaluated;
+}
+
+/**
+ * @brief Gets the projection of the fields a read keeps, with the id. nullptr if it keeps whole documents.
+ */
+static std::shared_ptr<const field_projector> read_projection(const read_options &options) {
+    if (options.fields.empty()) return nullptr;
+    std::vector<field_type> fields = options.fields;
+    fields.push_back({"id"});
+    std::shared_ptr<const field_projector> projection = std::make_shared<const field_projector>(fields);
+    return projection->whole() ? nullptr : projection;
+}
+
+/**
+ * @brief Gets the name of the stage that reads the documents with the plan of a profile: a scan or fetching them through an index.
+ */
+static std::string read_stage(const query_profile &profile) {
+    std::string path = profile.plan.value("path", "");
+    return path == "full_scan" || path == "zone_map_scan" ? "scan" : "fetch";
+}
+
+/**
+ * @brief Gets the id of an equality condition on the id, which reads the document directly. nullptr if there is none.
+ */
+static const json *id_equality(const std::vector<condition_type> &conditions) {
+    field_type id = {"id"};
+    for (const auto &[field_path, op, target_value] : conditions) {
+        if (op == "==" && field_path == id) return &target_value;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Gets the similarity of the embedding of a document to the query. Documents without an embedding of the same dimensions have none.
+ */
+static bool embedding_similarity(const json &document, const field_type &field, const std::vector<float> &query, float query_norm, vector_metric metric, float &similarity) {
+    std::vector<float> embedding;
+    try {
+        if (!vector_index::read_vector(access_nested_fields(document, field), embedding)) return false;
+    } catch (...) {
+        return false;
+    }
+    if (embedding.size() != query.size()) return false;
+    similarity = vector_index::similarity(metric, query.data(), embedding.data(), query.size(), query_norm, vector_index::norm(embedding.data(), embedding.size()));
+    return true;
+}
+
+/**
+ * @brief Creates an index object of the given structure. The index files are only touched once it is opened or built.
+ */
+static secondary_index *new_index(index_type type, const std::string &path, const std::vector<field_type> &fields) {
+    if (type == BTREE_INDEX) return new btree_index(path, fields);
+    if (type == BITMAP_INDEX) return new bitmap_index(path, fields);
+    if (type == TEXT_INDEX) return new text_index(path, fields);
+    if (type == TRIGRAM_INDEX) return new trigram_index(path, fields);
+    if (type == GEO_INDEX) return new geo_index(path, fields);
+    if (type == VECTOR_INDEX) return new vector_index(path, fields);
+    return new hash_index(path, fields);
+}
+
+/**
+ * @brief Gets the documents found through a bitmap index: the union of the bitmaps of the values looked up, intersected with the bitmaps of each inequality.
+ */
+static roaring_bitmap run_bitmap_access(const index_access &access) {
+    const bitmap_index *index = static_cast<const bitmap_index*>(access.index);
+    roaring_bitmap result;
+    bool started = false;
+
+    if (!access.prefix.empty()) {
+        result = index->lookup(access.prefix[0]);
+        started = true;
+    }
+    for (const json &value : access.excluded) {
+        roaring_bitmap others = index->lookup_except(value);
+        result = started ? result.intersect(others) : others;
+        started = true;
+    }
+    return result;
+}
+
+/**
+ * @brief Gets the documents found through a trigram index: the documents with the trigrams of every pattern.
+ */
+static roaring_bitmap run_trigram_access(const index_access &access) {
+    const trigram_index *index = static_cast<const trigram_index*>(access.index);
+    roaring_bitmap result = index->lookup(access.patterns[0].first, access.patterns[0].second);
+    for (size_t i = 1; i < access.patterns.size() && !result.empty(); i++) {
+        result = result.intersect(index->lookup(access.patterns[i].first, access.patterns[i].second));
+    }
+    return result;
+}
+
+/**
+ * @brief Checks if an index finds exactly the documents that satisfy the conditions it covers, so they can be counted without reading them: equality, "in" and, for bitmaps, inequality conditions, without ranges.
+ * Bitmaps are keyed by the text of the values. Hash keys are hashes, which different values can share, and B+tree keys are only exact for numbers a double holds exactly, so only those lookups are used.
+ * Null is also the key of fields inside a value that isn't an object, so nulls and inequalities are only exact on top level fields.
+ */
+static bool exact_access(const index_access &access) {
+    index_type type = access.index->get_type();
+    if (type != BTREE_INDEX && type != BITMAP_INDEX) return false;
+    if (!access.lower.is_null() || !access.upper.is_null() || (access.prefix.empty() && access.excluded.empty())) return false;
+
+    // Objects are keyed by their text, which doesn't match the way they are compared.
+    const double exact_integers = 9007199254740992.0;
+    std::vector<field_type> fields = access.index->get_fields();
+    for (size_t i = 0; i < access.prefix.size(); i++) {
+        for (const json &value : access.prefix[i]) {
+            if (!value.is_primitive() || (value.is_null() && fields[i].size() > 1)) return false;
+            if (type == BTREE_INDEX && (!value.is_number() || std::abs(value.get<double>()) > exact_integers)) return false;
+        }
+    }
+    for (const json &value : access.excluded) {
+        if (!value.is_primitive() || fields[0].size() > 1) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Gets the ids of the documents found through an index. Text indexes search the text, ranked, and geospatial indexes the area. Otherwise each combination of the prefix values is a separate lookup and their results are merged, keeping the first occurrence of each id.
+ */
+static std::vector<unsigned long long> run_access(const index_access &access) {
+    if (access.index->get_type() == TEXT_INDEX) return access.index->consult(access.text);
+    if (access.index->get_type() == GEO_INDEX) return static_cast<geo_index*>(access.index)->search(access.geo_op, access.geo);
+
+    std::vector<std::vector<json>> combinations(1);
+    for (const std::vector<json> &values : access.prefix) {
+        std::vector<std::vector<json>> extended;
+        for (const std::vector<json> &combination : combinations) {
+            for (const json &value : values) {
+                extended.push_back(combination);
+                extended.back().push_back(value);
+            }
+        }
+        combinations.swap(extended);
+    }
+
+    std::vector<unsigned long long> ids;
+    std::unordered_set<unsigned long long> seen;
+    for (const std::vector<json> &combination : combinations) {
+        std::vector<unsigned long long> found;
+        if (access.index->get_type() == BTREE_INDEX) found = static_cast<btree_index*>(access.index)->range(combination, access.lower, access.upper);
+        else found = access.index->consult(combination[0]);
+
+        if (combinations.size() == 1) return found;
+        for (unsigned long long id : found) {
+            if (seen.insert(id).second) ids.push_back(id);
+        }
+    }
+    return ids;
+}
 
-collection::collection(const std::string &path) : path(path), number_of_documents(0), parallel_processing(true) {}
+
+collection::collection(const std::string &path, storage_type storage) : path(path), number_of_documents(0), next_id(0), zones(nullptr), parallel_processing(true), storage(storage), primary(nullptr), segments(nullptr), wal(nullptr), checkpoint_lsn(0) {}
 
 collection::~collection() {
+    if (this->wal != nullptr) this->checkpoint();
     for (auto p : this->indexes) {
         delete p.second;
     }
+    delete this->zones;
+    delete this->segments;
+    delete this->primary;
+    delete this->wal;
 }
 
 void collection::turn_on_parallel_processing() {
@@ -35,16 +228,31 @@ int collection::build_from_scratch(const std::string &path_to_json) {
             fs::remove_all(entry);
     else fs::create_directory(path_to_collection);
 
-    if (path_to_json == "") {
-        fs::path header_path = fs::path(this->path) / "header.json";
-        std::ofstream header(header_path);
-        if (header.is_open()) {
-            json json_header;
-            json_header["number_of_documents"] = this->number_of_documents;
-            header << json_header << std::endl;
-            header.close();
+    delete this->primary;
+    this->primary = new primary_index((path_to_collection / "primary.idx").string());
+    if (this->primary->open() != 0) {
+        fs::remove_all(path_to_collection);
+        return 1;
+    }
+
+    if (this->storage == SEGMENT_STORAGE) {
+        delete this->segments;
+        this->segments = new segment_store((path_to_collection / "segments").string(), this->primary);
+        if (this->segments->create() != 0) {
+            fs::remove_all(path_to_collection);
+            return 1;
         }
-        else {
+    }
+
+    delete this->wal;
+    this->wal = new write_ahead_log((path_to_collection / "wal.log").string());
+    if (this->wal->open(this->checkpoint_lsn) != 0) {
+        fs::remove_all(path_to_collection);
+        return 1;
+    }
+
+    if (path_to_json == "") {
+        if (this->write_header() != 0) {
             throw_failed_to_create_header(this->get_name());
             fs::remove_all(path_to_collection);
             return 1;
@@ -92,15 +300,7 @@ int collection::build_from_scratch(const std::string &path_to_json) {
     throw_failed_to_create_collection_entries(failed_paths);
 
     // Creates the header file for the database.
-    fs::path header_path = fs::path(this->path) / "header.json";
-    std::ofstream header(header_path);
-    if (header.is_open()) {
-        json json_header;
-        json_header["number_of_documents"] = this->number_of_documents;
-        header << json_header << std::endl;
-        header.close();
-    }
-    else {
+    if (this->write_header() != 0) {
         throw_failed_to_create_header(this->get_name());
         fs::remove_all(path_to_collection);
         return 1;
@@ -116,17 +316,80 @@ int collection::build_from_existing() {
     fs::path header = fs::path(this->path) / "header.json";
     json header_json = read_and_parse_json(header);
     this->number_of_documents = header_json["number_of_documents"];
+    this->next_id = header_json.value("next_id", this->number_of_documents);
+    this->checkpoint_lsn = header_json.value("checkpoint_lsn", 0ULL);
+    this->storage = storage_type_from_string(header_json.value("storage", "hashed"));
+
+    // Open the primary index. Collections with HASHED_STORAGE from before it existed get it built from their files.
+    fs::path primary_path = fs::path(this->path) / "primary.idx";
+    bool missing_primary = !fs::exists(primary_path);
+    delete this->primary;
+    this->primary = new primary_index(primary_path.string());
+    if (this->primary->open() != 0) return 1;
+    if (missing_primary && this->storage == HASHED_STORAGE && this->rebuild_primary_index() != 0) return 1;
+
+    // Open the segment files.
+    if (this->storage == SEGMENT_STORAGE) {
+        delete this->segments;
+        this->segments = new segment_store((fs::path(this->path) / "segments").string(), this->primary);
+        if (this->segments->open() != 0) return 1;
+    }
 
-    // Build indices.
+    // Open the synopses of the zones. They are rebuilt from the documents if the file is missing or was written for other fields.
+    if (header_json.contains("zone_map")) {
+        delete this->zones;
+        this->zones = new zone_map((fs::path(this->path) / "zone_map.bin").string(), header_json["zone_map"].get<std::vector<field_type>>());
+        if (this->zones->open() != 0 && this->build_zone_map() != 0) return 1;
+    }
+
+    // Statistics from the last ANALYZE, the planner uses fixed estimates without them.
+    this->statistics.load((fs::path(this->path) / "statistics.json").string());
+
+    // Open the indexes, their meta.json has the structure and the indexed fields.
+    // Indexes in the old format (a directory of index.json buckets named after the field) are rebuilt as hash indexes.
     fs::path indexes_path = fs::path(this->path) / "indexes";
     if (fs::exists(indexes_path)) {
         for (const fs::path &index_path : fs::directory_iterator(indexes_path)) {
-            if (fs::is_directory(index_path)) {
-                this->indexes[get_last_dir(index_path.string())] = new hash_index(index_path.string());
+            if (!fs::is_directory(index_path)) continue;
+
+            std::string name = get_last_dir(index_path.string());
+            json meta = fs::exists(index_path / "meta.json") ? read_and_parse_json(index_path / "meta.json") : json::object();
+            index_type type = index_type_from_string(meta.value("type", "hash"));
+            std::vector<field_type> fields = {};
+            if (meta.contains("fields") && !meta["fields"].empty()) {
+                // Single field indexes used to store the path of the field directly.
+                if (meta["fields"][0].is_string()) fields.push_back(meta["fields"].get<field_type>());
+                else fields = meta["fields"].get<std::vector<field_type>>();
+            }
+            else {
+                field_type field = {};
+                std::stringstream ss(name);
+                std::string f;
+                std::getline(ss, f, '_');
+                while (std::getline(ss, f, '_')) field.push_back(f);
+                fields.push_back(field);
+            }
+
+            secondary_index *index = new_index(type, index_path.string(), fields);
+            if (index->open() != 0 && this->build_index(index) != 0) {
+                std::cerr << "Error: Failed to rebuild hash index: \"" << name << "\"" << std::endl;
+                delete index;
+                continue;
             }
+            this->indexes[name] = index;
         }
     }
 
+    // Replay the changes logged after the last checkpoint.
+    delete this->wal;
+    this->wal = new write_ahead_log((fs::path(this->path) / "wal.log").string());
+    std::vector<json> records;
+    if (this->wal->recover(this->checkpoint_lsn, records) != 0) return 1;
+    if (this->wal->open(this->checkpoint_lsn) != 0) return 1;
+
+    for (const json &record : records) this->add_pending(record);
+    if (!records.empty() && this->checkpoint() != 0) return 1;
+
     return 0;
 }
 
@@ -142,23 +405,296 @@ unsigned long long collection::get_number_of_documents() const {
     return this->number_of_documents;
 }
 
-int collection::add_document(json &json_object, bool update_header) {
+storage_type collection::get_storage() const {
+    return this->storage;
+}
 
-    int ret = 0;
+fs::path collection::document_file(unsigned long long id) const {
+    return this->hashed_document_file(hash_integer_value(id));
+}
 
-    json_object["id"] = this->number_of_documents;
+fs::path collection::hashed_document_file(unsigned long long id_hash) const {
+    std::string idHash = to_hex(id_hash);
+    return fs::path(this->path) / idHash.substr(0, 2) / idHash.substr(2, 2) / idHash.substr(4).append(".json");
+}
 
-    // Hash the id.
-    std::string idHash = hash_integer(this->number_of_documents);
- 
-    // Create the directory
-    fs::path directory = fs::path(this->path) / idHash.substr(0, 2) / idHash.substr(2, 2);
-    fs::create_directories(directory);
+unsigned int collection::document_zone(unsigned long long id) const {
+    if (this->storage == SEGMENT_STORAGE) {
+        document_location location;
+        return this->primary->find(id, location) ? location.segment : 0;
+    }
+    return std::stoul(to_hex(hash_integer_value(id)).substr(0, 2), nullptr, 16);
+}
+
+int collection::build_zone_map() {
+    this->zones->clear();
+    this->scan([&](const json &document, int) {
+        this->zones->add(this->document_zone(document["id"]), document);
+    });
+    return this->zones->sync();
+}
+
+int collection::rebuild_primary_index() {
+    if (this->primary->clear() != 0) return 1;
+
+    bool failed = false;
+    this->scan([&](const json &document, int) {
+        unsigned long long id = document["id"];
+        if (this->primary->set(id, {0, hash_integer_value(id), 1}) != 0) failed = true;
+    });
+
+    return failed || this->primary->sync() != 0 ? 1 : 0;
+}
+
+int collection::write_header() const {
+    // The header is written to a new file that replaces the old one once it is on the disk, so a crash leaves one of the two whole.
+    fs::path header_path = fs::path(this->path) / "header.json";
+    fs::path new_header_path = fs::path(this->path) / "header.json.tmp";
+    std::ofstream header(new_header_path);
+    if (!header.is_open()) {
+        throw_failed_to_open_file(new_header_path);
+        return 1;
+    }
+
+    json json_header;
+    json_header["number_of_documents"] = this->number_of_documents;
+    json_header["next_id"] = this->next_id;
+    json_header["checkpoint_lsn"] = this->checkpoint_lsn;
+    json_header["storage"] = storage_type_to_string(this->storage);
+    if (this->zones != nullptr) json_header["zone_map"] = this->zones->get_fields();
+    header << json_header << std::endl;
+    header.close();
+    if (!header || sync_file(new_header_path) != 0) return 1;
+
+    std::error_code error;
+    fs::rename(new_header_path, header_path, error);
+    if (error) {
+        std::cerr << "Error: Failed to replace file: " << header_path << "." << std::endl;
+        return 1;
+    }
+    return sync_file(this->path);
+}
+
+void collection::index_document(const json &document) {
+    unsigned long long id = document["id"];
+    for (auto index : this->indexes) {
+        index.second->update_index(index.second->extract(document), id);
+    }
+    if (this->zones != nullptr) this->zones->add(this->document_zone(id), document);
+}
+
+void collection::unindex_document(const json &document) {
+    unsigned long long id = document["id"];
+    for (auto index : this->indexes) {
+        index.second->remove_from_index(index.second->extract(document), id);
+    }
+}
+
+void collection::scan_targets(const std::vector<condition_type> &conditions, std::vector<std::pair<unsigned int, std::vector<document_location>>> &segments, std::vector<fs::path> &directories) const {
+    bool prune = this->zones != nullptr && this->zones->applies(conditions);
+
+    // The location table is read once for every segment.
+    if (this->storage == SEGMENT_STORAGE) {
+        std::vector<std::vector<document_location>> records = this->segments->live_records();
+        for (unsigned int segment : this->segments->get_segments()) {
+            if (segment >= records.size() || records[segment].empty()) continue;
+            if (!prune || this->zones->may_match(segment, conditions)) segments.push_back({segment, std::move(records[segment])});
+        }
+        return;
+    }
+
+    // The documents are in the directories named after the first two hex digits of the hash of their ids, one zone each.
+    for (const fs::directory_entry &entry : fs::directory_iterator(this->path)) {
+        std::string name = entry.path().filename().string();
+        if (!entry.is_directory() || name == "indexes" || name == "segments") continue;
+        bool hex = name.size() == 2 && std::isxdigit((unsigned char) name[0]) && std::isxdigit((unsigned char) name[1]);
+        if (prune && hex && !this->zones->may_match(std::stoul(name, nullptr, 16), conditions)) continue;
+        directories.push_back(entry.path());
+    }
+}
+
+void collection::scan_segment(unsigned int segment, const std::vector<document_location> &records, const std::function<void(const json &document, int thread_num)> &visit, query_profile *profile, const predicate *filter, const field_projector *projection, const std::atomic<bool> *stop) const {
+    // The segment is read sequentially in one go and its documents are parsed in parallel.
+    std::string buffer;
+    if (this->segments->read_segment(segment, buffer) != 0) return;
+    if (profile != nullptr) {
+        profile->files_opened++;
+        profile->bytes_read += buffer.size();
+    }
+
+    std::optional<lazy_filter> lazy;
+    if (filter != nullptr) lazy.emplace(*filter);
+
+    #pragma omp parallel for if(this->parallel_processing)
+    for (int i = 0; i < records.size(); i++) {
+        #ifdef _OPENMP
+            int thread_num = omp_get_thread_num();
+        #else
+            int thread_num = 0;
+        #endif
+
+        if (stop != nullptr && *stop) continue;
+        const char *record = buffer.data() + records[i].offset;
+        visit_text(record, record + records[i].length, thread_num, visit, lazy ? &*lazy : nullptr, filter, projection, profile);
+    }
+}
+
+void collection::scan_files(const std::vector<fs::path> &file_paths, const std::function<void(const json &document, int thread_num)> &visit, query_profile *profile, const predicate *filter, const field_projector *projection, const std::atomic<bool> *stop) const {
+    std::optional<lazy_filter> lazy;
+    if (filter != nullptr) lazy.emplace(*filter);
+
+    #pragma omp parallel for if(this->parallel_processing)
+    for (int i = 0; i < file_paths.size(); i++) {
+        #ifdef _OPENMP
+            int thread_num = omp_get_thread_num();
+        #else
+            int thread_num = 0;
+        #endif
+
+        if (stop != nullptr && *stop) continue;
+
+        // Files are arrays of documents, their elements are found without parsing them. Files that aren't are parsed in full.
+        if (lazy || projection != nullptr) {
+            std::ifstream file(file_paths[i], std::ios::binary);
+            if (!file.is_open()) {
+                throw_failed_to_open_file(file_paths[i]);
+                continue;
+            }
+            std::string buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            file.close();
+            if (profile != nullptr) {
+                profile->files_opened++;
+                profile->bytes_read += buffer.size();
+            }
+
+            std::vector<std::pair<const char*, const char*>> elements;
+            if (lazy_filter::split_array(buffer.data(), buffer.data() + buffer.size(), elements)) {
+                for (const auto &[begin, end] : elements) visit_text(begin, end, thread_num, visit, lazy ? &*lazy : nullptr, filter, projection, profile);
+                continue;
+            }
+        }
+
+        json file_content = read_and_parse_json(file_paths[i]);
+        if (profile != nullptr) {
+            if (!lazy && projection == nullptr) {
+                profile->files_opened++;
+                profile->bytes_read += fs::file_size(file_paths[i]);
+            }
+            profile->documents_parsed += file_content.size();
+        }
+        for (const json &document : file_content) {
+            if (filter != nullptr && !satisfies_conditions(document, *filter, profile)) continue;
+            visit(projection != nullptr ? projection->project(document) : document, thread_num);
+        }
+    }
+}
+
+void collection::scan(const std::function<void(const json &document, int thread_num)> &visit, const std::vector<condition_type> &conditions, query_profile *profile, const predicate *filter, const field_projector *projection) const {
+    std::vector<std::pair<unsigned int, std::vector<document_location>>> segments;
+    std::vector<fs::path> directories, file_paths;
+    this->scan_targets(conditions, segments, directories);
+    for (const auto &[segment, records] : segments) this->scan_segment(segment, records, visit, profile, filter, projection);
+    for (const fs::path &directory : directories) collect_paths(directory.string(), file_paths);
+    if (!file_paths.empty()) this->scan_files(file_paths, visit, profile, filter, projection);
+}
+
+int collection::build_index(secondary_index *index) const {
+    // Each thread collects the entries for the documents it reads.
+    std::vector<std::vector<std::pair<json, unsigned long long>>> all_thread_entries(get_max_threads());
+    this->scan([&](const json &document, int thread_num) {
+        all_thread_entries[thread_num].push_back({index->extract(document), document["id"]});
+    });
+
+    std::vector<std::pair<json, unsigned long long>> entries;
+    for (std::vector<std::pair<json, unsigned long long>> &thread_entries : all_thread_entries) {
+        entries.insert(entries.end(), std::make_move_iterator(thread_entries.begin()), std::make_move_iterator(thread_entries.end()));
+    }
+
+    index->set_parallel_processing(this->parallel_processing);
+    return index->build_index(entries);
+}
+
+int collection::migrate_storage(storage_type target) {
+    if (target == this->storage) return 0;
+    if (this->checkpoint() != 0) return 1;
+
+    std::vector<json> documents = this->read_all();
+    storage_type source = this->storage;
+    segment_store *source_segments = this->segments;
+
+    // Both layouts share the primary index, keep a copy of it in case the migration fails.
+    fs::path primary_path = fs::path(this->path) / "primary.idx";
+    fs::path primary_backup = fs::path(this->path) / "primary.idx.old";
+    this->primary->sync();
+    fs::copy_file(primary_path, primary_backup, fs::copy_options::overwrite_existing);
+
+    auto roll_back = [&]() {
+        if (this->segments != nullptr) this->segments->delete_store();
+        delete this->segments;
+        this->segments = source_segments;
+        this->storage = source;
+        this->primary->close();
+        fs::rename(primary_backup, primary_path);
+        this->primary->open();
+    };
+
+    // Write every document in the new layout before removing the old one.
+    this->storage = target;
+    this->segments = nullptr;
+    if (this->primary->clear() != 0) {
+        roll_back();
+        return 1;
+    }
+    if (target == SEGMENT_STORAGE) {
+        this->segments = new segment_store((fs::path(this->path) / "segments").string(), this->primary);
+        if (this->segments->create() != 0) {
+            roll_back();
+            return 1;
+        }
+    }
 
-    // Build the path for the file according to the id hash.
-    fs::path path_to_document = directory / idHash.substr(4).append(".json");
+    std::vector<fs::path> failed = {};
+    for (const json &document : documents) {
+        if (this->write_document(document) != 0) failed.push_back(std::to_string(document["id"].get<unsigned long long>()));
+    }
+    if (!failed.empty()) {
+        std::cerr << "Error: Failed to migrate collection \"" << this->get_name() << "\"." << std::endl;
+        throw_failed_to_create_collection_entries(failed);
+        roll_back();
+        return 1;
+    }
+    this->primary->sync();
+    fs::remove(primary_backup);
+
+    if (source == SEGMENT_STORAGE) {
+        source_segments->delete_store();
+        delete source_segments;
+    }
+    else {
+        for (const fs::path &entry : fs::directory_iterator(this->path)) {
+            if (!fs::is_directory(entry) || entry.filename() == "indexes" || entry.filename() == "segments") continue;
+            fs::remove_all(entry);
+        }
+    }
+
+    // The documents are in other zones now.
+    if (this->zones != nullptr && this->build_zone_map() != 0) return 1;
+
+    if (this->write_header() != 0) {
+        throw_failed_to_update_header(this->get_name());
+        return 1;
+    }
+    return 0;
+}
+
+int collection::write_document(const json &document) {
+    if (this->storage == SEGMENT_STORAGE) return this->segments->append(document);
 
-    // Prints the path for the created files
+    int ret = 0;
+    fs::path path_to_document = this->document_file(document["id"]);
+
+    // Create the directory
+    fs::create_directories(path_to_document.parent_path());
 
     // Create a new one or edit the file if it already exists (in case of a hash collision).
     if (fs::exists(path_to_document)) {
@@ -167,83 +703,73 @@ int collection::add_document(json &json_object, bool update_header) {
         if (file.is_open()) {
             if (json_file.empty()) {
                 ret = 1;
-                update_header = false;
             }
             else {
-                json_file.push_back(json_object);
+                json_file.push_back(document);
                 file << json_file << std::endl;
             }
         }
         else {
             throw_failed_to_open_file(path_to_document);
             ret = 1;
-            update_header = false;
         }
         file.close();
     }
     else {
         std::ofstream file(path_to_document);
         if (file.is_open()) {
-            file << '[' << json_object << ']' << std::endl;
+            file << '[' << document << ']' << std::endl;
         }
         else {
             throw_failed_to_create_file(path_to_document);
             ret = 1;
-            update_header = false;
         }
         file.close();
     }
 
-    std::vector<field_type> possible_indices = {};
-    for (auto index : this->indexes) {
-        std::string index_name = index.first;
-        std::stringstream ss(index_name);
-        field_type field = {};
-        std::string f;
-        std::getline(ss, f, '_');
-        while (std::getline(ss, f, '_')) field.push_back(f);
-
-        possible_indices.push_back(field);
-    }
-    for (const field_type &index_name : possible_indices) {
-        if (find_nested_field(json_object, index_name)) {
-            auto hsh_idx_it = this->indexes.find(build_index_name(index_name));
-            if (hsh_idx_it == this->indexes.end()) continue;
-            hsh_idx_it->second->update_index(access_nested_fields(json_object, index_name), path_to_document.string());
-        }   
+    if (ret == 0) {
+        unsigned long long id = document["id"];
+        ret = this->primary->set(id, {0, hash_integer_value(id), 1});
     }
-    
-    // Once everything else is successful increment the number of documents.
-    if (update_header) {
-        std::ofstream header(fs::path(this->path) / "header.json");
-        if (header.is_open()) {
-            json h = {};
-            h["number_of_documents"] = this->number_of_documents + 1;
-            // header >> h;
-            // h["number_of_documents"] = this->number_of_documents + 1;
-            header << h;
-            header.close();
-            this->number_of_documents++;
-        }
-        else {
-            throw_failed_to_open_file(fs::path(this->path) / "header.json");
-            throw_failed_to_update_header(this->get_name());
-            ret = 1;
+
+    return ret;
+}
+
+int collection::add_document(json &json_object, bool logged) {
+
+    if (logged) {
+        {
+            std::lock_guard<std::mutex> guard(this->pending_lock);
+            json_object["id"] = this->next_id++;
         }
+        return this->log_change("insert", json_object["id"], json_object);
     }
-    else  this->number_of_documents++;
+
+    int ret = 0;
+
+    json_object["id"] = this->next_id;
+
+    if (this->write_document(json_object) != 0) ret = 1;
+
+    this->index_document(json_object);
+    
+    // Once everything else is successful increment the number of documents.
+    this->number_of_documents++;
+    this->next_id++;
 
     return ret;
 }
 
-int collection::add_document(const std::string &json_content, bool update_header) {
+int collection::add_document(const std::string &json_content, bool logged) {
     json document = read_and_parse_json(json_content);
     if (document.empty()) return 1;
-    return this->add_document(document, update_header);
+    return this->add_document(document, logged);
 }
 
 int collection::add_document(const std::string &json_content) {
-    return this->add_document(json_content, true);
+    int ret = this->add_document(json_content, true);
+    this->maybe_checkpoint();
+    return ret;
 }
 
 int nosqlite::collection::create_document(const json &new_document) {
@@ -255,213 +781,815 @@ int nosqlite::collection::create_document(const json &new_document) {
         return 1;
     }
 
-    return this->add_document(doc_copy, true);
+    int ret = this->add_document(doc_copy, true);
+    this->maybe_checkpoint();
+    return ret;
 }
 
-std::vector<json> nosqlite::collection::read_all() const {
-    std::vector<json> results;
-    fs::path collection_path = this->path;
+int collection::log_change(const std::string &op, unsigned long long id, const json &document) {
+    json record = {{"op", op}, {"id", id}};
+    if (!document.is_null()) record["document"] = document;
 
-    // Uses parallel processing to speed up the query.
-    // Each thread has its own vector with results for the documents it collects.
-    // Each thread's result vector gets added to the all_thread_results vector.
-    // At the end of the parallel processing section all of the result in all_thread_results are pooled into the same vector and returned.
-    std::vector<std::vector<json>> all_thread_results;
-    int num_threads = 1;
+    // Writers only exclude checkpoints, so concurrent writers share the log flush.
+    std::shared_lock<std::shared_mutex> writing(this->checkpoint_lock);
+    if (this->wal->log(record) == 0) {
+        std::cerr << "Error: Failed to log the " << op << " of the document with ID \"" << id << "\"." << std::endl;
+        return 1;
+    }
+
+    this->add_pending(record);
+    return 0;
+}
 
-    std::vector<fs::path> file_paths = {};
-    collect_paths(collection_path.string(), file_paths);
+int collection::log_changes(const std::vector<json> &records) {
+    if (records.empty()) return 0;
 
-    #pragma omp parallel if(this->parallel_processing)
-    {
-        std::vector<json> thread_results;
+    std::shared_lock<std::shared_mutex> writing(this->checkpoint_lock);
+    if (this->wal->log(records) == 0) {
+        std::cerr << "Error: Failed to log the changes of " << records.size() << " documents." << std::endl;
+        return 1;
+    }
 
-        #pragma omp single
-        {
-            #ifdef _OPENMP
-                num_threads = omp_get_num_threads();
-            #else
-                num_threads = 1;
-            #endif
-            all_thread_results.resize(num_threads);
-        }
+    for (const json &record : records) this->add_pending(record);
+    return 0;
+}
 
-        #pragma omp barrier
+void collection::add_pending(const json &record) {
+    std::lock_guard<std::mutex> guard(this->pending_lock);
 
-        #ifdef _OPENMP
-            int thread_num = omp_get_thread_num();
-        #else
-            int thread_num = 0;
-        #endif
+    unsigned long long id = record["id"];
+    std::string op = record["op"];
+    if (op == "insert") {
+        this->number_of_documents++;
+        this->next_id = std::max(this->next_id, id + 1);
+    }
+    else if (op == "delete") this->number_of_documents--;
+
+    this->pending[id] = op == "delete" ? json() : record["document"];
+}
+
+std::map<unsigned long long, json> collection::pending_snapshot() const {
+    std::lock_guard<std::mutex> guard(this->pending_lock);
+    return this->pending;
+}
+
+json collection::read_stored(unsigned long long id) const {
+    if (this->storage == SEGMENT_STORAGE) return this->segments->read(id);
+
+    // The primary index has the hash of the id so the file is read without hashing or checking for it.
+    document_location location;
+    if (!this->primary->find(id, location)) return json();
+
+    fs::path path_to_doc = this->hashed_document_file(location.offset);
+
+    json doc_array = read_and_parse_json(path_to_doc);
+    for (const auto &doc : doc_array) {
+        if (doc.contains("id") && doc["id"] == id) return doc;
+    }
+    return json();
+}
+
+void collection::read_stored(const std::vector<unsigned long long> &ids, std::vector<json> &documents, query_profile *profile) const {
+    documents.assign(ids.size(), json());
+
+    if (this->storage == SEGMENT_STORAGE) {
+        // The segments are read sequentially and the documents parsed in parallel.
+        std::vector<std::string> contents;
+        if (this->segments->read_raw(ids, contents) != 0) return;
+        if (profile != nullptr) {
+            std::unordered_set<unsigned int> opened;
+            for (unsigned long long id : ids) {
+                document_location location;
+                if (this->primary->find(id, location)) opened.insert(location.segment);
+            }
+            profile->files_opened += opened.size();
+            for (const std::string &content : contents) {
+                profile->bytes_read += content.size();
+                profile->documents_parsed += !content.empty();
+            }
+        }
 
-        #pragma omp for
-        for (int i = 0; i < file_paths.size(); i++) {
-            const fs::path &file_path = file_paths[i];
+        #pragma omp parallel for if(this->parallel_processing)
+        for (int i = 0; i < ids.size(); i++) {
+            if (!contents[i].empty()) documents[i] = read_and_parse_json(contents[i]);
+        }
+        return;
+    }
+
+    // Documents whose ids have the same hash share a file, the positions of the ids are grouped by file.
+    std::unordered_map<unsigned long long, std::vector<size_t>> by_file;
+    for (size_t i = 0; i < ids.size(); i++) {
+        document_location location;
+        if (this->primary->find(ids[i], location)) by_file[location.offset].push_back(i);
+    }
+    std::vector<std::pair<unsigned long long, std::vector<size_t>>> files(by_file.begin(), by_file.end());
 
-            json file_content = read_and_parse_json(file_path);
-            for (const json &doc : file_content) {
-                thread_results.push_back(doc);
+    #pragma omp parallel for if(this->parallel_processing)
+    for (int f = 0; f < files.size(); f++) {
+        fs::path path_to_doc = this->hashed_document_file(files[f].first);
+        json doc_array = read_and_parse_json(path_to_doc);
+        if (profile != nullptr) {
+            profile->files_opened++;
+            profile->bytes_read += fs::file_size(path_to_doc);
+            profile->documents_parsed += doc_array.size();
+        }
+        for (const auto &doc : doc_array) {
+            if (!doc.contains("id")) continue;
+            for (size_t i : files[f].second) {
+                if (doc["id"] == ids[i]) documents[i] = doc;
             }
         }
+    }
+}
+
+int collection::apply_change(unsigned long long id, const json &document, std::set<fs::path> &unsynced) {
+    // Changes are applied as upserts and deletes of whatever is stored, so replaying them after a crash is harmless.
+    json stored = this->read_stored(id);
+
+    if (this->storage == SEGMENT_STORAGE) {
+        if (!stored.is_null()) {
+            this->unindex_document(stored);
+            if (document.is_null() && this->segments->remove(id) != 0) return 1;
+        }
+        if (!document.is_null()) {
+            if (this->segments->append(document) != 0) return 1;
+            this->index_document(document);
+        }
+        return 0;
+    }
 
-        all_thread_results[thread_num] = std::move(thread_results);
+    fs::path path_to_doc = this->document_file(id);
+    bool file_existed = fs::exists(path_to_doc);
+    json remaining_docs = json::array();
+    if (file_existed) {
+        for (const json &doc : read_and_parse_json(path_to_doc)) {
+            if (doc["id"] != id) remaining_docs.push_back(doc);
+        }
     }
 
+    if (!stored.is_null()) this->unindex_document(stored);
+    if (!document.is_null()) remaining_docs.push_back(document);
+
+    // The directory of the file has the entry of a created or removed file, and the ones above it the entries of created directories.
+    // A document added and deleted before the checkpoint never had a file, so nothing is written.
+    fs::path directory = path_to_doc.parent_path(), zone_directory = directory.parent_path();
+    if (remaining_docs.empty()) {
+        if (file_existed) {
+            fs::remove(path_to_doc);
+            unsynced.insert(directory);
+        }
+    }
+    else {
+        bool zone_existed = fs::exists(zone_directory), directory_existed = fs::exists(directory);
+        fs::create_directories(directory);
+        std::ofstream file(path_to_doc);
+        if (!file.is_open()) {
+            throw_failed_to_open_file(path_to_doc);
+            return 1;
+        }
+        file << remaining_docs << std::endl;
+        file.close();
+        if (!file) {
+            std::cerr << "Error: Failed to write file: " << path_to_doc << "." << std::endl;
+            return 1;
+        }
+        unsynced.insert(path_to_doc);
+        if (!file_existed) unsynced.insert(directory);
+        if (!directory_existed) unsynced.insert(zone_directory);
+        if (!zone_existed) unsynced.insert(fs::path(this->path));
+    }
+
+    if (document.is_null()) this->primary->erase(id);
+    else {
+        if (this->primary->set(id, {0, hash_integer_value(id), 1}) != 0) return 1;
+        this->index_document(document);
+    }
+    return 0;
+}
+
+int collection::checkpoint() {
+    std::unique_lock<std::shared_mutex> exclusive(this->checkpoint_lock);
+    std::lock_guard<std::mutex> guard(this->pending_lock);
+    if (this->pending.empty()) return 0;
+
+    std::set<fs::path> unsynced;
+    for (const auto &[id, document] : this->pending) {
+        if (this->apply_change(id, document, unsynced) != 0) {
+            std::cerr << "Error: Checkpoint of collection \"" << this->get_name() << "\" failed. The changes stay in the log." << std::endl;
+            return 1;
+        }
+    }
+
+    // The documents have to be on the disk before the header says the log is no longer needed. Files are synced in parallel, each sync waits for the disk.
+    if (this->storage == SEGMENT_STORAGE && this->segments->sync() != 0) return 1;
+    std::vector<fs::path> files(unsynced.begin(), unsynced.end());
+    std::atomic<bool> failed(false);
+    #pragma omp parallel for if(this->parallel_processing)
+    for (size_t i = 0; i < files.size(); i++) {
+        if (sync_file(files[i]) != 0) failed = true;
+    }
+    if (failed) return 1;
+
+    if (this->primary->sync() != 0) return 1;
+    for (auto index : this->indexes) {
+        if (index.second->sync() != 0) return 1;
+    }
+    if (this->zones != nullptr && this->zones->sync() != 0) return 1;
+
+    // The header is the commit point of the checkpoint: once it has the new lsn the log is no longer needed.
+    unsigned long long previous_lsn = this->checkpoint_lsn;
+    this->checkpoint_lsn = this->wal->get_last_lsn();
+    if (this->write_header() != 0) {
+        this->checkpoint_lsn = previous_lsn;
+        throw_failed_to_update_header(this->get_name());
+        return 1;
+    }
+
+    this->pending.clear();
+    return this->wal->truncate();
+}
+
+void collection::maybe_checkpoint() {
+    bool full;
+    {
+        std::lock_guard<std::mutex> guard(this->pending_lock);
+        full = this->pending.size() >= checkpoint_threshold;
+    }
+    if (full) this->checkpoint();
+}
+
+std::vector<json> nosqlite::collection::read_all() const {
+    std::vector<json> results;
+
+    // Uses parallel processing to speed up the query.
+    // Each thread has its own vector with results for the documents it collects.
+    // At the end of the parallel processing section all of the result in all_thread_results are pooled into the same vector and returned.
+    std::vector<std::vector<json>> all_thread_results(get_max_threads());
+    std::map<unsigned long long, json> pending = this->pending_snapshot();
+
+    // Documents with pending changes are taken from the pending changes instead of the storage.
+    this->scan([&](const json &document, int thread_num) {
+        if (pending.find(document["id"]) != pending.end()) return;
+        all_thread_results[thread_num].push_back(document);
+    });
+
     pool_results(all_thread_results, results);
+    for (const auto &[id, document] : pending) {
+        if (!document.is_null()) results.push_back(document);
+    }
 
     return results;
 }
 
-std::vector<json> collection::read_with_conditions(const std::vector<condition_type> &conditions) const {
+std::vector<json> collection::read_with_conditions(const std::vector<condition_type> &conditions, query_profile *profile, const read_options &options) const {
     std::vector<json> results;
-    fs::path collection_path = this->path;
-    field_type id = {"id"};
-    for(const auto &[field_path, op, target_value] : conditions) {
-        if (op == "==")
-            // Read by document id
-            if (field_path == id) return { this->get_document(target_value) };
-    }
-
-    condition_type index_condition = {};
-    std::string index_name = "";
-    bool use_index = false;
-    for(const auto &[field_path, op, target_value] : conditions) {
-        if (op == "==") {
-            index_name = build_index_name(field_path);
-            
-            if (this->indexes.find(index_name) != this->indexes.end()) {
-                index_condition = {field_path, op, target_value};
-                use_index = true;
-                break;
-            }
+
+    // Reads that don't need every document stop as soon as they have enough, sorted reads are sorted as they are read.
+    if (options.skip > 0 || options.limit > 0 || !options.order.empty()) {
+        cursor documents = this->open_cursor(conditions, options, profile);
+        json document;
+        while (documents.next(document)) results.push_back(std::move(document));
+        if (profile != nullptr) {
+            profile->end_stage(profile->plan.value("order", "") == "sort" ? "merge" : read_stage(*profile));
+            profile->end_stage("results");
+            profile->results = results.size();
         }
+        return results;
     }
 
+    // Only the fields asked for are kept, as the documents are read.
+    std::shared_ptr<const field_projector> projection = read_projection(options);
+
+    // Read by document id, the other conditions are still checked on the document.
+    if (const json *id = id_equality(conditions)) {
+        if (profile != nullptr) profile->plan = {{"path", "id_lookup"}};
+        json document = this->get_document(*id);
+        if (!document.is_null() && satisfies_conditions(document, predicate(conditions), profile)) results = { projection != nullptr ? projection->project(document) : document };
+        if (profile != nullptr) {
+            profile->end_stage("fetch");
+            profile->results = results.size();
+        }
+        return results;
+    }
+
+    // The conditions are compiled once and checked on every document read, even the ones the indexes answered since indexes can return documents that don't match.
+    predicate filter(conditions);
+    std::vector<unsigned long long> ids;
+    bool use_index = this->find_candidates(conditions, ids, profile);
+
     // Uses parallel processing to speed up the query.
     // Each thread has its own vector with results for the documents it collects.
-    // Each thread's result vector gets added to the all_thread_results vector.
     // At the end of the parallel processing section all of the result in all_thread_results are pooled into the same vector and returned.
-    std::vector<std::vector<json>> all_thread_results;
-    int num_threads = 1;
+    std::vector<std::vector<json>> all_thread_results(get_max_threads());
+
+    // Documents with pending changes are taken from the pending changes instead of the storage.
+    std::map<unsigned long long, json> pending = this->pending_snapshot();
 
     if (use_index) {
-        std::vector<std::string> paths = this->consult_hash_index(index_name, index_condition.value);
-        #pragma omp parallel if(this->parallel_processing)
-        {
-            std::vector<json> thread_results;
+        // The index has the ids and the primary index has their locations. Indexes can return documents that don't match (e.g.: values with the same hash) so the conditions are still checked.
+        // Documents are fetched into their position so the results keep the order of the index.
+        ids.erase(std::remove_if(ids.begin(), ids.end(), [&](unsigned long long id) { return pending.find(id) != pending.end(); }), ids.end());
+        std::vector<json> fetched;
+        this->read_stored(ids, fetched, profile);
+
+        #pragma omp parallel for if(this->parallel_processing)
+        for (int i = 0; i < fetched.size(); i++) {
+            if (fetched[i].is_null()) continue;
+            if (!satisfies_conditions(fetched[i], filter, profile)) fetched[i] = json();
+            else if (projection != nullptr) fetched[i] = projection->project(fetched[i]);
+        }
 
-            #pragma omp single
-            {
-                #ifdef _OPENMP
-                    num_threads = omp_get_num_threads();
-                #else
-                    num_threads = 1;
-                #endif
-                all_thread_results.resize(num_threads);
-            }
+        for (json &document : fetched) {
+            if (!document.is_null()) all_thread_results[0].push_back(std::move(document));
+        }
+        if (profile != nullptr) profile->end_stage("fetch");
+    } else {
+        this->scan([&](const json &document, int thread_num) {
+            if (pending.find(document["id"]) == pending.end()) all_thread_results[thread_num].push_back(document);
+        }, conditions, profile, &filter, projection.get());
+        if (profile != nullptr) profile->end_stage("scan");
+    }
+
+    pool_results(all_thread_results, results);
+    for (const auto &[id, document] : pending) {
+        if (!document.is_null() && satisfies_conditions(document, filter, profile)) results.push_back(projection != nullptr ? projection->project(document) : document);
+    }
+    if (profile != nullptr) {
+        profile->end_stage("results");
+        profile->results = results.size();
+    }
+    return results;
+}
+
+cursor collection::open_cursor(const std::vector<condition_type> &conditions, const read_options &options, query_profile *profile) const {
+    std::vector<cursor::batch> batches;
+    std::shared_ptr<const field_projector> projection = read_projection(options);
+    if (const json *id = id_equality(conditions)) {
+        if (profile != nullptr) profile->plan = {{"path", "id_lookup"}};
+        json id_value = *id;
+        std::shared_ptr<const predicate> filter = std::make_shared<const predicate>(conditions);
+        batches.push_back([this, id_value, filter, projection, profile](std::vector<json> &found, size_t) {
+            json document = this->get_document(id_value);
+            if (!document.is_null() && satisfies_conditions(document, *filter, profile)) found.push_back(projection != nullptr ? projection->project(document) : document);
+            return false;
+        });
+        return cursor(std::move(batches), options.skip, options.limit);
+    }
 
-            #pragma omp barrier
-
-            #ifdef _OPENMP
-                int thread_num = omp_get_thread_num();
-            #else
-                int thread_num = 0;
-            #endif
-
-            #pragma omp for
-            for (int i = 0; i < paths.size(); i++) {
-                const std::string &path = paths[i];
-
-                json documents = read_and_parse_json(fs::path(path));
-                for (const json &document : documents) {
-                    bool satisfies_all = true;
-                    for (const auto &[field_path, op, target_value] : conditions) {
-                        try{
-                            json actual_value = access_nested_fields(document, field_path);
-                            if(!compare(actual_value, op, target_value)){
-                                satisfies_all = false;
-                                break;
-                            }
-                        } catch(...){
-                            satisfies_all = false;
-                            break;
-                        }
-                    }
-
-                    if(satisfies_all){
-                        thread_results.push_back(document);
-                    }
+    // Sorted reads keep the fields they are sorted by until the documents are in order, the fields asked for are picked afterwards.
+    std::shared_ptr<const field_projector> read_fields = projection;
+    if (!options.order.empty() && projection != nullptr) {
+        read_options sorted = options;
+        for (const sort_key &key : options.order) sorted.fields.push_back(key.field);
+        read_fields = read_projection(sorted);
+    }
+
+    // The batches share the compiled conditions and the pending changes as of opening the cursor, which come after the stored documents like in read_with_conditions.
+    std::shared_ptr<const predicate> filter = std::make_shared<const predicate>(conditions);
+    std::shared_ptr<const std::map<unsigned long long, json>> pending = std::make_shared<const std::map<unsigned long long, json>>(this->pending_snapshot());
+
+    // Each reader visits the documents of a part of the read that satisfy the conditions, with the number of the thread that read them. Scans stop once the flag is set.
+    typedef std::function<void(const std::function<void(const json &document, int thread_num)>&, const std::atomic<bool>*)> reader;
+    std::vector<reader> readers;
+
+    // A read sorted by a single key can follow an index on it, if no pending change would have to be put in order.
+    bool pending_matches = false;
+    for (const auto &[id, document] : *pending) pending_matches = pending_matches || (!document.is_null() && filter->matches(document));
+    std::vector<unsigned long long> ids;
+    bool index_order = options.order.size() == 1 && !pending_matches && this->find_ordered_candidates(conditions, options.order[0], options.limit > 0, ids, profile);
+
+    if (index_order || this->find_candidates(conditions, ids, profile)) {
+        // Chunks of the ids keep the order of the index.
+        ids.erase(std::remove_if(ids.begin(), ids.end(), [&](unsigned long long id) { return pending->find(id) != pending->end(); }), ids.end());
+        for (size_t start = 0; start < ids.size(); start += cursor_batch_ids) {
+            std::vector<unsigned long long> chunk(ids.begin() + start, ids.begin() + std::min(start + cursor_batch_ids, ids.size()));
+            readers.push_back([this, filter, read_fields, chunk, profile](const std::function<void(const json &document, int thread_num)> &visit, const std::atomic<bool> *) {
+                std::vector<json> fetched;
+                this->read_stored(chunk, fetched, profile);
+                for (json &document : fetched) {
+                    if (document.is_null() || !satisfies_conditions(document, *filter, profile)) continue;
+                    visit(read_fields != nullptr ? read_fields->project(document) : document, 0);
                 }
+            });
+        }
+    } else {
+        std::vector<std::pair<unsigned int, std::vector<document_location>>> segments;
+        std::vector<fs::path> directories;
+        this->scan_targets(conditions, segments, directories);
+        for (auto &[segment, segment_records] : segments) {
+            readers.push_back([this, segment = segment, records = std::move(segment_records), filter, read_fields, pending, profile](const std::function<void(const json &document, int thread_num)> &visit, const std::atomic<bool> *stop) {
+                this->scan_segment(segment, records, [&](const json &document, int thread_num) {
+                    if (pending->find(document["id"]) == pending->end()) visit(document, thread_num);
+                }, profile, filter.get(), read_fields.get(), stop);
+            });
+        }
+        for (const fs::path &directory : directories) {
+            readers.push_back([this, directory, filter, read_fields, pending, profile](const std::function<void(const json &document, int thread_num)> &visit, const std::atomic<bool> *stop) {
+                std::vector<fs::path> file_paths;
+                collect_paths(directory.string(), file_paths);
+                this->scan_files(file_paths, [&](const json &document, int thread_num) {
+                    if (pending->find(document["id"]) == pending->end()) visit(document, thread_num);
+                }, profile, filter.get(), read_fields.get(), stop);
+            });
+        }
+    }
+    readers.push_back([filter, read_fields, pending, profile](const std::function<void(const json &document, int thread_num)> &visit, const std::atomic<bool> *) {
+        for (const auto &[id, document] : *pending) {
+            if (!document.is_null() && satisfies_conditions(document, *filter, profile)) visit(read_fields != nullptr ? read_fields->project(document) : document, 0);
+        }
+    });
+
+    // The documents are sorted as they are read, each thread keeping the ones the limit can return, and streamed in order once every one is read.
+    if (!options.order.empty() && !index_order) {
+        if (profile != nullptr) profile->plan["order"] = "sort";
+        std::shared_ptr<result_sorter> sorter = std::make_shared<result_sorter>(options.order, options.limit > 0 ? options.skip + options.limit : 0, options.sort_memory);
+        batches.push_back([sorter, readers, projection, read_fields, profile, filled = false](std::vector<json> &found, size_t wanted) mutable {
+            if (!filled) {
+                for (const reader &read : readers) read([&](const json &document, int thread_num) { sorter->add(document, thread_num); }, nullptr);
+                readers.clear();
+                filled = true;
+                if (profile != nullptr) profile->end_stage(read_stage(*profile));
+                sorter->finish();
+                if (profile != nullptr) profile->end_stage("sort");
             }
-            all_thread_results[thread_num] = std::move(thread_results);
+            size_t first = found.size();
+            bool more = sorter->read(found, std::min(wanted, cursor_batch_ids));
+            if (projection != read_fields) {
+                for (size_t i = first; i < found.size(); i++) found[i] = projection->project(found[i]);
+            }
+            return more;
+        });
+        return cursor(std::move(batches), options.skip, options.limit);
+    }
+
+    // In the order of an index, documents whose value isn't a number (e.g.: arrays) can be in the range out of order. They come after the numbers, sorted once the index is read.
+    if (index_order) {
+        std::shared_ptr<result_sorter> held = std::make_shared<result_sorter>(options.order, 0, options.sort_memory);
+        field_type field = options.order[0].field;
+        for (const reader &read : readers) {
+            batches.push_back([read, held, field, projection, read_fields](std::vector<json> &found, size_t) {
+                read([&](const json &document, int) {
+                    const json *value = predicate::resolve(document, field);
+                    if (value == nullptr || !value->is_number()) held->add(document, 0);
+                    else found.push_back(projection != read_fields ? projection->project(document) : document);
+                }, nullptr);
+                return false;
+            });
         }
-        pool_results(all_thread_results, results);
+        batches.push_back([held, projection, read_fields](std::vector<json> &found, size_t wanted) {
+            size_t first = found.size();
+            bool more = held->read(found, std::min(wanted, cursor_batch_ids));
+            if (projection != read_fields) {
+                for (size_t i = first; i < found.size(); i++) found[i] = projection->project(found[i]);
+            }
+            return more;
+        });
+        return cursor(std::move(batches), options.skip, options.limit);
+    }
+
+    // Each zone (a segment or a directory of files) is scanned in parallel and stops once the threads have found the documents wanted between them.
+    for (const reader &read : readers) {
+        batches.push_back([read](std::vector<json> &found, size_t wanted) {
+            std::vector<std::vector<json>> all_thread_results(get_max_threads());
+            std::atomic<size_t> count{0};
+            std::atomic<bool> stop{false};
+            read([&](const json &document, int thread_num) {
+                all_thread_results[thread_num].push_back(document);
+                if (++count >= wanted) stop = true;
+            }, &stop);
+            pool_results(all_thread_results, found);
+            return false;
+        });
+    }
+    return cursor(std::move(batches), options.skip, options.limit);
+}
 
+std::vector<json> collection::aggregate(const std::vector<condition_type> &conditions, const std::vector<aggregate_type> &aggregates, const std::vector<field_type> &group_by) const {
+    aggregator groups(aggregates, group_by);
+    predicate filter(conditions);
+    std::map<unsigned long long, json> pending = this->pending_snapshot();
+
+    // Scans only parse the fields the aggregates and the groups read, and the id to leave out the documents with pending changes.
+    std::vector<field_type> read_fields = groups.get_fields();
+    read_fields.push_back({"id"});
+    field_projector fields(read_fields);
+
+    std::vector<unsigned long long> ids;
+    const json *id_value = id_equality(conditions);
+    if (id_value != nullptr && id_value->is_number_unsigned()) {
+        if (pending.find(id_value->get<unsigned long long>()) == pending.end()) {
+            json document = this->read_stored(id_value->get<unsigned long long>());
+            if (!document.is_null() && satisfies_conditions(document, filter)) groups.add(document, 0);
+        }
+    } else if (this->find_candidates(conditions, ids)) {
+        ids.erase(std::remove_if(ids.begin(), ids.end(), [&](unsigned long long id) { return pending.find(id) != pending.end(); }), ids.end());
+        std::vector<json> fetched;
+        this->read_stored(ids, fetched);
+
+        // Each thread adds the documents it checks to its own groups.
+        #pragma omp parallel for if(this->parallel_processing)
+        for (int i = 0; i < fetched.size(); i++) {
+            if (!fetched[i].is_null() && satisfies_conditions(fetched[i], filter)) groups.add(fetched[i], omp_get_thread_num());
+        }
     } else {
+        this->scan([&](const json &document, int thread_num) {
+            if (pending.find(document["id"]) == pending.end()) groups.add(document, thread_num);
+        }, conditions, nullptr, &filter, &fields);
+    }
+
+    for (const auto &[id, document] : pending) {
+        if (!document.is_null() && satisfies_conditions(document, filter)) groups.add(document, 0);
+    }
+    return groups.results();
+}
 
-        std::vector<fs::path> file_paths = {};
-        collect_paths(collection_path.string(), file_paths);
+unsigned long long collection::count(const std::vector<condition_type> &conditions) const {
+    if (conditions.empty()) return this->number_of_documents;
+
+    // The indexes that find exactly the documents of some conditions, until every condition is covered. The indexes don't have the pending changes yet.
+    std::vector<index_access> accesses;
+    std::vector<bool> covered(conditions.size(), false);
+    size_t covered_count = 0;
+    for (const auto &[name, index] : this->indexes) {
+        index_access access = plan_access(index, conditions);
+        if (!exact_access(access)) continue;
+        bool useful = false;
+        for (size_t i : access.covered) useful = useful || !covered[i];
+        if (!useful) continue;
+        for (size_t i : access.covered) {
+            if (!covered[i]) covered_count++;
+            covered[i] = true;
+        }
+        accesses.push_back(access);
+    }
 
-        #pragma omp parallel if(this->parallel_processing)
-        {
-            std::vector<json> thread_results;
+    // Otherwise the documents are streamed through a count, parsing just their ids.
+    if (covered_count < conditions.size()) return this->aggregate(conditions, {{COUNT_AGGREGATE, {}, ""}}, {})[0]["count"];
+
+    predicate filter(conditions);
+    std::map<unsigned long long, json> pending = this->pending_snapshot();
+    unsigned long long found = 0;
+    bool all_bitmaps = std::all_of(accesses.begin(), accesses.end(), [](const index_access &access) { return access.index->get_type() == BITMAP_INDEX; });
+    if (all_bitmaps) {
+        // Bitmaps are intersected and counted without listing their ids.
+        roaring_bitmap combined = run_bitmap_access(accesses[0]);
+        for (size_t i = 1; i < accesses.size(); i++) combined = combined.intersect(run_bitmap_access(accesses[i]));
+        found = combined.cardinality();
+        for (const auto &[id, document] : pending) found -= combined.contains(id);
+    } else {
+        query_plan plan;
+        plan.accesses = accesses;
+        std::vector<unsigned long long> ids;
+        this->run_plan(plan, ids, nullptr);
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        found = ids.size();
+        for (const auto &[id, document] : pending) found -= std::binary_search(ids.begin(), ids.end(), id);
+    }
 
-            #pragma omp single
-            {
-                #ifdef _OPENMP
-                    num_threads = omp_get_num_threads();
-                #else
-                    num_threads = 1;
-                #endif
-                all_thread_results.resize(num_threads);
+    for (const auto &[id, document] : pending) {
+        if (!document.is_null() && filter.matches(document)) found++;
+    }
+    return found;
+}
+
+std::vector<json> collection::distinct(const field_type &field, const std::vector<condition_type> &conditions) const {
+    std::vector<json> values;
+
+    // A bitmap index on the field has every value, the ones only documents with pending changes had are left out and the values of the pending documents added.
+    auto index = this->indexes.find(build_index_name({field}, BITMAP_INDEX));
+    if (conditions.empty() && index != this->indexes.end()) {
+        std::map<unsigned long long, json> pending = this->pending_snapshot();
+        std::vector<unsigned long long> ignored;
+        for (const auto &[id, document] : pending) ignored.push_back(id);
+        values = static_cast<const bitmap_index*>(index->second)->values(ignored);
+
+        aggregator pending_values({}, {field});
+        for (const auto &[id, document] : pending) {
+            if (!document.is_null()) pending_values.add(document, 0);
+        }
+        for (const json &row : pending_values.results()) {
+            const json *value = predicate::resolve(row, field);
+            if (std::find_if(values.begin(), values.end(), [&](const json &other) { return result_sorter::compare(*value, other) == 0; }) == values.end()) values.push_back(*value);
+        }
+    } else {
+        for (const json &row : this->aggregate(conditions, {}, {field})) values.push_back(*predicate::resolve(row, field));
+    }
+
+    // Missing fields have no value.
+    values.erase(std::remove_if(values.begin(), values.end(), [](const json &value) { return value.is_null(); }), values.end());
+    std::sort(values.begin(), values.end(), [](const json &a, const json &b) { return result_sorter::compare(a, b) < 0; });
+    return values;
+}
+
+std::vector<json> collection::nearest(const field_type &field, const std::vector<float> &query, size_t k, vector_metric metric, unsigned int probes, const std::vector<condition_type> &conditions) const {
+    if (k == 0) return {};
+    float query_norm = vector_index::norm(query.data(), query.size());
+    predicate filter(conditions);
+    std::map<unsigned long long, json> pending = this->pending_snapshot();
+    std::vector<std::pair<float, json>> found;
+
+    auto index = this->indexes.find(build_index_name({field}, VECTOR_INDEX));
+    if (index != this->indexes.end()) {
+        const vector_index *vectors = static_cast<const vector_index*>(index->second);
+        unsigned int dimensions = vectors->get_dimensions();
+        if (dimensions != 0 && dimensions != query.size()) {
+            std::cerr << "Error: The query vector has " << query.size() << " dimensions and the embeddings in the index have " << dimensions << "." << std::endl;
+            return {};
+        }
+
+        // Documents with pending changes and documents that don't satisfy the conditions are skipped, so the index is asked for more until k documents are left or it has no more.
+        size_t requested = k, seen = 0;
+        while (true) {
+            std::vector<std::pair<unsigned long long, float>> hits = vectors->search(query, requested, metric, probes);
+            std::vector<unsigned long long> ids;
+            std::vector<float> similarities;
+            for (size_t i = seen; i < hits.size(); i++) {
+                if (pending.find(hits[i].first) != pending.end()) continue;
+                ids.push_back(hits[i].first);
+                similarities.push_back(hits[i].second);
             }
+            seen = hits.size();
 
-            #pragma omp barrier
-
-            #ifdef _OPENMP
-                int thread_num = omp_get_thread_num();
-            #else
-                int thread_num = 0;
-            #endif
-
-            #pragma omp for
-            for (int i = 0; i < file_paths.size(); i++) {
-                const fs::path &file_path = file_paths[i];
-                
-                json file_content = read_and_parse_json(file_path);
-                for(const json &doc : file_content){
-                    bool satisfies_all = true;
-
-                    for(const auto &[field_path, op, target_value] : conditions){
-                        try{
-                            json actual_value = access_nested_fields(doc, field_path);
-                            if(!compare(actual_value, op, target_value)){
-                                satisfies_all = false;
-                                break;
-                            }
-                        } catch(...){
-                            satisfies_all = false;
-                            break;
-                        }
-                    }
-
-                    if(satisfies_all){
-                        thread_results.push_back(doc);
-                    }
-                }
+            std::vector<json> fetched;
+            this->read_stored(ids, fetched);
+            for (size_t i = 0; i < fetched.size(); i++) {
+                if (!fetched[i].is_null() && satisfies_conditions(fetched[i], filter)) found.push_back({similarities[i], std::move(fetched[i])});
+            }
+            if (found.size() >= k || hits.size() < requested) break;
+            requested *= 2;
+        }
+    } else {
+        // Each thread keeps its most similar documents, trimmed to k whenever it has twice as many.
+        std::vector<std::vector<std::pair<float, json>>> all_thread_results(get_max_threads());
+        auto more_similar = [](const std::pair<float, json> &a, const std::pair<float, json> &b) { return a.first > b.first; };
+        this->scan([&](const json &document, int thread_num) {
+            float similarity;
+            if (pending.find(document["id"]) != pending.end() || !embedding_similarity(document, field, query, query_norm, metric, similarity)) return;
+
+            std::vector<std::pair<float, json>> &thread_results = all_thread_results[thread_num];
+            thread_results.push_back({similarity, document});
+            if (thread_results.size() >= 2 * k) {
+                std::nth_element(thread_results.begin(), thread_results.begin() + k - 1, thread_results.end(), more_similar);
+                thread_results.resize(k);
             }
-            all_thread_results[thread_num] = std::move(thread_results);
+        }, conditions, nullptr, &filter);
+        for (std::vector<std::pair<float, json>> &thread_results : all_thread_results) {
+            for (auto &result : thread_results) found.push_back(std::move(result));
         }
-        pool_results(all_thread_results, results);
     }
+
+    for (const auto &[id, document] : pending) {
+        float similarity;
+        if (!document.is_null() && embedding_similarity(document, field, query, query_norm, metric, similarity) && satisfies_conditions(document, filter)) found.push_back({similarity, document});
+    }
+
+    std::stable_sort(found.begin(), found.end(), [](const std::pair<float, json> &a, const std::pair<float, json> &b) { return a.first > b.first; });
+    std::vector<json> results;
+    for (size_t i = 0; i < found.size() && i < k; i++) results.push_back(std::move(found[i].second));
     return results;
 }
 
-int collection::create_hash_index(const field_type &field) {
+query_plan collection::plan_query(const std::vector<condition_type> &conditions) const {
+    std::vector<secondary_index*> indexes;
+    for (const auto &[name, index] : this->indexes) indexes.push_back(index);
+    double zone_fraction = this->zones != nullptr && this->zones->applies(conditions) ? this->zones->matching_fraction(conditions) : -1;
+    return choose_plan(indexes, conditions, this->statistics, this->number_of_documents, this->storage, zone_fraction);
+}
+
+bool collection::find_candidates(const std::vector<condition_type> &conditions, std::vector<unsigned long long> &ids, query_profile *profile) const {
+    query_plan plan = this->plan_query(conditions);
+    if (profile != nullptr) {
+        profile->plan = plan.to_json();
+        profile->end_stage("planning");
+    }
+    return this->run_plan(plan, ids, profile);
+}
 
-    if (field.size() == 0) return 0;
+bool collection::find_ordered_candidates(const std::vector<condition_type> &conditions, const sort_key &key, bool limited, std::vector<unsigned long long> &ids, query_profile *profile) const {
+    if (key.descending) return false;
 
-    std::string name = build_index_name(field);
+    // The index walks the range of the field in order when every field before it has a single value.
+    auto gives_order = [&](const index_access &access) {
+        if (access.index->get_type() != BTREE_INDEX || (access.lower.is_null() && access.upper.is_null())) return false;
+        for (const std::vector<json> &values : access.prefix) {
+            if (values.size() != 1) return false;
+        }
+        return access.index->get_fields()[access.prefix.size()] == key.field;
+    };
+
+    // A scan has to read every document to sort them, with a limit the index is read instead since the read stops once it has enough.
+    query_plan plan = this->plan_query(conditions);
+    if (plan.accesses.empty() && limited) {
+        for (const auto &[name, index] : this->indexes) {
+            index_access access = plan_access(index, conditions);
+            if (!gives_order(access)) continue;
+            plan.path = query_plan::INDEX_SCAN;
+            plan.accesses = {access};
+            break;
+        }
+    }
+    if (plan.accesses.empty() || !gives_order(plan.accesses[0])) return false;
+
+    if (profile != nullptr) {
+        profile->plan = plan.to_json();
+        profile->plan["order"] = "index";
+        profile->end_stage("planning");
+    }
+    return this->run_plan(plan, ids, profile);
+}
+
+bool collection::run_plan(const query_plan &plan, std::vector<unsigned long long> &ids, query_profile *profile) const {
+    if (plan.accesses.empty()) return false;
+    std::vector<const index_access*> chosen;
+    for (const index_access &access : plan.accesses) chosen.push_back(&access);
+
+    // Bitmap and trigram indexes are combined as bitmaps.
+    bool has_bitmap = false;
+    roaring_bitmap combined;
+    std::vector<const index_access*> lists;
+    for (const index_access *access : chosen) {
+        roaring_bitmap bitmap;
+        if (access->index->get_type() == BITMAP_INDEX) bitmap = run_bitmap_access(*access);
+        else if (access->index->get_type() == TRIGRAM_INDEX) bitmap = run_trigram_access(*access);
+        else {
+            lists.push_back(access);
+            continue;
+        }
+        if (profile != nullptr) {
+            profile->index_lookups += access->lookups();
+            profile->index_entries += bitmap.cardinality();
+        }
+        combined = has_bitmap ? combined.intersect(bitmap) : bitmap;
+        has_bitmap = true;
+    }
+
+    // The ids of the best index keep their order and are intersected with the ids of the other ones.
+    size_t next = 0;
+    if (lists.empty() || lists[0] != chosen[0]) ids = combined.to_vector();
+    else {
+        ids = run_access(*lists[0]);
+        next = 1;
+        if (profile != nullptr) {
+            profile->index_lookups += lists[0]->lookups();
+            profile->index_entries += ids.size();
+        }
+        if (has_bitmap) ids.erase(std::remove_if(ids.begin(), ids.end(), [&](unsigned long long id) { return !combined.contains(id); }), ids.end());
+    }
+    for (; next < lists.size() && !ids.empty(); next++) {
+        std::vector<unsigned long long> other = run_access(*lists[next]);
+        if (profile != nullptr) {
+            profile->index_lookups += lists[next]->lookups();
+            profile->index_entries += other.size();
+        }
+        std::unordered_set<unsigned long long> allowed(other.begin(), other.end());
+        ids.erase(std::remove_if(ids.begin(), ids.end(), [&](unsigned long long id) { return allowed.find(id) == allowed.end(); }), ids.end());
+    }
+    if (profile != nullptr) profile->end_stage("index");
+    return true;
+}
+
+json collection::explain(const std::vector<condition_type> &conditions) const {
+    if (id_equality(conditions) != nullptr) return {{"path", "id_lookup"}};
+    return this->plan_query(conditions).to_json();
+}
+
+int collection::analyze() {
+    if (this->checkpoint() != 0) return 1;
+
+    // Each thread collects the statistics of the documents it reads, they are merged at the end. Only the indexes with posting lists have statistics.
+    std::vector<statistics_collector> collectors(get_max_threads());
+    this->scan([&](const json &document, int thread_num) {
+        collectors[thread_num].add_document(document);
+        for (const auto &[name, index] : this->indexes) {
+            index_type type = index->get_type();
+            if (type != HASH_INDEX && type != BTREE_INDEX && type != BITMAP_INDEX) continue;
+            try {
+                collectors[thread_num].add_index_keys(name, index->extract(document), type != BTREE_INDEX);
+            } catch (...) {
+                continue;
+            }
+        }
+    });
+
+    this->statistics = collection_statistics(collectors);
+    return this->statistics.save((fs::path(this->path) / "statistics.json").string());
+}
+
+int collection::create_index(const std::vector<field_type> &fields, index_type type) {
+
+    if (fields.size() == 0 || fields[0].size() == 0) return 0;
+
+    if (type != BTREE_INDEX && fields.size() > 1) {
+        std::cerr << "Error: Compound indexes must be B+tree indexes, every other structure has a single field." << std::endl;
+        return 1;
+    }
+    if (fields.size() > btree_index::max_components) {
+        std::cerr << "Error: Compound indexes have at most " << btree_index::max_components << " fields." << std::endl;
+        return 1;
+    }
+
+    std::string name = build_index_name(fields, type);
 
     if (this->indexes.find(name) != this->indexes.end()) {
         std::cerr << "Index with name \"" << name << "\" already exists" << std::endl;
@@ -469,10 +1597,14 @@ int collection::create_hash_index(const field_type &field) {
     }
 
     std::string path = this->path + "/indexes/" + name;
+
+    // The index is built from the stored documents.
+    if (this->checkpoint() != 0) return 1;
     
-    hash_index* index = new hash_index(path);
-    if (index->build_index(field) != 0) {
-        std::cerr << "Failed to create hash index: \"" << name << "\"" << std::endl;
+    secondary_index* index = new_index(type, path, fields);
+    if (this->build_index(index) != 0) {
+        std::cerr << "Failed to create index: \"" << name << "\"" << std::endl;
+        delete index;
         return 1;
     }
 
@@ -480,8 +1612,8 @@ int collection::create_hash_index(const field_type &field) {
     return 0;
 }
 
-std::vector<std::string> collection::consult_hash_index(const std::string &index_name, const json &value) const {
-    hash_index *index = this->indexes.at(index_name);
+std::vector<unsigned long long> collection::consult_index(const std::string &index_name, const json &value) const {
+    secondary_index *index = this->indexes.at(index_name);
 
     return index->consult(value);
 }
@@ -516,77 +1648,31 @@ int collection::update_document(unsigned long long id, const json& updated_data,
         return 1;
     }
 
-    std::string idHash = hash_integer(id);
-    fs::path directory = fs::path(this->path) / idHash.substr(0, 2) / idHash.substr(2, 2);
-    fs::path path_to_doc = directory / idHash.substr(4).append(".json");
-
-    if(!fs::exists(path_to_doc)){
-        std::cerr << "Error: Document with ID \"" << id << "\" does not exist." << std::endl;
-        return 1;
-    }
-
-    json doc_array = read_and_parse_json(path_to_doc);
-    json original;
-    bool updated = false;
-    for(auto &doc : doc_array){
-        if(doc.contains("id") && doc["id"] == id){
-            original = json(doc);
-            field_type fields;
-            for(auto it = updated_data.begin(); it != updated_data.end(); ++it){
-                if(!doc.contains(it.key()) || doc[it.key()].is_null()){
-                    fields.push_back(it.key());
-                }
-            }
-
-            if(!fields.empty()){
-                std::cerr << "Error: The following fields do not exist on the document you're accessing:\n";
-                for(const auto& field : fields){
-                    std::cerr << " - " << field << std::endl;
-                }
-                return 1;
-            }
-
-            update_aux(doc, updated_data);
+    json doc = this->get_document(id);
+    if (doc.is_null()) return 1;
 
-            final = doc;
-            updated = true;
-            break;
+    field_type fields;
+    for(auto it = updated_data.begin(); it != updated_data.end(); ++it){
+        if(!doc.contains(it.key()) || doc[it.key()].is_null()){
+            fields.push_back(it.key());
         }
     }
 
-    if(updated){
-        std::ofstream file(path_to_doc);
-        if(file.is_open()){
-            file << doc_array.dump(4);
-            file.close();
-            std::vector<field_type> possible_indices = {};
-            for (auto index : this->indexes) {
-                std::string index_name = index.first;
-                std::stringstream ss(index_name);
-                field_type field = {};
-                std::string f;
-                std::getline(ss, f, '_');
-                while (std::getline(ss, f, '_')) field.push_back(f);
-
-                possible_indices.push_back(field);
-            }
-            for (const field_type &index_name : possible_indices) {
-                if (find_nested_field(final, index_name)) {
-                    auto hsh_idx_it = this->indexes.find(build_index_name(index_name));
-                    if (hsh_idx_it == this->indexes.end()) continue;
-                    hsh_idx_it->second->update_index(original, final, path_to_doc.string());
-                }
-                
-            }
-            return 0;
-        } else {
-            std::cerr << "Error: Failed to write updated document to file." << std::endl;
-            return 1;
+    if(!fields.empty()){
+        std::cerr << "Error: The following fields do not exist on the document you're accessing:\n";
+        for(const auto& field : fields){
+            std::cerr << " - " << field << std::endl;
         }
-    } else {
-        std::cerr << "Error: Document with ID \"" << id << "\" not found in file." << std::endl;
         return 1;
     }
+
+    update_aux(doc, updated_data);
+
+    // The document file and the indexes are updated at the next checkpoint.
+    if (this->log_change("update", id, doc) != 0) return 1;
+
+    final = doc;
+    return 0;
 }
 
 std::vector<json> nosqlite::collection::update_document(const std::vector<condition_type> &conditions, const json &updated_data) {
@@ -631,181 +1717,129 @@ std::vector<json> nosqlite::collection::update_document(const std::vector<condit
         }
     }
 
+    this->maybe_checkpoint();
     return updated;
 }
 
-json collection::get_document(unsigned long long id) const {
-    std::string idHash = hash_integer(id);
-    fs::path path_to_doc = fs::path(this->path) / idHash.substr(0, 2) / idHash.substr(2, 2) / idHash.substr(4).append(".json");
-
-    if (!fs::exists(path_to_doc)) {
-        std::cerr << "Error: Document with ID \"" << id << "\" does not exist." << std::endl;
-        return json();
-    }
-
-    json doc_array = read_and_parse_json(path_to_doc);
-    for (const auto &doc : doc_array) {
-        if (doc.contains("id") && doc["id"] == id) {
-            return doc;
-        }
+bool collection::document_exists(unsigned long long id) const {
+    {
+        std::lock_guard<std::mutex> guard(this->pending_lock);
+        auto pending_it = this->pending.find(id);
+        if (pending_it != this->pending.end()) return !pending_it->second.is_null();
     }
-
-    std::cerr << "Error: Document with ID \"" << id << "\" not found inside file." << std::endl;
-    return json();
+    return this->primary->contains(id);
 }
 
-int collection::delete_single(const fs::path &file_path, const std::vector<condition_type> &conditions) {
-    int docs_removed = 0;
-    json file_content = read_and_parse_json(file_path);
-    json remaining_docs = json::array();
-    bool file_modified = false;
-
-
-    for (const auto &doc : file_content) {
-        bool satisfies_all = true;
-
-        for (const auto &[field_path, op, target_value] : conditions) {
-            try {
-                json actual_value = access_nested_fields(doc, field_path);
-                if (!compare(actual_value, op, target_value)) {
-                    satisfies_all = false;
-                    break;
-                }
-            } catch (...) {
-                satisfies_all = false;
-                break;
-            }
-        }
-
-        if (satisfies_all) {
-
-            std::vector<field_type> possible_indices = {};
-            for (auto index : this->indexes) {
-                std::string index_name = index.first;
-                std::stringstream ss(index_name);
-                field_type field = {};
-                std::string f;
-                std::getline(ss, f, '_');
-                while (std::getline(ss, f, '_')) field.push_back(f);
-
-                possible_indices.push_back(field);
-            }
-            for (const field_type &index_name : possible_indices) {
-                if (find_nested_field(doc, index_name)) {
-                    auto hsh_idx_it = this->indexes.find(build_index_name(index_name));
-                    if (hsh_idx_it == this->indexes.end()) continue;
-                    hsh_idx_it->second->remove_from_index(access_nested_fields(doc, index_name), index_name, file_path.string());
-                }   
-            }
-
-            docs_removed++;
-            file_modified = true;
-        } else {
-            remaining_docs.push_back(doc);
-        }
-    }
-
-    // If documents were removed update the file
-    if (file_modified) {
-        if (remaining_docs.empty()) {
-            fs::remove(file_path);
-        } else {
-            std::ofstream file(file_path);
-            if (file.is_open()) {
-                file << remaining_docs << std::endl;
-                file.close();
-            } else {
-                throw_failed_to_open_file(file_path);
-                return -1;
-            }
+json collection::get_document(unsigned long long id) const {
+    {
+        std::lock_guard<std::mutex> guard(this->pending_lock);
+        auto pending_it = this->pending.find(id);
+        if (pending_it != this->pending.end()) {
+            if (pending_it->second.is_null()) std::cerr << "Error: Document with ID \"" << id << "\" does not exist." << std::endl;
+            return pending_it->second;
         }
     }
 
-    return docs_removed;
+    json document = this->read_stored(id);
+    if (document.is_null()) std::cerr << "Error: Document with ID \"" << id << "\" does not exist." << std::endl;
+    return document;
 }
 
 int collection::delete_with_conditions(const std::vector<condition_type> &conditions) {
 
     int docs_removed = 0;
-    fs::path collection_path = this->path;
-    bool modified = false;
-
-    condition_type index_condition = {};
-    std::string index_name = "";
-    bool use_index = false;
-    for(const auto &[field_path, op, target_value] : conditions){
-        if (op == "==") {
-            index_name = build_index_name(field_path);
-        
-            if (this->indexes.find(index_name) != this->indexes.end()) {
-                index_condition = {field_path, op, target_value};
-                use_index = true;
-                break;
-            }
-        }
-    }
-
-    // Uses parallel processing to speed up the query.
-    // The docs_removed variable is shared among the threads.
-    if (use_index) {
-        std::vector<std::string> paths = consult_hash_index(index_name, index_condition.value);
-
-        #pragma omp parallel for if(this->parallel_processing) reduction(+ : docs_removed)
-        for (int i = 0; i < paths.size(); i++) {
-            const std::string &path = paths[i];
-
-            docs_removed += delete_single(fs::path(path), conditions);
-        }
-
-    } else {
-        std::vector<fs::path> file_paths = {};
-        collect_paths(collection_path.string(), file_paths);
-
-        #pragma omp parallel for if(this->parallel_processing) reduction(+ : docs_removed)
-        for (int i = 0; i < file_paths.size(); i++) {
-            fs::path file_path = file_paths[i];
-            docs_removed += delete_single(file_path, conditions);
-        }
-    }
 
-    // Update if documents were deleted
-    if (docs_removed > 0) {
-        fs::path header_path = fs::path(this->path) / "header.json";
-        std::ofstream header(header_path);
-        if (header.is_open()) {
-            json json_header;
-            json_header["number_of_documents"] = this->number_of_documents - docs_removed;
-            header << json_header << std::endl;
-            header.close();
-            this->number_of_documents -= docs_removed;
-        } else {
-            throw_failed_to_open_file(header_path);
-            throw_failed_to_update_header(this->get_name());
-            return -1;
-        }
+    // The documents are found with the same access path as a read and deleted from the storage and indexes at the next checkpoint.
+    // Every deletion is logged with a single write and fsync.
+    std::vector<json> matching_docs = this->read_with_conditions(conditions);
+    std::vector<json> records;
+    for (const json &doc : matching_docs) {
+        if (doc.is_null()) continue;
+        records.push_back({{"op", "delete"}, {"id", doc["id"]}});
+        docs_removed++;
     }
+    if (this->log_changes(records) != 0) return -1;
 
+    this->maybe_checkpoint();
     return docs_removed;
 }
 
 void collection::delete_collection() {
+    {
+        std::lock_guard<std::mutex> guard(this->pending_lock);
+        this->pending.clear();
+    }
+    if (this->wal != nullptr) this->wal->delete_log();
+    if (this->segments != nullptr) this->segments->delete_store();
+    if (this->primary != nullptr) this->primary->close();
     fs::remove_all(fs::path(this->path));
 }
 
-bool collection::find_index(const field_type &field) {
-    return this->indexes.find(build_index_name(field)) != this->indexes.end();
+bool collection::find_index(const std::vector<field_type> &fields, index_type type) {
+    return this->indexes.find(build_index_name(fields, type)) != this->indexes.end();
 }
 
-int collection::delete_hash_index(const field_type &field) {
-    std::string index_name = build_index_name(field);
-    if (!this->find_index(field)) {
+int collection::delete_index(const std::vector<field_type> &fields, index_type type) {
+    std::string index_name = build_index_name(fields, type);
+    if (!this->find_index(fields, type)) {
         std::cerr << "Error: The index with name \"" << index_name << "\" does not exist." << std::endl;
         return 1;
     }
-    hash_index* index = this->indexes[index_name];
+    secondary_index* index = this->indexes[index_name];
     index->delete_index();
     delete index;
     this->indexes.erase(index_name);
     
     return 0;
 }
+
+int collection::create_zone_map(const field_type &field) {
+    if (field.empty()) return 0;
+
+    std::vector<field_type> fields = this->zones == nullptr ? std::vector<field_type>() : this->zones->get_fields();
+    if (std::find(fields.begin(), fields.end(), field) != fields.end()) {
+        std::cerr << "Error: The field " << json(field) << " already has a zone map." << std::endl;
+        return 1;
+    }
+    fields.push_back(field);
+
+    // The synopses are built from the stored documents.
+    if (this->checkpoint() != 0) return 1;
+
+    delete this->zones;
+    this->zones = new zone_map((fs::path(this->path) / "zone_map.bin").string(), fields);
+    if (this->build_zone_map() != 0 || this->write_header() != 0) {
+        std::cerr << "Error: Failed to create zone map on " << json(field) << "." << std::endl;
+        this->zones->delete_file();
+        delete this->zones;
+        this->zones = nullptr;
+        this->write_header();
+        return 1;
+    }
+    return 0;
+}
+
+int collection::delete_zone_map(const field_type &field) {
+    std::vector<field_type> fields = this->zones == nullptr ? std::vector<field_type>() : this->zones->get_fields();
+    auto found = std::find(fields.begin(), fields.end(), field);
+    if (found == fields.end()) {
+        std::cerr << "Error: The field " << json(field) << " has no zone map." << std::endl;
+        return 1;
+    }
+    fields.erase(found);
+
+    if (this->checkpoint() != 0) return 1;
+
+    this->zones->delete_file();
+    delete this->zones;
+    this->zones = nullptr;
+    if (!fields.empty()) {
+        this->zones = new zone_map((fs::path(this->path) / "zone_map.bin").string(), fields);
+        if (this->build_zone_map() != 0) {
+            this->zones->delete_file();
+            delete this->zones;
+            this->zones = nullptr;
+        }
+    }
+    return this->write_header();
+}
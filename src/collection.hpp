@@ -5,9 +5,30 @@
 #define COLLECTION_CLASS_H
 
 #include "hash_index.hpp"
+#include "btree_index.hpp"
+#include "bitmap_index.hpp"
+#include "text_index.hpp"
+#include "trigram_index.hpp"
+#include "geo_index.hpp"
+#include "vector_index.hpp"
+#include "zone_map.hpp"
+#include "statistics.hpp"
+#include "query_planner.hpp"
+#include "predicate.hpp"
+#include "cursor.hpp"
+#include "lazy_json.hpp"
+#include "segment_store.hpp"
+#include "primary_index.hpp"
+#include "write_ahead_log.hpp"
 #include "auxiliary.hpp"
+#include <atomic>
 #include <string>
 #include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <shared_mutex>
+#include <functional>
 #include <unordered_map>
 #include <iostream>
 #include <json.hpp>
@@ -35,39 +56,288 @@ namespace nosqlite {
          */
         unsigned long long number_of_documents;
 
+        /**
+         * @brief Id given to the next document added to the collection. Ids are never reused.
+         */
+        unsigned long long next_id;
+
         /**
          * @brief Map of indexes associated with the collection.
          */
-        std::unordered_map<std::string, hash_index*> indexes;
+        std::unordered_map<std::string, secondary_index*> indexes;
+
+        /**
+         * @brief Synopses of the zones of the collection, consulted by scans. nullptr if no field has one.
+         */
+        zone_map *zones;
+
+        /**
+         * @brief Statistics collected by the last ANALYZE, used by the planner to estimate how many documents satisfy the conditions.
+         */
+        collection_statistics statistics;
 
         /**
          * @brief Turns parallel processing on and off.
          */
         bool parallel_processing;
 
+        /**
+         * @brief Layout in which the documents are stored.
+         */
+        storage_type storage;
+
+        /**
+         * @brief Location of every stored document, by id.
+         */
+        primary_index *primary;
+
+        /**
+         * @brief Segment files of the collection. Only used with SEGMENT_STORAGE, nullptr otherwise.
+         */
+        segment_store *segments;
+
+        /**
+         * @brief Log of the changes that haven't been applied to the documents and indexes yet.
+         */
+        write_ahead_log *wal;
+
+        /**
+         * @brief Logged changes waiting for the next checkpoint, by document id. A null document marks a deletion.
+         */
+        std::map<unsigned long long, json> pending;
+
+        /**
+         * @brief Lsn of the last logged change applied to the documents and indexes.
+         */
+        unsigned long long checkpoint_lsn;
+
+        /**
+         * @brief Protects the pending changes and the document counters.
+         */
+        mutable std::mutex pending_lock;
+
+        /**
+         * @brief Held shared while a change is logged and exclusively during a checkpoint.
+         */
+        std::shared_mutex checkpoint_lock;
+
+        /**
+         * @param id Id of the document.
+         * @brief Builds the path to the file of a document stored with HASHED_STORAGE.
+         */
+        fs::path document_file(unsigned long long id) const;
+
+        /**
+         * @param id_hash Hash of the id of the document.
+         * @brief Builds the path to the file of a document stored with HASHED_STORAGE from the hash of its id.
+         */
+        fs::path hashed_document_file(unsigned long long id_hash) const;
+
+        /**
+         * @param id Id of a stored document.
+         * @brief Gets the zone where a document is stored: its segment with SEGMENT_STORAGE and the number of its top level directory with HASHED_STORAGE.
+         */
+        unsigned int document_zone(unsigned long long id) const;
+
+        /**
+         * @brief Scans the collection and rebuilds the synopses of every zone.
+         * @return 0 on success and 1 otherwise.
+         */
+        int build_zone_map();
+
+        /**
+         * @brief Rebuilds the primary index of a collection with HASHED_STORAGE from its document files.
+         * @return 0 on success and 1 otherwise.
+         */
+        int rebuild_primary_index();
+
+        /**
+         * @param document Document with an id.
+         * @brief Writes a new document to the storage. Does not touch the indexes or the header.
+         * @return 0 on success and 1 otherwise.
+         */
+        int write_document(const json &document);
+
+        /**
+         * @brief Writes the header file of the collection.
+         * @return 0 on success and 1 otherwise.
+         */
+        int write_header() const;
+
+        /**
+         * @param document Document to be indexed.
+         * @brief Adds a document to every index of the collection.
+         */
+        void index_document(const json &document);
+
+        /**
+         * @param document Document to be removed from the indexes.
+         * @brief Removes a document from every index of the collection.
+         */
+        void unindex_document(const json &document);
+
+        /**
+         * @param index Index to build.
+         * @brief Scans the collection and builds the index with the indexed value of every document.
+         * @return 0 on success and 1 otherwise.
+         */
+        int build_index(secondary_index *index) const;
+
+        /**
+         * @param conditions Conditions of the query.
+         * @brief Gets the cheapest plan for the conditions, from the indexes, the zone map and the statistics of the collection.
+         */
+        query_plan plan_query(const std::vector<condition_type> &conditions) const;
+
+        /**
+         * @param conditions Conditions of the query.
+         * @param ids Destination of the ids of the documents that may satisfy the conditions.
+         * @param profile Receives the plan, the index lookups and the time spent planning and in the indexes, if given.
+         * @brief Gets the candidate documents from the indexes chosen by the planner. The candidates are the intersection of their results and keep the order of the first index, the order of the indexed value for a B+tree.
+         * @return True if an index was used and false if the collection has to be scanned.
+         */
+        bool find_candidates(const std::vector<condition_type> &conditions, std::vector<unsigned long long> &ids, query_profile *profile = nullptr) const;
+
+        /**
+         * @param conditions Conditions of the query.
+         * @param key Key the documents are sorted by.
+         * @param limited True if the read has a limit.
+         * @param ids Destination of the ids of the documents that may satisfy the conditions, in the order of the key.
+         * @param profile Receives the plan, the index lookups and the time spent planning and in the indexes, if given.
+         * @brief Gets the candidate documents in the order of an ascending key from a B+tree index with a range on the field, which makes sorting them unnecessary. The index is the one chosen by the planner,
+         * or any that gives the order if the planner chose a scan and the read has a limit.
+         * @return False if no index gives the order.
+         */
+        bool find_ordered_candidates(const std::vector<condition_type> &conditions, const sort_key &key, bool limited, std::vector<unsigned long long> &ids, query_profile *profile = nullptr) const;
+
+        /**
+         * @param plan Plan of the query.
+         * @param ids Destination of the ids of the documents that may satisfy the conditions.
+         * @param profile Receives the index lookups and the time spent in the indexes, if given.
+         * @brief Runs the accesses of a plan: the candidates are the intersection of their results and keep the order of the first index.
+         * @return True if the plan uses an index.
+         */
+        bool run_plan(const query_plan &plan, std::vector<unsigned long long> &ids, query_profile *profile) const;
+
+        /**
+         * @param conditions Conditions of the query.
+         * @param segments Destination of the segments to read and the locations of their live documents, with SEGMENT_STORAGE.
+         * @param directories Destination of the directories of documents to read, with HASHED_STORAGE.
+         * @brief Lists the zones a scan reads, without the ones whose synopses show that no document satisfies the conditions.
+         */
+        void scan_targets(const std::vector<condition_type> &conditions, std::vector<std::pair<unsigned int, std::vector<document_location>>> &segments, std::vector<fs::path> &directories) const;
+
+        /**
+         * @param segment Number of the segment.
+         * @param records Locations of the live documents in the segment, sorted by offset.
+         * @param visit Function called with every document and the number of the thread that read it.
+         * @param profile Counts the files opened, the bytes read, the documents parsed and the conditions checked, if given.
+         * @param filter Only the documents that satisfy it are visited, if given.
+         * @param projection Only the fields it keeps are visited, if given.
+         * @param stop The documents left aren't read once it is set, if given.
+         * @brief Reads the documents of a segment, in parallel if parallel processing is on.
+         */
+        void scan_segment(unsigned int segment, const std::vector<document_location> &records, const std::function<void(const json &document, int thread_num)> &visit, query_profile *profile = nullptr, const predicate *filter = nullptr, const field_projector *projection = nullptr, const std::atomic<bool> *stop = nullptr) const;
+
+        /**
+         * @param file_paths Paths to the document files.
+         * @param visit Function called with every document and the number of the thread that read it.
+         * @param profile Counts the files opened, the bytes read, the documents parsed and the conditions checked, if given.
+         * @param filter Only the documents that satisfy it are visited, if given.
+         * @param projection Only the fields it keeps are visited, if given.
+         * @param stop The files left aren't read once it is set, if given.
+         * @brief Reads the documents of files of a collection with HASHED_STORAGE, in parallel if parallel processing is on.
+         */
+        void scan_files(const std::vector<fs::path> &file_paths, const std::function<void(const json &document, int thread_num)> &visit, query_profile *profile = nullptr, const predicate *filter = nullptr, const field_projector *projection = nullptr, const std::atomic<bool> *stop = nullptr) const;
+
+        /**
+         * @param visit Function called with every document and the number of the thread that read it.
+         * @param conditions Conditions of the query. Zones whose synopses show that no document satisfies them aren't read.
+         * @param profile Counts the files opened, the bytes read, the documents parsed and the conditions checked, if given.
+         * @param filter Only the documents that satisfy it are visited, if given. It is checked on the fields it reads before the rest of the document is parsed.
+         * @param projection Only the fields it keeps are parsed and visited, if given.
+         * @brief Reads every document in the collection, in parallel if parallel processing is on.
+         */
+        void scan(const std::function<void(const json &document, int thread_num)> &visit, const std::vector<condition_type> &conditions = {}, query_profile *profile = nullptr, const predicate *filter = nullptr, const field_projector *projection = nullptr) const;
+
         /**
          * @param json_content JSON document to add to the collection.
-         * @param update_header Indicates whether the header file should be updated or not.
-         * @brief Adds a new document to the collection, updates the indices and the header file (or not).
+         * @param logged Indicates whether the insert goes through the log (single inserts) or is written directly (bulk loads).
+         * @brief Adds a new document to the collection.
          */
-        int add_document(const std::string &json_content, bool update_header);
+        int add_document(const std::string &json_content, bool logged);
 
         /**
          * @param json_object JSON object to add to the collection.
-         * @param update_header Indicates whether the header file should be updated or not.
-         * @brief Adds a new document to the collection, updates the indices and the header file (or not).
+         * @param logged Indicates whether the insert goes through the log (single inserts) or is written directly (bulk loads).
+         * @brief Adds a new document to the collection.
+         */
+        int add_document(json &json_object, bool logged);
+
+        /**
+         * @param op Type of change: "insert", "update" or "delete".
+         * @param id Id of the document.
+         * @param document New version of the document, null for deletions.
+         * @brief Logs a change and adds it to the pending changes.
+         * @return 0 on success and 1 otherwise.
          */
-        int add_document(json &json_object, bool update_header);
+        int log_change(const std::string &op, unsigned long long id, const json &document);
 
-        int delete_single(const fs::path &file_path, const std::vector<condition_type> &conditions);
+        /**
+         * @param records Changes, each with its type ("op"), the id of the document ("id") and, except for deletions, its new version ("document").
+         * @brief Logs several changes with a single write and fsync, and adds them to the pending changes.
+         * @return 0 on success and 1 otherwise.
+         */
+        int log_changes(const std::vector<json> &records);
+
+        /**
+         * @param record Logged change.
+         * @brief Adds a logged change to the pending changes and updates the document counters.
+         */
+        void add_pending(const json &record);
+
+        /**
+         * @brief Gets a copy of the pending changes.
+         */
+        std::map<unsigned long long, json> pending_snapshot() const;
+
+        /**
+         * @param id Id of the document.
+         * @param document New version of the document, null to delete it.
+         * @param unsynced Destination of the document files and directories written, which have to be synced before the change is durable.
+         * @brief Writes a change to the documents and the indexes.
+         * @return 0 on success and 1 otherwise.
+         */
+        int apply_change(unsigned long long id, const json &document, std::set<fs::path> &unsynced);
+
+        /**
+         * @param id Id of the document.
+         * @brief Reads a document from the storage, ignoring pending changes.
+         * @return The document or null if it doesn't exist.
+         */
+        json read_stored(unsigned long long id) const;
+
+        /**
+         * @param ids Ids of the documents.
+         * @param documents Destination of the documents, in the order of the ids. Null for documents that don't exist.
+         * @param profile Counts the files opened, the bytes read and the documents parsed, if given.
+         * @brief Reads several documents from the storage, ignoring pending changes. Each file is read once however many of the documents it has.
+         */
+        void read_stored(const std::vector<unsigned long long> &ids, std::vector<json> &documents, query_profile *profile = nullptr) const;
+
+        /**
+         * @brief Runs a checkpoint if enough changes are pending.
+         */
+        void maybe_checkpoint();
 
     public:
 
         /**
          * @param path Path and name of the collection
+         * @param storage Layout in which the documents are stored. Replaced by the one in the header for existing collections.
          * @brief Constructor for the collection class.
          */
-        collection(const std::string &path);
+        collection(const std::string &path, storage_type storage = HASHED_STORAGE);
 
         /**
          * @brief Destructor for the collection class.
@@ -112,6 +382,34 @@ namespace nosqlite {
          */
         unsigned long long get_number_of_documents() const;
 
+        /**
+         * @brief Gets the layout in which the documents are stored.
+         */
+        storage_type get_storage() const;
+
+        /**
+         * @brief Maximum number of pending changes before a checkpoint is run.
+         */
+        static const size_t checkpoint_threshold = 1024;
+
+        /**
+         * @brief Number of ids of an index read by each batch of a cursor. Scans read a zone per batch.
+         */
+        static constexpr size_t cursor_batch_ids = 256;
+
+        /**
+         * @brief Applies the pending changes to the documents and indexes, updates the header and empties the log.
+         * @return 0 on success and 1 otherwise.
+         */
+        int checkpoint();
+
+        /**
+         * @param target New storage layout.
+         * @brief Moves every document of the collection to the target layout. The indexes hold document ids and stay valid.
+         * @return 0 on success and 1 otherwise.
+         */
+        int migrate_storage(storage_type target);
+
         /**
          * @param json_content JSON document to add to the collection.
          * @brief Adds a new document to the collection and updates the indices.
@@ -133,9 +431,60 @@ namespace nosqlite {
 
         /**
          * @param conditions List of conditions that condition the read operation.
+         * @param profile Receives the plan that ran, the counters of each stage and their timings (EXPLAIN ANALYZE), if given.
+         * @param options Documents skipped, most documents returned, fields kept and the order of the documents. With a limit, documents to skip or an order the documents are read through a cursor, which stops once it has enough.
          * @brief Gets all the documents in the collection that satisfy all of the conditions.
          */
-        std::vector<json> read_with_conditions(const std::vector<condition_type> &conditions) const;
+        std::vector<json> read_with_conditions(const std::vector<condition_type> &conditions, query_profile *profile = nullptr, const read_options &options = {}) const;
+
+        /**
+         * @param conditions List of conditions that condition the read operation.
+         * @param options Documents skipped, most documents returned, fields kept and the order of the documents.
+         * @param profile Receives the plan, the counters and the timings of the stages run while opening the cursor and reading from it, if given. It must outlive the cursor.
+         * @brief Opens a cursor over the documents in the collection that satisfy all of the conditions, in the same order as read_with_conditions. The documents are read a batch at a time as the cursor is advanced,
+         * a batch of ids of the index or a zone (a segment or a directory of files) scanned in parallel, and a scan stops reading once it has the documents the limit asks for.
+         * Sorted reads read every document into a result_sorter on the first batch and return them in order, unless an index gives the order.
+         */
+        cursor open_cursor(const std::vector<condition_type> &conditions, const read_options &options = {}, query_profile *profile = nullptr) const;
+
+        /**
+         * @param conditions List of conditions the documents aggregated satisfy.
+         * @param aggregates Aggregates computed over each group.
+         * @param group_by Fields the documents are grouped by, none for a single group.
+         * @brief Computes aggregates over the documents in the collection that satisfy all of the conditions, grouped by the values of some fields. The threads of the scan, or of the check of the documents an index found,
+         * add the documents to their own groups as they read them, so the documents aren't kept, and scans only parse the fields the aggregates and the groups read.
+         * @return Returns a row for each group, with the values of the group fields and the result of each aggregate.
+         */
+        std::vector<json> aggregate(const std::vector<condition_type> &conditions, const std::vector<aggregate_type> &aggregates, const std::vector<field_type> &group_by) const;
+
+        /**
+         * @param conditions List of conditions the documents counted satisfy.
+         * @brief Counts the documents in the collection that satisfy all of the conditions. Without conditions it is the number of documents in the header. If indexes find exactly the documents of every condition (equality and "in" conditions,
+         * and inequalities for bitmaps) the count comes from their postings, or the cardinality of the bitmaps, corrected with the pending changes. Otherwise the documents are streamed through an aggregate.
+         * @return Returns the number of documents.
+         */
+        unsigned long long count(const std::vector<condition_type> &conditions) const;
+
+        /**
+         * @param field Field whose values are returned.
+         * @param conditions List of conditions the documents satisfy.
+         * @brief Gets the distinct values of a field in the documents that satisfy all of the conditions, each element of arrays, in the order of order_by. Missing fields and nulls have no value.
+         * Without conditions, a bitmap index on the field has the values, corrected with the pending changes. Otherwise the documents are streamed through an aggregate grouped by the field.
+         * @return Returns the values.
+         */
+        std::vector<json> distinct(const field_type &field, const std::vector<condition_type> &conditions) const;
+
+        /**
+         * @param field Field with the embeddings.
+         * @param query Vector to compare the embeddings with.
+         * @param k Number of documents.
+         * @param metric Similarity of the vectors.
+         * @param probes Number of partitions of the vector index searched, 0 for an exact search.
+         * @param conditions Conditions the documents must satisfy.
+         * @brief Finds the k documents that satisfy the conditions with the embeddings most similar to the query. Uses the vector index on the field if there is one and scans the collection otherwise.
+         * @return The documents, the most similar first.
+         */
+        std::vector<json> nearest(const field_type &field, const std::vector<float> &query, size_t k, vector_metric metric, unsigned int probes, const std::vector<condition_type> &conditions) const;
 
         /**
          * @param id Id of the document to
@@ -153,6 +502,12 @@ namespace nosqlite {
          */
         std::vector<json> update_document(const std::vector<condition_type> &conditions, const json& updated_data);
         
+        /**
+         * @param id Id of the document.
+         * @brief Checks if a document exists without reading it.
+         */
+        bool document_exists(unsigned long long id) const;
+
         /**
          * @param id Id of the document to get.
          * @brief Gets a document by id.
@@ -161,17 +516,20 @@ namespace nosqlite {
         json get_document(unsigned long long id) const;
 
         /**
-         * @param field Field to be indexed if length is one and list of nested fields where the last one is indexed otherwise.
-         * @brief Creates a hash index on the field parameter.
+         * @param fields Fields to be indexed, each one a list of nested fields where the last one is indexed. More than one field makes a compound index.
+         * @param type Structure of the index. Compound indexes must be B+tree indexes.
+         * @brief Creates an index on the fields parameter.
+         * @return 0 on success and 1 otherwise.
          */
-        int create_hash_index(const field_type &field);
+        int create_index(const std::vector<field_type> &fields, index_type type = HASH_INDEX);
 
         /**
          * @param index_name Name of the index.
          * @param value Value to find in the index.
-         * @brief Wrapper to consult a hash index.
+         * @brief Wrapper to consult an index.
+         * @return Ids of the documents that may have the value.
          */
-        std::vector<std::string> consult_hash_index(const std::string &index_name, const json &value) const;
+        std::vector<unsigned long long> consult_index(const std::string &index_name, const json &value) const;
         
         /**
          * @param conditions Vector of tuples with (field_path, operator, value)
@@ -186,17 +544,46 @@ namespace nosqlite {
         void delete_collection();
 
         /**
-         * @param field Field of the index to find.
-         * @brief Checks if and index on the collection on the specified field exists.
+         * @param fields Fields of the index to find.
+         * @param type Structure of the index.
+         * @brief Checks if and index on the collection on the specified fields exists.
+         */
+        bool find_index(const std::vector<field_type> &fields, index_type type = HASH_INDEX);
+
+        /**
+         * @param field Field to summarize.
+         * @brief Keeps a Bloom filter of the values and the range of the numbers of a field in every zone of the collection, so scans skip the zones that can't satisfy their conditions on it.
+         * @return 0 on success and 1 otherwise.
+         */
+        int create_zone_map(const field_type &field);
+
+        /**
+         * @param field Summarized field.
+         * @brief Stops keeping synopses of a field.
+         * @return 0 on success and 1 otherwise.
+         */
+        int delete_zone_map(const field_type &field);
+
+        /**
+         * @brief Collects the statistics of the documents and the indexes used by the planner (ANALYZE) and writes them to statistics.json. Pending changes are checkpointed first.
+         * @return 0 on success and 1 otherwise.
+         */
+        int analyze();
+
+        /**
+         * @param conditions Conditions of a query.
+         * @brief Gets the plan the planner chooses for the conditions, without running it.
+         * @return The access path, the indexes used with the conditions each one covers, the estimated documents read and the estimated costs.
          */
-        bool find_index(const field_type &field);
+        json explain(const std::vector<condition_type> &conditions) const;
 
         /**
-         * @param Field of the index to delete.
-         * @brief Delete the hash index on the specified field.
+         * @param fields Fields of the index to delete.
+         * @param type Structure of the index.
+         * @brief Delete the index on the specified fields.
          * @return 0 on success and 1 otherwise.
          */
-        int delete_hash_index(const field_type &field);
+        int delete_index(const std::vector<field_type> &fields, index_type type = HASH_INDEX);
 
      };
  } // namespace nosqlite
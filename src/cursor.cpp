@@ -0,0 +1,42 @@
+#include "cursor.hpp"
+#include <limits>
+#include <json.hpp>
+
+using namespace nosqlite;
+using json = nlohmann::json;
+
+
+cursor::cursor() : next_batch(0), position(0), skip(0), limit(0), produced(0), skipped(0), delivered(0) {}
+
+cursor::cursor(std::vector<batch> batches, size_t skip, size_t limit)
+    : batches(std::move(batches)), next_batch(0), position(0), skip(skip), limit(limit), produced(0), skipped(0), delivered(0) {}
+
+bool cursor::next(json &document) {
+    while (this->limit == 0 || this->delivered < this->limit) {
+        if (this->position < this->buffer.size()) {
+            json &result = this->buffer[this->position++];
+            if (this->skipped < this->skip) {
+                this->skipped++;
+                continue;
+            }
+            document = std::move(result);
+            this->delivered++;
+            return true;
+        }
+        if (this->next_batch == this->batches.size()) return false;
+
+        // A batch only needs the results that are still missing. Batches are released once they have no more.
+        size_t wanted = this->limit == 0 ? std::numeric_limits<size_t>::max() : this->skip + this->limit - this->produced;
+        this->buffer.clear();
+        this->position = 0;
+        if (!this->batches[this->next_batch](this->buffer, wanted)) this->batches[this->next_batch++] = nullptr;
+        this->produced += this->buffer.size();
+    }
+
+    // The rest of the read is never needed.
+    this->batches.clear();
+    this->next_batch = 0;
+    this->buffer.clear();
+    this->position = 0;
+    return false;
+}
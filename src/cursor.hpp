@@ -0,0 +1,88 @@
+/**
+ * @file cursor.hpp
+ */
+#ifndef CURSOR_CLASS_H
+#define CURSOR_CLASS_H
+
+#include <functional>
+#include <vector>
+#include <json.hpp>
+using json = nlohmann::json;
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @class cursor
+     * @brief Results of a read delivered one at a time. The read is split in batches (a chunk of the ids an index returned, a segment or a directory of document files) that are only read when the documents before them are used up,
+     * so at most one batch of results is held and a read with a limit stops reading once it has enough documents. Documents changed while a cursor is open may or may not be returned.
+     * A cursor reads from its collection, it must not be used after the collection is deleted.
+     */
+    class cursor {
+    public:
+
+        /**
+         * @brief Reads a batch of the results into the vector. It may stop once it has the number of documents given. Returns true if it has more results, which are read by calling it again.
+         */
+        typedef std::function<bool(std::vector<json> &found, size_t wanted)> batch;
+
+    private:
+
+        /**
+         * @brief Batches of the read, in order.
+         */
+        std::vector<batch> batches;
+
+        /**
+         * @brief Index of the next batch to read.
+         */
+        size_t next_batch;
+
+        /**
+         * @brief Results of the last batch read and the position of the next one.
+         */
+        std::vector<json> buffer;
+        size_t position;
+
+        /**
+         * @brief Number of results skipped before the first one returned and the most results returned, 0 for all of them.
+         */
+        size_t skip;
+        size_t limit;
+
+        /**
+         * @brief Number of results read, skipped and returned so far.
+         */
+        size_t produced;
+        size_t skipped;
+        size_t delivered;
+
+    public:
+
+        /**
+         * @brief Constructor for an empty cursor.
+         */
+        cursor();
+
+        /**
+         * @param batches Batches of the read, in order.
+         * @param skip Number of results skipped.
+         * @param limit Most results returned, 0 for all of them.
+         * @brief Constructor for the cursor class. No batch is read until the first result is asked for.
+         */
+        cursor(std::vector<batch> batches, size_t skip, size_t limit);
+
+        /**
+         * @param document Destination of the next result.
+         * @brief Gets the next result, reading the next batches if the last one is used up.
+         * @return False if there are no more results.
+         */
+        bool next(json &document);
+    };
+
+}
+
+#endif
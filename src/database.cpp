@@ -26,7 +26,7 @@ void database::turn_off_parallel_processing() {
     for (auto col : this->collections) col.second->turn_off_parallel_processing();
 }
 
-int database::build_from_scratch(const std::string &path_to_json) {
+int database::build_from_scratch(const std::string &path_to_json, storage_type storage) {
 
     // Checks if the directory with the json files to create the database with exists.
     if (int ret = check_path_existence(path_to_json) != 0) return 1;
@@ -48,7 +48,7 @@ int database::build_from_scratch(const std::string &path_to_json) {
 
         fs::path collection_path = fs::path(this->path) / collection_name;
 
-        collection* col = new collection(collection_path.string());
+        collection* col = new collection(collection_path.string(), storage);
         if (col->build_from_scratch((entry.parent_path() / collection_name).string()) != 0) {
             std::cerr << "Error: Failed to create collection: \"" << collection_name << "\"" << std::endl;
             delete col;
@@ -128,21 +128,57 @@ void database::set_collection(const std::string &collection_name, collection* co
     this->collections[collection_name] = col;
 }
 
-int database::create_hash_index(const std::string &col_name, const field_type &field) {
+int database::create_index(const std::string &col_name, const std::vector<field_type> &fields, index_type type) {
     collection *col = this->get_collection(col_name);
 
-    return col->create_hash_index(field);
+    return col->create_index(fields, type);
 }
 
 int database::create_document(const std::string &col_name, json &document) {
     return this->get_collection(col_name)->create_document(document);
 }
 
-std::vector<json> database::read(const std::string &col_name, const std::vector<condition_type> &conditions) {
-    if (conditions.empty()) {
-        return this->get_collection(col_name)->read_all(); 
+std::vector<json> database::read(const std::string &col_name, const std::vector<condition_type> &conditions, query_profile *profile, const read_options &options) {
+    collection *col = this->get_collection(col_name);
+    if (col == nullptr) return {};
+    if (conditions.empty() && profile == nullptr && options.skip == 0 && options.limit == 0 && options.fields.empty() && options.order.empty()) {
+        return col->read_all(); 
+    }
+    else return col->read_with_conditions(conditions, profile, options);
+}
+
+int database::open_cursor(const std::string &col_name, const std::vector<condition_type> &conditions, const read_options &options, cursor &results) {
+    collection *col = this->get_collection(col_name);
+    if (col == nullptr) return 1;
+    results = col->open_cursor(conditions, options);
+    return 0;
+}
+
+std::vector<json> database::aggregate(const std::string &col_name, const std::vector<condition_type> &conditions, const std::vector<aggregate_type> &aggregates, const std::vector<field_type> &group_by) {
+    collection *col = this->get_collection(col_name);
+    if (col == nullptr) return {};
+    return col->aggregate(conditions, aggregates, group_by);
+}
+
+int database::count(const std::string &col_name, const std::vector<condition_type> &conditions, unsigned long long &result) {
+    collection *col = this->get_collection(col_name);
+    if (col == nullptr) return 1;
+    result = col->count(conditions);
+    return 0;
+}
+
+std::vector<json> database::distinct(const std::string &col_name, const field_type &field, const std::vector<condition_type> &conditions) {
+    collection *col = this->get_collection(col_name);
+    if (col == nullptr) return {};
+    return col->distinct(field, conditions);
+}
+
+std::vector<json> database::nearest(const std::string &col_name, const field_type &field, const std::vector<float> &query, size_t k, vector_metric metric, unsigned int probes, const std::vector<condition_type> &conditions) {
+    if (query.empty()) {
+        std::cerr << "Error: The query vector is empty." << std::endl;
+        return {};
     }
-    else return this->get_collection(col_name)->read_with_conditions(conditions);
+    return this->get_collection(col_name)->nearest(field, query, k, metric, probes, conditions);
 }
 
 std::vector<json> nosqlite::database::update(const std::string &col_name, const std::vector<condition_type> &conditions, const json &updated_data) {
@@ -207,13 +243,13 @@ int database::delete_collection(const std::string &col_name)
   return 0;
 }
 
-int database::create_collection(const std::string &col_name, const std::string &path_to_files) {
+int database::create_collection(const std::string &col_name, const std::string &path_to_files, storage_type storage) {
     if (this->collections.find(col_name) != this->collections.end()) {
         std::cerr << "Error: Collection with name \"" << col_name << "\" already exists." << std::endl;
         return 1;
     }
 
-    collection* col = new collection(this->path + "/" + col_name);
+    collection* col = new collection(this->path + "/" + col_name, storage);
     if (col->build_from_scratch(path_to_files) != 0) {
         std::cerr << "Error: Failed to build collection: \"" << col_name << "\"" << std::endl;
         delete col;
@@ -238,11 +274,56 @@ int database::create_collection(const std::string &col_name, const std::string &
     return 0;
 }
 
-int database::delete_hash_index(const std::string &col_name, const field_type &field) {
+int database::migrate_storage(const std::string &col_name, storage_type storage) {
+    if (this->collections.find(col_name) == this->collections.end()) {
+        std::cerr << "Error: Collection with name \"" << col_name << "\" does not exist." << std::endl;
+        return 1;
+    }
+
+    return this->get_collection(col_name)->migrate_storage(storage);
+}
+
+int database::delete_index(const std::string &col_name, const std::vector<field_type> &fields, index_type type) {
     if (this->collections.find(col_name) == this->collections.end()) {
         std::cerr << "Error: Collection with name \"" << col_name << "\" does not exist." << std::endl;
         return 1;
     }
 
-    return this->get_collection(col_name)->delete_hash_index(field);
+    return this->get_collection(col_name)->delete_index(fields, type);
+}
+
+int database::create_zone_map(const std::string &col_name, const field_type &field) {
+    if (this->collections.find(col_name) == this->collections.end()) {
+        std::cerr << "Error: Collection with name \"" << col_name << "\" does not exist." << std::endl;
+        return 1;
+    }
+
+    return this->get_collection(col_name)->create_zone_map(field);
+}
+
+int database::delete_zone_map(const std::string &col_name, const field_type &field) {
+    if (this->collections.find(col_name) == this->collections.end()) {
+        std::cerr << "Error: Collection with name \"" << col_name << "\" does not exist." << std::endl;
+        return 1;
+    }
+
+    return this->get_collection(col_name)->delete_zone_map(field);
+}
+
+int database::analyze(const std::string &col_name) {
+    if (this->collections.find(col_name) == this->collections.end()) {
+        std::cerr << "Error: Collection with name \"" << col_name << "\" does not exist." << std::endl;
+        return 1;
+    }
+
+    return this->get_collection(col_name)->analyze();
+}
+
+json database::explain(const std::string &col_name, const std::vector<condition_type> &conditions) {
+    if (this->collections.find(col_name) == this->collections.end()) {
+        std::cerr << "Error: Collection with name \"" << col_name << "\" does not exist." << std::endl;
+        return json();
+    }
+
+    return this->get_collection(col_name)->explain(conditions);
 }
@@ -62,10 +62,11 @@ namespace nosqlite {
 
         /**
         * @param path_to_json Path to the json files that will build the database. Must be a directory. Each subdirectory will be taken as an individual collection.
+        * @param storage Layout in which the documents of every collection are stored.
         * @brief Build a database from scratch using the json files in path_to_json. Will delete everything in the path directory.
         * @return 0 on success and 1 otherwise.
         */
-        int build_from_scratch(const std::string &path_to_json);
+        int build_from_scratch(const std::string &path_to_json, storage_type storage = HASHED_STORAGE);
 
         /**
          * @brief Builds the database instance from a database already in memory (must follow the NoSQLite specifications)
@@ -87,10 +88,11 @@ namespace nosqlite {
         
         /**
          * @param col_name Name of the collection.
-         * @param field Field to be indexed if length is one and list of nested fields where the last one is indexed otherwise.
-         * @brief Create an index on the collection and field in the parameters.
+         * @param fields Fields to be indexed, each one a list of nested fields where the last one is indexed. More than one field makes a compound index.
+         * @param type Structure of the index.
+         * @brief Create an index on the collection and fields in the parameters.
          */
-        int create_hash_index(const std::string &col_name, const field_type &field);
+        int create_index(const std::string &col_name, const std::vector<field_type> &fields, index_type type = HASH_INDEX);
 
         /**
          * @param col_name Name of the collection.
@@ -103,10 +105,63 @@ namespace nosqlite {
         /**
          * @param col_name Name of the collection.
          * @param conditions These values impose conditions on the documents that are read.
-         * @brief Reads from the database and returns the documents according to the conditions.
+         * @param profile Receives the plan that ran, its counters and its timings, if given.
+         * @param options Documents skipped, most documents returned, fields kept and the order of the documents.
+         * @brief Reads from the database and returns the documents according to the conditions. Reads with a limit stop once they have enough documents.
          * @return Returns a vector with the results.
          */
-        std::vector<json> read(const std::string &col_name, const std::vector<condition_type> &conditions = {});
+        std::vector<json> read(const std::string &col_name, const std::vector<condition_type> &conditions = {}, query_profile *profile = nullptr, const read_options &options = {});
+
+        /**
+         * @param col_name Name of the collection.
+         * @param conditions These values impose conditions on the documents that are read.
+         * @param options Documents skipped, most documents returned, fields kept and the order of the documents.
+         * @param results Destination of the cursor.
+         * @brief Opens a cursor over the documents that satisfy the conditions, which reads them a batch at a time as it is advanced.
+         * @return Returns 0 on success and 1 if the collection doesn't exist.
+         */
+        int open_cursor(const std::string &col_name, const std::vector<condition_type> &conditions, const read_options &options, cursor &results);
+
+        /**
+         * @param col_name Name of the collection.
+         * @param conditions These values impose conditions on the documents that are aggregated.
+         * @param aggregates Aggregates computed over each group.
+         * @param group_by Fields the documents are grouped by, none for a single group.
+         * @brief Computes aggregates over the documents that satisfy the conditions, grouped by the values of some fields, without reading the documents into memory.
+         * @return Returns a vector with a row for each group.
+         */
+        std::vector<json> aggregate(const std::string &col_name, const std::vector<condition_type> &conditions, const std::vector<aggregate_type> &aggregates, const std::vector<field_type> &group_by);
+
+        /**
+         * @param col_name Name of the collection.
+         * @param conditions These values impose conditions on the documents that are counted.
+         * @param result Destination of the number of documents.
+         * @brief Counts the documents that satisfy the conditions, from the indexes when they find exactly the documents of every condition.
+         * @return Returns 0 on success and 1 if the collection doesn't exist.
+         */
+        int count(const std::string &col_name, const std::vector<condition_type> &conditions, unsigned long long &result);
+
+        /**
+         * @param col_name Name of the collection.
+         * @param field Field whose values are returned.
+         * @param conditions These values impose conditions on the documents whose values are returned.
+         * @brief Gets the distinct values of a field in the documents that satisfy the conditions, from a bitmap index on the field when there are no conditions.
+         * @return Returns a vector with the values.
+         */
+        std::vector<json> distinct(const std::string &col_name, const field_type &field, const std::vector<condition_type> &conditions);
+
+        /**
+         * @param col_name Name of the collection.
+         * @param field Field with the embeddings.
+         * @param query Vector to compare the embeddings with.
+         * @param k Number of documents.
+         * @param metric Similarity of the vectors.
+         * @param probes Number of partitions of the vector index searched, 0 for an exact search.
+         * @param conditions These values impose conditions on the documents that are returned.
+         * @brief Finds the k documents with the embeddings most similar to the query.
+         * @return Returns a vector with the documents, the most similar first.
+         */
+        std::vector<json> nearest(const std::string &col_name, const field_type &field, const std::vector<float> &query, size_t k, vector_metric metric, unsigned int probes, const std::vector<condition_type> &conditions = {});
 
         /**
          * @param col_name Name of the collection.
@@ -135,18 +190,59 @@ namespace nosqlite {
         /**
          * @param col_name Name of the collection.
          * @param path_to_files Path to JSON files for the new collection.
+         * @param storage Layout in which the documents of the collection are stored.
          * @brief Creates from the files in the path_to_files or an empty collection if the path is an empty string.
          * @return 0 on success and 1 otherwise.
          */
-        int create_collection(const std::string &col_name, const std::string &path_to_files = "");
+        int create_collection(const std::string &col_name, const std::string &path_to_files = "", storage_type storage = HASHED_STORAGE);
 
         /**
          * @param col_name Name of the collection.
-         * @param field Indexed field for the index to be deleted.
-         * @brief Delete the the index from the specified collection on the specified field.
+         * @param storage New layout for the documents of the collection.
+         * @brief Moves the documents of a collection to another storage layout.
+         * @return 0 on success and 1 otherwise.
+         */
+        int migrate_storage(const std::string &col_name, storage_type storage);
+
+        /**
+         * @param col_name Name of the collection.
+         * @param fields Indexed fields for the index to be deleted.
+         * @param type Structure of the index.
+         * @brief Delete the the index from the specified collection on the specified fields.
+         * @return 0 on success and 1 otherwise
+         */
+        int delete_index(const std::string &col_name, const std::vector<field_type> &fields, index_type type = HASH_INDEX);
+
+        /**
+         * @param col_name Name of the collection.
+         * @param field Field to summarize.
+         * @brief Creates a zone map on the field of the specified collection.
+         * @return 0 on success and 1 otherwise
+         */
+        int create_zone_map(const std::string &col_name, const field_type &field);
+
+        /**
+         * @param col_name Name of the collection.
+         * @param field Summarized field.
+         * @brief Deletes the zone map on the field of the specified collection.
          * @return 0 on success and 1 otherwise
          */
-        int delete_hash_index(const std::string &col_name, const field_type &field);
+        int delete_zone_map(const std::string &col_name, const field_type &field);
+
+        /**
+         * @param col_name Name of the collection.
+         * @brief Collects the statistics the planner uses for the specified collection.
+         * @return 0 on success and 1 otherwise
+         */
+        int analyze(const std::string &col_name);
+
+        /**
+         * @param col_name Name of the collection.
+         * @param conditions Conditions of a query.
+         * @brief Gets the plan chosen for a query on the specified collection, without running it.
+         * @return The plan, null if the collection doesn't exist.
+         */
+        json explain(const std::string &col_name, const std::vector<condition_type> &conditions);
     
        
     };
@@ -0,0 +1,262 @@
+#include "geo_index.hpp"
+#include "auxiliary.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <mutex>
+#include <unordered_set>
+#include <json.hpp>
+
+using namespace nosqlite;
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+// The file has the magic number and the number of points, then the id of the document, longitude and latitude of each point.
+static const char geo_magic[8] = {'N', 'S', 'Q', 'G', 'E', 'O', 'I', '1'};
+
+/**
+ * @brief Maps a coordinate in [minimum, maximum] to 32 bits.
+ */
+static uint64_t quantize(double value, double minimum, double maximum) {
+    double scaled = std::floor((value - minimum) / (maximum - minimum) * 4294967296.0);
+    return (uint64_t) std::min(std::max(scaled, 0.0), 4294967295.0);
+}
+
+/**
+ * @brief Moves the 32 low bits of a value to the even bits.
+ */
+static uint64_t spread_bits(uint64_t value) {
+    value &= 0xffffffffULL;
+    value = (value | (value << 16)) & 0x0000ffff0000ffffULL;
+    value = (value | (value << 8)) & 0x00ff00ff00ff00ffULL;
+    value = (value | (value << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    value = (value | (value << 2)) & 0x3333333333333333ULL;
+    value = (value | (value << 1)) & 0x5555555555555555ULL;
+    return value;
+}
+
+/**
+ * @brief Interleaves the bits of the longitude and latitude cells, longitude first as in geohashes.
+ */
+static uint64_t interleave(uint64_t x, uint64_t y) {
+    return spread_bits(x) << 1 | spread_bits(y);
+}
+
+
+geo_index::geo_index(const std::string &path, const std::vector<field_type> &fields) : secondary_index(path, fields), dirty(false) {}
+
+index_type geo_index::get_type() const {
+    return GEO_INDEX;
+}
+
+bool geo_index::supports(const std::string &op, const json &value) const {
+    return valid_geo_condition(op, value);
+}
+
+uint64_t geo_index::geohash(const geo_point &point) {
+    return interleave(quantize(point.lng, -180.0, 180.0), quantize(point.lat, -90.0, 90.0));
+}
+
+std::vector<geo_index::entry> geo_index::document_entries(const json &value, unsigned long long id) {
+    std::vector<geo_point> points;
+    collect_geo_points(value, points);
+
+    std::vector<entry> document;
+    for (const geo_point &point : points) document.push_back({geohash(point), id, point});
+    return document;
+}
+
+std::vector<std::pair<uint64_t, uint64_t>> geo_index::covering_ranges(const std::vector<geo_box> &boxes) {
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    for (const geo_box &box : boxes) {
+        // The coarsest level with cells as large as the box, refined twice so the box spans at most 5 cells on each side.
+        int level = 32;
+        double width = box.max_lng - box.min_lng, height = box.max_lat - box.min_lat;
+        if (width > 0) level = std::min(level, (int) std::floor(std::log2(360.0 / width)));
+        if (height > 0) level = std::min(level, (int) std::floor(std::log2(180.0 / height)));
+        level = std::min(std::max(level + 2, 0), 32);
+
+        int shift = 32 - level;
+        uint64_t x0 = quantize(box.min_lng, -180.0, 180.0) >> shift, x1 = quantize(box.max_lng, -180.0, 180.0) >> shift;
+        uint64_t y0 = quantize(box.min_lat, -90.0, 90.0) >> shift, y1 = quantize(box.max_lat, -90.0, 90.0) >> shift;
+        uint64_t span = level == 0 ? ~0ULL : (1ULL << (64 - 2 * level)) - 1;
+        for (uint64_t x = x0; x <= x1; x++) {
+            for (uint64_t y = y0; y <= y1; y++) {
+                uint64_t low = interleave(x << shift, y << shift);
+                ranges.push_back({low, low | span});
+            }
+        }
+    }
+
+    std::sort(ranges.begin(), ranges.end());
+    std::vector<std::pair<uint64_t, uint64_t>> merged;
+    for (const auto &range : ranges) {
+        if (!merged.empty() && (merged.back().second == ~0ULL || range.first <= merged.back().second + 1)) merged.back().second = std::max(merged.back().second, range.second);
+        else merged.push_back(range);
+    }
+    return merged;
+}
+
+int geo_index::write_file() {
+    std::string buffer(geo_magic, sizeof(geo_magic));
+    unsigned long long count = this->entries.size();
+    buffer.append(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (const entry &e : this->entries) {
+        buffer.append(reinterpret_cast<const char*>(&e.id), sizeof(e.id));
+        buffer.append(reinterpret_cast<const char*>(&e.point.lng), sizeof(e.point.lng));
+        buffer.append(reinterpret_cast<const char*>(&e.point.lat), sizeof(e.point.lat));
+    }
+
+    // The new file replaces the old one in a single rename so a crash leaves one of them whole.
+    fs::path path_to_index(this->path);
+    fs::path temporary = path_to_index / "index.bin.tmp";
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw_failed_to_create_file(temporary);
+        return 1;
+    }
+    file.write(buffer.data(), buffer.size());
+    file.close();
+    if (file.fail()) return 1;
+
+    fs::rename(temporary, path_to_index / "index.bin");
+    this->dirty = false;
+    return 0;
+}
+
+int geo_index::open() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+
+    fs::path path_to_file = fs::path(this->path) / "index.bin";
+    if (!fs::exists(path_to_file)) return 1;
+
+    std::ifstream file(path_to_file, std::ios::binary);
+    if (!file.is_open()) {
+        throw_failed_to_open_file(path_to_file);
+        return 1;
+    }
+    std::string buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+
+    const size_t record_size = sizeof(unsigned long long) + 2 * sizeof(double);
+    unsigned long long count = 0;
+    bool valid = buffer.size() >= sizeof(geo_magic) + sizeof(count) && std::memcmp(buffer.data(), geo_magic, sizeof(geo_magic)) == 0;
+    if (valid) {
+        std::memcpy(&count, buffer.data() + sizeof(geo_magic), sizeof(count));
+        valid = buffer.size() == sizeof(geo_magic) + sizeof(count) + count * record_size;
+    }
+    if (!valid) {
+        std::cerr << "Error: Invalid geospatial index file: " << path_to_file << "." << std::endl;
+        return 1;
+    }
+
+    this->entries.clear();
+    const char *at = buffer.data() + sizeof(geo_magic) + sizeof(count);
+    for (unsigned long long i = 0; i < count; i++, at += record_size) {
+        entry e;
+        std::memcpy(&e.id, at, sizeof(e.id));
+        std::memcpy(&e.point.lng, at + sizeof(e.id), sizeof(double));
+        std::memcpy(&e.point.lat, at + sizeof(e.id) + sizeof(double), sizeof(double));
+        e.cell = geohash(e.point);
+        this->entries.insert(this->entries.end(), e);
+    }
+    this->dirty = false;
+    return 0;
+}
+
+int geo_index::build_index(const std::vector<std::pair<json, unsigned long long>> &entries) {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+
+    fs::path path_to_index(this->path);
+    if (this->reset_directory() != 0) {
+        fs::remove_all(path_to_index);
+        return 1;
+    }
+
+    std::vector<std::vector<entry>> document_points(entries.size());
+    #pragma omp parallel for
+    for (long long i = 0; i < (long long) entries.size(); i++) document_points[i] = document_entries(entries[i].first, entries[i].second);
+
+    std::vector<entry> sorted;
+    for (const std::vector<entry> &points : document_points) sorted.insert(sorted.end(), points.begin(), points.end());
+    std::sort(sorted.begin(), sorted.end());
+    this->entries = std::set<entry>(sorted.begin(), sorted.end());
+
+    if (this->write_file() != 0) {
+        std::cerr << "Error: Failed to write geospatial index: " << path_to_index / "index.bin" << "." << std::endl;
+        fs::remove_all(path_to_index);
+        return 1;
+    }
+    return 0;
+}
+
+std::vector<unsigned long long> geo_index::consult(const json &value) const {
+    return this->search(value.is_object() ? "near" : "within_box", value);
+}
+
+std::vector<unsigned long long> geo_index::search(const std::string &op, const json &value) const {
+    geo_point center;
+    geo_box box;
+    double radius = 0;
+    bool near = op == "near";
+    if (near ? !parse_near(value, center, radius) : op != "within_box" || !parse_box(value, box)) return {};
+    std::vector<std::pair<uint64_t, uint64_t>> ranges = covering_ranges(geo_bounds(op, value));
+
+    // Points in the covering cells can still be outside the area, each one is checked.
+    std::vector<std::pair<double, unsigned long long>> found;
+    {
+        std::shared_lock<std::shared_mutex> shared(this->lock);
+        for (const auto &[low, high] : ranges) {
+            for (auto it = this->entries.lower_bound({low, 0, {-1000.0, -1000.0}}); it != this->entries.end() && it->cell <= high; ++it) {
+                if (near) {
+                    double distance = geo_distance(center, it->point);
+                    if (distance <= radius) found.push_back({distance, it->id});
+                }
+                else if (geo_box_contains(box, it->point)) found.push_back({0.0, it->id});
+            }
+        }
+    }
+
+    // Documents with several points keep the closest one.
+    std::sort(found.begin(), found.end());
+    std::vector<unsigned long long> ids;
+    std::unordered_set<unsigned long long> seen;
+    for (const auto &[distance, id] : found) {
+        if (seen.insert(id).second) ids.push_back(id);
+    }
+    return ids;
+}
+
+void geo_index::update_index(const json &new_value, unsigned long long id) {
+    std::vector<entry> document = document_entries(new_value, id);
+    if (document.empty()) return;
+
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    this->entries.insert(document.begin(), document.end());
+    this->dirty = true;
+}
+
+void geo_index::remove_from_index(const json &value, unsigned long long id) {
+    std::vector<entry> document = document_entries(value, id);
+    if (document.empty()) return;
+
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    for (const entry &e : document) this->entries.erase(e);
+    this->dirty = true;
+}
+
+int geo_index::sync() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    if (!this->dirty) return 0;
+    return this->write_file();
+}
+
+void geo_index::delete_index() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    this->entries.clear();
+    this->dirty = false;
+    fs::remove_all(this->get_path());
+}
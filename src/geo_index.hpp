@@ -0,0 +1,165 @@
+/**
+ * @file geo_index.hpp
+ */
+#ifndef GEO_INDEX_CLASS_H
+#define GEO_INDEX_CLASS_H
+
+#include <set>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <shared_mutex>
+#include <json.hpp>
+#include "auxiliary.hpp"
+#include "geometry.hpp"
+#include "secondary_index.hpp"
+using json = nlohmann::json;
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @class geo_index
+     * @brief Geospatial index for "near" and "within_box" conditions on coordinates. The points are kept ordered by their geohash, a 64 bit code that interleaves the bits of the longitude and the latitude,
+     * so every cell of the grid at any precision is a contiguous range of codes. A query only reads the ranges of the cells that cover its area.
+     * The points are kept in memory and written to index.bin inside the index directory when the index is synced.
+     */
+    class geo_index : public secondary_index {
+    private:
+
+        /**
+         * @brief A point of a document.
+         */
+        struct entry {
+            uint64_t cell;
+            unsigned long long id;
+            geo_point point;
+
+            bool operator<(const entry &other) const {
+                if (cell != other.cell) return cell < other.cell;
+                if (id != other.id) return id < other.id;
+                if (point.lng != other.point.lng) return point.lng < other.point.lng;
+                return point.lat < other.point.lat;
+            }
+        };
+
+        /**
+         * @brief Points of the documents, by geohash.
+         */
+        std::set<entry> entries;
+
+        /**
+         * @brief Indicates whether the points changed since they were last written.
+         */
+        bool dirty;
+
+        /**
+         * @brief Lookups run in parallel, changes to the index need exclusive access.
+         */
+        mutable std::shared_mutex lock;
+
+        /**
+         * @param point Point.
+         * @brief Gets the geohash of a point at full precision, 32 bits for each coordinate.
+         */
+        static uint64_t geohash(const geo_point &point);
+
+        /**
+         * @param value Value of the field.
+         * @param id Id of the document.
+         * @brief Gets the entries of the points of a value.
+         */
+        static std::vector<entry> document_entries(const json &value, unsigned long long id);
+
+        /**
+         * @param boxes Area of a query.
+         * @brief Gets the ranges of geohashes of the cells that cover an area, sorted and merged. The cells are small enough for each box to span a few of them.
+         */
+        static std::vector<std::pair<uint64_t, uint64_t>> covering_ranges(const std::vector<geo_box> &boxes);
+
+        /**
+         * @brief Writes the points to the index file, replacing it at once.
+         * @return 0 on success and 1 otherwise.
+         */
+        int write_file();
+
+    public:
+
+        /**
+         * @param path Path to the index.
+         * @param fields Indexed field, geospatial indexes have a single one.
+         * @brief Constructor for the geo_index class.
+         */
+        geo_index(const std::string &path, const std::vector<field_type> &fields);
+
+        /**
+         * @brief Gets the structure of the index.
+         */
+        index_type get_type() const override;
+
+        /**
+         * @brief Opens an index that already exists in the file system.
+         * @return 0 on success and 1 otherwise.
+         */
+        int open() override;
+
+        /**
+         * @param entries Pairs of indexed value and id of the document with that value.
+         * @brief Builds the index and writes it.
+         * @return 0 on success and 1 otherwise.
+         */
+        int build_index(const std::vector<std::pair<json, unsigned long long>> &entries) override;
+
+        /**
+         * @param op Comparison operator.
+         * @param value Value compared against.
+         * @brief Geospatial indexes answer valid "near" and "within_box" conditions.
+         */
+        bool supports(const std::string &op, const json &value) const override;
+
+        /**
+         * @param value Value of a "near" condition (an object) or a "within_box" condition (an array).
+         * @brief Gets the ids of the documents that satisfy the condition.
+         */
+        std::vector<unsigned long long> consult(const json &value) const override;
+
+        /**
+         * @param op "near" or "within_box".
+         * @param value Value of the condition.
+         * @brief Gets the ids of the documents with a point that satisfies the condition, the closest first for "near" and by id for "within_box".
+         */
+        std::vector<unsigned long long> search(const std::string &op, const json &value) const;
+
+        /**
+         * @param new_value New indexed value.
+         * @param id Id of the document.
+         * @brief Adds the points of the document.
+         */
+        void update_index(const json &new_value, unsigned long long id) override;
+
+        /**
+         * @param value Indexed value.
+         * @param id Id of the document.
+         * @brief Removes the points of the document.
+         */
+        void remove_from_index(const json &value, unsigned long long id) override;
+
+        /**
+         * @brief Writes the points to the disk if they changed.
+         * @return 0 on success and 1 otherwise.
+         */
+        int sync() override;
+
+        /**
+         * @brief Deletes this index.
+         */
+        void delete_index() override;
+
+    };
+
+}
+
+#endif
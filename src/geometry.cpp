@@ -0,0 +1,111 @@
+#include "geometry.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace nosqlite {
+
+    // Mean radius of the Earth in meters.
+    static const double earth_radius = 6371008.8;
+
+    static double to_radians(double degrees) {
+        return degrees * M_PI / 180.0;
+    }
+
+    static double to_degrees(double radians) {
+        return radians * 180.0 / M_PI;
+    }
+
+    /**
+     * @brief Reads a [longitude, latitude] array with coordinates in range.
+     */
+    static bool read_point(const json &value, geo_point &point) {
+        if (!value.is_array() || value.size() != 2 || !value[0].is_number() || !value[1].is_number()) return false;
+        point = {value[0].get<double>(), value[1].get<double>()};
+        return point.lng >= -180.0 && point.lng <= 180.0 && point.lat >= -90.0 && point.lat <= 90.0;
+    }
+
+    void collect_geo_points(const json &value, std::vector<geo_point> &points) {
+        geo_point point;
+        if (value.is_object() && value.contains("coordinates")) collect_geo_points(value["coordinates"], points);
+        else if (read_point(value, point)) points.push_back(point);
+        else if (value.is_array()) {
+            for (const json &element : value) collect_geo_points(element, points);
+        }
+    }
+
+    double geo_distance(const geo_point &a, const geo_point &b) {
+        double dlat = to_radians(b.lat - a.lat), dlng = to_radians(b.lng - a.lng);
+        double h = std::sin(dlat / 2) * std::sin(dlat / 2) + std::cos(to_radians(a.lat)) * std::cos(to_radians(b.lat)) * std::sin(dlng / 2) * std::sin(dlng / 2);
+        return 2 * earth_radius * std::asin(std::min(1.0, std::sqrt(h)));
+    }
+
+    bool parse_near(const json &value, geo_point &center, double &radius) {
+        if (!value.is_object() || !value.contains("center") || !value.contains("radius") || !value["radius"].is_number()) return false;
+        radius = value["radius"].get<double>();
+        return read_point(value["center"], center) && radius >= 0;
+    }
+
+    bool parse_box(const json &value, geo_box &box) {
+        geo_point low, high;
+        if (!value.is_array() || value.size() != 2 || !read_point(value[0], low) || !read_point(value[1], high)) return false;
+        box = {low.lng, low.lat, high.lng, high.lat};
+        return box.min_lat <= box.max_lat;
+    }
+
+    bool geo_box_contains(const geo_box &box, const geo_point &point) {
+        if (point.lat < box.min_lat || point.lat > box.max_lat) return false;
+        if (box.min_lng <= box.max_lng) return point.lng >= box.min_lng && point.lng <= box.max_lng;
+        return point.lng >= box.min_lng || point.lng <= box.max_lng;
+    }
+
+    bool valid_geo_condition(const std::string &op, const json &value) {
+        geo_point center;
+        geo_box box;
+        double radius;
+        if (op == "near") return parse_near(value, center, radius);
+        if (op == "within_box") return parse_box(value, box);
+        return false;
+    }
+
+    std::vector<geo_box> geo_bounds(const std::string &op, const json &value) {
+        geo_point center;
+        geo_box box;
+        double radius;
+        if (op == "within_box" && parse_box(value, box)) {
+            if (box.min_lng <= box.max_lng) return {box};
+            return {{box.min_lng, box.min_lat, 180.0, box.max_lat}, {-180.0, box.min_lat, box.max_lng, box.max_lat}};
+        }
+        if (op != "near" || !parse_near(value, center, radius)) return {};
+
+        // The circle spans the same angle in latitude everywhere. In longitude it widens with the latitude, and covers every longitude if it reaches a pole.
+        double angle = radius / earth_radius;
+        double min_lat = center.lat - to_degrees(angle), max_lat = center.lat + to_degrees(angle);
+        if (min_lat <= -90.0 || max_lat >= 90.0 || angle >= M_PI / 2) return {{-180.0, std::max(min_lat, -90.0), 180.0, std::min(max_lat, 90.0)}};
+
+        double spread = std::sin(angle) / std::cos(to_radians(center.lat));
+        if (spread >= 1.0) return {{-180.0, min_lat, 180.0, max_lat}};
+        double dlng = to_degrees(std::asin(spread));
+        double min_lng = center.lng - dlng, max_lng = center.lng + dlng;
+        if (min_lng < -180.0) return {{min_lng + 360.0, min_lat, 180.0, max_lat}, {-180.0, min_lat, max_lng, max_lat}};
+        if (max_lng > 180.0) return {{min_lng, min_lat, 180.0, max_lat}, {-180.0, min_lat, max_lng - 360.0, max_lat}};
+        return {{min_lng, min_lat, max_lng, max_lat}};
+    }
+
+    bool geo_point_matches(const geo_point &point, const std::string &op, const json &value) {
+        geo_point center;
+        geo_box box;
+        double radius;
+        if (op == "near") return parse_near(value, center, radius) && geo_distance(point, center) <= radius;
+        return op == "within_box" && parse_box(value, box) && geo_box_contains(box, point);
+    }
+
+    bool geo_matches(const json &field_value, const std::string &op, const json &value) {
+        std::vector<geo_point> points;
+        collect_geo_points(field_value, points);
+        for (const geo_point &point : points) {
+            if (geo_point_matches(point, op, value)) return true;
+        }
+        return false;
+    }
+
+}
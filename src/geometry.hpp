@@ -0,0 +1,102 @@
+/**
+ * @file geometry.hpp
+ */
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <string>
+#include <vector>
+#include <json.hpp>
+using json = nlohmann::json;
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @brief Point on the Earth as longitude and latitude in degrees, the order of GeoJSON coordinates.
+     */
+    struct geo_point {
+        double lng, lat;
+    };
+
+    /**
+     * @brief Area covered by a "near" or "within_box" condition, as longitude and latitude bounds. Areas that cross the antimeridian are split in two boxes.
+     */
+    struct geo_box {
+        double min_lng, min_lat, max_lng, max_lat;
+    };
+
+    /**
+     * @param value Value of a field.
+     * @param points Destination of the points.
+     * @brief Collects the points of a value: a [longitude, latitude] array, a GeoJSON object with "coordinates" or an array of them.
+     */
+    void collect_geo_points(const json &value, std::vector<geo_point> &points);
+
+    /**
+     * @param a First point.
+     * @param b Second point.
+     * @brief Gets the distance between two points in meters, on a sphere of the mean radius of the Earth.
+     */
+    double geo_distance(const geo_point &a, const geo_point &b);
+
+    /**
+     * @param value Value of a "near" condition: {"center": [longitude, latitude], "radius": meters}.
+     * @param center Destination of the center.
+     * @param radius Destination of the radius.
+     * @brief Reads the value of a "near" condition.
+     * @return false if the value isn't valid.
+     */
+    bool parse_near(const json &value, geo_point &center, double &radius);
+
+    /**
+     * @param value Value of a "within_box" condition: [[min longitude, min latitude], [max longitude, max latitude]].
+     * @param box Destination of the box.
+     * @brief Reads the value of a "within_box" condition. The minimum longitude can be larger than the maximum for boxes that cross the antimeridian.
+     * @return false if the value isn't valid.
+     */
+    bool parse_box(const json &value, geo_box &box);
+
+    /**
+     * @param box Box, possibly crossing the antimeridian.
+     * @param point Point to check.
+     * @brief Checks if a point is inside a box, borders included.
+     */
+    bool geo_box_contains(const geo_box &box, const geo_point &point);
+
+    /**
+     * @param op "near" or "within_box".
+     * @param value Value of the condition.
+     * @brief Checks if a condition is a valid geospatial condition.
+     */
+    bool valid_geo_condition(const std::string &op, const json &value);
+
+    /**
+     * @param op "near" or "within_box".
+     * @param value Value of the condition.
+     * @brief Gets the boxes that hold every point satisfying a geospatial condition.
+     */
+    std::vector<geo_box> geo_bounds(const std::string &op, const json &value);
+
+    /**
+     * @param point Point to check.
+     * @param op "near" or "within_box".
+     * @param value Value of the condition.
+     * @brief Checks if a point satisfies a geospatial condition.
+     */
+    bool geo_point_matches(const geo_point &point, const std::string &op, const json &value);
+
+    /**
+     * @param field_value Value of the field.
+     * @param op "near" or "within_box".
+     * @param value Value of the condition.
+     * @brief Checks if any point of the field satisfies a geospatial condition.
+     */
+    bool geo_matches(const json &field_value, const std::string &op, const json &value);
+
+}
+
+#endif
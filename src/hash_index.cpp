@@ -1,216 +1,531 @@
 #include "hash_index.hpp"
 #include "auxiliary.hpp"
-#include <fstream>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <filesystem>
+#include <functional>
+#include <mutex>
 #include <json.hpp>
 
 using namespace nosqlite;
 using json = nlohmann::json;
 namespace fs = std::filesystem;
 
-
-hash_index::hash_index(const std::string path) : path(path) {}
-
-std::string hash_index::get_path() {
-    return this->path;
+// The file is split in pages. Page 0 is the header, the slot table takes a run of contiguous pages and every other page is a posting page or free.
+// Header: magic number, number of slots, number of used slots, first page of the table, pages in use, first free page and number of postings.
+static const char hash_magic[8] = {'N', 'S', 'Q', 'H', 'A', 'S', 'H', '3'};
+static const size_t hash_page_size = 4096;
+static const size_t hash_slot_count_offset = 8;
+static const size_t hash_used_slots_offset = 16;
+static const size_t hash_table_page_offset = 24;
+static const size_t hash_page_count_offset = 28;
+static const size_t hash_free_page_offset = 32;
+static const size_t hash_postings_offset = 40;
+
+// Slot: hashed value (0 when empty), number of documents, id of the document when there is only one and first posting page (0 when the id is inline).
+static const size_t hash_slot_size = 32;
+static const size_t hash_slot_count_field = 8;
+static const size_t hash_slot_inline_field = 16;
+static const size_t hash_slot_head_field = 24;
+
+// Posting page: next page of the chain, number of ids in the page, bytes of encoded ids, largest id in the page and the ids.
+// The ids of a chain are sorted, every page has larger ids than the one before it. Inside a page the first id is a varint and every other one the varint of its difference to the previous.
+static const size_t hash_posting_count_field = 4;
+static const size_t hash_posting_bytes_field = 8;
+static const size_t hash_posting_last_field = 16;
+static const size_t hash_posting_header_size = 24;
+static const size_t hash_posting_capacity = hash_page_size - hash_posting_header_size;
+
+static const unsigned long long hash_initial_slots = 1024;
+static const double hash_max_load = 0.7;
+
+template <typename T> static T load(const char *at) {
+    T value;
+    std::memcpy(&value, at, sizeof(T));
+    return value;
 }
 
-std::string hash_index::get_field() {
-    return get_last_dir(this->path);
+template <typename T> static void store(char *at, T value) {
+    std::memcpy(at, &value, sizeof(T));
 }
 
-int hash_index::build_index(const field_type &fields) {
+/**
+ * @brief Writes as many of the sorted ids as fit in a posting page. The next page of the chain is left as it is.
+ * @return Number of ids written.
+ */
+static size_t encode_postings(char *posting_page, const unsigned long long *ids, size_t n) {
+    unsigned char *data = reinterpret_cast<unsigned char*>(posting_page + hash_posting_header_size);
+    size_t bytes = 0, written = 0;
+
+    for (unsigned long long previous = 0; written < n; written++) {
+        unsigned long long value = ids[written] - previous;
+        size_t length = 1;
+        for (unsigned long long rest = value >> 7; rest != 0; rest >>= 7) length++;
+        if (bytes + length > hash_posting_capacity) break;
+
+        for (; value >= 0x80; value >>= 7) data[bytes++] = (unsigned char) (value | 0x80);
+        data[bytes++] = (unsigned char) value;
+        previous = ids[written];
+    }
 
-    // Delete everything from the directory where the index will be stored if it exists, else create it.
-    fs::path path_to_index(this->path);
-    if (fs::exists(path_to_index))
-        for (const fs::path &entry : fs::directory_iterator(path_to_index))
-            fs::remove_all(entry);
-    else fs::create_directories(path_to_index);
-
-    fs::path col = path_to_index.parent_path().parent_path();
-
-    // Get all the file JSON paths in the collection except the header.
-    std::vector<fs::path> paths;
-    collect_paths(col.string(), paths);
-
-    for (const fs::path &p : paths) {
-        json documents = read_and_parse_json(p);
-        if (documents.empty()) continue;
-
-        for (json document : documents) {
-            json indexee = access_nested_fields(document, fields);
-            std::string hash;
-
-            if (indexee == nullptr) hash = hash_string("NULL");
-            else hash = hash_json(indexee);
-
-            // Create the directory
-            fs::path directory = fs::path(this->path) / hash.substr(0, 2) / hash.substr(2, 2);
-            fs::create_directories(directory);
-
-            fs::path path_to_index_file = directory / "index.json";
-
-            if (fs::exists(path_to_index_file)) {
-                json index = read_and_parse_json(path_to_index_file);
-                index[hash.substr(4)].push_back(p.string());
-
-                std::ofstream file(path_to_index_file);
-                if (file.is_open()) {
-                    file << index;
-                    file.close();
-                }
-                else {
-                    throw_failed_to_open_file(path_to_index_file);
-                    fs::remove_all(path_to_index);
-                    return 1;
-                }
-            }
-            else {
-                std::ofstream file(path_to_index_file);
-                if (file.is_open()) {
-                    json index = {};
-                    index[hash.substr(4)].push_back(p.string());
-                    file << index;
-                    file.close();
-                }
-                else {
-                    throw_failed_to_create_file(path_to_index_file);
-                    fs::remove_all(path_to_index);
-                    return 1;
-                }
+    store<unsigned int>(posting_page + hash_posting_count_field, written);
+    store<unsigned int>(posting_page + hash_posting_bytes_field, bytes);
+    store<unsigned long long>(posting_page + hash_posting_last_field, written > 0 ? ids[written - 1] : 0);
+    return written;
+}
+
+/**
+ * @brief Appends the ids of a posting page to a vector.
+ */
+static void decode_postings(const char *posting_page, std::vector<unsigned long long> &ids) {
+    const unsigned char *data = reinterpret_cast<const unsigned char*>(posting_page + hash_posting_header_size);
+    const unsigned char *end = data + load<unsigned int>(posting_page + hash_posting_bytes_field);
+
+    unsigned long long previous = 0;
+    while (data < end) {
+        // Most differences between ids fit in a byte.
+        unsigned long long value = *data++;
+        if (value >= 0x80) {
+            value &= 0x7f;
+            for (unsigned int shift = 7; ; shift += 7) {
+                unsigned long long byte = *data++;
+                value |= (byte & 0x7f) << shift;
+                if (byte < 0x80) break;
             }
         }
+        previous += value;
+        ids.push_back(previous);
     }
-
-    return 0;
 }
 
-std::vector<std::string> hash_index::consult(const json &value) {
-    
-    std::vector<std::string> documents({});
-    
-    std::string hash = value == nullptr ? hash_string("NULL") : hash_json(value);
 
-    fs::path index_file_path(this->path);
-    index_file_path = index_file_path / hash.substr(0, 2) / hash.substr(2, 2) / "index.json";
-    if (fs::exists(index_file_path)) {
-        json index_file = read_and_parse_json(index_file_path);
+hash_index::hash_index(const std::string path, const std::vector<field_type> &fields) : secondary_index(path, fields), file((fs::path(path) / "index.bin").string()) {}
 
-        json doc = index_file[hash.substr(4)];
+index_type hash_index::get_type() const {
+    return HASH_INDEX;
+}
+
+bool hash_index::supports(const std::string &op, const json &value) const {
+    // Arrays are indexed by their elements, so a whole array is never a key.
+    return op == "==" && !value.is_array();
+}
 
-        if (doc != nullptr) documents = doc;
+unsigned long long hash_index::hash_key(const json &value) {
+    unsigned long long key = std::hash<std::string>{}(value == nullptr ? "NULL" : canonical_dump(value));
+    // Zero marks an empty slot.
+    return key == 0 ? 1 : key;
+}
+
+void hash_index::collect_keys(const json &value, std::vector<unsigned long long> &keys) {
+    // Conditions on an array match any of its elements, at any depth.
+    if (value.is_array()) {
+        for (const json &element : value) collect_keys(element, keys);
     }
+    else keys.push_back(hash_key(value));
+}
 
-    return documents;
+std::vector<unsigned long long> hash_index::document_keys(const json &value) {
+    std::vector<unsigned long long> keys;
+    collect_keys(value, keys);
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
 }
 
-void hash_index::update_index(json original_value, json updated_value, const std::string &document_path) {
-    //Uses original_value to find and delete index entry for document in document_path
-    std::string hash = hash_json(original_value);
-    fs::path path_to_index_file = fs::path(this->path) / hash.substr(0, 2) / hash.substr(2, 2) / "index.json";;
-    if (!fs::exists(path_to_index_file)) {
-        return;
+char *hash_index::page(unsigned int page_number) const {
+    return this->file.get_data() + (size_t) page_number * hash_page_size;
+}
+
+char *hash_index::slot(unsigned long long slot_number) const {
+    return this->page(load<unsigned int>(this->page(0) + hash_table_page_offset)) + slot_number * hash_slot_size;
+}
+
+long long hash_index::find_slot(unsigned long long key, bool insert) const {
+    unsigned long long slot_count = load<unsigned long long>(this->page(0) + hash_slot_count_offset);
+
+    // Linear probing, the load factor keeps the table from filling up.
+    for (unsigned long long i = key & (slot_count - 1), probes = 0; probes < slot_count; i = (i + 1) & (slot_count - 1), probes++) {
+        unsigned long long slot_key = load<unsigned long long>(this->slot(i));
+        if (slot_key == key) return i;
+        if (slot_key == 0) return insert ? (long long) i : -1;
     }
-    json index = read_and_parse_json(path_to_index_file);
-    size_t n = index[hash.substr(4)].erase(document_path);
+    return -1;
+}
 
-    if (n == 0) {
-       return;
+unsigned int hash_index::allocate_pages(unsigned int pages) {
+    unsigned int first = load<unsigned int>(this->page(0) + hash_page_count_offset);
+    size_t needed = ((size_t) first + pages) * hash_page_size;
+
+    // The file grows geometrically so appending pages doesn't remap it every time.
+    if (needed > this->file.get_size()) {
+        size_t new_size = std::max(needed, this->file.get_size() * 2);
+        if (this->file.resize(new_size) != 0) return 0;
     }
 
-    std::ofstream file(path_to_index_file);
-    if (file.is_open()) file << index;
-    else throw_failed_to_open_file(path_to_index_file);
+    store<unsigned int>(this->page(0) + hash_page_count_offset, first + pages);
+    std::memset(this->page(first), 0, (size_t) pages * hash_page_size);
+    return first;
+}
 
-    file.close();
+unsigned int hash_index::allocate_page() {
+    unsigned int free_page = load<unsigned int>(this->page(0) + hash_free_page_offset);
+    if (free_page == 0) return this->allocate_pages(1);
 
-    //Created new index entry with updated_value
-    hash = hash_json(updated_value);
-    path_to_index_file = fs::path(this->path) / hash.substr(0, 2) / hash.substr(2, 2) / "index.json";
-    if (fs::exists(path_to_index_file)) {
-        json index = read_and_parse_json(path_to_index_file);
-        index[hash.substr(4)].push_back(document_path);
+    store<unsigned int>(this->page(0) + hash_free_page_offset, load<unsigned int>(this->page(free_page)));
+    std::memset(this->page(free_page), 0, hash_page_size);
+    return free_page;
+}
 
-        std::ofstream file(path_to_index_file);
-        if (file.is_open()) file << index;
-        else throw_failed_to_open_file(path_to_index_file);
+void hash_index::free_page(unsigned int page_number) {
+    store<unsigned int>(this->page(page_number), load<unsigned int>(this->page(0) + hash_free_page_offset));
+    store<unsigned int>(this->page(0) + hash_free_page_offset, page_number);
+}
 
-        file.close();
-    }
-    else {
-        fs::create_directories(fs::path(path_to_index_file).remove_filename());
-        std::ofstream file(path_to_index_file);
-        if (file.is_open()) {
-            json index = {};
-            index[hash.substr(4)].push_back(document_path);
-            file << index;
-        }
-        else throw_failed_to_create_file(path_to_index_file);
+int hash_index::initialize(unsigned long long slot_count) {
+    unsigned int table_pages = (slot_count * hash_slot_size + hash_page_size - 1) / hash_page_size;
+
+    if (this->file.resize(0) != 0 || this->file.resize((1 + (size_t) table_pages) * hash_page_size) != 0) return 1;
 
-        file.close();
+    char *header = this->page(0);
+    std::memcpy(header, hash_magic, sizeof(hash_magic));
+    store<unsigned long long>(header + hash_slot_count_offset, slot_count);
+    store<unsigned long long>(header + hash_used_slots_offset, 0);
+    store<unsigned int>(header + hash_table_page_offset, 1);
+    store<unsigned int>(header + hash_page_count_offset, 1 + table_pages);
+    store<unsigned int>(header + hash_free_page_offset, 0);
+    store<unsigned long long>(header + hash_postings_offset, 0);
+    return 0;
+}
+
+int hash_index::rehash(unsigned long long slot_count) {
+    unsigned long long old_slot_count = load<unsigned long long>(this->page(0) + hash_slot_count_offset);
+    unsigned int old_table_page = load<unsigned int>(this->page(0) + hash_table_page_offset);
+    unsigned int old_table_pages = (old_slot_count * hash_slot_size + hash_page_size - 1) / hash_page_size;
+    unsigned int table_pages = (slot_count * hash_slot_size + hash_page_size - 1) / hash_page_size;
+
+    unsigned int table_page = this->allocate_pages(table_pages);
+    if (table_page == 0) return 1;
+
+    // Posting pages stay where they are, only the slots move.
+    unsigned long long used = 0;
+    for (unsigned long long i = 0; i < old_slot_count; i++) {
+        const char *old_slot = this->page(old_table_page) + i * hash_slot_size;
+        unsigned long long key = load<unsigned long long>(old_slot);
+        if (key == 0 || load<unsigned long long>(old_slot + hash_slot_count_field) == 0) continue;
+
+        unsigned long long j = key & (slot_count - 1);
+        while (load<unsigned long long>(this->page(table_page) + j * hash_slot_size) != 0) j = (j + 1) & (slot_count - 1);
+        std::memcpy(this->page(table_page) + j * hash_slot_size, old_slot, hash_slot_size);
+        used++;
     }
+
+    char *header = this->page(0);
+    store<unsigned long long>(header + hash_slot_count_offset, slot_count);
+    store<unsigned long long>(header + hash_used_slots_offset, used);
+    store<unsigned int>(header + hash_table_page_offset, table_page);
+
+    for (unsigned int p = 0; p < old_table_pages; p++) this->free_page(old_table_page + p);
+    return 0;
 }
 
-void nosqlite::hash_index::update_index(json new_value, const std::string &document_path) {
+int hash_index::add(unsigned long long key, unsigned long long id) {
+    unsigned long long slot_count = load<unsigned long long>(this->page(0) + hash_slot_count_offset);
+    unsigned long long used = load<unsigned long long>(this->page(0) + hash_used_slots_offset);
+    if (used + 1 > slot_count * hash_max_load && this->rehash(slot_count * 2) != 0) return 1;
+
+    long long slot_number = this->find_slot(key, true);
+    if (slot_number < 0) return 1;
 
-    std::string hash = hash_json(new_value);
-    fs::path path_to_index_file = fs::path(this->path) / hash.substr(0, 2) / hash.substr(2, 2) / "index.json";
-    if (fs::exists(path_to_index_file)) {
-        json index = read_and_parse_json(path_to_index_file);
-        index[hash.substr(4)].push_back(document_path);
+    char *s = this->slot(slot_number);
+    if (load<unsigned long long>(s) == 0) {
+        store<unsigned long long>(s, key);
+        store<unsigned long long>(this->page(0) + hash_used_slots_offset, load<unsigned long long>(this->page(0) + hash_used_slots_offset) + 1);
+    }
 
-        std::ofstream file(path_to_index_file);
-        if (file.is_open()) file << index;
-        else throw_failed_to_open_file(path_to_index_file);
+    unsigned long long count = load<unsigned long long>(s + hash_slot_count_field);
+    unsigned int head = load<unsigned int>(s + hash_slot_head_field);
 
-        file.close();
+    if (count == 0 && head == 0) {
+        // A value with a single document needs no posting page.
+        store<unsigned long long>(s + hash_slot_inline_field, id);
+    }
+    else if (head == 0) {
+        // The second document moves the inline id to a posting page.
+        unsigned long long inline_id = load<unsigned long long>(s + hash_slot_inline_field);
+        if (inline_id == id) return 0;
+
+        unsigned int first = this->allocate_page();
+        if (first == 0) return 1;
+        unsigned long long ids[2] = {std::min(inline_id, id), std::max(inline_id, id)};
+        encode_postings(this->page(first), ids, 2);
+        store<unsigned int>(this->slot(slot_number) + hash_slot_head_field, first);
     }
     else {
-        fs::create_directories(fs::path(path_to_index_file).remove_filename());
-        std::ofstream file(path_to_index_file);
-        if (file.is_open()) {
-            json index = {};
-            index[hash.substr(4)].push_back(document_path);
-            file << index;
+        // The id goes to the first page whose largest id isn't smaller, or to the last page.
+        unsigned int target = head;
+        while (load<unsigned int>(this->page(target)) != 0 && load<unsigned long long>(this->page(target) + hash_posting_last_field) < id) {
+            target = load<unsigned int>(this->page(target));
         }
-        else throw_failed_to_create_file(path_to_index_file);
 
-        file.close();
+        std::vector<unsigned long long> ids;
+        decode_postings(this->page(target), ids);
+        auto position = std::lower_bound(ids.begin(), ids.end(), id);
+        if (position != ids.end() && *position == id) return 0;
+        size_t index = position - ids.begin();
+        ids.insert(position, id);
+
+        // A full page is split in two halves, the new page follows it in the chain.
+        size_t written = encode_postings(this->page(target), ids.data(), ids.size());
+        if (written < ids.size()) {
+            unsigned int right = this->allocate_page();
+            if (right == 0) {
+                ids.erase(ids.begin() + index);
+                encode_postings(this->page(target), ids.data(), ids.size());
+                return 1;
+            }
+            size_t half = ids.size() / 2;
+            encode_postings(this->page(target), ids.data(), half);
+            encode_postings(this->page(right), ids.data() + half, ids.size() - half);
+            store<unsigned int>(this->page(right), load<unsigned int>(this->page(target)));
+            store<unsigned int>(this->page(target), right);
+        }
     }
+
+    s = this->slot(slot_number);
+    store<unsigned long long>(s + hash_slot_count_field, count + 1);
+    store<unsigned long long>(this->page(0) + hash_postings_offset, load<unsigned long long>(this->page(0) + hash_postings_offset) + 1);
+    return 0;
 }
 
-void nosqlite::hash_index::remove_from_index(json value, field_type field, const std::string &document_path) {
-    json doc = read_and_parse_json(fs::path(document_path));
-    if (doc.size() > 1) {
-        int count = 0;
-        for (json d : doc) {
-            if (access_nested_fields(d, field) == value) count++;
+int hash_index::open() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+
+    fs::path path_to_index(this->path);
+    if (!fs::exists(path_to_index / "index.bin")) return 1;
+
+    if (this->file.open(hash_page_size) != 0) return 1;
+    if (std::memcmp(this->page(0), hash_magic, sizeof(hash_magic) - 1) != 0) {
+        std::cerr << "Error: Invalid hash index file: " << path_to_index / "index.bin" << "." << std::endl;
+        this->file.close();
+        return 1;
+    }
+
+    // Files from an older version of the layout are rebuilt.
+    if (std::memcmp(this->page(0), hash_magic, sizeof(hash_magic)) != 0) {
+        this->file.close();
+        return 1;
+    }
+    return 0;
+}
+
+int hash_index::build_index(const std::vector<std::pair<json, unsigned long long>> &entries) {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+
+    fs::path path_to_index(this->path);
+    this->file.close();
+    if (this->reset_directory() != 0) {
+        fs::remove_all(path_to_index);
+        return 1;
+    }
+
+    // Hash the values in parallel, then group the entries by key: the top bits of the key pick a partition and each partition is sorted by its own thread.
+    // Arrays give one entry per distinct element.
+    std::vector<std::vector<unsigned long long>> entry_keys(entries.size());
+    #pragma omp parallel for if(this->parallel_processing)
+    for (long long i = 0; i < (long long) entries.size(); i++) entry_keys[i] = document_keys(entries[i].first);
+
+    size_t total = 0;
+    for (const auto &keys : entry_keys) total += keys.size();
+    std::vector<std::pair<unsigned long long, unsigned long long>> keyed;
+    keyed.reserve(total);
+    for (size_t i = 0; i < entries.size(); i++) {
+        for (unsigned long long key : entry_keys[i]) keyed.push_back({key, entries[i].second});
+    }
+    entry_keys.clear();
+    entry_keys.shrink_to_fit();
+
+    const unsigned int partitions = 256;
+    std::vector<size_t> partition_start(partitions + 1, 0);
+    for (const auto &[key, id] : keyed) partition_start[(key >> 56) + 1]++;
+    for (unsigned int p = 0; p < partitions; p++) partition_start[p + 1] += partition_start[p];
+
+    std::vector<std::pair<unsigned long long, unsigned long long>> grouped(keyed.size());
+    std::vector<size_t> position(partition_start.begin(), partition_start.end() - 1);
+    for (const auto &entry : keyed) grouped[position[entry.first >> 56]++] = entry;
+    keyed.clear();
+    keyed.shrink_to_fit();
+
+    #pragma omp parallel for schedule(dynamic) if(this->parallel_processing)
+    for (int p = 0; p < (int) partitions; p++) std::sort(grouped.begin() + partition_start[p], grouped.begin() + partition_start[p + 1]);
+    grouped.erase(std::unique(grouped.begin(), grouped.end()), grouped.end());
+
+    // Each run of equal keys is a distinct value.
+    std::vector<size_t> runs;
+    for (size_t i = 0; i < grouped.size(); i++) {
+        if (i == 0 || grouped[i].first != grouped[i - 1].first) runs.push_back(i);
+    }
+    runs.push_back(grouped.size());
+    size_t distinct = runs.size() - 1;
+
+    unsigned long long slot_count = hash_initial_slots;
+    while (distinct > slot_count * hash_max_load) slot_count *= 2;
+
+    auto fail = [&]() {
+        std::cerr << "Error: Failed to write hash index: " << path_to_index / "index.bin" << "." << std::endl;
+        this->file.close();
+        fs::remove_all(path_to_index);
+        return 1;
+    };
+
+    if (this->file.open(hash_page_size) != 0 || this->initialize(slot_count) != 0) {
+        fs::remove_all(path_to_index);
+        return 1;
+    }
+
+    // Every value with more than one document gets a chain of consecutive posting pages, all of them allocated at once.
+    // The ids are already sorted, the pages each value needs are counted by encoding them in a scratch page.
+    std::vector<unsigned long long> sorted_ids(grouped.size());
+    for (size_t i = 0; i < grouped.size(); i++) sorted_ids[i] = grouped[i].second;
+
+    std::vector<unsigned int> pages_needed(distinct, 0);
+    #pragma omp parallel for schedule(dynamic) if(this->parallel_processing)
+    for (long long r = 0; r < (long long) distinct; r++) {
+        size_t count = runs[r + 1] - runs[r];
+        if (count < 2) continue;
+        std::vector<char> scratch(hash_page_size);
+        for (size_t done = 0; done < count; pages_needed[r]++) done += encode_postings(scratch.data(), sorted_ids.data() + runs[r] + done, count - done);
+    }
+
+    std::vector<unsigned int> first_page(distinct, 0);
+    unsigned int total_pages = 0;
+    for (size_t r = 0; r < distinct; r++) {
+        first_page[r] = total_pages;
+        total_pages += pages_needed[r];
+    }
+    unsigned int base = total_pages > 0 ? this->allocate_pages(total_pages) : 0;
+    if (total_pages > 0 && base == 0) return fail();
+
+    // The slots are filled in order, the posting pages of different values don't overlap so they are written in parallel.
+    for (size_t r = 0; r < distinct; r++) {
+        unsigned long long key = grouped[runs[r]].first;
+        size_t count = runs[r + 1] - runs[r];
+        char *s = this->slot(this->find_slot(key, true));
+        store<unsigned long long>(s, key);
+        store<unsigned long long>(s + hash_slot_count_field, count);
+        if (count == 1) store<unsigned long long>(s + hash_slot_inline_field, sorted_ids[runs[r]]);
+        else store<unsigned int>(s + hash_slot_head_field, base + first_page[r]);
+    }
+
+    #pragma omp parallel for schedule(dynamic) if(this->parallel_processing)
+    for (long long r = 0; r < (long long) distinct; r++) {
+        size_t count = runs[r + 1] - runs[r];
+        if (count < 2) continue;
+
+        unsigned int page_number = base + first_page[r];
+        for (size_t done = 0; done < count; page_number++) {
+            char *posting_page = this->page(page_number);
+            done += encode_postings(posting_page, sorted_ids.data() + runs[r] + done, count - done);
+            store<unsigned int>(posting_page, done < count ? page_number + 1 : 0);
         }
+    }
+
+    store<unsigned long long>(this->page(0) + hash_used_slots_offset, distinct);
+    store<unsigned long long>(this->page(0) + hash_postings_offset, grouped.size());
+    return this->file.sync();
+}
+
+std::vector<unsigned long long> hash_index::consult(const json &value) const {
+    std::shared_lock<std::shared_mutex> shared(this->lock);
+
+    std::vector<unsigned long long> ids;
+    if (!this->file.is_open()) return ids;
 
-        if (count > 1) return;
+    long long slot_number = this->find_slot(hash_key(value), false);
+    if (slot_number < 0) return ids;
+
+    const char *s = this->slot(slot_number);
+    unsigned long long count = load<unsigned long long>(s + hash_slot_count_field);
+    unsigned int head = load<unsigned int>(s + hash_slot_head_field);
+
+    if (head == 0) {
+        if (count == 1) ids.push_back(load<unsigned long long>(s + hash_slot_inline_field));
+        return ids;
     }
-    std::string hash = hash_json(value);
-    fs::path path_to_index_file = fs::path(this->path) / hash.substr(0, 2) / hash.substr(2, 2) / "index.json";
-    if (fs::exists(path_to_index_file)) {
-        json index = read_and_parse_json(path_to_index_file);
-        json i = index[hash.substr(4)];
-        json new_i = json::array();
 
-        for (json p : i) {
-            if (p != document_path) new_i.push_back(p);
+    ids.reserve(count);
+    for (unsigned int p = head; p != 0; p = load<unsigned int>(this->page(p))) decode_postings(this->page(p), ids);
+    return ids;
+}
+
+void hash_index::update_index(const json &new_value, unsigned long long id) {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    if (!this->file.is_open()) return;
+
+    for (unsigned long long key : document_keys(new_value)) {
+        if (this->add(key, id) != 0) {
+            std::cerr << "Error: Failed to add the document with ID \"" << id << "\" to the hash index: \"" << this->get_field() << "\"." << std::endl;
+            return;
         }
-        
-        index[hash.substr(4)] = new_i;
-        std::ofstream file(path_to_index_file);
-        if (file.is_open()) file << index;
-        else throw_failed_to_open_file(path_to_index_file);
+    }
+}
+
+void hash_index::remove_from_index(const json &value, unsigned long long id) {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    if (!this->file.is_open()) return;
 
-        file.close();
+    for (unsigned long long key : document_keys(value)) this->remove(key, id);
+}
+
+void hash_index::remove(unsigned long long key, unsigned long long id) {
+    long long slot_number = this->find_slot(key, false);
+    if (slot_number < 0) return;
+
+    char *s = this->slot(slot_number);
+    unsigned long long count = load<unsigned long long>(s + hash_slot_count_field);
+    unsigned int head = load<unsigned int>(s + hash_slot_head_field);
+
+    if (head == 0) {
+        if (count != 1 || load<unsigned long long>(s + hash_slot_inline_field) != id) return;
     }
+    else {
+        // The id can only be in the first page whose largest id isn't smaller.
+        unsigned int previous = 0, target = head;
+        while (target != 0 && load<unsigned long long>(this->page(target) + hash_posting_last_field) < id) {
+            previous = target;
+            target = load<unsigned int>(this->page(target));
+        }
+        if (target == 0) return;
+
+        std::vector<unsigned long long> ids;
+        decode_postings(this->page(target), ids);
+        auto position = std::lower_bound(ids.begin(), ids.end(), id);
+        if (position == ids.end() || *position != id) return;
+        ids.erase(position);
+
+        // Removing an id never makes the encoding longer. Empty pages leave the chain.
+        if (!ids.empty()) encode_postings(this->page(target), ids.data(), ids.size());
+        else {
+            unsigned int next = load<unsigned int>(this->page(target));
+            if (previous == 0) store<unsigned int>(s + hash_slot_head_field, next);
+            else store<unsigned int>(this->page(previous), next);
+            this->free_page(target);
+        }
+    }
+
+    // Emptied slots keep their key so probing still works. They are dropped when the table is rehashed.
+    store<unsigned long long>(s + hash_slot_count_field, count - 1);
+    store<unsigned long long>(this->page(0) + hash_postings_offset, load<unsigned long long>(this->page(0) + hash_postings_offset) - 1);
+}
+
+int hash_index::sync() {
+    std::shared_lock<std::shared_mutex> shared(this->lock);
+    if (!this->file.is_open()) return 0;
+    return this->file.sync();
 }
 
 void hash_index::delete_index() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    this->file.close();
     fs::remove_all(this->get_path());
 }
@@ -1,12 +1,16 @@
 /**
- * @file collection.hpp
+ * @file hash_index.hpp
  */
 #ifndef HASH_INDEX_CLASS_H
 #define HASH_INDEX_CLASS_H
 
 #include <string>
+#include <vector>
+#include <shared_mutex>
 #include <json.hpp>
 #include "auxiliary.hpp"
+#include "mapped_file.hpp"
+#include "secondary_index.hpp"
 using json = nlohmann::json;
 
 
@@ -15,69 +19,180 @@ using json = nlohmann::json;
  */
 namespace nosqlite {
 
-    class hash_index {
+    /**
+     * @class hash_index
+     * @brief Hash index stored in a single memory-mapped file (index.bin inside the index directory).
+     * The file is made of pages. The first page is the header, followed by an open addressing table of fixed size slots (one per distinct hashed value).
+     * Arrays are indexed by their elements, so a document is in the postings of each distinct element.
+     * A slot holds the id of its only document inline or points to a chain of posting pages with the ids of all its documents, sorted and delta encoded as varints.
+     */
+    class hash_index : public secondary_index {
     private:
 
         /**
-         * @brief Doubles as the path to the index files and the name of the indexed field.
+         * @brief The index file.
          */
-        std::string path;
+        mapped_file file;
+
+        /**
+         * @brief Lookups run in parallel, changes to the index need exclusive access.
+         */
+        mutable std::shared_mutex lock;
+
+        /**
+         * @param page_number Number of the page.
+         * @brief Gets a pointer to the start of a page. Invalidated when the file grows.
+         */
+        char *page(unsigned int page_number) const;
+
+        /**
+         * @param slot_number Number of the slot.
+         * @brief Gets a pointer to a slot of the table. Invalidated when the file grows.
+         */
+        char *slot(unsigned long long slot_number) const;
+
+        /**
+         * @param key Hashed value.
+         * @param insert Indicates whether the first empty slot is returned when the key isn't in the table.
+         * @brief Probes the table for the slot of a key.
+         * @return The number of the slot or -1 if there is none.
+         */
+        long long find_slot(unsigned long long key, bool insert) const;
+
+        /**
+         * @param pages Number of contiguous pages.
+         * @brief Allocates pages at the end of the file, growing it if needed.
+         * @return Number of the first page or 0 if the file couldn't grow.
+         */
+        unsigned int allocate_pages(unsigned int pages);
+
+        /**
+         * @brief Allocates a single page, reusing freed pages first.
+         * @return Number of the page or 0 if the file couldn't grow.
+         */
+        unsigned int allocate_page();
+
+        /**
+         * @param page_number Number of the page.
+         * @brief Adds a page to the list of free pages.
+         */
+        void free_page(unsigned int page_number);
+
+        /**
+         * @param slot_count New number of slots, must be a power of two.
+         * @brief Moves every slot to a new table. Slots without documents are dropped.
+         * @return 0 on success and 1 otherwise.
+         */
+        int rehash(unsigned long long slot_count);
+
+        /**
+         * @param slot_count Number of slots, must be a power of two.
+         * @brief Truncates the file and writes an empty index.
+         * @return 0 on success and 1 otherwise.
+         */
+        int initialize(unsigned long long slot_count);
+
+        /**
+         * @param key Hashed value.
+         * @param id Id of the document.
+         * @brief Adds a document id to the postings of a key. Needs exclusive access.
+         * @return 0 on success and 1 otherwise.
+         */
+        int add(unsigned long long key, unsigned long long id);
+
+        /**
+         * @param key Hashed value.
+         * @param id Id of the document.
+         * @brief Removes a document id from the postings of a key. Needs exclusive access.
+         */
+        void remove(unsigned long long key, unsigned long long id);
+
+        /**
+         * @param value Indexed value.
+         * @brief Hashes an indexed value into a key of the table.
+         */
+        static unsigned long long hash_key(const json &value);
+
+        /**
+         * @param value Value of the field.
+         * @param keys Destination of the keys.
+         * @brief Collects the keys of a value, one per element for arrays.
+         */
+        static void collect_keys(const json &value, std::vector<unsigned long long> &keys);
+
+        /**
+         * @param value Indexed value of a document.
+         * @brief Gets the distinct keys a document is indexed under. Documents with an empty array have none.
+         */
+        static std::vector<unsigned long long> document_keys(const json &value);
 
     public:
 
         /**
          * @param path Path to the index.
-         * @brief Constructor for the hash_index class. Constructs the index object of an index already in memory.
+         * @param fields Indexed field, hash indexes have a single one.
+         * @brief Constructor for the hash_index class.
+         */
+        hash_index(const std::string path, const std::vector<field_type> &fields);
+
+        /**
+         * @brief Gets the structure of the index.
          */
-        hash_index(const std::string path);
+        index_type get_type() const override;
 
         /**
-         * @param fields List of nested fields. Only the last one will be indexed.
-         * @brief Builds the hash index.
+         * @brief Opens an index that already exists in the file system.
+         * @return 0 on success and 1 otherwise.
          */
-        int build_index(const field_type &fields);
+        int open() override;
 
         /**
-         * @brief Getter for the path attribute.
+         * @param entries Pairs of indexed value and id of the document with that value.
+         * @brief Builds the hash index in bulk: the entries are grouped by value in parallel and every slot and posting page is written once.
          */
-        std::string get_path();
+        int build_index(const std::vector<std::pair<json, unsigned long long>> &entries) override;
 
         /**
-         * @brief Getter for the indexed field name derived from the path attribute.
+         * @param op Comparison operator.
+         * @param value Value compared against.
+         * @brief Hash indexes only answer equality conditions.
          */
-        std::string get_field();
+        bool supports(const std::string &op, const json &value) const override;
 
         /**
          * @param value Value of the indexed field.
-         * @return List of the paths to the files containing the documents with the fields that hash to the parameter value.
-         * @brief Consults the index to get the paths to the documents with the coresponding hash.
+         * @return List of the ids of the documents with fields that hash to the same value as the parameter.
+         * @brief Consults the index to get the ids of the documents with the coresponding hash.
          */
-        std::vector<std::string> consult(const json &value);
+        std::vector<unsigned long long> consult(const json &value) const override;
 
         /**
          * @brief Deletes this index.
          */
-        void delete_index();
-    
+        void delete_index() override;
+
         /**
-         * @param original_value Original indexed value.
-         * @param updated_value Updated indexed value.
-         * @param document_path Path to the updated document.
-         * @brief Updates the hash index. Should be called after updating a value for an indexed field.
+         * @param new_value New indexed value.
+         * @param id Id of the updated document.
+         * @brief Updates the hash index. Should be called after adding a value for an indexed field.
          */
-        void update_index(json original_value, json updated_value, const std::string &document_path);
-        
+        void update_index(const json &new_value, unsigned long long id) override;
+
         /**
-         * @param new_value New indexed value.
-         * @param document_path Path to the updated document.
-         * @brief Updates the hash index. Should be called after updating a value for an indexed field.
+         * @param value Indexed value.
+         * @param id Id of the document.
+         * @brief Removes the document id from the postings of the value.
          */
-        void update_index(json new_value, const std::string &document_path);
+        void remove_from_index(const json &value, unsigned long long id) override;
 
-        void remove_from_index(json value, field_type field, const std::string &document_path);
+        /**
+         * @brief Writes the index to the disk.
+         * @return 0 on success and 1 otherwise.
+         */
+        int sync() override;
 
     };
 
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,211 @@
+#include "lazy_json.hpp"
+#include <cstring>
+#include <string_view>
+#include <json.hpp>
+
+using namespace nosqlite;
+using json = nlohmann::json;
+
+/**
+ * @brief Moves past spaces, tabs and line breaks.
+ */
+static void skip_whitespace(const char *&p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) p++;
+}
+
+/**
+ * @brief Moves past a string from its opening quote. A quote closes the string unless it follows an odd number of backslashes.
+ * @return False if the string isn't closed.
+ */
+static bool skip_string(const char *&p, const char *end) {
+    const char *quote = p + 1;
+    while (quote < end) {
+        quote = static_cast<const char*>(std::memchr(quote, '"', end - quote));
+        if (quote == nullptr) return false;
+        const char *backslashes = quote;
+        while (*(backslashes - 1) == '\\') backslashes--;
+        if ((quote - backslashes) % 2 == 0) {
+            p = quote + 1;
+            return true;
+        }
+        quote++;
+    }
+    return false;
+}
+
+/**
+ * @brief Moves past a value. Objects and arrays are skipped by counting brackets outside of strings, without checking what is inside them.
+ * @return False if the value isn't closed.
+ */
+static bool skip_value(const char *&p, const char *end) {
+    if (p >= end) return false;
+    if (*p == '"') return skip_string(p, end);
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        while (p < end) {
+            switch (*p) {
+                case '"':
+                    if (!skip_string(p, end)) return false;
+                    continue;
+                case '{':
+                case '[':
+                    depth++;
+                    break;
+                case '}':
+                case ']':
+                    if (--depth == 0) {
+                        p++;
+                        return true;
+                    }
+                    break;
+                default:
+                    break;
+            }
+            p++;
+        }
+        return false;
+    }
+
+    // Numbers, true, false and null end at the next separator.
+    const char *start = p;
+    while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\n' && *p != '\r' && *p != '\t') p++;
+    return p > start;
+}
+
+
+field_projector::field_projector(const std::vector<field_type> &paths) {
+    for (const field_type &path : paths) {
+        path_node *node = &this->root;
+        for (const std::string &field : path) {
+            if (node->whole) break;
+            auto child = node->children.begin();
+            while (child != node->children.end() && child->first != field) ++child;
+            if (child == node->children.end()) {
+                node->children.push_back({field, path_node()});
+                child = node->children.end() - 1;
+            }
+            node = &child->second;
+        }
+        node->whole = true;
+    }
+}
+
+bool field_projector::project(const char *&p, const char *end, const path_node &node, json &projection) {
+    p++;
+    skip_whitespace(p, end);
+    if (p < end && *p == '}') {
+        p++;
+        return true;
+    }
+
+    while (p < end && *p == '"') {
+        const char *key_start = p;
+        if (!skip_string(p, end)) return false;
+
+        // Keys with escapes are compared unescaped.
+        std::string unescaped;
+        std::string_view key(key_start + 1, p - key_start - 2);
+        if (key.find('\\') != std::string_view::npos) {
+            try {
+                unescaped = json::parse(key_start, p).get<std::string>();
+            } catch (const json::parse_error &error) {
+                return false;
+            }
+            key = unescaped;
+        }
+        const std::pair<std::string, path_node> *child = nullptr;
+        for (const auto &candidate : node.children) {
+            if (candidate.first == key) child = &candidate;
+        }
+
+        skip_whitespace(p, end);
+        if (p >= end || *p != ':') return false;
+        p++;
+        skip_whitespace(p, end);
+
+        const char *value_start = p;
+        if (child == nullptr) {
+            if (!skip_value(p, end)) return false;
+        } else if (!child->second.whole && p < end && *p == '{') {
+            json &nested = projection[child->first] = json::object();
+            if (!project(p, end, child->second, nested)) return false;
+        } else {
+            if (!skip_value(p, end)) return false;
+            try {
+                projection[child->first] = json::parse(value_start, p);
+            } catch (const json::parse_error &error) {
+                return false;
+            }
+        }
+
+        skip_whitespace(p, end);
+        if (p >= end) return false;
+        if (*p == '}') {
+            p++;
+            return true;
+        }
+        if (*p != ',') return false;
+        p++;
+        skip_whitespace(p, end);
+    }
+    return false;
+}
+
+void field_projector::project(const json &value, const path_node &node, json &projection) {
+    for (const auto &[field, child] : node.children) {
+        auto found = value.find(field);
+        if (found == value.end()) continue;
+        if (child.whole || !found->is_object()) projection[field] = *found;
+        else project(*found, child, projection[field] = json::object());
+    }
+}
+
+bool field_projector::whole() const {
+    return this->root.whole;
+}
+
+bool field_projector::project(const char *begin, const char *end, json &projection) const {
+    if (this->root.whole) return false;
+    skip_whitespace(begin, end);
+    if (begin >= end || *begin != '{') return false;
+    projection = json::object();
+    return project(begin, end, this->root, projection);
+}
+
+json field_projector::project(const json &document) const {
+    if (this->root.whole || !document.is_object()) return document;
+    json projection = json::object();
+    project(document, this->root, projection);
+    return projection;
+}
+
+lazy_filter::lazy_filter(const predicate &filter) : filter(filter), fields(filter.get_paths()) {}
+
+int lazy_filter::matches(const char *begin, const char *end, size_t *evaluated) const {
+    if (this->filter.empty()) return 1;
+    json projection;
+    if (!this->fields.project(begin, end, projection)) return -1;
+    return this->filter.matches(projection, evaluated) ? 1 : 0;
+}
+
+bool lazy_filter::split_array(const char *begin, const char *end, std::vector<std::pair<const char*, const char*>> &elements) {
+    const char *p = begin;
+    skip_whitespace(p, end);
+    if (p >= end || *p != '[') return false;
+    p++;
+    skip_whitespace(p, end);
+    if (p < end && *p == ']') return true;
+
+    while (p < end) {
+        const char *element_start = p;
+        if (!skip_value(p, end)) return false;
+        elements.push_back({element_start, p});
+        skip_whitespace(p, end);
+        if (p >= end) return false;
+        if (*p == ']') return true;
+        if (*p != ',') return false;
+        p++;
+        skip_whitespace(p, end);
+    }
+    return false;
+}
@@ -0,0 +1,136 @@
+/**
+ * @file lazy_json.hpp
+ */
+#ifndef LAZY_JSON_CLASS_H
+#define LAZY_JSON_CLASS_H
+
+#include "predicate.hpp"
+#include "auxiliary.hpp"
+#include <string>
+#include <utility>
+#include <vector>
+#include <json.hpp>
+using json = nlohmann::json;
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @class field_projector
+     * @brief Picks some fields out of documents, from their text or from their JSON. The text is walked structurally: values are skipped by matching brackets and quotes and only the fields picked are parsed.
+     * A field is kept with the objects on its path, a value on the path that isn't an object is kept whole, and missing fields are left out. Later duplicate keys replace earlier ones, like in a full parse.
+     */
+    class field_projector {
+    private:
+
+        /**
+         * @brief Node of the tree of paths picked. Fields kept whole (a field picked, or a prefix of another path) are parsed as they are, the others are walked into if they are objects.
+         */
+        struct path_node {
+            std::vector<std::pair<std::string, path_node>> children;
+            bool whole = false;
+        };
+
+        /**
+         * @brief Tree of the paths picked.
+         */
+        path_node root;
+
+        /**
+         * @param p Position of the opening brace of an object, moved past its closing brace.
+         * @param end End of the text.
+         * @param node Fields to pick out of the object.
+         * @param projection Destination of the fields.
+         * @brief Picks the fields of a tree of paths out of the text of an object.
+         * @return False if the text isn't valid.
+         */
+        static bool project(const char *&p, const char *end, const path_node &node, json &projection);
+
+        /**
+         * @param value Object.
+         * @param node Fields to pick out of the object.
+         * @param projection Destination of the fields.
+         * @brief Picks the fields of a tree of paths out of an object.
+         */
+        static void project(const json &value, const path_node &node, json &projection);
+
+    public:
+
+        /**
+         * @param paths Paths of the fields picked. An empty path picks the whole document.
+         * @brief Constructor for the field_projector class, builds the tree of the paths.
+         */
+        field_projector(const std::vector<field_type> &paths);
+
+        /**
+         * @brief Checks if the whole document is picked.
+         */
+        bool whole() const;
+
+        /**
+         * @param begin Start of the text of a document.
+         * @param end End of the text of the document.
+         * @param projection Destination of the fields.
+         * @brief Picks the fields out of the text of a document.
+         * @return False if the text isn't an object or isn't valid, or the whole document is picked.
+         */
+        bool project(const char *begin, const char *end, json &projection) const;
+
+        /**
+         * @param document Document.
+         * @brief Picks the fields out of a document. Documents that aren't objects are kept whole.
+         */
+        json project(const json &document) const;
+    };
+
+    /**
+     * @class lazy_filter
+     * @brief Checks a predicate on the text of a document without parsing all of it: the fields the conditions read are picked out of the text and the predicate is checked on an object with just those fields, which it can't tell apart from the whole document.
+     * Scans parse the rest of the document only if it passes. Text that isn't an object, or that the walk doesn't understand, is left undecided so it is parsed in full and reported like before.
+     */
+    class lazy_filter {
+    private:
+
+        /**
+         * @brief Predicate checked on the documents.
+         */
+        const predicate &filter;
+
+        /**
+         * @brief Picks the fields the conditions read.
+         */
+        field_projector fields;
+
+    public:
+
+        /**
+         * @param filter Predicate checked on the documents. It must outlive the lazy_filter.
+         * @brief Constructor for the lazy_filter class.
+         */
+        lazy_filter(const predicate &filter);
+
+        /**
+         * @param begin Start of the text of a document.
+         * @param end End of the text of the document.
+         * @param evaluated Incremented by the number of conditions checked, if given.
+         * @brief Checks if a document satisfies the predicate from its text.
+         * @return 1 if it does, 0 if it doesn't and -1 if it can't be decided without parsing the whole document.
+         */
+        int matches(const char *begin, const char *end, size_t *evaluated = nullptr) const;
+
+        /**
+         * @param begin Start of the text of an array.
+         * @param end End of the text of the array.
+         * @param elements Destination of the start and end of each element.
+         * @brief Finds the elements of an array without parsing them, e.g.: the documents of a file.
+         * @return False if the text isn't an array.
+         */
+        static bool split_array(const char *begin, const char *end, std::vector<std::pair<const char*, const char*>> &elements);
+    };
+
+}
+
+#endif
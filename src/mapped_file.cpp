@@ -0,0 +1,155 @@
+#include "mapped_file.hpp"
+#include "auxiliary.hpp"
+#include <fstream>
+#include <iostream>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+using namespace nosqlite;
+
+
+mapped_file::mapped_file(const std::string &path) : path(path), fd(-1), data(nullptr), size(0) {}
+
+mapped_file::~mapped_file() {
+    this->close();
+}
+
+#ifndef _WIN32
+
+void mapped_file::unmap() {
+    if (this->data != nullptr) munmap(this->data, this->size);
+    this->data = nullptr;
+}
+
+int mapped_file::map() {
+    if (this->size == 0) return 0;
+    void *address = mmap(nullptr, this->size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+    if (address == MAP_FAILED) {
+        std::cerr << "Error: Failed to map file: \"" << this->path << "\" into memory." << std::endl;
+        return 1;
+    }
+    this->data = static_cast<char*>(address);
+    return 0;
+}
+
+int mapped_file::open(size_t minimum_size) {
+    this->close();
+
+    this->fd = ::open(this->path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (this->fd < 0) {
+        throw_failed_to_open_file(this->path);
+        return 1;
+    }
+
+    struct stat info;
+    if (fstat(this->fd, &info) != 0) {
+        throw_failed_to_open_file(this->path);
+        return 1;
+    }
+    this->size = info.st_size;
+
+    if (this->size < minimum_size) return this->resize(minimum_size);
+    return this->map();
+}
+
+int mapped_file::resize(size_t new_size) {
+    this->unmap();
+    if (ftruncate(this->fd, new_size) != 0) {
+        std::cerr << "Error: Failed to resize file: \"" << this->path << "\"." << std::endl;
+        return 1;
+    }
+    this->size = new_size;
+    return this->map();
+}
+
+int mapped_file::sync() {
+    if (this->data == nullptr) return 0;
+    if (msync(this->data, this->size, MS_SYNC) != 0) {
+        std::cerr << "Error: Failed to write file: \"" << this->path << "\" to disk." << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+void mapped_file::close() {
+    if (this->fd < 0) return;
+    this->sync();
+    this->unmap();
+    ::close(this->fd);
+    this->fd = -1;
+    this->size = 0;
+}
+
+#else
+
+// Windows has no mmap, the file is read into memory and written back when synced.
+
+void mapped_file::unmap() {
+    this->data = nullptr;
+}
+
+int mapped_file::map() {
+    this->data = this->contents.empty() ? nullptr : this->contents.data();
+    return 0;
+}
+
+int mapped_file::open(size_t minimum_size) {
+    this->close();
+
+    std::ifstream file(this->path, std::ios::binary);
+    if (file.is_open()) {
+        this->contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        file.close();
+    }
+    this->fd = 0;
+    this->size = this->contents.size();
+
+    if (this->size < minimum_size) return this->resize(minimum_size);
+    return this->map();
+}
+
+int mapped_file::resize(size_t new_size) {
+    this->contents.resize(new_size, 0);
+    this->size = new_size;
+    return this->map();
+}
+
+int mapped_file::sync() {
+    if (this->fd < 0) return 0;
+    std::ofstream file(this->path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw_failed_to_open_file(this->path);
+        return 1;
+    }
+    file.write(this->contents.data(), this->contents.size());
+    file.close();
+    return 0;
+}
+
+void mapped_file::close() {
+    if (this->fd < 0) return;
+    this->sync();
+    this->contents.clear();
+    this->data = nullptr;
+    this->fd = -1;
+    this->size = 0;
+}
+
+#endif
+
+char *mapped_file::get_data() const {
+    return this->data;
+}
+
+size_t mapped_file::get_size() const {
+    return this->size;
+}
+
+bool mapped_file::is_open() const {
+    return this->fd >= 0;
+}
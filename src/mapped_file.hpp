@@ -0,0 +1,116 @@
+/**
+ * @file mapped_file.hpp
+ */
+#ifndef MAPPED_FILE_CLASS_H
+#define MAPPED_FILE_CLASS_H
+
+#include <string>
+#include <vector>
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @class mapped_file
+     * @brief A file mapped into memory for reading and writing. Changes reach the file when it is synced, resized or closed.
+     */
+    class mapped_file {
+    private:
+        /**
+         * @brief Path to the file.
+         */
+        std::string path;
+
+        /**
+         * @brief File descriptor, -1 when closed.
+         */
+        int fd;
+
+        /**
+         * @brief Start of the mapping.
+         */
+        char *data;
+
+        /**
+         * @brief Size of the file and the mapping.
+         */
+        size_t size;
+
+#ifdef _WIN32
+        /**
+         * @brief Contents of the file, there is no mapping on Windows.
+         */
+        std::vector<char> contents;
+#endif
+
+        /**
+         * @brief Removes the mapping without closing the file.
+         */
+        void unmap();
+
+        /**
+         * @brief Maps the whole file.
+         * @return 0 on success and 1 otherwise.
+         */
+        int map();
+
+    public:
+
+        /**
+         * @param path Path to the file.
+         * @brief Constructor for the mapped_file class.
+         */
+        mapped_file(const std::string &path);
+
+        /**
+         * @brief Destructor for the mapped_file class. Syncs and closes the file.
+         */
+        ~mapped_file();
+
+        /**
+         * @param minimum_size The file is grown (with zeros) to at least this size.
+         * @brief Opens and maps the file, creating it if it doesn't exist.
+         * @return 0 on success and 1 otherwise.
+         */
+        int open(size_t minimum_size);
+
+        /**
+         * @param new_size New size of the file.
+         * @brief Resizes the file and maps it again. Pointers to the old mapping become invalid. New bytes are zero.
+         * @return 0 on success and 1 otherwise.
+         */
+        int resize(size_t new_size);
+
+        /**
+         * @brief Writes the changes to the disk.
+         * @return 0 on success and 1 otherwise.
+         */
+        int sync();
+
+        /**
+         * @brief Syncs, unmaps and closes the file.
+         */
+        void close();
+
+        /**
+         * @brief Gets the start of the mapping.
+         */
+        char *get_data() const;
+
+        /**
+         * @brief Gets the size of the file.
+         */
+        size_t get_size() const;
+
+        /**
+         * @brief Checks if the file is open.
+         */
+        bool is_open() const;
+    };
+
+} // namespace nosqlite
+
+#endif
@@ -1,6 +1,7 @@
 #include "auxiliary.hpp"
 #include "database.hpp"
 #include "collection.hpp"
+#include "geometry.hpp"
 #include <string>
 #include <vector>
 #include <json.hpp>
@@ -16,6 +17,7 @@ nosqlite_api::nosqlite_api(const std::string &path) {
         delete this->db;
         exit(1);
     }
+    this->sort_memory = read_options().sort_memory;
     this->clear_all();
 }
 
@@ -25,6 +27,7 @@ nosqlite_api::nosqlite_api(const std::string &path_to_database, const std::strin
         delete this->db;
         exit(1);
     }
+    this->sort_memory = read_options().sort_memory;
     this->clear_all();
 }
 
@@ -40,24 +43,84 @@ void nosqlite_api::turn_off_parallel_processing() {
     this->db->turn_off_parallel_processing();
 }
 
+void nosqlite_api::set_sort_memory(size_t bytes) {
+    this->sort_memory = bytes;
+}
+
 void nosqlite_api::clear_all() {
     this->active_collection = "";
-    this->active_field = {};
+    this->active_fields = {};
     this->active_json = {};
     this->active_query_type = NONE;
+    this->active_storage = HASHED_STORAGE;
+    this->active_index_type = HASH_INDEX;
+    this->active_vector = {};
+    this->active_limit = 0;
+    this->active_skip = 0;
+    this->active_projection = {};
+    this->active_order = {};
+    this->active_aggregates = {};
+    this->active_metric = COSINE_SIMILARITY;
+    this->active_probes = 0;
+    this->active_explain = NO_EXPLAIN;
     this->conditions = {};
 }
 
 int nosqlite_api::execute(std::vector<json> &results) {
     int ret = 1;
 
+    if (this->active_explain != NO_EXPLAIN && this->active_query_type != READ) {
+        std::cerr << "Error: Only reads can be explained." << std::endl;
+        this->clear_all();
+        return ret;
+    }
+
+    if ((this->active_limit > 0 && this->active_query_type != READ && this->active_query_type != NEAREST) || ((this->active_skip > 0 || !this->active_projection.empty() || !this->active_order.empty()) && this->active_query_type != READ)) {
+        std::cerr << "Error: Only reads can be limited, skip documents, return some of their fields or be sorted." << std::endl;
+        this->clear_all();
+        return ret;
+    }
+
     switch (this->active_query_type) {
         case CREATE: {
             ret = this->db->create_document(this->active_collection, this->active_json);
             break;
         }
         case READ: {
-            results = this->db->read(this->active_collection, this->conditions);
+            read_options options = {this->active_skip, this->active_limit, this->active_projection, this->active_order, this->sort_memory};
+            if (this->active_explain == EXPLAIN_PLAN) {
+                json plan = this->db->explain(this->active_collection, this->conditions);
+                if (plan.is_null()) break;
+                results = {{{"plan", plan}}};
+            }
+            else if (this->active_explain == EXPLAIN_ANALYZE) {
+                query_profile profile;
+                this->db->read(this->active_collection, this->conditions, &profile, options);
+                if (profile.plan.is_null()) break;
+                results = {{{"plan", profile.plan}, {"execution", profile.to_json()}}};
+            }
+            else results = this->db->read(this->active_collection, this->conditions, nullptr, options);
+            ret = 0;
+            break;
+        }
+        case NEAREST: {
+            results = this->db->nearest(this->active_collection, this->active_fields[0], this->active_vector, this->active_limit, this->active_metric, this->active_probes, this->conditions);
+            ret = 0;
+            break;
+        }
+        case AGGREGATE: {
+            results = this->db->aggregate(this->active_collection, this->conditions, this->active_aggregates, this->active_fields);
+            ret = 0;
+            break;
+        }
+        case COUNT: {
+            unsigned long long count;
+            ret = this->db->count(this->active_collection, this->conditions, count);
+            if (ret == 0) results = {{{"count", count}}};
+            break;
+        }
+        case DISTINCT: {
+            results = this->db->distinct(this->active_collection, this->active_fields[0], this->conditions);
             ret = 0;
             break;
         }
@@ -78,11 +141,23 @@ int nosqlite_api::execute(std::vector<json> &results) {
             break;
         }
         case DELETE_INDEX: {
-            ret = this->db->delete_hash_index(this->active_collection, this->active_field);
+            ret = this->db->delete_index(this->active_collection, this->active_fields, this->active_index_type);
             break;
         }
         case CREATE_INDEX: {
-            ret = this->db->create_hash_index(this->active_collection, this->active_field);
+            ret = this->db->create_index(this->active_collection, this->active_fields, this->active_index_type);
+            break;
+        }
+        case CREATE_ZONE_MAP: {
+            ret = this->db->create_zone_map(this->active_collection, this->active_fields[0]);
+            break;
+        }
+        case DELETE_ZONE_MAP: {
+            ret = this->db->delete_zone_map(this->active_collection, this->active_fields[0]);
+            break;
+        }
+        case ANALYZE: {
+            ret = this->db->analyze(this->active_collection);
             break;
         }
         case DELETE_COLLECTION: {
@@ -90,7 +165,11 @@ int nosqlite_api::execute(std::vector<json> &results) {
             break;
         }
         case CREATE_COLLECTION: {
-            ret = this->db->create_collection(this->active_collection, this->active_path);
+            ret = this->db->create_collection(this->active_collection, this->active_path, this->active_storage);
+            break;
+        }
+        case MIGRATE_STORAGE: {
+            ret = this->db->migrate_storage(this->active_collection, this->active_storage);
             break;
         }
         default: {
@@ -103,6 +182,18 @@ int nosqlite_api::execute(std::vector<json> &results) {
     return ret;
 }
 
+int nosqlite_api::execute(cursor &results) {
+    int ret = 1;
+    if (this->active_query_type != READ || this->active_explain != NO_EXPLAIN) {
+        std::cerr << "Error: Only reads that aren't explained return a cursor." << std::endl;
+    }
+    else ret = this->db->open_cursor(this->active_collection, this->conditions, {this->active_skip, this->active_limit, this->active_projection, this->active_order, this->sort_memory}, results);
+
+    this->clear_all();
+
+    return ret;
+}
+
 nosqlite_api* nosqlite_api::create(std::string col_name, json document) {
     this->active_query_type = CREATE;
     this->active_collection = col_name;
@@ -138,6 +229,40 @@ nosqlite_api *nosqlite::nosqlite_api::remove(std::string col_name, condition_typ
     return this;
 }
 
+nosqlite_api* nosqlite_api::nearest(const std::string &col_name, const field_type &field, const std::vector<float> &query, size_t k, vector_metric metric, unsigned int probes) {
+    this->active_query_type = NEAREST;
+    this->active_collection = col_name;
+    this->active_fields = {field};
+    this->active_vector = query;
+    this->active_limit = k;
+    this->active_metric = metric;
+    this->active_probes = probes;
+    return this;
+}
+
+nosqlite_api* nosqlite_api::aggregate(const std::string &col_name, const std::vector<aggregate_type> &aggregates, const std::vector<field_type> &group_by) {
+    this->active_query_type = AGGREGATE;
+    this->active_collection = col_name;
+    this->active_aggregates = aggregates;
+    this->active_fields = group_by;
+    return this;
+}
+
+nosqlite_api* nosqlite_api::count(const std::string &col_name, condition_type condition) {
+    this->active_query_type = COUNT;
+    this->active_collection = col_name;
+    if (valid_condition(condition)) this->conditions.push_back(condition);
+    return this;
+}
+
+nosqlite_api* nosqlite_api::distinct(const std::string &col_name, const field_type &field, condition_type condition) {
+    this->active_query_type = DISTINCT;
+    this->active_collection = col_name;
+    this->active_fields = {field};
+    if (valid_condition(condition)) this->conditions.push_back(condition);
+    return this;
+}
+
 nosqlite_api *nosqlite_api::AND(condition_type condition)
 {
   if (valid_condition(condition))
@@ -145,8 +270,41 @@ nosqlite_api *nosqlite_api::AND(condition_type condition)
   return this;
 }
 
+nosqlite_api* nosqlite_api::explain(bool analyze) {
+    this->active_explain = analyze ? EXPLAIN_ANALYZE : EXPLAIN_PLAN;
+    return this;
+}
+
+nosqlite_api* nosqlite_api::limit(size_t count) {
+    this->active_limit = count;
+    return this;
+}
+
+nosqlite_api* nosqlite_api::skip(size_t count) {
+    this->active_skip = count;
+    return this;
+}
+
+nosqlite_api* nosqlite_api::project(const std::vector<field_type> &fields) {
+    this->active_projection = fields;
+    return this;
+}
+
+nosqlite_api* nosqlite_api::order_by(const field_type &field, bool descending) {
+    this->active_order.push_back({field, descending});
+    return this;
+}
+
 bool nosqlite_api::valid_condition(condition_type condition) {
     if (condition == empty_condition) return false;
+    if (condition.op == "in") return condition.value.is_array();
+    if (condition.op == "text" || condition.op == "contains" || condition.op == "prefix") return condition.value.is_string();
+    if (condition.op == "near" || condition.op == "within_box") return valid_geo_condition(condition.op, condition.value);
+    if (condition.op == "regex") {
+        if (condition.value.is_string() && valid_regex(condition.value)) return true;
+        std::cerr << "Error: Invalid regular expression: " << condition.value << "." << std::endl;
+        return false;
+    }
     return condition.op == "==" || condition.op == "!=" || condition.op == ">" || condition.op == "<" || condition.op == ">=" || condition.op == "<=";
 }
 
@@ -156,24 +314,71 @@ nosqlite_api* nosqlite_api::delete_collection(const std::string &col_name) {
     return this;
 }
 
-nosqlite_api* nosqlite_api::create_collection(const std::string &col_name, const std::string &path_to_json) {
+nosqlite_api* nosqlite_api::create_collection(const std::string &col_name, const std::string &path_to_json, storage_type storage) {
     this->active_query_type = CREATE_COLLECTION;
     this->active_collection = col_name;
     this->active_path = path_to_json;
+    this->active_storage = storage;
+
+    return this;
+}
 
+nosqlite_api* nosqlite_api::migrate_storage(const std::string &col_name, storage_type storage) {
+    this->active_query_type = MIGRATE_STORAGE;
+    this->active_collection = col_name;
+    this->active_storage = storage;
+
+    return this;
+}
+
+nosqlite_api* nosqlite_api::delete_index(const std::string &col_name, const field_type &field, index_type type) {
+    this->active_query_type = DELETE_INDEX;
+    this->active_collection = col_name;
+    this->active_fields = {field};
+    this->active_index_type = type;
+    return this;
+}
+
+nosqlite_api* nosqlite_api::create_index(const std::string &col_name, const field_type &field, index_type type) {
+    this->active_query_type = CREATE_INDEX;
+    this->active_collection = col_name;
+    this->active_fields = {field};
+    this->active_index_type = type;
     return this;
 }
 
-nosqlite_api* nosqlite_api::delete_index(const std::string &col_name, const field_type &field) {
+nosqlite_api* nosqlite_api::delete_compound_index(const std::string &col_name, const std::vector<field_type> &fields) {
     this->active_query_type = DELETE_INDEX;
     this->active_collection = col_name;
-    this->active_field = field;
+    this->active_fields = fields;
+    this->active_index_type = BTREE_INDEX;
     return this;
 }
 
-nosqlite_api* nosqlite_api::create_index(const std::string &col_name, const field_type &field) {
+nosqlite_api* nosqlite_api::create_compound_index(const std::string &col_name, const std::vector<field_type> &fields) {
     this->active_query_type = CREATE_INDEX;
     this->active_collection = col_name;
-    this->active_field = field;
+    this->active_fields = fields;
+    this->active_index_type = BTREE_INDEX;
+    return this;
+}
+
+nosqlite_api* nosqlite_api::create_zone_map(const std::string &col_name, const field_type &field) {
+    this->active_query_type = CREATE_ZONE_MAP;
+    this->active_collection = col_name;
+    this->active_fields = {field};
+    return this;
+}
+
+nosqlite_api* nosqlite_api::delete_zone_map(const std::string &col_name, const field_type &field) {
+    this->active_query_type = DELETE_ZONE_MAP;
+    this->active_collection = col_name;
+    this->active_fields = {field};
+    return this;
+}
+
+nosqlite_api* nosqlite_api::analyze(const std::string &col_name) {
+    this->active_query_type = ANALYZE;
+    this->active_collection = col_name;
     return this;
 }
@@ -19,7 +19,9 @@ using json = nlohmann::json;
  */
 namespace nosqlite {
 
-    enum query_type {NONE, CREATE, READ, UPDATE, REMOVE, CREATE_INDEX, DELETE_INDEX, CREATE_COLLECTION, DELETE_COLLECTION};
+    enum query_type {NONE, CREATE, READ, UPDATE, REMOVE, CREATE_INDEX, DELETE_INDEX, CREATE_COLLECTION, DELETE_COLLECTION, MIGRATE_STORAGE, NEAREST, CREATE_ZONE_MAP, DELETE_ZONE_MAP, ANALYZE, AGGREGATE, COUNT, DISTINCT};
+
+    enum explain_mode {NO_EXPLAIN, EXPLAIN_PLAN, EXPLAIN_ANALYZE};
 
     /**
      * @class nosqlite
@@ -30,10 +32,22 @@ namespace nosqlite {
         database* db;
         std::vector<condition_type> conditions;
         std::string active_collection;
-        field_type active_field;
+        std::vector<field_type> active_fields;
         query_type active_query_type;
         json active_json;
         std::string active_path;
+        storage_type active_storage;
+        index_type active_index_type;
+        std::vector<float> active_vector;
+        size_t active_limit;
+        size_t active_skip;
+        std::vector<field_type> active_projection;
+        std::vector<sort_key> active_order;
+        std::vector<aggregate_type> active_aggregates;
+        size_t sort_memory;
+        vector_metric active_metric;
+        unsigned int active_probes;
+        explain_mode active_explain;
 
         void clear_all();
 
@@ -69,6 +83,12 @@ namespace nosqlite {
          */
         void turn_off_parallel_processing();
 
+        /**
+         * @param bytes Bytes of documents a sorted read keeps in memory, 256 MB by default.
+         * @brief Sets the memory budget of sorted reads without a limit. Past it, the documents are sorted in parts written to temporary files, which are merged as the documents are returned.
+         */
+        void set_sort_memory(size_t bytes);
+
         /**
          * @param results Reference for the results of the query.
          * @brief Executes the query that was build up to the point of execution.
@@ -76,6 +96,14 @@ namespace nosqlite {
          */
         int execute(std::vector<json> &results);
 
+        /**
+         * @param results Destination of the cursor over the documents of the read.
+         * @brief Executes the read that was built up to the point of execution without reading its documents: the cursor reads them a batch at a time as it is advanced, so only one batch is held at a time and reading stops with the limit.
+         * The cursor must not be used after its collection is deleted.
+         * @return Return 0 if the query was successful or 1 otherwise.
+         */
+        int execute(cursor &results);
+
         /**
          * @param col_name Name of the collection.
          * @param document JSON of the document to be created.
@@ -109,6 +137,48 @@ namespace nosqlite {
          */
         nosqlite_api* remove(std::string col_name, condition_type condition);
 
+        /**
+         * @param col_name Name of the collection.
+         * @param field Field with the embeddings, arrays of numbers.
+         * @param query Vector to compare the embeddings with.
+         * @param k Number of documents to return.
+         * @param metric Similarity of the vectors.
+         * @param probes Number of partitions of the vector index searched. 0 compares every embedding, more probes are slower and find more of the exact neighbours.
+         * @brief Sets up the search of the k documents with the embeddings most similar to the query, the most similar first. Conditions added with AND filter the documents.
+         * @return Returns self.
+         */
+        nosqlite_api* nearest(const std::string &col_name, const field_type &field, const std::vector<float> &query, size_t k, vector_metric metric = COSINE_SIMILARITY, unsigned int probes = 0);
+
+        /**
+         * @param col_name Name of the collection.
+         * @param aggregates Aggregates computed over each group: COUNT_AGGREGATE, SUM_AGGREGATE, AVG_AGGREGATE, MIN_AGGREGATE or MAX_AGGREGATE, the field they read and, optionally, the name of the result.
+         * @param group_by Fields the documents are grouped by, none for a single group of every document.
+         * @brief Sets up an aggregation over the documents of the collection that satisfy the conditions, added with AND. It returns a row for each group, with the values of the group fields and the result of each aggregate, ordered by the values of the group fields.
+         * A group field with an array puts the document in the group of each of its elements. The threads of the read compute the aggregates of their documents as they read them, so the documents aren't kept.
+         * @return Returns self.
+         */
+        nosqlite_api* aggregate(const std::string &col_name, const std::vector<aggregate_type> &aggregates, const std::vector<field_type> &group_by = {});
+
+        /**
+         * @param col_name Name of the collection.
+         * @param condition Condition the documents counted satisfy, more can be added with AND.
+         * @brief Sets up a count of the documents of the collection that satisfy the conditions. It returns a single result with the number of documents ("count").
+         * Without conditions it comes from the header of the collection. When indexes find exactly the documents of every condition (equality and "in" conditions on bitmap indexes and on B+tree indexes for numbers, and inequalities on bitmap indexes)
+         * it comes from their postings without reading any document. Otherwise the documents are streamed through a count.
+         * @return Returns self.
+         */
+        nosqlite_api* count(const std::string &col_name, condition_type condition = empty_condition);
+
+        /**
+         * @param col_name Name of the collection.
+         * @param field Field whose values are returned.
+         * @param condition Condition the documents satisfy, more can be added with AND.
+         * @brief Sets up a query for the distinct values of a field in the documents of the collection that satisfy the conditions, each element of arrays, in the order of order_by. Missing fields and nulls have no value.
+         * Without conditions, a bitmap index on the field has the values without reading any document. Otherwise the documents are streamed through a group by the field.
+         * @return Returns self.
+         */
+        nosqlite_api* distinct(const std::string &col_name, const field_type &field, condition_type condition = empty_condition);
+
         /**
          * @param condition The operation will be conditioned according to this value.
          * @brief Adds a condition to the operation that is being build.
@@ -116,6 +186,46 @@ namespace nosqlite {
          */
         nosqlite_api* AND(condition_type condition);
 
+        /**
+         * @param analyze Runs the read and adds what it did to the plan (EXPLAIN ANALYZE).
+         * @brief Makes the read being built return how it runs instead of its documents: a single result with the plan the planner chooses ("plan").
+         * When analyzing, the read runs and the result also has its counters and timings ("execution"): files opened, bytes read, documents parsed, conditions evaluated, index keys looked up and ids they returned, documents returned and the milliseconds of each stage.
+         * @return Returns self.
+         */
+        nosqlite_api* explain(bool analyze = false);
+
+        /**
+         * @param count Most documents returned.
+         * @brief Makes the read being built stop once it has the number of documents given. Reads through an index keep its order, scans return any of the documents that satisfy the conditions. For nearest it replaces k.
+         * @return Returns self.
+         */
+        nosqlite_api* limit(size_t count);
+
+        /**
+         * @param count Number of documents skipped.
+         * @brief Makes the read being built leave out its first documents, in the same order as the limit.
+         * @return Returns self.
+         */
+        nosqlite_api* skip(size_t count);
+
+        /**
+         * @param fields Fields kept, each one a list of nested fields.
+         * @brief Makes the read being built return only some fields of the documents, and their id. Nested fields keep the objects on their path, values on the path that aren't objects are kept whole and missing fields are left out.
+         * The fields are picked as the documents are read, so the rest of each document isn't parsed or copied.
+         * @return Returns self.
+         */
+        nosqlite_api* project(const std::vector<field_type> &fields);
+
+        /**
+         * @param field Field the documents are sorted by, a list of nested fields.
+         * @param descending Sorts from the largest value to the smallest.
+         * @brief Makes the read being built return the documents sorted by the field. Each call adds a key, used to order the documents the keys before it leave tied, and documents still tied are ordered by id.
+         * Values of different types are ordered null (and missing fields), booleans, numbers, strings, objects and arrays. With a limit each thread keeps only the documents the limit can return.
+         * A read sorted by an ascending field with a B+tree index and a range condition on it follows the index instead of sorting.
+         * @return Returns self.
+         */
+        nosqlite_api* order_by(const field_type &field, bool descending = false);
+
         /**
          * @param col_name Name of the collection.
          * @brief Sets up the deletion of a collection from the database.
@@ -126,26 +236,77 @@ namespace nosqlite {
         /**
          * @param col_name Name of the collection.
          * @param path_to_json Path to the JSON files for the new collection.
+         * @param storage Layout in which the documents of the collection are stored.
          * @brief Sets up the creation of a new collection in the database from the JSON files at the specified path or an empty collection if the path is a empty string.
          * @return Returns self.
          */
-        nosqlite_api* create_collection(const std::string &col_name, const std::string &path_to_json = "");
+        nosqlite_api* create_collection(const std::string &col_name, const std::string &path_to_json = "", storage_type storage = HASHED_STORAGE);
+
+        /**
+         * @param col_name Name of the collection.
+         * @param storage New layout for the documents of the collection.
+         * @brief Sets up the migration of a collection to another storage layout.
+         * @return Returns self.
+         */
+        nosqlite_api* migrate_storage(const std::string &col_name, storage_type storage);
 
         /**
          * @param col_name Name of the collection.
          * @param field Field of the index to be deleted.
+         * @param type Structure of the index to be deleted.
          * @brief Sets up the deletion of an index on the specified field and collection.
          * @return Returns self.
          */
-        nosqlite_api* delete_index(const std::string &col_name, const field_type &field);
+        nosqlite_api* delete_index(const std::string &col_name, const field_type &field, index_type type = HASH_INDEX);
         
         /**
          * @param col_name Name of the collection.
          * @param field Field of the index to be created.
+         * @param type Structure of the index: HASH_INDEX for equality conditions, BTREE_INDEX for equality conditions and range conditions on numbers, BITMAP_INDEX for equality and inequality conditions on fields with few distinct values, TEXT_INDEX for "text" conditions on string fields, TRIGRAM_INDEX for "contains", "prefix" and "regex" conditions on string fields, GEO_INDEX for "near" and "within_box" conditions on coordinates or VECTOR_INDEX for nearest neighbour searches on embeddings.
          * @brief Sets up the creation of an index on the specified field and collection.
          * @return Returns self.
          */
-        nosqlite_api* create_index(const std::string &col_name, const field_type &field);
+        nosqlite_api* create_index(const std::string &col_name, const field_type &field, index_type type = HASH_INDEX);
+
+        /**
+         * @param col_name Name of the collection.
+         * @param fields Fields of the index to be deleted, in the order they were given when it was created.
+         * @brief Sets up the deletion of a compound index on the specified fields and collection.
+         * @return Returns self.
+         */
+        nosqlite_api* delete_compound_index(const std::string &col_name, const std::vector<field_type> &fields);
+
+        /**
+         * @param col_name Name of the collection.
+         * @param fields Fields of the index to be created, in order. Queries with equality conditions on the first fields and an optional range on the next one use it.
+         * @brief Sets up the creation of a B+tree index on several fields of the specified collection.
+         * @return Returns self.
+         */
+        nosqlite_api* create_compound_index(const std::string &col_name, const std::vector<field_type> &fields);
+
+        /**
+         * @param col_name Name of the collection.
+         * @param field Field to summarize.
+         * @brief Sets up the creation of a zone map on the specified field and collection: a Bloom filter of its values and the range of its numbers for each segment or directory of documents, which lets scans skip the ones that can't satisfy "==", "in" and range conditions on it.
+         * @return Returns self.
+         */
+        nosqlite_api* create_zone_map(const std::string &col_name, const field_type &field);
+
+        /**
+         * @param col_name Name of the collection.
+         * @param field Summarized field.
+         * @brief Sets up the deletion of the zone map on the specified field and collection.
+         * @return Returns self.
+         */
+        nosqlite_api* delete_zone_map(const std::string &col_name, const field_type &field);
+
+        /**
+         * @param col_name Name of the collection.
+         * @brief Sets up the collection of statistics of the specified collection (ANALYZE): the documents with each field, its distinct and most common values and a histogram of its numbers, and the postings of its indexes.
+         * The planner uses them to estimate how many documents each index returns and picks the cheapest plan. Without them it uses fixed estimates. The statistics aren't updated by changes, only by running it again.
+         * @return Returns self.
+         */
+        nosqlite_api* analyze(const std::string &col_name);
 
     };
 
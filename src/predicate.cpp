@@ -0,0 +1,190 @@
+#include "predicate.hpp"
+#include "auxiliary.hpp"
+#include "geometry.hpp"
+#include "text_analyzer.hpp"
+#include <algorithm>
+#include <json.hpp>
+
+using namespace nosqlite;
+using json = nlohmann::json;
+
+/**
+ * @brief Gets the order in which a condition is checked: comparisons, then string searches, then text, regular expressions and geospatial conditions.
+ */
+static int check_order(predicate_op op) {
+    if (op == CONTAINS || op == PREFIX) return 1;
+    if (op == TEXT || op == REGEX || op == NEAR || op == WITHIN_BOX) return 2;
+    return 0;
+}
+
+
+predicate_op predicate::op_from_string(const std::string &op) {
+    if (op == "==") return EQUAL;
+    if (op == "!=") return NOT_EQUAL;
+    if (op == ">") return GREATER;
+    if (op == ">=") return GREATER_EQUAL;
+    if (op == "<") return LESS;
+    if (op == "<=") return LESS_EQUAL;
+    if (op == "in") return IN;
+    if (op == "text") return TEXT;
+    if (op == "contains") return CONTAINS;
+    if (op == "prefix") return PREFIX;
+    if (op == "regex") return REGEX;
+    if (op == "near") return NEAR;
+    if (op == "within_box") return WITHIN_BOX;
+    return INVALID;
+}
+
+predicate::term predicate::compile(const condition_type &condition) {
+    term compiled;
+    compiled.op = op_from_string(condition.op);
+    compiled.path = condition.field;
+    compiled.value = condition.value;
+    const json &value = condition.value;
+
+    switch (compiled.op) {
+        case EQUAL:
+        case NOT_EQUAL:
+            if (value.is_string()) compiled.text = value.get<std::string>();
+            compiled.valid = true;
+            break;
+        case GREATER:
+        case GREATER_EQUAL:
+        case LESS:
+        case LESS_EQUAL:
+            compiled.valid = value.is_number();
+            break;
+        case IN:
+            if (!value.is_array()) break;
+            for (const json &element : value) {
+                if (element.is_string()) compiled.strings.insert(element.get<std::string>());
+                else compiled.others.push_back(element);
+            }
+            compiled.valid = true;
+            break;
+        case TEXT:
+            if (!value.is_string()) break;
+            compiled.query = parse_text_query(value.get<std::string>());
+            compiled.valid = !compiled.query.terms.empty();
+            break;
+        case CONTAINS:
+        case PREFIX:
+            if (!value.is_string()) break;
+            compiled.text = value.get<std::string>();
+            compiled.valid = true;
+            break;
+        case REGEX:
+            if (!value.is_string()) break;
+            try {
+                compiled.expression = std::regex(value.get<std::string>());
+                compiled.valid = true;
+            } catch (const std::regex_error &error) {
+                compiled.valid = false;
+            }
+            break;
+        case NEAR:
+            compiled.valid = parse_near(value, compiled.center, compiled.radius);
+            break;
+        case WITHIN_BOX:
+            compiled.valid = parse_box(value, compiled.box);
+            break;
+        default:
+            break;
+    }
+    return compiled;
+}
+
+predicate::predicate(const std::vector<condition_type> &conditions) {
+    for (const condition_type &condition : conditions) this->terms.push_back(compile(condition));
+    std::stable_sort(this->terms.begin(), this->terms.end(), [](const term &a, const term &b) { return check_order(a.op) < check_order(b.op); });
+}
+
+const json *predicate::resolve(const json &document, const field_type &path) {
+    static const json missing;
+    const json *current = &document;
+    for (const std::string &field : path) {
+        if (current->is_null()) return &missing;
+        if (!current->is_object()) return nullptr;
+        auto found = current->find(field);
+        if (found == current->end()) return &missing;
+        current = &*found;
+    }
+    return current;
+}
+
+bool predicate::satisfies(const term &condition, const json &value) {
+    // Coordinates are arrays themselves, geospatial conditions look for the points at any depth.
+    if (condition.op == NEAR || condition.op == WITHIN_BOX) {
+        std::vector<geo_point> points;
+        collect_geo_points(value, points);
+        for (const geo_point &point : points) {
+            if (condition.op == NEAR ? geo_distance(point, condition.center) <= condition.radius : geo_box_contains(condition.box, point)) return true;
+        }
+        return false;
+    }
+
+    if (value.is_array()) {
+        for (const json &element : value) {
+            if (satisfies(condition, element)) return true;
+        }
+        return false;
+    }
+
+    switch (condition.op) {
+        case EQUAL:
+            if (condition.value.is_string()) return value.is_string() && value.get_ref<const std::string&>() == condition.text;
+            return value == condition.value;
+        case NOT_EQUAL:
+            if (condition.value.is_string()) return !value.is_string() || value.get_ref<const std::string&>() != condition.text;
+            return value != condition.value;
+        case GREATER:
+            return value.is_number() && value > condition.value;
+        case GREATER_EQUAL:
+            return value.is_number() && value >= condition.value;
+        case LESS:
+            return value.is_number() && value < condition.value;
+        case LESS_EQUAL:
+            return value.is_number() && value <= condition.value;
+        case IN:
+            if (value.is_string()) return condition.strings.find(value.get_ref<const std::string&>()) != condition.strings.end();
+            for (const json &element : condition.others) {
+                if (value == element) return true;
+            }
+            return false;
+        case TEXT:
+            return value.is_string() && text_matches(value.get_ref<const std::string&>(), condition.query);
+        case CONTAINS:
+            return value.is_string() && value.get_ref<const std::string&>().find(condition.text) != std::string::npos;
+        case PREFIX:
+            return value.is_string() && value.get_ref<const std::string&>().compare(0, condition.text.size(), condition.text) == 0;
+        case REGEX:
+            if (!value.is_string()) return false;
+            try {
+                return std::regex_search(value.get_ref<const std::string&>(), condition.expression);
+            } catch (const std::regex_error &error) {
+                return false;
+            }
+        default:
+            return false;
+    }
+}
+
+bool predicate::matches(const json &document, size_t *evaluated) const {
+    for (const term &condition : this->terms) {
+        if (evaluated != nullptr) (*evaluated)++;
+        if (!condition.valid) return false;
+        const json *value = resolve(document, condition.path);
+        if (value == nullptr || !satisfies(condition, *value)) return false;
+    }
+    return true;
+}
+
+bool predicate::empty() const {
+    return this->terms.empty();
+}
+
+std::vector<field_type> predicate::get_paths() const {
+    std::vector<field_type> paths;
+    for (const term &condition : this->terms) paths.push_back(condition.path);
+    return paths;
+}
@@ -0,0 +1,118 @@
+/**
+ * @file predicate.hpp
+ */
+#ifndef PREDICATE_CLASS_H
+#define PREDICATE_CLASS_H
+
+#include "auxiliary.hpp"
+#include "geometry.hpp"
+#include "text_analyzer.hpp"
+#include <regex>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <json.hpp>
+using json = nlohmann::json;
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @brief Operators of the conditions, INVALID for unknown ones, which no document satisfies.
+     */
+    enum predicate_op {EQUAL, NOT_EQUAL, GREATER, GREATER_EQUAL, LESS, LESS_EQUAL, IN, TEXT, CONTAINS, PREFIX, REGEX, NEAR, WITHIN_BOX, INVALID};
+
+    /**
+     * @class predicate
+     * @brief Conditions of a query compiled once and checked against every document it reads: the operators are resolved, the values prepared for their operator (strings, sets of strings, parsed text queries, compiled regular expressions and geospatial areas)
+     * and the fields read from the documents in place, without copying them. Cheap conditions are checked first.
+     * A condition on an array holds if any element satisfies it, at any depth, except for geospatial conditions, which look for the points in the whole value. Missing fields are null, fields inside values that aren't objects satisfy no condition.
+     * Range conditions only hold between numbers, "in" if the value is one of the elements of the list, "text" if the value is a string with every word and quoted phrase of the query after the same analysis as text indexes,
+     * "contains", "prefix" and "regex" if the value is a string with the substring, the prefix or a match of the regular expression (ECMAScript syntax), and "near" and "within_box" if the value has a point within the distance of the center or inside the box.
+     */
+    class predicate {
+    private:
+
+        /**
+         * @brief A compiled condition: the operator, the path of the field and the value prepared for the operator. Conditions whose value can't be used with their operator are never satisfied.
+         */
+        struct term {
+            predicate_op op = INVALID;
+            field_type path;
+            json value;
+            std::string text;
+            std::unordered_set<std::string> strings;
+            std::vector<json> others;
+            text_query query;
+            std::regex expression;
+            geo_point center = {0, 0};
+            double radius = 0;
+            geo_box box = {0, 0, 0, 0};
+            bool valid = false;
+        };
+
+        /**
+         * @brief Compiled conditions, in the order they are checked.
+         */
+        std::vector<term> terms;
+
+        /**
+         * @param condition Condition.
+         * @brief Compiles a condition.
+         */
+        static term compile(const condition_type &condition);
+
+        /**
+         * @param condition Compiled condition.
+         * @param value Value of the field.
+         * @brief Checks if a value satisfies a condition, any element of arrays.
+         */
+        static bool satisfies(const term &condition, const json &value);
+
+    public:
+
+        /**
+         * @param document Document.
+         * @param path Path of the field.
+         * @brief Gets the value of a field in place. Missing fields are null.
+         * @return nullptr if a field on the path is inside a value that isn't an object.
+         */
+        static const json *resolve(const json &document, const field_type &path);
+
+        /**
+         * @param op Comparison operator.
+         * @brief Gets the operator of a condition.
+         */
+        static predicate_op op_from_string(const std::string &op);
+
+        /**
+         * @param conditions Conditions, all of which must be satisfied.
+         * @brief Constructor for the predicate class, compiles the conditions.
+         */
+        predicate(const std::vector<condition_type> &conditions);
+
+        /**
+         * @param document Document.
+         * @param evaluated Incremented by the number of conditions checked, if given.
+         * @brief Checks if a document satisfies all of the conditions, stopping at the first one it doesn't.
+         */
+        bool matches(const json &document, size_t *evaluated = nullptr) const;
+
+        /**
+         * @brief Checks if there are no conditions, which every document satisfies.
+         */
+        bool empty() const;
+
+        /**
+         * @brief Gets the paths of the fields the conditions read, the only parts of a document needed to check them.
+         */
+        std::vector<field_type> get_paths() const;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,149 @@
+#include "primary_index.hpp"
+#include "auxiliary.hpp"
+#include <cstring>
+#include <iostream>
+#include <mutex>
+
+using namespace nosqlite;
+
+// The table starts with a header (magic number, capacity and number of documents) followed by the slots.
+// A slot holds the offset, the segment and the length of a location.
+static const char primary_magic[8] = {'N', 'S', 'Q', 'P', 'R', 'I', 'M', '1'};
+static const size_t primary_header_size = 64;
+static const size_t primary_capacity_offset = 8;
+static const size_t primary_size_offset = 16;
+static const size_t primary_slot_size = 16;
+static const unsigned long long primary_initial_capacity = 1024;
+
+
+primary_index::primary_index(const std::string &path) : file(path) {}
+
+unsigned long long primary_index::capacity() const {
+    unsigned long long capacity;
+    std::memcpy(&capacity, this->file.get_data() + primary_capacity_offset, sizeof(capacity));
+    return capacity;
+}
+
+char *primary_index::slot(unsigned long long id) const {
+    return this->file.get_data() + primary_header_size + id * primary_slot_size;
+}
+
+int primary_index::open() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+
+    if (this->file.open(primary_header_size) != 0) return 1;
+
+    // A new file is all zeros and gets a header.
+    char *data = this->file.get_data();
+    if (std::memcmp(data, primary_magic, sizeof(primary_magic)) != 0) {
+        unsigned long long empty[2] = {0, 0};
+        if (std::memcmp(data, empty, sizeof(empty)) != 0) {
+            std::cerr << "Error: Invalid primary index file." << std::endl;
+            return 1;
+        }
+        if (this->file.resize(primary_header_size + primary_initial_capacity * primary_slot_size) != 0) return 1;
+        data = this->file.get_data();
+        unsigned long long capacity = primary_initial_capacity;
+        std::memcpy(data, primary_magic, sizeof(primary_magic));
+        std::memcpy(data + primary_capacity_offset, &capacity, sizeof(capacity));
+    }
+    return 0;
+}
+
+int primary_index::set(unsigned long long id, const document_location &location) {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+
+    // Grow the table by doubling it until the id fits.
+    unsigned long long capacity = this->capacity();
+    if (id >= capacity) {
+        while (id >= capacity) capacity *= 2;
+        if (this->file.resize(primary_header_size + capacity * primary_slot_size) != 0) return 1;
+        std::memcpy(this->file.get_data() + primary_capacity_offset, &capacity, sizeof(capacity));
+    }
+
+    char *s = this->slot(id);
+    unsigned int previous_length;
+    std::memcpy(&previous_length, s + 12, sizeof(previous_length));
+
+    std::memcpy(s, &location.offset, sizeof(location.offset));
+    std::memcpy(s + 8, &location.segment, sizeof(location.segment));
+    std::memcpy(s + 12, &location.length, sizeof(location.length));
+
+    if ((previous_length == 0) != (location.length == 0)) {
+        unsigned long long size;
+        std::memcpy(&size, this->file.get_data() + primary_size_offset, sizeof(size));
+        size = location.length == 0 ? size - 1 : size + 1;
+        std::memcpy(this->file.get_data() + primary_size_offset, &size, sizeof(size));
+    }
+    return 0;
+}
+
+void primary_index::erase(unsigned long long id) {
+    {
+        std::shared_lock<std::shared_mutex> shared(this->lock);
+        if (id >= this->capacity()) return;
+    }
+    this->set(id, {0, 0, 0});
+}
+
+bool primary_index::find(unsigned long long id, document_location &location) const {
+    std::shared_lock<std::shared_mutex> shared(this->lock);
+
+    if (id >= this->capacity()) return false;
+
+    const char *s = this->slot(id);
+    std::memcpy(&location.offset, s, sizeof(location.offset));
+    std::memcpy(&location.segment, s + 8, sizeof(location.segment));
+    std::memcpy(&location.length, s + 12, sizeof(location.length));
+    return location.length != 0;
+}
+
+bool primary_index::contains(unsigned long long id) const {
+    document_location location;
+    return this->find(id, location);
+}
+
+unsigned long long primary_index::size() const {
+    std::shared_lock<std::shared_mutex> shared(this->lock);
+
+    unsigned long long size;
+    std::memcpy(&size, this->file.get_data() + primary_size_offset, sizeof(size));
+    return size;
+}
+
+void primary_index::for_each(const std::function<void(unsigned long long id, const document_location &location)> &visit) const {
+    std::shared_lock<std::shared_mutex> shared(this->lock);
+
+    unsigned long long capacity = this->capacity();
+    for (unsigned long long id = 0; id < capacity; id++) {
+        const char *s = this->slot(id);
+        document_location location;
+        std::memcpy(&location.length, s + 12, sizeof(location.length));
+        if (location.length == 0) continue;
+        std::memcpy(&location.offset, s, sizeof(location.offset));
+        std::memcpy(&location.segment, s + 8, sizeof(location.segment));
+        visit(id, location);
+    }
+}
+
+int primary_index::clear() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+
+    if (this->file.resize(primary_header_size + primary_initial_capacity * primary_slot_size) != 0) return 1;
+    char *data = this->file.get_data();
+    std::memset(data + primary_header_size, 0, primary_initial_capacity * primary_slot_size);
+    unsigned long long capacity = primary_initial_capacity, size = 0;
+    std::memcpy(data + primary_capacity_offset, &capacity, sizeof(capacity));
+    std::memcpy(data + primary_size_offset, &size, sizeof(size));
+    return 0;
+}
+
+int primary_index::sync() {
+    std::shared_lock<std::shared_mutex> shared(this->lock);
+    return this->file.sync();
+}
+
+void primary_index::close() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    this->file.close();
+}
@@ -0,0 +1,130 @@
+/**
+ * @file primary_index.hpp
+ */
+#ifndef PRIMARY_INDEX_CLASS_H
+#define PRIMARY_INDEX_CLASS_H
+
+#include "mapped_file.hpp"
+#include <string>
+#include <functional>
+#include <shared_mutex>
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @brief Location of a document.
+     * With SEGMENT_STORAGE it is the segment, the offset inside the segment and the length of the document.
+     * With HASHED_STORAGE the offset holds the hash of the id that names the document file.
+     * A length of zero means there is no document.
+     */
+    struct document_location {
+        unsigned int segment;
+        unsigned long long offset;
+        unsigned int length;
+    };
+
+    /**
+     * @class primary_index
+     * @brief Dense, memory-mapped table from document id to document location. Slot i holds the location of the document with id i.
+     */
+    class primary_index {
+    private:
+        /**
+         * @brief The table file.
+         */
+        mapped_file file;
+
+        /**
+         * @brief Lookups run in parallel, growing the table remaps it and needs exclusive access.
+         */
+        mutable std::shared_mutex lock;
+
+        /**
+         * @brief Gets the number of slots in the table.
+         */
+        unsigned long long capacity() const;
+
+        /**
+         * @param id Id of the document.
+         * @brief Gets a pointer to the slot of a document. The id must be smaller than the capacity.
+         */
+        char *slot(unsigned long long id) const;
+
+    public:
+
+        /**
+         * @param path Path to the table file.
+         * @brief Constructor for the primary_index class.
+         */
+        primary_index(const std::string &path);
+
+        /**
+         * @brief Opens the table, creating an empty one if it doesn't exist.
+         * @return 0 on success and 1 otherwise.
+         */
+        int open();
+
+        /**
+         * @param id Id of the document.
+         * @param location Location of the document.
+         * @brief Sets the location of a document, growing the table if needed.
+         * @return 0 on success and 1 otherwise.
+         */
+        int set(unsigned long long id, const document_location &location);
+
+        /**
+         * @param id Id of the document.
+         * @brief Removes a document from the table.
+         */
+        void erase(unsigned long long id);
+
+        /**
+         * @param id Id of the document.
+         * @param location Destination of the location.
+         * @brief Looks up the location of a document.
+         * @return True if the document exists and false otherwise.
+         */
+        bool find(unsigned long long id, document_location &location) const;
+
+        /**
+         * @param id Id of the document.
+         * @brief Checks if a document exists.
+         */
+        bool contains(unsigned long long id) const;
+
+        /**
+         * @brief Gets the number of documents in the table.
+         */
+        unsigned long long size() const;
+
+        /**
+         * @param visit Function called with the id and location of every document, in id order.
+         * @brief Iterates over every document in the table.
+         */
+        void for_each(const std::function<void(unsigned long long id, const document_location &location)> &visit) const;
+
+        /**
+         * @brief Removes every document from the table.
+         * @return 0 on success and 1 otherwise.
+         */
+        int clear();
+
+        /**
+         * @brief Writes the table to the disk.
+         * @return 0 on success and 1 otherwise.
+         */
+        int sync();
+
+        /**
+         * @brief Closes the table.
+         */
+        void close();
+    };
+
+} // namespace nosqlite
+
+#endif
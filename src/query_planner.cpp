@@ -0,0 +1,230 @@
+#include "query_planner.hpp"
+#include "auxiliary.hpp"
+#include "btree_index.hpp"
+#include <algorithm>
+#include <json.hpp>
+
+using namespace nosqlite;
+using json = nlohmann::json;
+
+// Relative costs. Reading a document in a scan of segments is sequential, fetching one by id is a random read in either layout.
+static const double hashed_scan_cost = 1.0;
+static const double segment_scan_cost = 0.5;
+static const double fetch_cost = 1.0;
+
+// Reading an id from a posting and looking up a key, per type of index. Bitmaps are looked up in memory and combined a container at a time.
+static const double entry_cost = 0.01;
+
+/**
+ * @brief Gets the cost of one lookup in an index.
+ */
+static double lookup_cost(index_type type) {
+    if (type == HASH_INDEX) return 0.5;
+    if (type == BITMAP_INDEX) return 0.05;
+    if (type == TRIGRAM_INDEX) return 0.5;
+    if (type == TEXT_INDEX) return 2.0;
+    return 1.0;
+}
+
+/**
+ * @brief Gets the name of an access path.
+ */
+static std::string access_path_to_string(query_plan::access_path path) {
+    if (path == query_plan::ZONE_MAP_SCAN) return "zone_map_scan";
+    if (path == query_plan::INDEX_SCAN) return "index_scan";
+    if (path == query_plan::INDEX_INTERSECTION) return "index_intersection";
+    return "full_scan";
+}
+
+/**
+ * @brief Estimates the number of ids an index returns for the conditions it covers and the cost of getting them.
+ */
+static void estimate_access(index_access &access, const std::vector<condition_type> &conditions, const collection_statistics &statistics, unsigned long long documents) {
+    std::vector<condition_type> covered;
+    for (size_t i : access.covered) covered.push_back(conditions[i]);
+    access.rows = documents * statistics.selectivity(covered);
+
+    // With every field of a compound index in the prefix, the average posting is a better estimate than assuming the fields are independent.
+    std::vector<field_type> fields = access.index->get_fields();
+    const index_statistics *postings = statistics.get_index(build_index_name(fields, access.index->get_type()));
+    if (fields.size() > 1 && access.prefix.size() == fields.size() && postings != nullptr && postings->keys > 0) {
+        access.rows = std::min<double>(documents, (double) access.lookups() * postings->entries / postings->keys);
+    }
+
+    access.cost = access.lookups() * lookup_cost(access.index->get_type()) + access.rows * entry_cost;
+}
+
+
+bool index_access::ordered() const {
+    return !this->text.is_null() || this->geo_op == "near";
+}
+
+unsigned long long index_access::lookups() const {
+    unsigned long long combinations = this->prefix.empty() ? 0 : 1;
+    for (const std::vector<json> &values : this->prefix) combinations *= values.size();
+    return std::max<unsigned long long>(1, combinations + this->patterns.size() + this->excluded.size());
+}
+
+query_profile::query_profile() : started(std::chrono::steady_clock::now()), mark(started) {}
+
+void query_profile::end_stage(const std::string &name) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    this->stages.push_back({name, std::chrono::duration<double, std::milli>(now - this->mark).count()});
+    this->mark = now;
+}
+
+json query_profile::to_json() const {
+    json stages = json::array();
+    for (const auto &[name, milliseconds] : this->stages) stages.push_back({{"stage", name}, {"milliseconds", milliseconds}});
+    return {
+        {"files_opened", this->files_opened.load()}, {"bytes_read", this->bytes_read.load()}, {"documents_parsed", this->documents_parsed.load()},
+        {"predicate_evaluations", this->predicate_evaluations.load()}, {"index_lookups", this->index_lookups.load()}, {"index_entries", this->index_entries.load()},
+        {"results", this->results}, {"stages", stages}, {"milliseconds", std::chrono::duration<double, std::milli>(this->mark - this->started).count()}
+    };
+}
+
+json query_plan::to_json() const {
+    json indexes = json::array();
+    for (const index_access &access : this->accesses) {
+        indexes.push_back({{"index", build_index_name(access.index->get_fields(), access.index->get_type())}, {"conditions", access.covered}, {"rows", access.rows}, {"cost", access.cost}});
+    }
+    json plan = {{"path", access_path_to_string(this->path)}, {"indexes", indexes}, {"rows", this->rows}, {"cost", this->cost}, {"full_scan_cost", this->full_scan_cost}};
+    if (this->zone_map_scan_cost >= 0) plan["zone_map_scan_cost"] = this->zone_map_scan_cost;
+    return plan;
+}
+
+std::vector<json> nosqlite::accepted_values(const condition_type &condition) {
+    if (condition.op == "==") return {condition.value};
+    if (condition.op == "in" && condition.value.is_array()) return condition.value.get<std::vector<json>>();
+    return {};
+}
+
+index_access nosqlite::plan_access(secondary_index *index, const std::vector<condition_type> &conditions) {
+    index_access access;
+    access.index = index;
+    std::vector<field_type> fields = index->get_fields();
+
+    // The longest prefix of the indexed fields with an equality or "in" condition on each. The index has to be able to look up every value, an empty list needs no lookups.
+    while (access.prefix.size() < fields.size()) {
+        size_t found = conditions.size();
+        for (size_t i = 0; i < conditions.size() && found == conditions.size(); i++) {
+            if (conditions[i].field != fields[access.prefix.size()] || (conditions[i].op != "==" && conditions[i].op != "in")) continue;
+            std::vector<json> values = accepted_values(conditions[i]);
+            bool supported = true;
+            for (const json &value : values) supported = supported && index->supports("==", value);
+            if (!supported) continue;
+            found = i;
+            access.prefix.push_back(values);
+        }
+        if (found == conditions.size()) break;
+        access.covered.push_back(found);
+    }
+
+    // Combine the range conditions on the next field into a single range. Bounds are inclusive, the conditions are checked on the documents.
+    // When a document had an array in the field, a lower and an upper bound can be met by different elements, so only the bounds on the side of the first range condition are used.
+    if (access.prefix.size() < fields.size()) {
+        bool multikey = index->get_type() == BTREE_INDEX && static_cast<btree_index*>(index)->multikey(access.prefix.size());
+        for (size_t i = 0; i < conditions.size(); i++) {
+            const auto &[field_path, op, target_value] = conditions[i];
+            if (field_path != fields[access.prefix.size()] || op == "==" || op == "in" || !index->supports(op, target_value)) continue;
+            if ((op == ">" || op == ">=") && (!multikey || access.upper.is_null()) && (access.lower.is_null() || target_value > access.lower)) access.lower = target_value;
+            else if ((op == "<" || op == "<=") && (!multikey || access.lower.is_null()) && (access.upper.is_null() || target_value < access.upper)) access.upper = target_value;
+            else continue;
+            access.covered.push_back(i);
+        }
+    }
+
+    // Inequalities on the first field, only bitmap indexes answer them.
+    for (size_t i = 0; i < conditions.size(); i++) {
+        const auto &[field_path, op, target_value] = conditions[i];
+        if (op != "!=" || field_path != fields[0] || !index->supports(op, target_value)) continue;
+        access.excluded.push_back(target_value);
+        access.covered.push_back(i);
+    }
+
+    // The first "text" condition on the field is searched, any other one is checked on the documents.
+    for (size_t i = 0; i < conditions.size() && access.text.is_null(); i++) {
+        const auto &[field_path, op, target_value] = conditions[i];
+        if (op != "text" || field_path != fields[0] || !index->supports(op, target_value)) continue;
+        access.text = target_value;
+        access.covered.push_back(i);
+    }
+
+    // Substring, prefix and regular expression conditions on the field, every one the index can narrow down.
+    for (size_t i = 0; i < conditions.size(); i++) {
+        const auto &[field_path, op, target_value] = conditions[i];
+        if ((op != "contains" && op != "prefix" && op != "regex") || field_path != fields[0] || !index->supports(op, target_value)) continue;
+        access.patterns.push_back({op, target_value.get<std::string>()});
+        access.covered.push_back(i);
+    }
+
+    // The first geospatial condition on the field is searched, "near" before "within_box" so the documents come closest first.
+    for (const char *geo_op : {"near", "within_box"}) {
+        for (size_t i = 0; i < conditions.size() && access.geo.is_null(); i++) {
+            const auto &[field_path, op, target_value] = conditions[i];
+            if (op != geo_op || field_path != fields[0] || !index->supports(op, target_value)) continue;
+            access.geo_op = op;
+            access.geo = target_value;
+            access.covered.push_back(i);
+        }
+    }
+    return access;
+}
+
+query_plan nosqlite::choose_plan(const std::vector<secondary_index*> &indexes, const std::vector<condition_type> &conditions, const collection_statistics &statistics, unsigned long long documents, storage_type storage, double zone_fraction) {
+    query_plan plan;
+    double scan_cost = storage == SEGMENT_STORAGE ? segment_scan_cost : hashed_scan_cost;
+    plan.full_scan_cost = documents * scan_cost;
+    plan.rows = documents;
+    plan.cost = plan.full_scan_cost;
+    if (zone_fraction >= 0) {
+        plan.zone_map_scan_cost = documents * zone_fraction * scan_cost;
+        if (plan.zone_map_scan_cost < plan.cost) {
+            plan.path = query_plan::ZONE_MAP_SCAN;
+            plan.rows = documents * zone_fraction;
+            plan.cost = plan.zone_map_scan_cost;
+        }
+    }
+
+    std::vector<index_access> accesses;
+    for (secondary_index *index : indexes) {
+        index_access access = plan_access(index, conditions);
+        if (access.covered.empty()) continue;
+        estimate_access(access, conditions, statistics, documents);
+        accesses.push_back(access);
+    }
+    if (accesses.empty()) return plan;
+
+    // The index that drives the query is the one with the cheapest documents to fetch, unless a search has to keep its order. The others are tried from the cheapest.
+    auto total_cost = [](const index_access &access) { return access.cost + access.rows * fetch_cost; };
+    std::stable_sort(accesses.begin(), accesses.end(), [&](const index_access &a, const index_access &b) {
+        if (a.ordered() != b.ordered()) return a.ordered();
+        return total_cost(a) < total_cost(b);
+    });
+    std::stable_sort(accesses.begin() + 1, accesses.end(), [](const index_access &a, const index_access &b) { return a.cost < b.cost; });
+
+    // Another index is used when the documents it rules out (assuming it's independent of the ones before it) cost more to fetch than its lookups.
+    std::vector<bool> covered(conditions.size(), false);
+    std::vector<index_access> chosen;
+    double rows = 0, cost = 0;
+    for (const index_access &access : accesses) {
+        bool useful = false;
+        for (size_t i : access.covered) useful = useful || !covered[i];
+        if (!useful) continue;
+
+        double kept = documents > 0 ? access.rows / documents : 0;
+        if (!chosen.empty() && access.cost >= rows * (1 - kept) * fetch_cost) continue;
+        for (size_t i : access.covered) covered[i] = true;
+        rows = chosen.empty() ? access.rows : rows * kept;
+        cost += access.cost;
+        chosen.push_back(access);
+    }
+    cost += rows * fetch_cost;
+
+    if (cost >= plan.cost && !chosen[0].ordered()) return plan;
+    plan.path = chosen.size() > 1 ? query_plan::INDEX_INTERSECTION : query_plan::INDEX_SCAN;
+    plan.accesses = std::move(chosen);
+    plan.rows = rows;
+    plan.cost = cost;
+    return plan;
+}
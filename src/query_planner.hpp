@@ -0,0 +1,131 @@
+/**
+ * @file query_planner.hpp
+ */
+#ifndef QUERY_PLANNER_H
+#define QUERY_PLANNER_H
+
+#include "secondary_index.hpp"
+#include "statistics.hpp"
+#include "auxiliary.hpp"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <json.hpp>
+using json = nlohmann::json;
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @brief How an index answers part of the conditions of a query: the values looked up for a prefix of its fields, a range on the next field, the values excluded by inequalities, the text searched, the substring, prefix and regular expression conditions, the geospatial condition and the conditions it covers.
+     * The planner adds the estimated number of ids it returns and the cost of getting them.
+     */
+    struct index_access {
+        secondary_index *index = nullptr;
+        std::vector<std::vector<json>> prefix;
+        json lower, upper;
+        json text;
+        std::string geo_op;
+        json geo;
+        std::vector<std::pair<std::string, std::string>> patterns;
+        std::vector<json> excluded;
+        std::vector<size_t> covered;
+        double rows = 0;
+        double cost = 0;
+
+        /**
+         * @brief Checks if the ids come in an order the results keep: ranked for text searches and closest first for "near".
+         */
+        bool ordered() const;
+
+        /**
+         * @brief Gets the number of keys looked up: each combination of the prefix values, each pattern and each inequality. Ranges and searches are one lookup.
+         */
+        unsigned long long lookups() const;
+    };
+
+    /**
+     * @brief Plan of a query: how the candidate documents are found, the accesses used (the first one gives the order of the candidates), the estimated number of documents read and the estimated cost, and the costs of scanning the collection for comparison.
+     * Costs are in units of reading one document in a scan of a collection with HASHED_STORAGE.
+     */
+    struct query_plan {
+        enum access_path {FULL_SCAN, ZONE_MAP_SCAN, INDEX_SCAN, INDEX_INTERSECTION};
+        access_path path = FULL_SCAN;
+        std::vector<index_access> accesses;
+        double rows = 0;
+        double cost = 0;
+        double full_scan_cost = 0;
+        double zone_map_scan_cost = -1;
+
+        /**
+         * @brief Gets the plan as JSON, for inspection.
+         */
+        json to_json() const;
+    };
+
+    /**
+     * @brief Counters and timings of a query run by EXPLAIN ANALYZE, with the plan it ran. The counters are updated by the threads that read the documents.
+     * Each stage is timed from the end of the one before it.
+     */
+    struct query_profile {
+        std::atomic<unsigned long long> files_opened{0};
+        std::atomic<unsigned long long> bytes_read{0};
+        std::atomic<unsigned long long> documents_parsed{0};
+        std::atomic<unsigned long long> predicate_evaluations{0};
+        std::atomic<unsigned long long> index_lookups{0};
+        std::atomic<unsigned long long> index_entries{0};
+        unsigned long long results = 0;
+        json plan;
+        std::vector<std::pair<std::string, double>> stages;
+        std::chrono::steady_clock::time_point started, mark;
+
+        /**
+         * @brief Constructor for the query_profile struct, starts timing the first stage.
+         */
+        query_profile();
+
+        /**
+         * @param name Name of the stage.
+         * @brief Records the time since the end of the previous stage.
+         */
+        void end_stage(const std::string &name);
+
+        /**
+         * @brief Gets the counters and the time of each stage, in milliseconds, as JSON.
+         */
+        json to_json() const;
+    };
+
+    /**
+     * @param condition Condition.
+     * @brief Gets the values a condition accepts for its field: the value for equality and the elements of the list for "in". Other operators accept none.
+     */
+    std::vector<json> accepted_values(const condition_type &condition);
+
+    /**
+     * @param index Index.
+     * @param conditions Conditions of the query.
+     * @brief Works out how much of the conditions an index can answer. Indexes that can't answer any cover none.
+     */
+    index_access plan_access(secondary_index *index, const std::vector<condition_type> &conditions);
+
+    /**
+     * @param indexes Indexes of the collection.
+     * @param conditions Conditions of the query.
+     * @param statistics Statistics of the collection, empty before the first ANALYZE.
+     * @param documents Number of documents in the collection.
+     * @param storage Layout in which the documents are stored.
+     * @param zone_fraction Fraction of the zones a scan reads with the zone map, negative if it doesn't apply to the conditions.
+     * @brief Picks the cheapest way to find the documents that satisfy the conditions. Every index is costed by the documents it returns, estimated from the statistics, and the cheapest one drives the query.
+     * Other indexes are intersected with it while the documents they rule out save more than they cost. The result is compared with scanning the collection, with and without the zone map.
+     * Text and "near" searches always drive the query so the documents keep their ranking or come closest first.
+     */
+    query_plan choose_plan(const std::vector<secondary_index*> &indexes, const std::vector<condition_type> &conditions, const collection_statistics &statistics, unsigned long long documents, storage_type storage, double zone_fraction);
+
+}
+
+#endif
@@ -0,0 +1,202 @@
+#include "result_sorter.hpp"
+#include "predicate.hpp"
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <json.hpp>
+#include <omp.h>
+#include <unistd.h>
+
+using namespace nosqlite;
+using json = nlohmann::json;
+
+// Memory taken by a field of an object besides its key and value: the node of the map.
+static const size_t object_field_overhead = 48;
+
+std::atomic<unsigned long long> result_sorter::files_created{0};
+
+/**
+ * @brief Gets the position of the type of a value in the sort order.
+ */
+static int type_rank(const json &value) {
+    switch (value.type()) {
+        case json::value_t::boolean:
+            return 1;
+        case json::value_t::number_integer:
+        case json::value_t::number_unsigned:
+        case json::value_t::number_float:
+            return 2;
+        case json::value_t::string:
+            return 3;
+        case json::value_t::object:
+            return 4;
+        case json::value_t::array:
+            return 5;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Estimates the memory taken by a value: the value itself, its strings and, for objects and arrays, every field and element.
+ */
+static size_t approximate_size(const json &value) {
+    size_t size = sizeof(json);
+    if (value.is_string()) size += value.get_ref<const std::string&>().size();
+    else if (value.is_object()) {
+        for (auto field = value.begin(); field != value.end(); ++field) size += object_field_overhead + field.key().size() + approximate_size(field.value());
+    } else if (value.is_array()) {
+        for (const json &element : value) size += approximate_size(element);
+    }
+    return size;
+}
+
+
+result_sorter::result_sorter(const std::vector<sort_key> &order, size_t kept, size_t memory)
+    : order(order), kept(kept), buffers(get_max_threads()), buffered_bytes(buffers.size(), 0), runs(buffers.size()), finished(false) {
+    this->thread_memory = memory / this->buffers.size();
+}
+
+result_sorter::~result_sorter() {
+    this->sources.clear();
+    for (const std::vector<fs::path> &thread_runs : this->runs) {
+        for (const fs::path &run : thread_runs) {
+            std::error_code error;
+            fs::remove(run, error);
+        }
+    }
+}
+
+std::vector<json> result_sorter::sort_values(const json &document) const {
+    std::vector<json> values;
+    for (const sort_key &key : this->order) {
+        const json *value = predicate::resolve(document, key.field);
+        values.push_back(value != nullptr ? *value : json());
+    }
+    return values;
+}
+
+int result_sorter::compare(const json &a, const json &b) {
+    int a_rank = type_rank(a), b_rank = type_rank(b);
+    if (a_rank != b_rank) return a_rank < b_rank ? -1 : 1;
+    if (a < b) return -1;
+    return b < a ? 1 : 0;
+}
+
+bool result_sorter::before(const entry &a, const entry &b) const {
+    for (size_t i = 0; i < this->order.size(); i++) {
+        int comparison = compare(a.keys[i], b.keys[i]);
+        if (comparison != 0) return this->order[i].descending ? comparison > 0 : comparison < 0;
+    }
+    return a.id < b.id;
+}
+
+void result_sorter::spill(int thread_num) {
+    std::vector<entry> &buffer = this->buffers[thread_num];
+    std::error_code error;
+    fs::path run = fs::temp_directory_path(error) / ("nosqlite-sort-" + std::to_string(getpid()) + "-" + std::to_string(files_created++) + ".jsonl");
+
+    // Without a run the documents stay in memory, the thread tries again once it has as many more.
+    std::ofstream file;
+    if (!error) file.open(run);
+    if (!file.is_open()) {
+        std::cerr << "Error: Failed to write the temporary file \"" << run.string() << "\" of a sort, its documents are kept in memory." << std::endl;
+        this->buffered_bytes[thread_num] = 0;
+        return;
+    }
+    std::sort(buffer.begin(), buffer.end(), [this](const entry &a, const entry &b) { return this->before(a, b); });
+    for (const entry &sorted : buffer) file << sorted.document.dump() << '\n';
+    file.close();
+    if (!file) {
+        std::cerr << "Error: Failed to write the temporary file \"" << run.string() << "\" of a sort, its documents are kept in memory." << std::endl;
+        fs::remove(run, error);
+        this->buffered_bytes[thread_num] = 0;
+        return;
+    }
+    this->runs[thread_num].push_back(run);
+    buffer.clear();
+    this->buffered_bytes[thread_num] = 0;
+}
+
+bool result_sorter::advance(source &next) const {
+    if (!next.file.is_open()) {
+        if (next.position == next.entries.size()) return false;
+        next.head = std::move(next.entries[next.position++]);
+        return true;
+    }
+
+    std::string line;
+    if (!std::getline(next.file, line)) return false;
+    next.head.document = json::parse(line);
+    next.head.keys = this->sort_values(next.head.document);
+    next.head.id = next.head.document.value("id", 0ULL);
+    return true;
+}
+
+void result_sorter::add(const json &document, int thread_num) {
+    entry added;
+    added.keys = this->sort_values(document);
+    added.id = document.is_object() ? document.value("id", 0ULL) : 0;
+    std::vector<entry> &buffer = this->buffers[thread_num];
+    auto in_order = [this](const entry &a, const entry &b) { return this->before(a, b); };
+
+    // The heap has the worst document kept on top, a document that comes after it isn't copied.
+    if (this->kept > 0) {
+        if (buffer.size() == this->kept) {
+            if (!this->before(added, buffer.front())) return;
+            std::pop_heap(buffer.begin(), buffer.end(), in_order);
+            buffer.pop_back();
+        }
+        added.document = document;
+        buffer.push_back(std::move(added));
+        std::push_heap(buffer.begin(), buffer.end(), in_order);
+        return;
+    }
+
+    this->buffered_bytes[thread_num] += approximate_size(document);
+    added.document = document;
+    buffer.push_back(std::move(added));
+    if (this->buffered_bytes[thread_num] > this->thread_memory) this->spill(thread_num);
+}
+
+void result_sorter::finish() {
+    if (this->finished) return;
+    this->finished = true;
+    #pragma omp parallel for
+    for (int i = 0; i < this->buffers.size(); i++) {
+        std::sort(this->buffers[i].begin(), this->buffers[i].end(), [this](const entry &a, const entry &b) { return this->before(a, b); });
+    }
+
+    for (std::vector<entry> &buffer : this->buffers) {
+        if (buffer.empty()) continue;
+        this->sources.push_back(std::make_unique<source>());
+        this->sources.back()->entries = std::move(buffer);
+    }
+    for (const std::vector<fs::path> &thread_runs : this->runs) {
+        for (const fs::path &run : thread_runs) {
+            this->sources.push_back(std::make_unique<source>());
+            this->sources.back()->file.open(run);
+        }
+    }
+    this->buffers.clear();
+
+    for (size_t i = 0; i < this->sources.size(); i++) {
+        if (this->advance(*this->sources[i])) this->heap.push_back(i);
+    }
+    std::make_heap(this->heap.begin(), this->heap.end(), [this](size_t a, size_t b) { return this->before(this->sources[b]->head, this->sources[a]->head); });
+}
+
+bool result_sorter::read(std::vector<json> &found, size_t count) {
+    this->finish();
+    auto after = [this](size_t a, size_t b) { return this->before(this->sources[b]->head, this->sources[a]->head); };
+    while (count > 0 && !this->heap.empty()) {
+        std::pop_heap(this->heap.begin(), this->heap.end(), after);
+        source &next = *this->sources[this->heap.back()];
+        found.push_back(std::move(next.head.document));
+        count--;
+        if (this->advance(next)) std::push_heap(this->heap.begin(), this->heap.end(), after);
+        else this->heap.pop_back();
+    }
+    return !this->heap.empty();
+}
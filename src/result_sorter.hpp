@@ -0,0 +1,165 @@
+/**
+ * @file result_sorter.hpp
+ */
+#ifndef RESULT_SORTER_CLASS_H
+#define RESULT_SORTER_CLASS_H
+
+#include "auxiliary.hpp"
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include <json.hpp>
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @class result_sorter
+     * @brief Sorts the results of a read as the threads of the read add them. Documents are ordered by the value of each key in turn and then by id. Values of different types are ordered null (and missing fields), booleans, numbers, strings, objects and arrays,
+     * descending keys reverse the order of their values.
+     * With a number of documents kept, each thread keeps its best ones in a bounded heap. Otherwise each thread sorts its documents on its own and writes them to a temporary file (a run) whenever its share of the memory budget is full.
+     * The sorted documents of the threads and the runs are then merged as they are read. Temporary files are removed with the sorter.
+     */
+    class result_sorter {
+    private:
+
+        /**
+         * @brief Document with the values of its sort keys.
+         */
+        struct entry {
+            std::vector<json> keys;
+            unsigned long long id = 0;
+            json document;
+        };
+
+        /**
+         * @brief Sorted documents merged: the ones a thread kept in memory or a run in a file, with the next document.
+         */
+        struct source {
+            std::vector<entry> entries;
+            size_t position = 0;
+            std::ifstream file;
+            entry head;
+        };
+
+        /**
+         * @brief Keys the documents are sorted by.
+         */
+        std::vector<sort_key> order;
+
+        /**
+         * @brief Number of documents kept, 0 for all of them.
+         */
+        size_t kept;
+
+        /**
+         * @brief Bytes of documents each thread keeps in memory before it writes them to a run.
+         */
+        size_t thread_memory;
+
+        /**
+         * @brief Documents of each thread and their estimated size in bytes.
+         */
+        std::vector<std::vector<entry>> buffers;
+        std::vector<size_t> buffered_bytes;
+
+        /**
+         * @brief Runs written by each thread.
+         */
+        std::vector<std::vector<fs::path>> runs;
+
+        /**
+         * @brief Sources of the merge, a heap of the ones with documents left (the next document first) and if the merge started.
+         */
+        std::vector<std::unique_ptr<source>> sources;
+        std::vector<size_t> heap;
+        bool finished;
+
+        /**
+         * @brief Number of temporary files created by the process, for their names.
+         */
+        static std::atomic<unsigned long long> files_created;
+
+        /**
+         * @param document Document.
+         * @brief Gets the values of the sort keys of a document, null for missing fields.
+         */
+        std::vector<json> sort_values(const json &document) const;
+
+        /**
+         * @param a First document.
+         * @param b Second document.
+         * @brief Checks if a document comes before another one.
+         */
+        bool before(const entry &a, const entry &b) const;
+
+        /**
+         * @param thread_num Number of the thread.
+         * @brief Sorts the documents of a thread and writes them to a new run.
+         */
+        void spill(int thread_num);
+
+        /**
+         * @param next Source of the merge.
+         * @brief Moves to the next document of a source.
+         * @return False if it has no more.
+         */
+        bool advance(source &next) const;
+
+    public:
+
+        /**
+         * @param order Keys the documents are sorted by.
+         * @param kept Number of documents kept, the first ones in order. 0 keeps all of them.
+         * @param memory Bytes of documents kept in memory, shared between the threads.
+         * @brief Constructor for the result_sorter class.
+         */
+        result_sorter(const std::vector<sort_key> &order, size_t kept, size_t memory);
+
+        /**
+         * @brief Destructor for the result_sorter class, removes the runs.
+         */
+        ~result_sorter();
+
+        /**
+         * @param a First value.
+         * @param b Second value.
+         * @brief Compares two values in the sort order of ascending keys.
+         * @return -1 if the first one comes first, 1 if the second one does and 0 if they are equal.
+         */
+        static int compare(const json &a, const json &b);
+
+        result_sorter(const result_sorter&) = delete;
+        result_sorter &operator=(const result_sorter&) = delete;
+
+        /**
+         * @param document Document.
+         * @param thread_num Number of the thread that adds it.
+         * @brief Adds a document. Threads can add documents at the same time, each with its own number.
+         */
+        void add(const json &document, int thread_num);
+
+        /**
+         * @brief Sorts the documents of every thread, in parallel, and starts the merge. No documents can be added afterwards.
+         */
+        void finish();
+
+        /**
+         * @param found Destination of the documents.
+         * @param count Most documents read.
+         * @brief Reads the next documents in order, finishing the sort the first time.
+         * @return False if there are no more.
+         */
+        bool read(std::vector<json> &found, size_t count);
+    };
+
+}
+
+#endif
@@ -0,0 +1,289 @@
+#include "roaring_bitmap.hpp"
+#include <algorithm>
+#include <cstring>
+
+using namespace nosqlite;
+
+static const unsigned int roaring_array_limit = 4096;
+static const size_t roaring_words = 65536 / 64;
+
+template <typename T> static void append(std::string &out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T> static bool take(const char *&at, const char *end, T &value) {
+    if (end - at < (long) sizeof(T)) return false;
+    std::memcpy(&value, at, sizeof(T));
+    at += sizeof(T);
+    return true;
+}
+
+/**
+ * @brief Checks if a container has the low bits of an id.
+ */
+template <typename C> static bool container_contains(const C &c, uint16_t low) {
+    if (c.is_bitmap()) return (c.bits[low >> 6] >> (low & 63)) & 1;
+    return std::binary_search(c.array.begin(), c.array.end(), low);
+}
+
+
+size_t roaring_bitmap::find_container(unsigned long long key) const {
+    auto it = std::lower_bound(this->containers.begin(), this->containers.end(), key, [](const container &c, unsigned long long k) {
+        return c.key < k;
+    });
+    return it - this->containers.begin();
+}
+
+void roaring_bitmap::normalize(container &c) {
+    if (!c.is_bitmap() && c.cardinality > roaring_array_limit) {
+        c.bits.assign(roaring_words, 0);
+        for (uint16_t low : c.array) c.bits[low >> 6] |= 1ULL << (low & 63);
+        c.array.clear();
+        c.array.shrink_to_fit();
+    }
+    else if (c.is_bitmap() && c.cardinality <= roaring_array_limit) {
+        c = from_words(c.key, c.bits);
+    }
+}
+
+std::vector<uint64_t> roaring_bitmap::to_words(const container &c) {
+    if (c.is_bitmap()) return c.bits;
+    std::vector<uint64_t> words(roaring_words, 0);
+    for (uint16_t low : c.array) words[low >> 6] |= 1ULL << (low & 63);
+    return words;
+}
+
+roaring_bitmap::container roaring_bitmap::from_words(unsigned long long key, const std::vector<uint64_t> &words) {
+    container c = {key, {}, {}, 0};
+    for (uint64_t word : words) c.cardinality += __builtin_popcountll(word);
+
+    if (c.cardinality > roaring_array_limit) {
+        c.bits = words;
+        return c;
+    }
+
+    c.array.reserve(c.cardinality);
+    for (size_t w = 0; w < words.size(); w++) {
+        for (uint64_t word = words[w]; word != 0; word &= word - 1) {
+            c.array.push_back((uint16_t) (w * 64 + __builtin_ctzll(word)));
+        }
+    }
+    return c;
+}
+
+void roaring_bitmap::add(unsigned long long id) {
+    unsigned long long key = id >> 16;
+    uint16_t low = (uint16_t) (id & 0xffff);
+
+    size_t position = this->find_container(key);
+    if (position == this->containers.size() || this->containers[position].key != key) {
+        this->containers.insert(this->containers.begin() + position, container{key, {low}, {}, 1});
+        return;
+    }
+
+    container &c = this->containers[position];
+    if (c.is_bitmap()) {
+        uint64_t &word = c.bits[low >> 6];
+        if ((word >> (low & 63)) & 1) return;
+        word |= 1ULL << (low & 63);
+    }
+    else {
+        auto it = std::lower_bound(c.array.begin(), c.array.end(), low);
+        if (it != c.array.end() && *it == low) return;
+        c.array.insert(it, low);
+    }
+    c.cardinality++;
+    normalize(c);
+}
+
+void roaring_bitmap::remove(unsigned long long id) {
+    unsigned long long key = id >> 16;
+    uint16_t low = (uint16_t) (id & 0xffff);
+
+    size_t position = this->find_container(key);
+    if (position == this->containers.size() || this->containers[position].key != key) return;
+
+    container &c = this->containers[position];
+    if (c.is_bitmap()) {
+        uint64_t &word = c.bits[low >> 6];
+        if (!((word >> (low & 63)) & 1)) return;
+        word &= ~(1ULL << (low & 63));
+    }
+    else {
+        auto it = std::lower_bound(c.array.begin(), c.array.end(), low);
+        if (it == c.array.end() || *it != low) return;
+        c.array.erase(it);
+    }
+    c.cardinality--;
+
+    if (c.cardinality == 0) this->containers.erase(this->containers.begin() + position);
+    else normalize(c);
+}
+
+bool roaring_bitmap::contains(unsigned long long id) const {
+    size_t position = this->find_container(id >> 16);
+    if (position == this->containers.size() || this->containers[position].key != (id >> 16)) return false;
+    return container_contains(this->containers[position], (uint16_t) (id & 0xffff));
+}
+
+unsigned long long roaring_bitmap::cardinality() const {
+    unsigned long long total = 0;
+    for (const container &c : this->containers) total += c.cardinality;
+    return total;
+}
+
+bool roaring_bitmap::empty() const {
+    return this->containers.empty();
+}
+
+roaring_bitmap roaring_bitmap::intersect(const roaring_bitmap &other) const {
+    roaring_bitmap result;
+    size_t i = 0, j = 0;
+
+    while (i < this->containers.size() && j < other.containers.size()) {
+        const container &a = this->containers[i], &b = other.containers[j];
+        if (a.key < b.key) { i++; continue; }
+        if (b.key < a.key) { j++; continue; }
+
+        container c = {a.key, {}, {}, 0};
+        if (!a.is_bitmap() || !b.is_bitmap()) {
+            // An array is filtered by the other container, the result is never larger than the array.
+            const container &small = a.is_bitmap() ? b : a, &large = a.is_bitmap() ? a : b;
+            for (uint16_t low : small.array) {
+                if (container_contains(large, low)) c.array.push_back(low);
+            }
+            c.cardinality = c.array.size();
+        }
+        else {
+            std::vector<uint64_t> words(roaring_words);
+            for (size_t w = 0; w < roaring_words; w++) words[w] = a.bits[w] & b.bits[w];
+            c = from_words(a.key, words);
+        }
+
+        if (c.cardinality > 0) result.containers.push_back(std::move(c));
+        i++;
+        j++;
+    }
+    return result;
+}
+
+roaring_bitmap roaring_bitmap::unite(const roaring_bitmap &other) const {
+    roaring_bitmap result;
+    size_t i = 0, j = 0;
+
+    while (i < this->containers.size() || j < other.containers.size()) {
+        if (j == other.containers.size() || (i < this->containers.size() && this->containers[i].key < other.containers[j].key)) {
+            result.containers.push_back(this->containers[i++]);
+            continue;
+        }
+        if (i == this->containers.size() || other.containers[j].key < this->containers[i].key) {
+            result.containers.push_back(other.containers[j++]);
+            continue;
+        }
+
+        const container &a = this->containers[i], &b = other.containers[j];
+        container c = {a.key, {}, {}, 0};
+        if (!a.is_bitmap() && !b.is_bitmap()) {
+            std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), std::back_inserter(c.array));
+            c.cardinality = c.array.size();
+            normalize(c);
+        }
+        else {
+            std::vector<uint64_t> words = to_words(a);
+            std::vector<uint64_t> other_words = to_words(b);
+            for (size_t w = 0; w < roaring_words; w++) words[w] |= other_words[w];
+            c = from_words(a.key, words);
+        }
+
+        result.containers.push_back(std::move(c));
+        i++;
+        j++;
+    }
+    return result;
+}
+
+roaring_bitmap roaring_bitmap::subtract(const roaring_bitmap &other) const {
+    roaring_bitmap result;
+    size_t j = 0;
+
+    for (const container &a : this->containers) {
+        while (j < other.containers.size() && other.containers[j].key < a.key) j++;
+        if (j == other.containers.size() || other.containers[j].key != a.key) {
+            result.containers.push_back(a);
+            continue;
+        }
+
+        const container &b = other.containers[j];
+        container c = {a.key, {}, {}, 0};
+        if (!a.is_bitmap()) {
+            for (uint16_t low : a.array) {
+                if (!container_contains(b, low)) c.array.push_back(low);
+            }
+            c.cardinality = c.array.size();
+        }
+        else {
+            std::vector<uint64_t> words = a.bits;
+            std::vector<uint64_t> other_words = to_words(b);
+            for (size_t w = 0; w < roaring_words; w++) words[w] &= ~other_words[w];
+            c = from_words(a.key, words);
+        }
+
+        if (c.cardinality > 0) result.containers.push_back(std::move(c));
+    }
+    return result;
+}
+
+std::vector<unsigned long long> roaring_bitmap::to_vector() const {
+    std::vector<unsigned long long> ids;
+    ids.reserve(this->cardinality());
+
+    for (const container &c : this->containers) {
+        unsigned long long high = c.key << 16;
+        if (!c.is_bitmap()) {
+            for (uint16_t low : c.array) ids.push_back(high | low);
+            continue;
+        }
+        for (size_t w = 0; w < roaring_words; w++) {
+            for (uint64_t word = c.bits[w]; word != 0; word &= word - 1) ids.push_back(high | (w * 64 + __builtin_ctzll(word)));
+        }
+    }
+    return ids;
+}
+
+void roaring_bitmap::serialize(std::string &out) const {
+    // Number of containers, then the key, cardinality and ids of each one. Arrays are written as they are, bitmaps as their words.
+    append<unsigned long long>(out, this->containers.size());
+    for (const container &c : this->containers) {
+        append<unsigned long long>(out, c.key);
+        append<unsigned int>(out, c.cardinality);
+        if (c.is_bitmap()) out.append(reinterpret_cast<const char*>(c.bits.data()), roaring_words * sizeof(uint64_t));
+        else out.append(reinterpret_cast<const char*>(c.array.data()), c.array.size() * sizeof(uint16_t));
+    }
+}
+
+int roaring_bitmap::deserialize(const char *&at, const char *end) {
+    this->containers.clear();
+
+    unsigned long long count;
+    if (!take(at, end, count)) return 1;
+
+    for (unsigned long long i = 0; i < count; i++) {
+        container c = {0, {}, {}, 0};
+        if (!take(at, end, c.key) || !take(at, end, c.cardinality) || c.cardinality == 0 || c.cardinality > 65536) return 1;
+
+        // The cardinality tells which form the container was written in.
+        size_t bytes = c.cardinality > roaring_array_limit ? roaring_words * sizeof(uint64_t) : c.cardinality * sizeof(uint16_t);
+        if ((size_t) (end - at) < bytes) return 1;
+        if (c.cardinality > roaring_array_limit) {
+            c.bits.resize(roaring_words);
+            std::memcpy(c.bits.data(), at, bytes);
+        }
+        else {
+            c.array.resize(c.cardinality);
+            std::memcpy(c.array.data(), at, bytes);
+        }
+        at += bytes;
+        this->containers.push_back(std::move(c));
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+/**
+ * @file roaring_bitmap.hpp
+ */
+#ifndef ROARING_BITMAP_CLASS_H
+#define ROARING_BITMAP_CLASS_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @class roaring_bitmap
+     * @brief Compressed set of document ids. The ids are split in chunks of 65536 by their high bits and each chunk is a container:
+     * a sorted array of the low 16 bits while it has at most 4096 ids, a plain bitmap of 65536 bits otherwise.
+     */
+    class roaring_bitmap {
+    private:
+
+        /**
+         * @brief Ids of a chunk. Exactly one of array and bits is in use.
+         */
+        struct container {
+            unsigned long long key;
+            std::vector<uint16_t> array;
+            std::vector<uint64_t> bits;
+            unsigned int cardinality;
+
+            bool is_bitmap() const { return !bits.empty(); }
+        };
+
+        /**
+         * @brief Containers sorted by key. Empty containers are removed.
+         */
+        std::vector<container> containers;
+
+        /**
+         * @param key High bits of the ids.
+         * @brief Finds the position of the container with the key, or where it would be inserted.
+         */
+        size_t find_container(unsigned long long key) const;
+
+        /**
+         * @param c Container to convert.
+         * @brief Turns an array container into a bitmap once it grows past 4096 ids and a bitmap into an array once it shrinks to 4096.
+         */
+        static void normalize(container &c);
+
+        /**
+         * @param c Container.
+         * @brief Gets the ids of a container as bitmap words.
+         */
+        static std::vector<uint64_t> to_words(const container &c);
+
+        /**
+         * @param key High bits of the ids.
+         * @param words Bitmap of the chunk.
+         * @brief Builds a container from bitmap words, in the smallest form.
+         */
+        static container from_words(unsigned long long key, const std::vector<uint64_t> &words);
+
+    public:
+
+        /**
+         * @param id Id to add.
+         * @brief Adds an id to the set.
+         */
+        void add(unsigned long long id);
+
+        /**
+         * @param id Id to remove.
+         * @brief Removes an id from the set.
+         */
+        void remove(unsigned long long id);
+
+        /**
+         * @param id Id to look for.
+         * @brief Checks if the set has the id.
+         */
+        bool contains(unsigned long long id) const;
+
+        /**
+         * @brief Gets the number of ids in the set.
+         */
+        unsigned long long cardinality() const;
+
+        /**
+         * @brief Checks if the set is empty.
+         */
+        bool empty() const;
+
+        /**
+         * @param other The other set.
+         * @brief Gets the ids in both sets.
+         */
+        roaring_bitmap intersect(const roaring_bitmap &other) const;
+
+        /**
+         * @param other The other set.
+         * @brief Gets the ids in any of the sets.
+         */
+        roaring_bitmap unite(const roaring_bitmap &other) const;
+
+        /**
+         * @param other The other set.
+         * @brief Gets the ids in this set that are not in the other one.
+         */
+        roaring_bitmap subtract(const roaring_bitmap &other) const;
+
+        /**
+         * @brief Gets the ids in the set, sorted.
+         */
+        std::vector<unsigned long long> to_vector() const;
+
+        /**
+         * @param out Destination of the serialized set.
+         * @brief Appends the set to a binary buffer.
+         */
+        void serialize(std::string &out) const;
+
+        /**
+         * @param at Start of the serialized set, moved past it.
+         * @param end End of the buffer.
+         * @brief Reads a set written by serialize.
+         * @return 0 on success and 1 if the buffer is truncated or invalid.
+         */
+        int deserialize(const char *&at, const char *end);
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,71 @@
+#include "secondary_index.hpp"
+#include "auxiliary.hpp"
+#include <fstream>
+#include <filesystem>
+#include <json.hpp>
+
+using namespace nosqlite;
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+
+/**
+ * @brief Gets the value of a field of a document. Documents without the field have null.
+ * The document is walked in place, only the value of the field is copied.
+ */
+static json field_value(const json &document, const field_type &field) {
+    const json *value = &document;
+    for (const std::string &name : field) {
+        if (!value->is_object()) return nullptr;
+        auto it = value->find(name);
+        if (it == value->end()) return nullptr;
+        value = &*it;
+    }
+    return *value;
+}
+
+
+secondary_index::secondary_index(const std::string &path, const std::vector<field_type> &fields) : path(path), fields(fields), parallel_processing(true) {}
+
+std::string secondary_index::get_path() const {
+    return this->path;
+}
+
+std::string secondary_index::get_field() const {
+    return get_last_dir(this->path);
+}
+
+std::vector<field_type> secondary_index::get_fields() const {
+    return this->fields;
+}
+
+void secondary_index::set_parallel_processing(bool parallel_processing) {
+    this->parallel_processing = parallel_processing;
+}
+
+json secondary_index::extract(const json &document) const {
+    if (this->fields.size() == 1) return field_value(document, this->fields[0]);
+
+    json values = json::array();
+    for (const field_type &field : this->fields) values.push_back(field_value(document, field));
+    return values;
+}
+
+int secondary_index::reset_directory() const {
+
+    // Delete everything from the directory where the index will be stored if it exists, else create it.
+    fs::path path_to_index(this->path);
+    if (fs::exists(path_to_index))
+        for (const fs::path &entry : fs::directory_iterator(path_to_index))
+            fs::remove_all(entry);
+    else fs::create_directories(path_to_index);
+
+    std::ofstream meta(path_to_index / "meta.json");
+    if (!meta.is_open()) {
+        throw_failed_to_create_file(path_to_index / "meta.json");
+        return 1;
+    }
+    meta << json({{"type", index_type_to_string(this->get_type())}, {"fields", this->fields}}) << std::endl;
+    meta.close();
+    return 0;
+}
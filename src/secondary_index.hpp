@@ -0,0 +1,149 @@
+/**
+ * @file secondary_index.hpp
+ */
+#ifndef SECONDARY_INDEX_CLASS_H
+#define SECONDARY_INDEX_CLASS_H
+
+#include <string>
+#include <vector>
+#include <json.hpp>
+#include "auxiliary.hpp"
+using json = nlohmann::json;
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @class secondary_index
+     * @brief Index from the values of one or more fields to the ids of the documents with them. Every index lives in its own directory with a meta.json file describing it.
+     * The indexed value of a document is the value of the field, or an array with the value of each field for compound indexes.
+     */
+    class secondary_index {
+    protected:
+
+        /**
+         * @brief Doubles as the path to the index files and the name of the index.
+         */
+        std::string path;
+
+        /**
+         * @brief Indexed fields, in order.
+         */
+        std::vector<field_type> fields;
+
+        /**
+         * @brief Whether building the index may use several threads, set by the collection.
+         */
+        bool parallel_processing;
+
+        /**
+         * @brief Deletes everything in the index directory, creating it if needed, and writes the meta.json file.
+         * @return 0 on success and 1 otherwise.
+         */
+        int reset_directory() const;
+
+    public:
+
+        /**
+         * @param path Path to the index.
+         * @param fields Indexed fields.
+         * @brief Constructor for the secondary_index class.
+         */
+        secondary_index(const std::string &path, const std::vector<field_type> &fields);
+
+        /**
+         * @brief Destructor for the secondary_index class.
+         */
+        virtual ~secondary_index() = default;
+
+        /**
+         * @brief Gets the structure of the index.
+         */
+        virtual index_type get_type() const = 0;
+
+        /**
+         * @brief Opens an index that already exists in the file system.
+         * @return 0 on success and 1 otherwise.
+         */
+        virtual int open() = 0;
+
+        /**
+         * @param entries Pairs of indexed value and id of the document with that value.
+         * @brief Builds the index from scratch.
+         * @return 0 on success and 1 otherwise.
+         */
+        virtual int build_index(const std::vector<std::pair<json, unsigned long long>> &entries) = 0;
+
+        /**
+         * @param op Comparison operator.
+         * @param value Value compared against.
+         * @brief Checks if the index can find the documents that satisfy a condition.
+         */
+        virtual bool supports(const std::string &op, const json &value) const = 0;
+
+        /**
+         * @param value Value of the indexed field.
+         * @brief Consults the index to get the ids of the documents that may have the value. Conditions must still be checked on the documents.
+         */
+        virtual std::vector<unsigned long long> consult(const json &value) const = 0;
+
+        /**
+         * @param new_value New indexed value.
+         * @param id Id of the document.
+         * @brief Adds the document to the index.
+         */
+        virtual void update_index(const json &new_value, unsigned long long id) = 0;
+
+        /**
+         * @param value Indexed value.
+         * @param id Id of the document.
+         * @brief Removes the document from the index.
+         */
+        virtual void remove_from_index(const json &value, unsigned long long id) = 0;
+
+        /**
+         * @brief Writes the index to the disk.
+         * @return 0 on success and 1 otherwise.
+         */
+        virtual int sync() = 0;
+
+        /**
+         * @brief Deletes this index.
+         */
+        virtual void delete_index() = 0;
+
+        /**
+         * @brief Getter for the path attribute.
+         */
+        std::string get_path() const;
+
+        /**
+         * @brief Getter for the index name derived from the path attribute.
+         */
+        std::string get_field() const;
+
+        /**
+         * @brief Getter for the indexed fields.
+         */
+        std::vector<field_type> get_fields() const;
+
+        /**
+         * @param parallel_processing Whether building the index may use several threads.
+         * @brief Setter for the parallel_processing attribute.
+         */
+        void set_parallel_processing(bool parallel_processing);
+
+        /**
+         * @param document Document to index.
+         * @brief Gets the indexed value of a document. Missing fields have the value null.
+         */
+        json extract(const json &document) const;
+
+    };
+
+}
+
+#endif
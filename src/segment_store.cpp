@@ -0,0 +1,223 @@
+#include "segment_store.hpp"
+#include "auxiliary.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <json.hpp>
+
+using namespace nosqlite;
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+segment_store::segment_store(const std::string &path, primary_index *locations) : path(path), locations(locations), active_segment(0), active_size(0), unsynced_segment(0), unsynced(false), segment_created(false) {}
+
+fs::path segment_store::segment_path(unsigned int segment) const {
+    std::stringstream name;
+    name << "segment_" << std::setw(6) << std::setfill('0') << segment << ".seg";
+    return fs::path(this->path) / name.str();
+}
+
+int segment_store::open_files() {
+    if (this->segment_file.is_open()) this->segment_file.close();
+
+    this->segment_file.open(this->segment_path(this->active_segment), std::ios::binary | std::ios::app);
+    if (!this->segment_file.is_open()) {
+        throw_failed_to_open_file(this->segment_path(this->active_segment));
+        return 1;
+    }
+    return 0;
+}
+
+int segment_store::create() {
+    fs::path store_path(this->path);
+    if (fs::exists(store_path)) fs::remove_all(store_path);
+    fs::create_directories(store_path);
+
+    if (this->locations->clear() != 0) return 1;
+    this->active_segment = 0;
+    this->active_size = 0;
+    this->unsynced = false;
+    this->segment_created = true;
+    return this->open_files();
+}
+
+int segment_store::open() {
+    if (check_path_existence(this->path) != 0) return 1;
+
+    // The active segment is the last one in the directory.
+    this->active_segment = 0;
+    for (const fs::path &entry : fs::directory_iterator(this->path)) {
+        if (entry.extension() != ".seg") continue;
+        unsigned int segment = std::stoul(entry.stem().string().substr(std::string("segment_").size()));
+        this->active_segment = std::max(this->active_segment, segment);
+    }
+    fs::path active = this->segment_path(this->active_segment);
+    this->active_size = fs::exists(active) ? fs::file_size(active) : 0;
+    this->unsynced = false;
+    this->segment_created = !fs::exists(active);
+
+    return this->open_files();
+}
+
+int segment_store::append(const json &document) {
+    if (!document.contains("id")) {
+        std::cerr << "Error: Cannot store a document without an id." << std::endl;
+        return 1;
+    }
+    unsigned long long id = document["id"];
+    std::string content = document.dump();
+    content.push_back('\n');
+
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    // Start a new segment once the active one is full.
+    if (this->active_size > 0 && this->active_size + content.size() > max_segment_size) {
+        this->active_segment++;
+        this->active_size = 0;
+        this->segment_created = true;
+        if (this->open_files() != 0) return 1;
+    }
+    if (!this->unsynced) {
+        this->unsynced_segment = this->active_segment;
+        this->unsynced = true;
+    }
+
+    document_location location = {this->active_segment, this->active_size, (unsigned int) content.size()};
+    this->segment_file.write(content.data(), content.size());
+    this->segment_file.flush();
+    if (!this->segment_file) {
+        std::cerr << "Error: Failed to write to segment: " << this->segment_path(this->active_segment) << "." << std::endl;
+        return 1;
+    }
+    this->active_size += content.size();
+
+    return this->locations->set(id, location);
+}
+
+int segment_store::sync() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    if (!this->unsynced) return 0;
+
+    // The appends were flushed to the files, every segment written since the last sync is forced to the disk.
+    for (unsigned int segment = this->unsynced_segment; segment <= this->active_segment; segment++) {
+        if (sync_file(this->segment_path(segment)) != 0) return 1;
+    }
+    if (this->segment_created && sync_file(this->path) != 0) return 1;
+    this->unsynced = false;
+    this->segment_created = false;
+    return 0;
+}
+
+int segment_store::remove(unsigned long long id) {
+    if (!this->locations->contains(id)) return 1;
+    this->locations->erase(id);
+    return 0;
+}
+
+json segment_store::read(unsigned long long id) const {
+    document_location location;
+    if (!this->locations->find(id, location)) return json();
+
+    fs::path segment = this->segment_path(location.segment);
+    std::ifstream file(segment, std::ios::binary);
+    if (!file.is_open()) {
+        throw_failed_to_open_file(segment);
+        return json();
+    }
+
+    std::string content(location.length, '\0');
+    file.seekg(location.offset);
+    file.read(&content[0], location.length);
+    file.close();
+
+    return read_and_parse_json(content);
+}
+
+int segment_store::read_raw(const std::vector<unsigned long long> &ids, std::vector<std::string> &contents) const {
+    contents.assign(ids.size(), std::string());
+
+    // Positions of the ids sorted by segment and offset.
+    std::vector<std::pair<document_location, size_t>> wanted;
+    wanted.reserve(ids.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+        document_location location;
+        if (this->locations->find(ids[i], location)) wanted.push_back({location, i});
+    }
+    std::sort(wanted.begin(), wanted.end(), [](const auto &a, const auto &b) {
+        return a.first.segment != b.first.segment ? a.first.segment < b.first.segment : a.first.offset < b.first.offset;
+    });
+
+    std::ifstream file;
+    unsigned int open_segment = 0;
+    for (const auto &[location, i] : wanted) {
+        if (!file.is_open() || location.segment != open_segment) {
+            if (file.is_open()) file.close();
+            fs::path segment = this->segment_path(location.segment);
+            file.open(segment, std::ios::binary);
+            if (!file.is_open()) {
+                throw_failed_to_open_file(segment);
+                return 1;
+            }
+            open_segment = location.segment;
+        }
+
+        contents[i].resize(location.length);
+        file.seekg(location.offset);
+        file.read(&contents[i][0], location.length);
+    }
+    return 0;
+}
+
+bool segment_store::contains(unsigned long long id) const {
+    return this->locations->contains(id);
+}
+
+unsigned long long segment_store::size() const {
+    return this->locations->size();
+}
+
+std::vector<unsigned int> segment_store::get_segments() const {
+    std::vector<unsigned int> segments;
+    for (unsigned int segment = 0; segment <= this->active_segment; segment++) {
+        if (fs::exists(this->segment_path(segment))) segments.push_back(segment);
+    }
+    return segments;
+}
+
+std::vector<std::vector<document_location>> segment_store::live_records() const {
+    std::vector<std::vector<document_location>> records;
+    this->locations->for_each([&](unsigned long long, const document_location &location) {
+        if (location.segment >= records.size()) records.resize(location.segment + 1);
+        records[location.segment].push_back(location);
+    });
+    for (std::vector<document_location> &segment_records : records) {
+        std::sort(segment_records.begin(), segment_records.end(), [](const document_location &a, const document_location &b) {
+            return a.offset < b.offset;
+        });
+    }
+    return records;
+}
+
+int segment_store::read_segment(unsigned int segment, std::string &buffer) const {
+    fs::path segment_file_path = this->segment_path(segment);
+    std::ifstream file(segment_file_path, std::ios::binary);
+    if (!file.is_open()) {
+        throw_failed_to_open_file(segment_file_path);
+        return 1;
+    }
+
+    file.seekg(0, std::ios::end);
+    buffer.resize(file.tellg());
+    file.seekg(0, std::ios::beg);
+    file.read(&buffer[0], buffer.size());
+    file.close();
+
+    return 0;
+}
+
+void segment_store::delete_store() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    if (this->segment_file.is_open()) this->segment_file.close();
+    fs::remove_all(this->path);
+}
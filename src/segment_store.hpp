@@ -0,0 +1,176 @@
+/**
+ * @file segment_store.hpp
+ */
+#ifndef SEGMENT_STORE_CLASS_H
+#define SEGMENT_STORE_CLASS_H
+
+#include "auxiliary.hpp"
+#include "primary_index.hpp"
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+#include <json.hpp>
+using json = nlohmann::json;
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @class segment_store
+     * @brief Append-only document storage. Documents are appended to large segment files and found through an id to location table.
+     */
+    class segment_store {
+    private:
+        /**
+         * @brief Path to the directory with the segment files.
+         */
+        std::string path;
+
+        /**
+         * @brief Location of the most recent version of every live document. Owned by the collection.
+         */
+        primary_index *locations;
+
+        /**
+         * @brief Number of the segment currently being appended to.
+         */
+        unsigned int active_segment;
+
+        /**
+         * @brief Size in bytes of the active segment.
+         */
+        unsigned long long active_size;
+
+        /**
+         * @brief Open handle to the active segment.
+         */
+        std::ofstream segment_file;
+
+        /**
+         * @brief First segment written to since the last sync and if a segment was created since then.
+         */
+        unsigned int unsynced_segment;
+        bool unsynced;
+        bool segment_created;
+
+        /**
+         * @brief Serializes appends.
+         */
+        std::mutex lock;
+
+        /**
+         * @param segment Number of the segment.
+         * @brief Builds the path to a segment file.
+         */
+        fs::path segment_path(unsigned int segment) const;
+
+        /**
+         * @brief Opens the active segment for appending.
+         * @return 0 on success and 1 otherwise.
+         */
+        int open_files();
+
+    public:
+
+        /**
+         * @brief Maximum size of a segment file before a new one is started.
+         */
+        static const unsigned long long max_segment_size = 64ULL * 1024 * 1024;
+
+        /**
+         * @param path Path to the directory with the segment files.
+         * @param locations Table with the location of every document.
+         * @brief Constructor for the segment_store class.
+         */
+        segment_store(const std::string &path, primary_index *locations);
+
+        /**
+         * @brief Creates an empty store, deleting any segment files already in the directory.
+         * @return 0 on success and 1 otherwise.
+         */
+        int create();
+
+        /**
+         * @brief Opens an existing store.
+         * @return 0 on success and 1 otherwise.
+         */
+        int open();
+
+        /**
+         * @param document Document to append, must have an "id" field.
+         * @brief Appends a document to the active segment. If a document with the same id exists it is superseded.
+         * @return 0 on success and 1 otherwise.
+         */
+        int append(const json &document);
+
+        /**
+         * @brief Forces the documents appended since the last sync to the disk, and the directory if a segment was created.
+         * @return 0 on success and 1 otherwise.
+         */
+        int sync();
+
+        /**
+         * @param id Id of the document to remove.
+         * @brief Removes a document from the location table. The bytes stay in the segment.
+         * @return 0 on success and 1 otherwise.
+         */
+        int remove(unsigned long long id);
+
+        /**
+         * @param id Id of the document.
+         * @brief Reads a single document.
+         * @return The document or null if it doesn't exist.
+         */
+        json read(unsigned long long id) const;
+
+        /**
+         * @param ids Ids of the documents.
+         * @param contents Destination of the raw JSON of each document, in the order of the ids. Empty for documents that don't exist.
+         * @brief Reads several documents, opening each segment once and reading its documents in the order they are stored.
+         * @return 0 on success and 1 otherwise.
+         */
+        int read_raw(const std::vector<unsigned long long> &ids, std::vector<std::string> &contents) const;
+
+        /**
+         * @param id Id of the document.
+         * @brief Checks if a document is stored.
+         */
+        bool contains(unsigned long long id) const;
+
+        /**
+         * @brief Gets the number of live documents.
+         */
+        unsigned long long size() const;
+
+        /**
+         * @brief Gets the numbers of all segments, in order.
+         */
+        std::vector<unsigned int> get_segments() const;
+
+        /**
+         * @brief Gets the locations of the live documents of every segment, sorted by offset, with a single pass over the location table.
+         * @return A vector with the locations of the documents of each segment, by number of segment.
+         */
+        std::vector<std::vector<document_location>> live_records() const;
+
+        /**
+         * @param segment Number of the segment.
+         * @param buffer Destination of the raw contents of the segment file.
+         * @brief Reads a whole segment sequentially.
+         * @return 0 on success and 1 otherwise.
+         */
+        int read_segment(unsigned int segment, std::string &buffer) const;
+
+        /**
+         * @brief Deletes the store from the file system.
+         */
+        void delete_store();
+    };
+
+} // namespace nosqlite
+
+#endif
@@ -0,0 +1,280 @@
+#include "statistics.hpp"
+#include "auxiliary.hpp"
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <filesystem>
+#include <json.hpp>
+
+using namespace nosqlite;
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+/**
+ * @brief Hashes a value as its canonical JSON, so numbers that compare equal have the same hash.
+ */
+static uint64_t value_hash(const json &value) {
+    return std::hash<std::string>()(canonical_dump(value));
+}
+
+/**
+ * @brief Collects the values compared by conditions on a field: the value itself or, for arrays, their elements at any depth.
+ */
+static void collect_leaves(const json &value, std::vector<const json*> &leaves) {
+    if (!value.is_array()) {
+        leaves.push_back(&value);
+        return;
+    }
+    for (const json &element : value) collect_leaves(element, leaves);
+}
+
+/**
+ * @brief Gets the fraction of the numbers of a histogram below a value, interpolating within the bucket.
+ */
+static double histogram_fraction(const std::vector<double> &bounds, double value) {
+    if (value <= bounds.front()) return 0;
+    if (value >= bounds.back()) return 1;
+    size_t bucket = std::upper_bound(bounds.begin(), bounds.end(), value) - bounds.begin() - 1;
+    double width = bounds[bucket + 1] - bounds[bucket];
+    double within = width > 0 ? (value - bounds[bucket]) / width : 0;
+    return (bucket + within) / (bounds.size() - 1);
+}
+
+
+void statistics_collector::add_document(const json &document) {
+    this->documents++;
+    field_type path;
+    for (auto it = document.begin(); it != document.end(); ++it) {
+        path.push_back(it.key());
+        this->add_value(path, it.value());
+        path.pop_back();
+    }
+}
+
+void statistics_collector::add_value(field_type &path, const json &value) {
+    if (value.is_object()) {
+        for (auto it = value.begin(); it != value.end(); ++it) {
+            path.push_back(it.key());
+            this->add_value(path, it.value());
+            path.pop_back();
+        }
+        return;
+    }
+    if (value.is_null()) return;
+    if (this->fields.size() >= max_fields && this->fields.find(path) == this->fields.end()) return;
+
+    std::vector<const json*> leaves;
+    collect_leaves(value, leaves);
+    if (leaves.empty()) return;
+
+    // Each distinct value counts once per document, like a key in a posting list.
+    field_accumulator &accumulator = this->fields[path];
+    accumulator.present++;
+    std::vector<uint64_t> seen;
+    for (const json *leaf : leaves) {
+        uint64_t hash = value_hash(*leaf);
+        if (std::find(seen.begin(), seen.end(), hash) != seen.end()) continue;
+        seen.push_back(hash);
+
+        auto &[count, sample] = accumulator.frequencies[hash];
+        if (count++ == 0) sample = *leaf;
+        if (leaf->is_number()) accumulator.numbers.push_back(leaf->get<double>());
+    }
+}
+
+void statistics_collector::add_index_keys(const std::string &name, const json &value, bool by_element) {
+    std::vector<const json*> leaves;
+    if (by_element) collect_leaves(value, leaves);
+    else leaves.push_back(&value);
+
+    std::vector<uint64_t> seen;
+    for (const json *leaf : leaves) {
+        uint64_t hash = value_hash(*leaf);
+        if (std::find(seen.begin(), seen.end(), hash) != seen.end()) continue;
+        seen.push_back(hash);
+        this->index_keys[name][hash]++;
+    }
+}
+
+
+collection_statistics::collection_statistics() : documents(0) {}
+
+collection_statistics::collection_statistics(std::vector<statistics_collector> &collectors) : documents(0) {
+    std::map<field_type, statistics_collector::field_accumulator> merged;
+    std::map<std::string, std::unordered_map<uint64_t, unsigned long long>> merged_keys;
+    for (statistics_collector &collector : collectors) {
+        this->documents += collector.documents;
+        for (auto &[path, accumulator] : collector.fields) {
+            statistics_collector::field_accumulator &target = merged[path];
+            target.present += accumulator.present;
+            for (auto &[hash, frequency] : accumulator.frequencies) {
+                auto &[count, sample] = target.frequencies[hash];
+                if (count == 0) sample = std::move(frequency.second);
+                count += frequency.first;
+            }
+            target.numbers.insert(target.numbers.end(), accumulator.numbers.begin(), accumulator.numbers.end());
+        }
+        for (auto &[name, keys] : collector.index_keys) {
+            for (const auto &[hash, count] : keys) merged_keys[name][hash] += count;
+        }
+    }
+
+    for (auto &[path, accumulator] : merged) {
+        field_statistics &statistics = this->fields[path];
+        statistics.present = accumulator.present;
+        statistics.distinct = accumulator.frequencies.size();
+
+        // Values in a single document aren't common.
+        std::vector<std::pair<unsigned long long, const json*>> counts;
+        for (const auto &[hash, frequency] : accumulator.frequencies) {
+            if (frequency.first > 1) counts.push_back({frequency.first, &frequency.second});
+        }
+        size_t kept = std::min(counts.size(), most_common_values);
+        std::partial_sort(counts.begin(), counts.begin() + kept, counts.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+        for (size_t i = 0; i < kept; i++) statistics.most_common.push_back({*counts[i].second, counts[i].first});
+
+        // The bounds split the numbers in buckets with the same number of values.
+        std::vector<double> &numbers = accumulator.numbers;
+        statistics.numbers = numbers.size();
+        if (!numbers.empty()) {
+            std::sort(numbers.begin(), numbers.end());
+            size_t buckets = std::min(histogram_buckets, numbers.size());
+            for (size_t i = 0; i <= buckets; i++) statistics.histogram.push_back(numbers[i * (numbers.size() - 1) / buckets]);
+        }
+    }
+
+    for (const auto &[name, keys] : merged_keys) {
+        index_statistics &statistics = this->indexes[name];
+        statistics.keys = keys.size();
+        for (const auto &[hash, count] : keys) {
+            statistics.entries += count;
+            statistics.longest = std::max(statistics.longest, count);
+        }
+    }
+}
+
+bool collection_statistics::empty() const {
+    return this->fields.empty();
+}
+
+const index_statistics *collection_statistics::get_index(const std::string &name) const {
+    auto found = this->indexes.find(name);
+    return found == this->indexes.end() ? nullptr : &found->second;
+}
+
+double collection_statistics::equality_selectivity(const field_type &field, const json &value) const {
+    auto found = this->fields.find(field);
+    if (found == this->fields.end() || this->documents == 0) return default_equality;
+    const field_statistics &statistics = found->second;
+
+    // Missing fields compare as null.
+    if (value.is_null()) return 1.0 - (double) statistics.present / this->documents;
+
+    std::string key = canonical_dump(value);
+    unsigned long long common = 0;
+    for (const auto &[common_value, count] : statistics.most_common) {
+        if (canonical_dump(common_value) == key) return (double) count / this->documents;
+        common += count;
+    }
+    if (value.is_number() && !statistics.histogram.empty() && (value.get<double>() < statistics.histogram.front() || value.get<double>() > statistics.histogram.back())) return 0;
+
+    // The other values share the other documents evenly.
+    unsigned long long others = statistics.distinct - std::min<unsigned long long>(statistics.distinct, statistics.most_common.size());
+    if (others == 0 || statistics.present <= common) return 0;
+    return (double) (statistics.present - common) / others / this->documents;
+}
+
+double collection_statistics::range_selectivity(const field_type &field, const json &lower, const json &upper) const {
+    auto found = this->fields.find(field);
+    if (found == this->fields.end() || this->documents == 0) return !lower.is_null() && !upper.is_null() ? default_closed_range : default_range;
+    const field_statistics &statistics = found->second;
+    if (statistics.histogram.empty()) return 0;
+
+    double below_upper = upper.is_null() ? 1 : histogram_fraction(statistics.histogram, upper.get<double>());
+    double below_lower = lower.is_null() ? 0 : histogram_fraction(statistics.histogram, lower.get<double>());
+    double with_numbers = (double) std::min(statistics.present, statistics.numbers) / this->documents;
+    return std::max(0.0, below_upper - below_lower) * with_numbers;
+}
+
+double collection_statistics::selectivity(const std::vector<condition_type> &conditions) const {
+    double result = 1;
+    std::map<field_type, std::pair<json, json>> ranges;
+    for (const auto &[field, op, value] : conditions) {
+        if (op == ">" || op == ">=" || op == "<" || op == "<=") {
+            // Range conditions only match numbers.
+            if (!value.is_number()) return 0;
+            auto &[lower, upper] = ranges[field];
+            if (op[0] == '>' && (lower.is_null() || value > lower)) lower = value;
+            if (op[0] == '<' && (upper.is_null() || value < upper)) upper = value;
+        }
+        else if (op == "==") result *= this->equality_selectivity(field, value);
+        else if (op == "!=") result *= 1.0 - this->equality_selectivity(field, value);
+        else if (op == "in") {
+            double any = 0;
+            if (value.is_array()) {
+                for (const json &element : value) any += this->equality_selectivity(field, element);
+            }
+            result *= std::min(any, 1.0);
+        }
+        else result *= default_match;
+    }
+    for (const auto &[field, bounds] : ranges) result *= this->range_selectivity(field, bounds.first, bounds.second);
+    return std::min(std::max(result, 0.0), 1.0);
+}
+
+json collection_statistics::to_json() const {
+    json fields = json::array();
+    for (const auto &[path, statistics] : this->fields) {
+        json most_common = json::array();
+        for (const auto &[value, count] : statistics.most_common) most_common.push_back({value, count});
+        fields.push_back({{"field", path}, {"present", statistics.present}, {"distinct", statistics.distinct}, {"most_common", most_common}, {"numbers", statistics.numbers}, {"histogram", statistics.histogram}});
+    }
+    json indexes = json::object();
+    for (const auto &[name, statistics] : this->indexes) {
+        indexes[name] = {{"keys", statistics.keys}, {"entries", statistics.entries}, {"longest", statistics.longest}};
+    }
+    return {{"documents", this->documents}, {"fields", fields}, {"indexes", indexes}};
+}
+
+int collection_statistics::load(const std::string &path) {
+    if (!fs::exists(path)) return 1;
+    json content = read_and_parse_json(fs::path(path));
+    collection_statistics loaded;
+    try {
+        loaded.documents = content.at("documents");
+        for (const json &entry : content.at("fields")) {
+            field_statistics &statistics = loaded.fields[entry.at("field").get<field_type>()];
+            statistics.present = entry.at("present");
+            statistics.distinct = entry.at("distinct");
+            for (const json &common : entry.at("most_common")) statistics.most_common.push_back({common.at(0), common.at(1).get<unsigned long long>()});
+            statistics.numbers = entry.at("numbers");
+            statistics.histogram = entry.at("histogram").get<std::vector<double>>();
+        }
+        for (const auto &[name, entry] : content.at("indexes").items()) {
+            loaded.indexes[name] = {entry.at("keys"), entry.at("entries"), entry.at("longest")};
+        }
+    } catch (...) {
+        std::cerr << "Error: Invalid statistics file: " << path << "." << std::endl;
+        return 1;
+    }
+    *this = std::move(loaded);
+    return 0;
+}
+
+int collection_statistics::save(const std::string &path) const {
+    // The new file replaces the old one in a single rename so a crash leaves one of them whole.
+    fs::path temporary = path + ".tmp";
+    std::ofstream file(temporary);
+    if (!file.is_open()) {
+        throw_failed_to_create_file(temporary);
+        return 1;
+    }
+    file << this->to_json() << std::endl;
+    file.close();
+    if (file.fail() || sync_file(temporary) != 0) return 1;
+
+    fs::rename(temporary, path);
+    fs::path directory = fs::path(path).parent_path();
+    return sync_file(directory.empty() ? fs::path(".") : directory);
+}
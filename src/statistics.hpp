@@ -0,0 +1,204 @@
+/**
+ * @file statistics.hpp
+ */
+#ifndef STATISTICS_CLASS_H
+#define STATISTICS_CLASS_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <json.hpp>
+#include "auxiliary.hpp"
+using json = nlohmann::json;
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @brief Statistics of a field: the documents where it has a value that isn't null, the number of distinct values, the most common values with the number of documents that have them
+     * and the bounds of an equi-depth histogram of its numbers. The values of arrays are their elements.
+     */
+    struct field_statistics {
+        unsigned long long present = 0;
+        unsigned long long distinct = 0;
+        std::vector<std::pair<json, unsigned long long>> most_common;
+        unsigned long long numbers = 0;
+        std::vector<double> histogram;
+    };
+
+    /**
+     * @brief Statistics of the posting lists of an index: the number of keys, the number of ids in all of the postings and the length of the longest posting.
+     */
+    struct index_statistics {
+        unsigned long long keys = 0;
+        unsigned long long entries = 0;
+        unsigned long long longest = 0;
+    };
+
+    /**
+     * @class statistics_collector
+     * @brief Accumulates the statistics of the documents read by one thread during an ANALYZE.
+     */
+    class statistics_collector {
+    private:
+
+        /**
+         * @brief Values seen for a field: the documents with each one (by hash, with the value) and every number.
+         */
+        struct field_accumulator {
+            unsigned long long present = 0;
+            std::unordered_map<uint64_t, std::pair<unsigned long long, json>> frequencies;
+            std::vector<double> numbers;
+        };
+
+        unsigned long long documents = 0;
+        std::map<field_type, field_accumulator> fields;
+        std::map<std::string, std::unordered_map<uint64_t, unsigned long long>> index_keys;
+
+        /**
+         * @param path Path of the field.
+         * @param value Value of the field.
+         * @brief Adds the value of a field of a document and, for objects, the values of their fields.
+         */
+        void add_value(field_type &path, const json &value);
+
+        friend class collection_statistics;
+
+    public:
+
+        /**
+         * @brief Maximum number of fields kept, documents with many distinct keys (e.g.: maps) don't use up the memory.
+         */
+        static constexpr size_t max_fields = 1024;
+
+        /**
+         * @param document Document.
+         * @brief Adds the values of every field of a document.
+         */
+        void add_document(const json &document);
+
+        /**
+         * @param name Name of the index.
+         * @param value Indexed value of a document.
+         * @param by_element Indicates whether the index has a key for each element of arrays.
+         * @brief Adds the keys of a document to the postings of an index.
+         */
+        void add_index_keys(const std::string &name, const json &value, bool by_element);
+
+    };
+
+    /**
+     * @class collection_statistics
+     * @brief Statistics of a collection collected by ANALYZE and the estimates of the fraction of the documents that satisfy conditions made from them.
+     * Fields without statistics (or every field, before the first ANALYZE) use fixed estimates. The statistics are kept in statistics.json inside the collection directory.
+     */
+    class collection_statistics {
+    private:
+
+        /**
+         * @brief Number of documents when the statistics were collected.
+         */
+        unsigned long long documents;
+
+        /**
+         * @brief Statistics of each field, by path.
+         */
+        std::map<field_type, field_statistics> fields;
+
+        /**
+         * @brief Statistics of each index, by name.
+         */
+        std::map<std::string, index_statistics> indexes;
+
+        /**
+         * @param field Field.
+         * @param value Value.
+         * @brief Estimates the fraction of the documents where the field has the value.
+         */
+        double equality_selectivity(const field_type &field, const json &value) const;
+
+        /**
+         * @param field Field.
+         * @param lower Lower bound, null if there is none.
+         * @param upper Upper bound, null if there is none.
+         * @brief Estimates the fraction of the documents where the field has a number within the bounds, from the histogram.
+         */
+        double range_selectivity(const field_type &field, const json &lower, const json &upper) const;
+
+    public:
+
+        /**
+         * @brief Number of most common values kept for each field.
+         */
+        static constexpr size_t most_common_values = 16;
+
+        /**
+         * @brief Number of buckets of the histograms.
+         */
+        static constexpr size_t histogram_buckets = 32;
+
+        /**
+         * @brief Fractions of the documents assumed to satisfy conditions on fields without statistics.
+         */
+        static constexpr double default_equality = 0.005;
+        static constexpr double default_range = 1.0 / 3;
+        static constexpr double default_closed_range = 0.005;
+        static constexpr double default_match = 0.01;
+
+        /**
+         * @brief Constructor for the collection_statistics class, without statistics.
+         */
+        collection_statistics();
+
+        /**
+         * @param collectors Statistics accumulated by each thread.
+         * @brief Builds the statistics of a collection from the values accumulated during an ANALYZE.
+         */
+        collection_statistics(std::vector<statistics_collector> &collectors);
+
+        /**
+         * @brief Checks if the statistics have been collected.
+         */
+        bool empty() const;
+
+        /**
+         * @param name Name of the index.
+         * @brief Gets the statistics of an index, nullptr if it has none.
+         */
+        const index_statistics *get_index(const std::string &name) const;
+
+        /**
+         * @param conditions Conditions, all of which must be satisfied.
+         * @brief Estimates the fraction of the documents that satisfy the conditions. Range conditions on the same field are estimated together, conditions on different fields are assumed independent.
+         */
+        double selectivity(const std::vector<condition_type> &conditions) const;
+
+        /**
+         * @brief Gets the statistics as JSON.
+         */
+        json to_json() const;
+
+        /**
+         * @param path Path to the statistics file.
+         * @brief Reads the statistics from a file. A missing or invalid file leaves no statistics.
+         * @return 0 on success and 1 otherwise.
+         */
+        int load(const std::string &path);
+
+        /**
+         * @param path Path to the statistics file.
+         * @brief Writes the statistics to a file.
+         * @return 0 on success and 1 otherwise.
+         */
+        int save(const std::string &path) const;
+
+    };
+
+}
+
+#endif
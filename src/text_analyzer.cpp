@@ -0,0 +1,142 @@
+#include "text_analyzer.hpp"
+#include <algorithm>
+#include <cctype>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace nosqlite {
+
+    // Words skipped by the index and the queries, the English stopwords of most search engines.
+    static const std::unordered_set<std::string> stopwords = {
+        "a", "an", "and", "are", "as", "at", "be", "but", "by", "for", "if", "in", "into", "is", "it", "no", "not", "of",
+        "on", "or", "such", "that", "the", "their", "then", "there", "these", "they", "this", "to", "was", "will", "with"
+    };
+
+    // Elements of an array are this many positions apart so phrases don't match across them.
+    static const unsigned int element_gap = 100;
+
+    /**
+     * @brief Strips plural endings and folds a final "y" or "ie" into "i", so "story" and "stories" are "stori" and "movie" and "movies" are "movi". Short words and words ending in "ss" or "us" keep their "s".
+     */
+    static void stem(std::string &word) {
+        size_t n = word.size();
+        if (n <= 3) return;
+        if (word.compare(n - 3, 3, "ies") == 0 && word[n - 4] != 'e' && word[n - 4] != 'a') word.erase(n - 2);
+        else if (word.compare(n - 2, 2, "es") == 0 && word[n - 3] != 'a' && word[n - 3] != 'e' && word[n - 3] != 'o') word.erase(n - 1);
+        else if (word[n - 1] == 's' && word[n - 2] != 'u' && word[n - 2] != 's') word.erase(n - 1);
+
+        n = word.size();
+        if (n > 3 && word.compare(n - 2, 2, "ie") == 0) word.erase(n - 1);
+        else if (n > 3 && word[n - 1] == 'y' && std::string("aeiou").find(word[n - 2]) == std::string::npos) word[n - 1] = 'i';
+    }
+
+    /**
+     * @brief Analyzes a text into tokens starting at a position.
+     * @return Number of words in the text, stopwords included.
+     */
+    static unsigned int split_words(const std::string &text, unsigned int first_position, std::vector<text_token> &tokens) {
+        unsigned int words = 0;
+        std::string word;
+        for (size_t i = 0; i <= text.size(); i++) {
+            // Letters and digits make words. Bytes of multibyte UTF-8 characters are kept as they are.
+            unsigned char c = i < text.size() ? text[i] : ' ';
+            if (std::isalnum(c) || c >= 0x80) {
+                word.push_back(c < 0x80 ? std::tolower(c) : c);
+                continue;
+            }
+            if (word.empty()) continue;
+            if (stopwords.find(word) == stopwords.end()) {
+                stem(word);
+                tokens.push_back({word, first_position + words});
+            }
+            words++;
+            word.clear();
+        }
+        return words;
+    }
+
+    /**
+     * @brief Analyzes the strings of a value into tokens, moving the position past them.
+     */
+    static void analyze_into(const json &value, std::vector<text_token> &tokens, unsigned int &position) {
+        if (value.is_string()) position += split_words(value.get_ref<const std::string&>(), position, tokens) + element_gap;
+        else if (value.is_array()) {
+            for (const json &element : value) analyze_into(element, tokens, position);
+        }
+    }
+
+    std::vector<text_token> analyze_text(const std::string &text, unsigned int first_position) {
+        std::vector<text_token> tokens;
+        split_words(text, first_position, tokens);
+        return tokens;
+    }
+
+    std::vector<text_token> analyze_value(const json &value) {
+        std::vector<text_token> tokens;
+        unsigned int position = 0;
+        analyze_into(value, tokens, position);
+        return tokens;
+    }
+
+    text_query parse_text_query(const std::string &query) {
+        text_query parsed;
+        std::unordered_set<std::string> seen;
+
+        // The text between each pair of double quotes is a phrase.
+        size_t start = 0;
+        bool quoted = false;
+        while (start <= query.size()) {
+            size_t end = std::min(query.find('"', start), query.size());
+            std::vector<text_token> tokens = analyze_text(query.substr(start, end - start));
+            for (const text_token &token : tokens) {
+                if (seen.insert(token.first).second) parsed.terms.push_back(token.first);
+            }
+            if (quoted && tokens.size() > 1) parsed.phrases.push_back(tokens);
+            quoted = !quoted;
+            start = end + 1;
+        }
+        return parsed;
+    }
+
+    bool phrase_matches(const std::vector<text_token> &phrase, const std::function<const std::vector<unsigned int>*(const std::string &term)> &positions) {
+        std::vector<const std::vector<unsigned int>*> lists;
+        for (const text_token &token : phrase) {
+            lists.push_back(positions(token.first));
+            if (lists.back() == nullptr) return false;
+        }
+
+        for (unsigned int start : *lists[0]) {
+            bool found = true;
+            for (size_t i = 1; i < phrase.size() && found; i++) {
+                unsigned int expected = start + phrase[i].second - phrase[0].second;
+                found = std::binary_search(lists[i]->begin(), lists[i]->end(), expected);
+            }
+            if (found) return true;
+        }
+        return false;
+    }
+
+    bool text_matches(const std::string &text, const std::string &query) {
+        return text_matches(text, parse_text_query(query));
+    }
+
+    bool text_matches(const std::string &text, const text_query &parsed) {
+        if (parsed.terms.empty()) return false;
+
+        std::unordered_map<std::string, std::vector<unsigned int>> positions;
+        for (const text_token &token : analyze_text(text)) positions[token.first].push_back(token.second);
+
+        for (const std::string &term : parsed.terms) {
+            if (positions.find(term) == positions.end()) return false;
+        }
+        for (const std::vector<text_token> &phrase : parsed.phrases) {
+            bool found = phrase_matches(phrase, [&](const std::string &term) -> const std::vector<unsigned int>* {
+                auto it = positions.find(term);
+                return it == positions.end() ? nullptr : &it->second;
+            });
+            if (!found) return false;
+        }
+        return true;
+    }
+
+}
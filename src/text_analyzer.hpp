@@ -0,0 +1,76 @@
+/**
+ * @file text_analyzer.hpp
+ */
+#ifndef TEXT_ANALYZER_H
+#define TEXT_ANALYZER_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <json.hpp>
+using json = nlohmann::json;
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @brief A term of a text and its position, counting every word of the text including the stopwords.
+     */
+    typedef std::pair<std::string, unsigned int> text_token;
+
+    /**
+     * @brief Query of a "text" condition. Every term has to be in the text and the terms of each phrase have to be at consecutive positions.
+     */
+    struct text_query {
+        std::vector<std::string> terms;
+        std::vector<std::vector<text_token>> phrases;
+    };
+
+    /**
+     * @param text Text to analyze.
+     * @param first_position Position of the first word.
+     * @brief Splits a text in words, lowercases them, drops the stopwords and stems the rest.
+     * @return The terms of the text with their positions.
+     */
+    std::vector<text_token> analyze_text(const std::string &text, unsigned int first_position = 0);
+
+    /**
+     * @param value String or array of strings.
+     * @brief Analyzes the strings of a value. The elements of an array are far enough apart that no phrase spans two of them.
+     * @return The terms of the value with their positions.
+     */
+    std::vector<text_token> analyze_value(const json &value);
+
+    /**
+     * @param query Words of the query, phrases are in double quotes.
+     * @brief Parses the query of a "text" condition with the same analysis as the indexed texts.
+     */
+    text_query parse_text_query(const std::string &query);
+
+    /**
+     * @param phrase Terms of the phrase with their positions in the query.
+     * @param positions Gets the sorted positions of a term in the text, or nullptr if it isn't in it.
+     * @brief Checks if the terms of a phrase are in the text in the same order and distances.
+     */
+    bool phrase_matches(const std::vector<text_token> &phrase, const std::function<const std::vector<unsigned int>*(const std::string &term)> &positions);
+
+    /**
+     * @param text Text to search.
+     * @param query Query of a "text" condition.
+     * @brief Checks if a text has every term and phrase of the query. Queries without terms match no text.
+     */
+    bool text_matches(const std::string &text, const std::string &query);
+
+    /**
+     * @param text Text to search.
+     * @param query Parsed query of a "text" condition.
+     * @brief Checks if a text has every term and phrase of a query parsed once for many texts. Queries without terms match no text.
+     */
+    bool text_matches(const std::string &text, const text_query &query);
+
+}
+
+#endif
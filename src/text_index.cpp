@@ -0,0 +1,375 @@
+#include "text_index.hpp"
+#include "auxiliary.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <mutex>
+#include <queue>
+#include <json.hpp>
+
+using namespace nosqlite;
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+// The file has the magic number, the sum of the lengths, the id and length of each document and then the text, number of documents, largest id and encoded postings of each term.
+static const char text_magic[8] = {'N', 'S', 'Q', 'T', 'E', 'X', 'T', '1'};
+
+// BM25 parameters: saturation of the term frequency and how much the length of a document counts.
+static const double bm25_k1 = 1.2;
+static const double bm25_b = 0.75;
+
+template <typename T> static void put(std::string &out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T> static bool take(const char *&at, const char *end, T &value) {
+    if (end - at < (long) sizeof(T)) return false;
+    std::memcpy(&value, at, sizeof(T));
+    at += sizeof(T);
+    return true;
+}
+
+static void put_varint(std::string &out, unsigned long long value) {
+    while (value >= 0x80) {
+        out.push_back((char) (value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char) value);
+}
+
+static unsigned long long get_varint(const char *&at) {
+    unsigned long long value = 0;
+    for (int shift = 0;; shift += 7) {
+        unsigned char byte = *at++;
+        value |= (unsigned long long) (byte & 0x7f) << shift;
+        if (byte < 0x80) return value;
+    }
+}
+
+
+text_index::text_index(const std::string &path, const std::vector<field_type> &fields) : secondary_index(path, fields), total_length(0), dirty(false) {}
+
+index_type text_index::get_type() const {
+    return TEXT_INDEX;
+}
+
+bool text_index::supports(const std::string &op, const json &value) const {
+    return op == "text" && value.is_string();
+}
+
+std::vector<text_index::posting> text_index::decode(const term_postings &postings) {
+    std::vector<posting> decoded(postings.documents);
+    const char *at = postings.data.data();
+    unsigned long long id = 0;
+    for (posting &p : decoded) {
+        id += get_varint(at);
+        p.id = id;
+        p.positions.resize(get_varint(at));
+        unsigned int position = 0;
+        for (unsigned int &q : p.positions) {
+            position += get_varint(at);
+            q = position;
+        }
+    }
+    return decoded;
+}
+
+void text_index::append(term_postings &postings, unsigned long long id, const std::vector<unsigned int> &positions) {
+    put_varint(postings.data, id - postings.last_id);
+    put_varint(postings.data, positions.size());
+    unsigned int previous = 0;
+    for (unsigned int position : positions) {
+        put_varint(postings.data, position - previous);
+        previous = position;
+    }
+    postings.documents++;
+    postings.last_id = id;
+}
+
+unsigned int text_index::group_terms(const json &value, std::unordered_map<std::string, std::vector<unsigned int>> &positions) {
+    std::vector<text_token> tokens = analyze_value(value);
+    for (const text_token &token : tokens) positions[token.first].push_back(token.second);
+    return tokens.size();
+}
+
+int text_index::write_file() {
+    std::string buffer(text_magic, sizeof(text_magic));
+    put<unsigned long long>(buffer, this->total_length);
+    put<unsigned long long>(buffer, this->lengths.size());
+    for (const auto &[id, length] : this->lengths) {
+        put<unsigned long long>(buffer, id);
+        put<unsigned int>(buffer, length);
+    }
+    put<unsigned long long>(buffer, this->terms.size());
+    for (const auto &[term, postings] : this->terms) {
+        put<unsigned int>(buffer, term.size());
+        buffer.append(term);
+        put<unsigned long long>(buffer, postings.documents);
+        put<unsigned long long>(buffer, postings.last_id);
+        put<unsigned long long>(buffer, postings.data.size());
+        buffer.append(postings.data);
+    }
+
+    // The new file replaces the old one in a single rename so a crash leaves one of them whole.
+    fs::path path_to_index(this->path);
+    fs::path temporary = path_to_index / "index.bin.tmp";
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw_failed_to_create_file(temporary);
+        return 1;
+    }
+    file.write(buffer.data(), buffer.size());
+    file.close();
+    if (file.fail()) return 1;
+
+    fs::rename(temporary, path_to_index / "index.bin");
+    this->dirty = false;
+    return 0;
+}
+
+int text_index::open() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+
+    fs::path path_to_file = fs::path(this->path) / "index.bin";
+    if (!fs::exists(path_to_file)) return 1;
+
+    std::ifstream file(path_to_file, std::ios::binary);
+    if (!file.is_open()) {
+        throw_failed_to_open_file(path_to_file);
+        return 1;
+    }
+    std::string buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+
+    const char *at = buffer.data(), *end = buffer.data() + buffer.size();
+    unsigned long long count = 0;
+    bool valid = buffer.size() >= sizeof(text_magic) && std::memcmp(at, text_magic, sizeof(text_magic)) == 0;
+    if (valid) at += sizeof(text_magic);
+    valid = valid && take(at, end, this->total_length) && take(at, end, count);
+
+    this->lengths.clear();
+    this->terms.clear();
+    for (unsigned long long i = 0; valid && i < count; i++) {
+        unsigned long long id;
+        unsigned int length;
+        valid = take(at, end, id) && take(at, end, length);
+        if (valid) this->lengths[id] = length;
+    }
+
+    valid = valid && take(at, end, count);
+    for (unsigned long long i = 0; valid && i < count; i++) {
+        unsigned int size;
+        valid = take(at, end, size) && (size_t) (end - at) >= size;
+        if (!valid) break;
+        term_postings &postings = this->terms[std::string(at, size)];
+        at += size;
+
+        unsigned long long bytes;
+        valid = take(at, end, postings.documents) && take(at, end, postings.last_id) && take(at, end, bytes) && (size_t) (end - at) >= bytes;
+        if (!valid) break;
+        postings.data.assign(at, bytes);
+        at += bytes;
+    }
+
+    if (!valid) {
+        std::cerr << "Error: Invalid text index file: " << path_to_file << "." << std::endl;
+        this->lengths.clear();
+        this->terms.clear();
+        this->total_length = 0;
+        return 1;
+    }
+    this->dirty = false;
+    return 0;
+}
+
+int text_index::build_index(const std::vector<std::pair<json, unsigned long long>> &entries) {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+
+    fs::path path_to_index(this->path);
+    if (this->reset_directory() != 0) {
+        fs::remove_all(path_to_index);
+        return 1;
+    }
+
+    // The texts are analyzed in parallel, then appended to the postings by increasing id.
+    std::vector<size_t> order(entries.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return entries[a].second < entries[b].second; });
+
+    std::vector<std::unordered_map<std::string, std::vector<unsigned int>>> grouped(entries.size());
+    std::vector<unsigned int> document_lengths(entries.size());
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (long long i = 0; i < (long long) order.size(); i++) document_lengths[i] = group_terms(entries[order[i]].first, grouped[i]);
+
+    this->terms.clear();
+    this->lengths.clear();
+    this->total_length = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+        if (document_lengths[i] == 0) continue;
+        unsigned long long id = entries[order[i]].second;
+        this->lengths[id] = document_lengths[i];
+        this->total_length += document_lengths[i];
+        for (const auto &[term, positions] : grouped[i]) append(this->terms[term], id, positions);
+        grouped[i].clear();
+    }
+
+    if (this->write_file() != 0) {
+        std::cerr << "Error: Failed to write text index: " << path_to_index / "index.bin" << "." << std::endl;
+        fs::remove_all(path_to_index);
+        return 1;
+    }
+    return 0;
+}
+
+std::vector<unsigned long long> text_index::consult(const json &value) const {
+    std::vector<unsigned long long> ids;
+    if (!value.is_string()) return ids;
+    for (const auto &[id, score] : this->search(value.get<std::string>(), 0)) ids.push_back(id);
+    return ids;
+}
+
+std::vector<std::pair<unsigned long long, double>> text_index::search(const std::string &query, size_t limit) const {
+    std::vector<std::pair<unsigned long long, double>> ranked;
+    text_query parsed = parse_text_query(query);
+    if (parsed.terms.empty()) return ranked;
+
+    std::shared_lock<std::shared_mutex> shared(this->lock);
+
+    // Every term has to be in the document, so the rarest one gives the candidates and the others filter them.
+    std::vector<const term_postings*> found;
+    for (const std::string &term : parsed.terms) {
+        auto it = this->terms.find(term);
+        if (it == this->terms.end()) return ranked;
+        found.push_back(&it->second);
+    }
+    std::vector<size_t> by_rarity(found.size());
+    for (size_t i = 0; i < by_rarity.size(); i++) by_rarity[i] = i;
+    std::sort(by_rarity.begin(), by_rarity.end(), [&](size_t a, size_t b) { return found[a]->documents < found[b]->documents; });
+
+    std::vector<std::vector<posting>> lists(found.size());
+    for (size_t i = 0; i < found.size(); i++) lists[i] = decode(*found[i]);
+
+    double documents = this->lengths.size();
+    double average_length = documents > 0 ? (double) this->total_length / documents : 1.0;
+    std::vector<double> idf(found.size());
+    for (size_t i = 0; i < found.size(); i++) idf[i] = std::log(1.0 + (documents - found[i]->documents + 0.5) / (found[i]->documents + 0.5));
+
+    // Best documents seen so far, the worst of them on top so it is the one replaced.
+    auto worse = [](const std::pair<unsigned long long, double> &a, const std::pair<unsigned long long, double> &b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    };
+    std::priority_queue<std::pair<unsigned long long, double>, std::vector<std::pair<unsigned long long, double>>, decltype(worse)> best(worse);
+
+    std::vector<size_t> cursor(found.size(), 0);
+    std::vector<const posting*> matched(found.size());
+    for (const posting &candidate : lists[by_rarity[0]]) {
+        bool complete = true;
+        for (size_t i : by_rarity) {
+            std::vector<posting> &list = lists[i];
+            while (cursor[i] < list.size() && list[cursor[i]].id < candidate.id) cursor[i]++;
+            if (cursor[i] == list.size() || list[cursor[i]].id != candidate.id) {
+                complete = false;
+                break;
+            }
+            matched[i] = &list[cursor[i]];
+        }
+        if (!complete) continue;
+
+        for (const std::vector<text_token> &phrase : parsed.phrases) {
+            complete = complete && phrase_matches(phrase, [&](const std::string &term) -> const std::vector<unsigned int>* {
+                size_t i = std::find(parsed.terms.begin(), parsed.terms.end(), term) - parsed.terms.begin();
+                return &matched[i]->positions;
+            });
+        }
+        if (!complete) continue;
+
+        double length = this->lengths.at(candidate.id), score = 0;
+        for (size_t i = 0; i < found.size(); i++) {
+            double frequency = matched[i]->positions.size();
+            score += idf[i] * frequency * (bm25_k1 + 1) / (frequency + bm25_k1 * (1 - bm25_b + bm25_b * length / average_length));
+        }
+
+        best.push({candidate.id, score});
+        if (limit > 0 && best.size() > limit) best.pop();
+    }
+
+    ranked.resize(best.size());
+    for (size_t i = ranked.size(); i > 0; i--) {
+        ranked[i - 1] = best.top();
+        best.pop();
+    }
+    return ranked;
+}
+
+void text_index::update_index(const json &new_value, unsigned long long id) {
+    std::unordered_map<std::string, std::vector<unsigned int>> grouped;
+    unsigned int length = group_terms(new_value, grouped);
+    if (length == 0) return;
+
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    if (this->lengths.find(id) != this->lengths.end()) return;
+    this->lengths[id] = length;
+    this->total_length += length;
+
+    for (const auto &[term, positions] : grouped) {
+        term_postings &postings = this->terms[term];
+        if (postings.documents == 0 || id > postings.last_id) {
+            append(postings, id, positions);
+            continue;
+        }
+
+        // Documents with smaller ids than the last one are inserted in order, re-encoding the postings.
+        std::vector<posting> decoded = decode(postings);
+        auto position = std::lower_bound(decoded.begin(), decoded.end(), id, [](const posting &p, unsigned long long id) { return p.id < id; });
+        decoded.insert(position, {id, positions});
+        postings = term_postings();
+        for (const posting &p : decoded) append(postings, p.id, p.positions);
+    }
+    this->dirty = true;
+}
+
+void text_index::remove_from_index(const json &value, unsigned long long id) {
+    std::unordered_map<std::string, std::vector<unsigned int>> grouped;
+    group_terms(value, grouped);
+
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    auto length = this->lengths.find(id);
+    if (length == this->lengths.end()) return;
+    this->total_length -= length->second;
+    this->lengths.erase(length);
+
+    for (const auto &[term, positions] : grouped) {
+        auto it = this->terms.find(term);
+        if (it == this->terms.end()) continue;
+
+        std::vector<posting> decoded = decode(it->second);
+        auto position = std::lower_bound(decoded.begin(), decoded.end(), id, [](const posting &p, unsigned long long id) { return p.id < id; });
+        if (position == decoded.end() || position->id != id) continue;
+        decoded.erase(position);
+        if (decoded.empty()) {
+            this->terms.erase(it);
+            continue;
+        }
+        it->second = term_postings();
+        for (const posting &p : decoded) append(it->second, p.id, p.positions);
+    }
+    this->dirty = true;
+}
+
+int text_index::sync() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    if (!this->dirty) return 0;
+    return this->write_file();
+}
+
+void text_index::delete_index() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    this->terms.clear();
+    this->lengths.clear();
+    this->total_length = 0;
+    this->dirty = false;
+    fs::remove_all(this->get_path());
+}
@@ -0,0 +1,178 @@
+/**
+ * @file text_index.hpp
+ */
+#ifndef TEXT_INDEX_CLASS_H
+#define TEXT_INDEX_CLASS_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <shared_mutex>
+#include <json.hpp>
+#include "auxiliary.hpp"
+#include "text_analyzer.hpp"
+#include "secondary_index.hpp"
+using json = nlohmann::json;
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @class text_index
+     * @brief Inverted index for full-text search on string fields. Every term of the analyzed texts has the list of the documents with it, the number of times it appears in each and its positions.
+     * The lists are kept compressed in memory and written to index.bin inside the index directory when the index is synced. Searches rank the documents with BM25.
+     */
+    class text_index : public secondary_index {
+    private:
+
+        /**
+         * @brief Postings of a term: number of documents, largest id and, for each document by increasing id, the varints of the id delta, the term frequency and the position deltas.
+         */
+        struct term_postings {
+            unsigned long long documents = 0;
+            unsigned long long last_id = 0;
+            std::string data;
+        };
+
+        /**
+         * @brief A document in the postings of a term, decoded.
+         */
+        struct posting {
+            unsigned long long id;
+            std::vector<unsigned int> positions;
+        };
+
+        /**
+         * @brief Postings of every term.
+         */
+        std::unordered_map<std::string, term_postings> terms;
+
+        /**
+         * @brief Number of terms of each indexed document. Documents without terms aren't in it.
+         */
+        std::unordered_map<unsigned long long, unsigned int> lengths;
+
+        /**
+         * @brief Sum of the lengths, for the average length used by BM25.
+         */
+        unsigned long long total_length;
+
+        /**
+         * @brief Indicates whether the index changed since it was last written.
+         */
+        bool dirty;
+
+        /**
+         * @brief Searches run in parallel, changes to the index need exclusive access.
+         */
+        mutable std::shared_mutex lock;
+
+        /**
+         * @param postings Postings of a term.
+         * @brief Decodes the postings of a term.
+         */
+        static std::vector<posting> decode(const term_postings &postings);
+
+        /**
+         * @param postings Destination of the postings.
+         * @param id Id of the document, larger than the last one.
+         * @param positions Sorted positions of the term in the document.
+         * @brief Appends a document to the postings of a term.
+         */
+        static void append(term_postings &postings, unsigned long long id, const std::vector<unsigned int> &positions);
+
+        /**
+         * @param value Indexed value.
+         * @param positions Destination of the positions of each term.
+         * @brief Analyzes a value and groups the positions by term.
+         * @return Number of terms in the value.
+         */
+        static unsigned int group_terms(const json &value, std::unordered_map<std::string, std::vector<unsigned int>> &positions);
+
+        /**
+         * @brief Writes the index to the index file, replacing it at once.
+         * @return 0 on success and 1 otherwise.
+         */
+        int write_file();
+
+    public:
+
+        /**
+         * @param path Path to the index.
+         * @param fields Indexed field, text indexes have a single one.
+         * @brief Constructor for the text_index class.
+         */
+        text_index(const std::string &path, const std::vector<field_type> &fields);
+
+        /**
+         * @brief Gets the structure of the index.
+         */
+        index_type get_type() const override;
+
+        /**
+         * @brief Opens an index that already exists in the file system.
+         * @return 0 on success and 1 otherwise.
+         */
+        int open() override;
+
+        /**
+         * @param entries Pairs of indexed value and id of the document with that value.
+         * @brief Builds the postings and writes them.
+         * @return 0 on success and 1 otherwise.
+         */
+        int build_index(const std::vector<std::pair<json, unsigned long long>> &entries) override;
+
+        /**
+         * @param op Comparison operator.
+         * @param value Value compared against.
+         * @brief Text indexes answer "text" conditions.
+         */
+        bool supports(const std::string &op, const json &value) const override;
+
+        /**
+         * @param value Query of a "text" condition.
+         * @brief Gets the ids of the documents with every term of the query, best ranked first.
+         */
+        std::vector<unsigned long long> consult(const json &value) const override;
+
+        /**
+         * @param query Query of a "text" condition.
+         * @param limit Maximum number of documents, 0 for all of them.
+         * @brief Finds the documents with every term and phrase of the query and ranks them with BM25.
+         * @return Pairs of id and score, best ranked first.
+         */
+        std::vector<std::pair<unsigned long long, double>> search(const std::string &query, size_t limit) const;
+
+        /**
+         * @param new_value New indexed value.
+         * @param id Id of the document.
+         * @brief Adds the document to the postings of its terms.
+         */
+        void update_index(const json &new_value, unsigned long long id) override;
+
+        /**
+         * @param value Indexed value.
+         * @param id Id of the document.
+         * @brief Removes the document from the postings of its terms.
+         */
+        void remove_from_index(const json &value, unsigned long long id) override;
+
+        /**
+         * @brief Writes the index to the disk if it changed.
+         * @return 0 on success and 1 otherwise.
+         */
+        int sync() override;
+
+        /**
+         * @brief Deletes this index.
+         */
+        void delete_index() override;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,296 @@
+#include "trigram_index.hpp"
+#include "auxiliary.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <mutex>
+#include <json.hpp>
+
+using namespace nosqlite;
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+// The file has the magic number and the number of trigrams, then each trigram followed by its bitmap.
+static const char trigram_magic[8] = {'N', 'S', 'Q', 'T', 'R', 'G', 'M', '1'};
+
+// Put twice in front of every indexed string, so the first trigrams of a string are only found by prefixes.
+static const char trigram_start = '\x01';
+
+/**
+ * @brief Gets the position of the ']' that closes the character class starting at a position of a regular expression.
+ */
+static size_t skip_class(const std::string &pattern, size_t i) {
+    i++;
+    // A ']' right after the opening bracket, or after "[^", is part of the class.
+    if (i < pattern.size() && pattern[i] == '^') i++;
+    if (i < pattern.size() && pattern[i] == ']') i++;
+    for (; i < pattern.size() && pattern[i] != ']'; i++) {
+        if (pattern[i] == '\\') i++;
+    }
+    return i;
+}
+
+/**
+ * @brief Gets the position of the ')' that closes the group starting at a position of a regular expression.
+ */
+static size_t skip_group(const std::string &pattern, size_t i) {
+    int depth = 0;
+    for (; i < pattern.size(); i++) {
+        if (pattern[i] == '\\') i++;
+        else if (pattern[i] == '[') i = skip_class(pattern, i);
+        else if (pattern[i] == '(') depth++;
+        else if (pattern[i] == ')' && --depth == 0) break;
+    }
+    return i;
+}
+
+
+trigram_index::trigram_index(const std::string &path, const std::vector<field_type> &fields) : secondary_index(path, fields), dirty(false) {}
+
+index_type trigram_index::get_type() const {
+    return TRIGRAM_INDEX;
+}
+
+bool trigram_index::supports(const std::string &op, const json &value) const {
+    std::vector<uint32_t> trigrams;
+    return value.is_string() && required_trigrams(op, value.get<std::string>(), trigrams);
+}
+
+void trigram_index::collect_trigrams(const std::string &text, bool anchored, std::vector<uint32_t> &trigrams) {
+    std::string padded = anchored ? std::string(2, trigram_start) + text : text;
+    for (size_t i = 0; i + 3 <= padded.size(); i++) {
+        trigrams.push_back((uint32_t) (unsigned char) padded[i] << 16 | (uint32_t) (unsigned char) padded[i + 1] << 8 | (unsigned char) padded[i + 2]);
+    }
+}
+
+std::vector<uint32_t> trigram_index::document_trigrams(const json &value) {
+    std::vector<uint32_t> trigrams;
+    if (value.is_string()) collect_trigrams(value.get_ref<const std::string&>(), true, trigrams);
+    else if (value.is_array()) {
+        for (const json &element : value) {
+            std::vector<uint32_t> element_trigrams = document_trigrams(element);
+            trigrams.insert(trigrams.end(), element_trigrams.begin(), element_trigrams.end());
+        }
+    }
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    return trigrams;
+}
+
+bool trigram_index::required_trigrams(const std::string &op, const std::string &pattern, std::vector<uint32_t> &trigrams) {
+    if (op == "contains") collect_trigrams(pattern, false, trigrams);
+    else if (op == "prefix" && !pattern.empty()) collect_trigrams(pattern, true, trigrams);
+    else if (op == "regex") {
+        // Runs of literal characters every match contains. Groups and character classes are skipped and optional characters end a run.
+        // A run right after a leading '^' is the start of the string.
+        std::vector<std::pair<std::string, bool>> runs;
+        std::string run;
+        bool run_anchored = false;
+        auto finish = [&]() {
+            if (!run.empty()) runs.push_back({run, run_anchored});
+            run.clear();
+            run_anchored = false;
+        };
+
+        for (size_t i = 0; i < pattern.size(); i++) {
+            char c = pattern[i];
+            // With alternatives at the top level no run is required.
+            if (c == '|') return false;
+            if (c == '^' && i == 0) run_anchored = true;
+            else if (c == '\\' && i + 1 < pattern.size()) {
+                // Escaped letters and digits are classes, back references or control characters, anything else is literal.
+                char escaped = pattern[++i];
+                if (std::isalnum((unsigned char) escaped)) finish();
+                else run.push_back(escaped);
+            }
+            else if (c == '*' || c == '?' || c == '{') {
+                if (!run.empty()) run.pop_back();
+                finish();
+                if (c == '{') i = std::min(pattern.find('}', i), pattern.size());
+            }
+            else if (c == '[') {
+                finish();
+                i = skip_class(pattern, i);
+            }
+            else if (c == '(') {
+                finish();
+                i = skip_group(pattern, i);
+            }
+            else if (c == '.' || c == '+' || c == '$' || c == '^' || c == ')') finish();
+            else run.push_back(c);
+        }
+        finish();
+        for (const auto &[text, anchored] : runs) collect_trigrams(text, anchored, trigrams);
+    }
+
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    return !trigrams.empty();
+}
+
+int trigram_index::write_file() {
+    std::string buffer(trigram_magic, sizeof(trigram_magic));
+    unsigned long long count = this->bitmaps.size();
+    buffer.append(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (const auto &[trigram, bitmap] : this->bitmaps) {
+        buffer.append(reinterpret_cast<const char*>(&trigram), sizeof(trigram));
+        bitmap.serialize(buffer);
+    }
+
+    // The new file replaces the old one in a single rename so a crash leaves one of them whole.
+    fs::path path_to_index(this->path);
+    fs::path temporary = path_to_index / "index.bin.tmp";
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw_failed_to_create_file(temporary);
+        return 1;
+    }
+    file.write(buffer.data(), buffer.size());
+    file.close();
+    if (file.fail()) return 1;
+
+    fs::rename(temporary, path_to_index / "index.bin");
+    this->dirty = false;
+    return 0;
+}
+
+int trigram_index::open() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+
+    fs::path path_to_file = fs::path(this->path) / "index.bin";
+    if (!fs::exists(path_to_file)) return 1;
+
+    std::ifstream file(path_to_file, std::ios::binary);
+    if (!file.is_open()) {
+        throw_failed_to_open_file(path_to_file);
+        return 1;
+    }
+    std::string buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+
+    const char *at = buffer.data(), *end = buffer.data() + buffer.size();
+    unsigned long long count = 0;
+    bool valid = buffer.size() >= sizeof(trigram_magic) + sizeof(count) && std::memcmp(at, trigram_magic, sizeof(trigram_magic)) == 0;
+    if (valid) {
+        std::memcpy(&count, at + sizeof(trigram_magic), sizeof(count));
+        at += sizeof(trigram_magic) + sizeof(count);
+    }
+
+    this->bitmaps.clear();
+    for (unsigned long long i = 0; valid && i < count; i++) {
+        uint32_t trigram;
+        if (end - at < (long) sizeof(trigram)) valid = false;
+        else {
+            std::memcpy(&trigram, at, sizeof(trigram));
+            at += sizeof(trigram);
+            valid = this->bitmaps[trigram].deserialize(at, end) == 0;
+        }
+    }
+
+    if (!valid) {
+        std::cerr << "Error: Invalid trigram index file: " << path_to_file << "." << std::endl;
+        this->bitmaps.clear();
+        return 1;
+    }
+    this->dirty = false;
+    return 0;
+}
+
+int trigram_index::build_index(const std::vector<std::pair<json, unsigned long long>> &entries) {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+
+    fs::path path_to_index(this->path);
+    if (this->reset_directory() != 0) {
+        fs::remove_all(path_to_index);
+        return 1;
+    }
+
+    // The strings are split in parallel. The pairs are then sorted by trigram and id so the ids are appended to the containers.
+    std::vector<std::vector<uint32_t>> entry_trigrams(entries.size());
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (long long i = 0; i < (long long) entries.size(); i++) entry_trigrams[i] = document_trigrams(entries[i].first);
+
+    std::vector<std::pair<uint32_t, unsigned long long>> pairs;
+    for (size_t i = 0; i < entries.size(); i++) {
+        for (uint32_t trigram : entry_trigrams[i]) pairs.push_back({trigram, entries[i].second});
+    }
+    entry_trigrams.clear();
+    entry_trigrams.shrink_to_fit();
+    std::sort(pairs.begin(), pairs.end());
+
+    this->bitmaps.clear();
+    roaring_bitmap *bitmap = nullptr;
+    for (size_t i = 0; i < pairs.size(); i++) {
+        if (i == 0 || pairs[i].first != pairs[i - 1].first) bitmap = &this->bitmaps[pairs[i].first];
+        bitmap->add(pairs[i].second);
+    }
+
+    if (this->write_file() != 0) {
+        std::cerr << "Error: Failed to write trigram index: " << path_to_index / "index.bin" << "." << std::endl;
+        fs::remove_all(path_to_index);
+        return 1;
+    }
+    return 0;
+}
+
+std::vector<unsigned long long> trigram_index::consult(const json &value) const {
+    if (!value.is_string()) return {};
+    return this->lookup("contains", value.get<std::string>()).to_vector();
+}
+
+roaring_bitmap trigram_index::lookup(const std::string &op, const std::string &pattern) const {
+    std::vector<uint32_t> trigrams;
+    if (!required_trigrams(op, pattern, trigrams)) return roaring_bitmap();
+
+    std::shared_lock<std::shared_mutex> shared(this->lock);
+
+    // The rarest trigrams go first so the intersection shrinks fast.
+    std::vector<const roaring_bitmap*> found;
+    for (uint32_t trigram : trigrams) {
+        auto it = this->bitmaps.find(trigram);
+        if (it == this->bitmaps.end()) return roaring_bitmap();
+        found.push_back(&it->second);
+    }
+    std::sort(found.begin(), found.end(), [](const roaring_bitmap *a, const roaring_bitmap *b) { return a->cardinality() < b->cardinality(); });
+
+    roaring_bitmap result = *found[0];
+    for (size_t i = 1; i < found.size() && !result.empty(); i++) result = result.intersect(*found[i]);
+    return result;
+}
+
+void trigram_index::update_index(const json &new_value, unsigned long long id) {
+    std::vector<uint32_t> trigrams = document_trigrams(new_value);
+
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    for (uint32_t trigram : trigrams) this->bitmaps[trigram].add(id);
+    this->dirty = true;
+}
+
+void trigram_index::remove_from_index(const json &value, unsigned long long id) {
+    std::vector<uint32_t> trigrams = document_trigrams(value);
+
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    for (uint32_t trigram : trigrams) {
+        auto it = this->bitmaps.find(trigram);
+        if (it == this->bitmaps.end()) continue;
+        it->second.remove(id);
+        if (it->second.empty()) this->bitmaps.erase(it);
+    }
+    this->dirty = true;
+}
+
+int trigram_index::sync() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    if (!this->dirty) return 0;
+    return this->write_file();
+}
+
+void trigram_index::delete_index() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    this->bitmaps.clear();
+    this->dirty = false;
+    fs::remove_all(this->get_path());
+}
@@ -0,0 +1,153 @@
+/**
+ * @file trigram_index.hpp
+ */
+#ifndef TRIGRAM_INDEX_CLASS_H
+#define TRIGRAM_INDEX_CLASS_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <shared_mutex>
+#include <json.hpp>
+#include "auxiliary.hpp"
+#include "roaring_bitmap.hpp"
+#include "secondary_index.hpp"
+using json = nlohmann::json;
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @class trigram_index
+     * @brief Trigram index for substring, prefix and regular expression conditions on string fields. Every sequence of three bytes of the strings has a compressed bitmap of the documents with it.
+     * Strings are indexed with two start markers in front so prefixes of any length have trigrams. Arrays get the document in the bitmaps of each element.
+     * The index only narrows down the candidates, the conditions are checked on the documents. The bitmaps are kept in memory and written to index.bin inside the index directory when the index is synced.
+     */
+    class trigram_index : public secondary_index {
+    private:
+
+        /**
+         * @brief Bitmap of every trigram, by the trigram packed in the low 24 bits.
+         */
+        std::map<uint32_t, roaring_bitmap> bitmaps;
+
+        /**
+         * @brief Indicates whether the bitmaps changed since they were last written.
+         */
+        bool dirty;
+
+        /**
+         * @brief Lookups run in parallel, changes to the index need exclusive access.
+         */
+        mutable std::shared_mutex lock;
+
+        /**
+         * @param text String to split.
+         * @param anchored Whether the string is the start of the indexed value, with the start markers in front.
+         * @param trigrams Destination of the trigrams.
+         * @brief Collects the trigrams of a string.
+         */
+        static void collect_trigrams(const std::string &text, bool anchored, std::vector<uint32_t> &trigrams);
+
+        /**
+         * @param value Value of the field.
+         * @brief Gets the distinct trigrams of the strings of a value.
+         */
+        static std::vector<uint32_t> document_trigrams(const json &value);
+
+        /**
+         * @param op "contains", "prefix" or "regex".
+         * @param pattern Value of the condition.
+         * @param trigrams Destination of the trigrams.
+         * @brief Gets the trigrams every string that satisfies the condition has. Regular expressions give the trigrams of the literal text they require.
+         * @return false if the condition doesn't require any trigram.
+         */
+        static bool required_trigrams(const std::string &op, const std::string &pattern, std::vector<uint32_t> &trigrams);
+
+        /**
+         * @brief Writes the bitmaps to the index file, replacing it at once.
+         * @return 0 on success and 1 otherwise.
+         */
+        int write_file();
+
+    public:
+
+        /**
+         * @param path Path to the index.
+         * @param fields Indexed field, trigram indexes have a single one.
+         * @brief Constructor for the trigram_index class.
+         */
+        trigram_index(const std::string &path, const std::vector<field_type> &fields);
+
+        /**
+         * @brief Gets the structure of the index.
+         */
+        index_type get_type() const override;
+
+        /**
+         * @brief Opens an index that already exists in the file system.
+         * @return 0 on success and 1 otherwise.
+         */
+        int open() override;
+
+        /**
+         * @param entries Pairs of indexed value and id of the document with that value.
+         * @brief Builds the bitmaps and writes them.
+         * @return 0 on success and 1 otherwise.
+         */
+        int build_index(const std::vector<std::pair<json, unsigned long long>> &entries) override;
+
+        /**
+         * @param op Comparison operator.
+         * @param value Value compared against.
+         * @brief Trigram indexes answer "contains", "prefix" and "regex" conditions that require at least one trigram, e.g. substrings of three or more bytes.
+         */
+        bool supports(const std::string &op, const json &value) const override;
+
+        /**
+         * @param value Substring of the indexed field.
+         * @brief Gets the ids of the documents that may contain the substring.
+         */
+        std::vector<unsigned long long> consult(const json &value) const override;
+
+        /**
+         * @param op "contains", "prefix" or "regex".
+         * @param pattern Value of the condition.
+         * @brief Gets the documents with every trigram the condition requires.
+         */
+        roaring_bitmap lookup(const std::string &op, const std::string &pattern) const;
+
+        /**
+         * @param new_value New indexed value.
+         * @param id Id of the document.
+         * @brief Adds the document to the bitmaps of its trigrams.
+         */
+        void update_index(const json &new_value, unsigned long long id) override;
+
+        /**
+         * @param value Indexed value.
+         * @param id Id of the document.
+         * @brief Removes the document from the bitmaps of its trigrams.
+         */
+        void remove_from_index(const json &value, unsigned long long id) override;
+
+        /**
+         * @brief Writes the bitmaps to the disk if they changed.
+         * @return 0 on success and 1 otherwise.
+         */
+        int sync() override;
+
+        /**
+         * @brief Deletes this index.
+         */
+        void delete_index() override;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,408 @@
+#include "vector_index.hpp"
+#include "auxiliary.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <limits>
+#include <mutex>
+#include <queue>
+#include <json.hpp>
+#include <omp.h>
+
+using namespace nosqlite;
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+// The file has the magic number, the dimensions, the number of rows and the number of partitions,
+// then the ids, the partition of each row, the matrix and the centroids.
+static const char vector_magic[8] = {'N', 'S', 'Q', 'V', 'E', 'C', 'T', '1'};
+
+// Indexes with fewer rows are only searched exactly, a scan of them is already fast.
+static const size_t min_rows_to_partition = 1024;
+
+// Rows per partition sampled to train the centroids and number of k-means iterations.
+static const size_t training_rows_per_list = 64;
+static const int training_iterations = 10;
+
+/**
+ * @brief Gets the dot product of two vectors.
+ */
+static float dot(const float *a, const float *b, unsigned int dimensions) {
+    float sum = 0;
+    #pragma omp simd reduction(+:sum)
+    for (unsigned int i = 0; i < dimensions; i++) sum += a[i] * b[i];
+    return sum;
+}
+
+/**
+ * @brief Gets the squared euclidean distance between two vectors.
+ */
+static float squared_distance(const float *a, const float *b, unsigned int dimensions) {
+    float sum = 0;
+    #pragma omp simd reduction(+:sum)
+    for (unsigned int i = 0; i < dimensions; i++) sum += (a[i] - b[i]) * (a[i] - b[i]);
+    return sum;
+}
+
+/**
+ * @brief Keeps the k pairs of similarity and row with the largest similarity, the smallest of them on top.
+ */
+using row_heap = std::priority_queue<std::pair<float, size_t>, std::vector<std::pair<float, size_t>>, std::greater<std::pair<float, size_t>>>;
+
+static void push_bounded(row_heap &heap, size_t k, float score, size_t row) {
+    if (heap.size() < k) heap.push({score, row});
+    else if (score > heap.top().first) {
+        heap.pop();
+        heap.push({score, row});
+    }
+}
+
+
+vector_index::vector_index(const std::string &path, const std::vector<field_type> &fields) : secondary_index(path, fields), dimensions(0), dirty(false) {}
+
+index_type vector_index::get_type() const {
+    return VECTOR_INDEX;
+}
+
+bool vector_index::supports(const std::string &, const json &) const {
+    return false;
+}
+
+std::vector<unsigned long long> vector_index::consult(const json &) const {
+    return {};
+}
+
+unsigned int vector_index::get_dimensions() const {
+    std::shared_lock<std::shared_mutex> shared(this->lock);
+    return this->dimensions;
+}
+
+bool vector_index::read_vector(const json &value, std::vector<float> &vector) {
+    if (!value.is_array() || value.empty()) return false;
+    vector.clear();
+    vector.reserve(value.size());
+    for (const json &component : value) {
+        if (!component.is_number()) return false;
+        vector.push_back(component.get<float>());
+    }
+    return true;
+}
+
+float vector_index::norm(const float *vector, unsigned int dimensions) {
+    return std::sqrt(dot(vector, vector, dimensions));
+}
+
+float vector_index::similarity(vector_metric metric, const float *a, const float *b, unsigned int dimensions, float norm_a, float norm_b) {
+    if (metric == L2_DISTANCE) return -squared_distance(a, b, dimensions);
+    float product = dot(a, b, dimensions);
+    if (metric == DOT_PRODUCT) return product;
+    return norm_a == 0 || norm_b == 0 ? 0 : product / (norm_a * norm_b);
+}
+
+unsigned int vector_index::closest_list(const float *vector) const {
+    unsigned int best = 0;
+    float best_distance = std::numeric_limits<float>::max();
+    for (unsigned int l = 0; l < this->lists.size(); l++) {
+        float distance = squared_distance(vector, this->centroids.data() + (size_t) l * this->dimensions, this->dimensions);
+        if (distance < best_distance) {
+            best_distance = distance;
+            best = l;
+        }
+    }
+    return best;
+}
+
+void vector_index::train() {
+    size_t count = this->ids.size();
+    unsigned int dims = this->dimensions;
+    this->centroids.clear();
+    this->lists.clear();
+    this->row_list.assign(count, 0);
+    if (count < min_rows_to_partition) return;
+
+    // The centroids start at evenly spaced rows of an evenly spaced sample and move to the mean of their rows.
+    size_t nlist = (size_t) std::sqrt((double) count);
+    size_t sample_size = std::min(count, nlist * training_rows_per_list);
+    std::vector<size_t> sample(sample_size);
+    for (size_t i = 0; i < sample_size; i++) sample[i] = i * count / sample_size;
+
+    this->centroids.resize(nlist * dims);
+    for (size_t l = 0; l < nlist; l++) {
+        std::memcpy(this->centroids.data() + l * dims, this->matrix.data() + sample[l * sample_size / nlist] * dims, dims * sizeof(float));
+    }
+    this->lists.resize(nlist);
+
+    std::vector<unsigned int> assignment(sample_size);
+    for (int iteration = 0; iteration < training_iterations; iteration++) {
+        #pragma omp parallel for
+        for (long long i = 0; i < (long long) sample_size; i++) assignment[i] = this->closest_list(this->matrix.data() + sample[i] * dims);
+
+        // Partitions left without rows keep their centroid.
+        std::vector<double> sums(nlist * dims, 0.0);
+        std::vector<size_t> sizes(nlist, 0);
+        for (size_t i = 0; i < sample_size; i++) {
+            const float *row = this->matrix.data() + sample[i] * dims;
+            for (unsigned int d = 0; d < dims; d++) sums[assignment[i] * dims + d] += row[d];
+            sizes[assignment[i]]++;
+        }
+        for (size_t l = 0; l < nlist; l++) {
+            if (sizes[l] == 0) continue;
+            for (unsigned int d = 0; d < dims; d++) this->centroids[l * dims + d] = (float) (sums[l * dims + d] / sizes[l]);
+        }
+    }
+
+    #pragma omp parallel for
+    for (long long r = 0; r < (long long) count; r++) this->row_list[r] = this->closest_list(this->matrix.data() + r * dims);
+    for (size_t r = 0; r < count; r++) this->lists[this->row_list[r]].push_back(r);
+}
+
+void vector_index::add_row(unsigned long long id, const std::vector<float> &vector) {
+    size_t row = this->ids.size();
+    this->ids.push_back(id);
+    this->matrix.insert(this->matrix.end(), vector.begin(), vector.end());
+    this->norms.push_back(norm(vector.data(), this->dimensions));
+    this->rows[id] = row;
+
+    unsigned int list = this->lists.empty() ? 0 : this->closest_list(vector.data());
+    this->row_list.push_back(list);
+    if (!this->lists.empty()) this->lists[list].push_back(row);
+}
+
+int vector_index::write_file() {
+    unsigned long long count = this->ids.size();
+    unsigned int nlist = this->lists.size();
+    std::string buffer(vector_magic, sizeof(vector_magic));
+    buffer.append(reinterpret_cast<const char*>(&this->dimensions), sizeof(this->dimensions));
+    buffer.append(reinterpret_cast<const char*>(&count), sizeof(count));
+    buffer.append(reinterpret_cast<const char*>(&nlist), sizeof(nlist));
+    buffer.append(reinterpret_cast<const char*>(this->ids.data()), count * sizeof(unsigned long long));
+    buffer.append(reinterpret_cast<const char*>(this->row_list.data()), count * sizeof(unsigned int));
+    buffer.append(reinterpret_cast<const char*>(this->matrix.data()), this->matrix.size() * sizeof(float));
+    buffer.append(reinterpret_cast<const char*>(this->centroids.data()), this->centroids.size() * sizeof(float));
+
+    // The new file replaces the old one in a single rename so a crash leaves one of them whole.
+    fs::path path_to_index(this->path);
+    fs::path temporary = path_to_index / "index.bin.tmp";
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw_failed_to_create_file(temporary);
+        return 1;
+    }
+    file.write(buffer.data(), buffer.size());
+    file.close();
+    if (file.fail()) return 1;
+
+    fs::rename(temporary, path_to_index / "index.bin");
+    this->dirty = false;
+    return 0;
+}
+
+int vector_index::open() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+
+    fs::path path_to_file = fs::path(this->path) / "index.bin";
+    if (!fs::exists(path_to_file)) return 1;
+
+    std::ifstream file(path_to_file, std::ios::binary);
+    if (!file.is_open()) {
+        throw_failed_to_open_file(path_to_file);
+        return 1;
+    }
+    std::string buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+
+    unsigned int dims = 0, nlist = 0;
+    unsigned long long count = 0;
+    const size_t header_size = sizeof(vector_magic) + sizeof(dims) + sizeof(count) + sizeof(nlist);
+    bool valid = buffer.size() >= header_size && std::memcmp(buffer.data(), vector_magic, sizeof(vector_magic)) == 0;
+    if (valid) {
+        const char *at = buffer.data() + sizeof(vector_magic);
+        std::memcpy(&dims, at, sizeof(dims));
+        std::memcpy(&count, at + sizeof(dims), sizeof(count));
+        std::memcpy(&nlist, at + sizeof(dims) + sizeof(count), sizeof(nlist));
+        valid = buffer.size() == header_size + count * (sizeof(unsigned long long) + sizeof(unsigned int) + (size_t) dims * sizeof(float)) + (size_t) nlist * dims * sizeof(float);
+    }
+    if (!valid) {
+        std::cerr << "Error: Invalid vector index file: " << path_to_file << "." << std::endl;
+        return 1;
+    }
+
+    const char *at = buffer.data() + header_size;
+    this->dimensions = dims;
+    this->ids.resize(count);
+    std::memcpy(this->ids.data(), at, count * sizeof(unsigned long long));
+    at += count * sizeof(unsigned long long);
+    this->row_list.resize(count);
+    std::memcpy(this->row_list.data(), at, count * sizeof(unsigned int));
+    at += count * sizeof(unsigned int);
+    this->matrix.resize(count * dims);
+    std::memcpy(this->matrix.data(), at, this->matrix.size() * sizeof(float));
+    at += this->matrix.size() * sizeof(float);
+    this->centroids.resize((size_t) nlist * dims);
+    std::memcpy(this->centroids.data(), at, this->centroids.size() * sizeof(float));
+
+    this->rows.clear();
+    this->norms.resize(count);
+    this->lists.assign(nlist, {});
+    for (size_t r = 0; r < count; r++) {
+        this->rows[this->ids[r]] = r;
+        this->norms[r] = norm(this->matrix.data() + r * dims, dims);
+        if (nlist > 0) this->lists[std::min(this->row_list[r], nlist - 1)].push_back(r);
+    }
+    this->dirty = false;
+    return 0;
+}
+
+int vector_index::build_index(const std::vector<std::pair<json, unsigned long long>> &entries) {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+
+    fs::path path_to_index(this->path);
+    if (this->reset_directory() != 0) {
+        fs::remove_all(path_to_index);
+        return 1;
+    }
+
+    this->dimensions = 0;
+    this->matrix.clear();
+    this->ids.clear();
+    this->norms.clear();
+    this->rows.clear();
+    this->centroids.clear();
+    this->lists.clear();
+    this->row_list.clear();
+
+    // The entries come in no particular order, the dimensions are the ones most vectors have.
+    std::vector<std::vector<float>> vectors(entries.size());
+    std::unordered_map<size_t, size_t> frequency;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (read_vector(entries[i].first, vectors[i])) frequency[vectors[i].size()]++;
+    }
+    size_t most = 0;
+    for (const auto &[dims, times] : frequency) {
+        if (times > most) {
+            most = times;
+            this->dimensions = dims;
+        }
+    }
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (vectors[i].size() == this->dimensions && this->dimensions != 0) this->add_row(entries[i].second, vectors[i]);
+    }
+    this->train();
+
+    if (this->write_file() != 0) {
+        std::cerr << "Error: Failed to write vector index: " << path_to_index / "index.bin" << "." << std::endl;
+        fs::remove_all(path_to_index);
+        return 1;
+    }
+    return 0;
+}
+
+std::vector<std::pair<unsigned long long, float>> vector_index::search(const std::vector<float> &query, size_t k, vector_metric metric, unsigned int probes) const {
+    std::shared_lock<std::shared_mutex> shared(this->lock);
+    if (k == 0 || this->ids.empty() || query.size() != this->dimensions) return {};
+
+    unsigned int dims = this->dimensions;
+    float query_norm = norm(query.data(), dims);
+
+    // Approximate searches only read the rows of the partitions with the closest centroids.
+    std::vector<size_t> candidates;
+    bool exact = probes == 0 || this->lists.empty() || probes >= this->lists.size();
+    if (!exact) {
+        std::vector<std::pair<float, unsigned int>> closest;
+        for (unsigned int l = 0; l < this->lists.size(); l++) {
+            const float *centroid = this->centroids.data() + (size_t) l * dims;
+            closest.push_back({similarity(metric, query.data(), centroid, dims, query_norm, norm(centroid, dims)), l});
+        }
+        std::partial_sort(closest.begin(), closest.begin() + probes, closest.end(), std::greater<std::pair<float, unsigned int>>());
+        for (unsigned int p = 0; p < probes; p++) {
+            const std::vector<size_t> &list = this->lists[closest[p].second];
+            candidates.insert(candidates.end(), list.begin(), list.end());
+        }
+    }
+    long long total = exact ? this->ids.size() : candidates.size();
+
+    // Each thread keeps the best rows it compares, then the heaps are merged.
+    std::vector<row_heap> heaps(get_max_threads());
+    #pragma omp parallel for
+    for (long long i = 0; i < total; i++) {
+        #ifdef _OPENMP
+            int thread_num = omp_get_thread_num();
+        #else
+            int thread_num = 0;
+        #endif
+
+        size_t row = exact ? i : candidates[i];
+        float score = similarity(metric, query.data(), this->matrix.data() + row * dims, dims, query_norm, this->norms[row]);
+        push_bounded(heaps[thread_num], k, score, row);
+    }
+
+    row_heap best;
+    for (row_heap &heap : heaps) {
+        for (; !heap.empty(); heap.pop()) push_bounded(best, k, heap.top().first, heap.top().second);
+    }
+
+    std::vector<std::pair<unsigned long long, float>> results(best.size());
+    for (size_t i = results.size(); i > 0; i--, best.pop()) results[i - 1] = {this->ids[best.top().second], best.top().first};
+    return results;
+}
+
+void vector_index::update_index(const json &new_value, unsigned long long id) {
+    std::vector<float> vector;
+    if (!read_vector(new_value, vector)) return;
+
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    if (this->dimensions == 0) this->dimensions = vector.size();
+    if (vector.size() != this->dimensions || this->rows.find(id) != this->rows.end()) return;
+    this->add_row(id, vector);
+    this->dirty = true;
+}
+
+void vector_index::remove_from_index(const json &, unsigned long long id) {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    auto found = this->rows.find(id);
+    if (found == this->rows.end()) return;
+
+    // The last row moves into the place of the removed one so the matrix stays contiguous.
+    size_t row = found->second, last = this->ids.size() - 1;
+    unsigned int dims = this->dimensions;
+    if (!this->lists.empty()) {
+        std::vector<size_t> &list = this->lists[this->row_list[row]];
+        list.erase(std::find(list.begin(), list.end(), row));
+        if (row != last) *std::find(this->lists[this->row_list[last]].begin(), this->lists[this->row_list[last]].end(), last) = row;
+    }
+    if (row != last) {
+        std::memcpy(this->matrix.data() + row * dims, this->matrix.data() + last * dims, dims * sizeof(float));
+        this->ids[row] = this->ids[last];
+        this->norms[row] = this->norms[last];
+        this->row_list[row] = this->row_list[last];
+        this->rows[this->ids[row]] = row;
+    }
+    this->rows.erase(id);
+    this->ids.pop_back();
+    this->norms.pop_back();
+    this->row_list.pop_back();
+    this->matrix.resize(this->ids.size() * dims);
+    this->dirty = true;
+}
+
+int vector_index::sync() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    if (!this->dirty) return 0;
+    return this->write_file();
+}
+
+void vector_index::delete_index() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    this->matrix.clear();
+    this->ids.clear();
+    this->norms.clear();
+    this->rows.clear();
+    this->centroids.clear();
+    this->lists.clear();
+    this->row_list.clear();
+    this->dirty = false;
+    fs::remove_all(this->get_path());
+}
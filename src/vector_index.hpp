@@ -0,0 +1,216 @@
+/**
+ * @file vector_index.hpp
+ */
+#ifndef VECTOR_INDEX_CLASS_H
+#define VECTOR_INDEX_CLASS_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <shared_mutex>
+#include <json.hpp>
+#include "auxiliary.hpp"
+#include "secondary_index.hpp"
+using json = nlohmann::json;
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @class vector_index
+     * @brief Vector index for nearest neighbour searches on embedding fields. The vectors are rows of a contiguous float matrix, compared with SIMD loops.
+     * Exact searches compare the query with every row. Indexes with enough vectors are also partitioned in lists around k-means centroids (IVF) when they are built,
+     * and approximate searches only compare the rows of the lists with the closest centroids. New vectors join the list of their closest centroid.
+     * The matrix is kept in memory and written to index.bin inside the index directory when the index is synced.
+     */
+    class vector_index : public secondary_index {
+    private:
+
+        /**
+         * @brief Number of components of the vectors, the most common one when the index is built. Documents with other vectors aren't indexed.
+         */
+        unsigned int dimensions;
+
+        /**
+         * @brief Vectors of the documents, one row each.
+         */
+        std::vector<float> matrix;
+
+        /**
+         * @brief Id of the document of each row.
+         */
+        std::vector<unsigned long long> ids;
+
+        /**
+         * @brief Euclidean norm of each row, for the cosine similarity.
+         */
+        std::vector<float> norms;
+
+        /**
+         * @brief Row of each document.
+         */
+        std::unordered_map<unsigned long long, size_t> rows;
+
+        /**
+         * @brief Centroids of the partitions, one row each. Empty if the index isn't partitioned.
+         */
+        std::vector<float> centroids;
+
+        /**
+         * @brief Rows of each partition.
+         */
+        std::vector<std::vector<size_t>> lists;
+
+        /**
+         * @brief Partition of each row.
+         */
+        std::vector<unsigned int> row_list;
+
+        /**
+         * @brief Indicates whether the index changed since it was last written.
+         */
+        bool dirty;
+
+        /**
+         * @brief Searches run in parallel, changes to the index need exclusive access.
+         */
+        mutable std::shared_mutex lock;
+
+        /**
+         * @param vector Vector to place.
+         * @brief Gets the partition with the closest centroid.
+         */
+        unsigned int closest_list(const float *vector) const;
+
+        /**
+         * @brief Partitions the rows with k-means, about the square root of the number of rows lists. Small indexes aren't partitioned.
+         */
+        void train();
+
+        /**
+         * @param id Id of the document.
+         * @param vector Vector of the document.
+         * @brief Appends a row. Needs exclusive access.
+         */
+        void add_row(unsigned long long id, const std::vector<float> &vector);
+
+        /**
+         * @brief Writes the index to the index file, replacing it at once.
+         * @return 0 on success and 1 otherwise.
+         */
+        int write_file();
+
+    public:
+
+        /**
+         * @param path Path to the index.
+         * @param fields Indexed field, vector indexes have a single one.
+         * @brief Constructor for the vector_index class.
+         */
+        vector_index(const std::string &path, const std::vector<field_type> &fields);
+
+        /**
+         * @param value Value of a field.
+         * @param vector Destination of the components.
+         * @brief Reads an array of numbers as a vector.
+         * @return false if the value isn't a non-empty array of numbers.
+         */
+        static bool read_vector(const json &value, std::vector<float> &vector);
+
+        /**
+         * @param metric Similarity.
+         * @param a First vector.
+         * @param b Second vector.
+         * @param dimensions Number of components.
+         * @param norm_a Norm of the first vector, only used by the cosine similarity.
+         * @param norm_b Norm of the second vector, only used by the cosine similarity.
+         * @brief Gets the similarity of two vectors, larger is closer. The L2 distance is negated.
+         */
+        static float similarity(vector_metric metric, const float *a, const float *b, unsigned int dimensions, float norm_a, float norm_b);
+
+        /**
+         * @param vector Vector.
+         * @param dimensions Number of components.
+         * @brief Gets the euclidean norm of a vector.
+         */
+        static float norm(const float *vector, unsigned int dimensions);
+
+        /**
+         * @brief Gets the number of components of the indexed vectors, 0 if there are none.
+         */
+        unsigned int get_dimensions() const;
+
+        /**
+         * @brief Gets the structure of the index.
+         */
+        index_type get_type() const override;
+
+        /**
+         * @brief Opens an index that already exists in the file system.
+         * @return 0 on success and 1 otherwise.
+         */
+        int open() override;
+
+        /**
+         * @param entries Pairs of indexed value and id of the document with that value.
+         * @brief Builds the matrix, partitions it and writes it.
+         * @return 0 on success and 1 otherwise.
+         */
+        int build_index(const std::vector<std::pair<json, unsigned long long>> &entries) override;
+
+        /**
+         * @param op Comparison operator.
+         * @param value Value compared against.
+         * @brief Vector indexes don't answer conditions, they are searched with search.
+         */
+        bool supports(const std::string &op, const json &value) const override;
+
+        /**
+         * @param value Value of the indexed field.
+         * @brief Vector indexes don't answer conditions, no ids are returned.
+         */
+        std::vector<unsigned long long> consult(const json &value) const override;
+
+        /**
+         * @param query Query vector, with the dimensions of the index.
+         * @param k Number of documents.
+         * @param metric Similarity.
+         * @param probes Number of partitions searched, closest centroids first. 0 compares every row.
+         * @brief Finds the k documents with the vectors most similar to the query.
+         * @return Pairs of id and similarity, most similar first.
+         */
+        std::vector<std::pair<unsigned long long, float>> search(const std::vector<float> &query, size_t k, vector_metric metric, unsigned int probes) const;
+
+        /**
+         * @param new_value New indexed value.
+         * @param id Id of the document.
+         * @brief Adds the vector of the document.
+         */
+        void update_index(const json &new_value, unsigned long long id) override;
+
+        /**
+         * @param value Indexed value.
+         * @param id Id of the document.
+         * @brief Removes the vector of the document, moving the last row into its place.
+         */
+        void remove_from_index(const json &value, unsigned long long id) override;
+
+        /**
+         * @brief Writes the index to the disk if it changed.
+         * @return 0 on success and 1 otherwise.
+         */
+        int sync() override;
+
+        /**
+         * @brief Deletes this index.
+         */
+        void delete_index() override;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,166 @@
+#include "write_ahead_log.hpp"
+#include "auxiliary.hpp"
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <json.hpp>
+
+#ifdef _WIN32
+    #include <io.h>
+    #define open_log(path) _open(path, _O_WRONLY | _O_APPEND | _O_CREAT | _O_BINARY, 0644)
+    #define write_log _write
+    #define sync_log _commit
+    #define close_log _close
+#else
+    #include <unistd.h>
+    #define open_log(path) ::open(path, O_WRONLY | O_APPEND | O_CREAT, 0644)
+    #define write_log ::write
+    #define sync_log ::fsync
+    #define close_log ::close
+#endif
+
+using namespace nosqlite;
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+
+write_ahead_log::write_ahead_log(const std::string &path) : path(path), fd(-1), next_lsn(1), durable_lsn(0), failed_lsn(0), buffered_lsn(0), flushing(false) {}
+
+write_ahead_log::~write_ahead_log() {
+    if (this->fd >= 0) close_log(this->fd);
+}
+
+int write_ahead_log::recover(unsigned long long checkpoint_lsn, std::vector<json> &records) {
+    records.clear();
+    if (!fs::exists(this->path)) return 0;
+
+    std::ifstream file(this->path, std::ios::binary);
+    if (!file.is_open()) {
+        throw_failed_to_open_file(this->path);
+        return 1;
+    }
+
+    // Every record is a JSON object on its own line. Stop at the first one that is incomplete.
+    unsigned long long valid_size = 0;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (file.eof()) break;
+        json record;
+        try {
+            record = json::parse(line);
+        }
+        catch (const nlohmann::json::parse_error &e) {
+            break;
+        }
+
+        valid_size += line.size() + 1;
+        unsigned long long lsn = record["lsn"];
+        this->next_lsn = std::max(this->next_lsn, lsn + 1);
+        if (lsn > checkpoint_lsn) records.push_back(record);
+    }
+    file.close();
+
+    if (valid_size < fs::file_size(this->path)) {
+        std::cerr << "Warning: Discarding an incomplete record at the end of the log: \"" << this->path << "\"." << std::endl;
+        fs::resize_file(this->path, valid_size);
+    }
+
+    return 0;
+}
+
+int write_ahead_log::open(unsigned long long checkpoint_lsn) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    if (this->fd >= 0) close_log(this->fd);
+    this->fd = open_log(this->path.c_str());
+    if (this->fd < 0) {
+        throw_failed_to_open_file(this->path);
+        return 1;
+    }
+
+    this->next_lsn = std::max(this->next_lsn, checkpoint_lsn + 1);
+    this->durable_lsn = this->next_lsn - 1;
+    this->buffered_lsn = this->durable_lsn;
+    return 0;
+}
+
+unsigned long long write_ahead_log::log(json record) {
+    return this->log(std::vector<json>{std::move(record)});
+}
+
+unsigned long long write_ahead_log::log(std::vector<json> records) {
+    std::unique_lock<std::mutex> guard(this->lock);
+    if (this->fd < 0 || records.empty()) return 0;
+
+    unsigned long long lsn = 0;
+    for (json &record : records) {
+        lsn = this->next_lsn++;
+        record["lsn"] = lsn;
+        this->buffer += record.dump();
+        this->buffer.push_back('\n');
+    }
+    this->buffered_lsn = lsn;
+
+    // The first writer to arrive flushes everything buffered so far, the others wait for it.
+    while (this->durable_lsn < lsn) {
+        if (lsn <= this->failed_lsn) return 0;
+
+        if (this->flushing) {
+            this->flushed.wait(guard);
+            continue;
+        }
+
+        this->flushing = true;
+        std::string batch;
+        batch.swap(this->buffer);
+        unsigned long long batch_lsn = this->buffered_lsn;
+        guard.unlock();
+
+        bool ok = true;
+        size_t written = 0;
+        while (ok && written < batch.size()) {
+            auto n = write_log(this->fd, batch.data() + written, batch.size() - written);
+            if (n <= 0) ok = false;
+            else written += n;
+        }
+        if (ok && sync_log(this->fd) != 0) ok = false;
+
+        guard.lock();
+        this->flushing = false;
+        if (ok) this->durable_lsn = batch_lsn;
+        else {
+            std::cerr << "Error: Failed to write to the log: \"" << this->path << "\"." << std::endl;
+            this->failed_lsn = batch_lsn;
+        }
+        this->flushed.notify_all();
+    }
+
+    return lsn;
+}
+
+unsigned long long write_ahead_log::get_last_lsn() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->next_lsn - 1;
+}
+
+int write_ahead_log::truncate() {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    if (this->fd >= 0) close_log(this->fd);
+    std::error_code error;
+    fs::resize_file(this->path, 0, error);
+    this->fd = open_log(this->path.c_str());
+    if (error || this->fd < 0) {
+        throw_failed_to_open_file(this->path);
+        return 1;
+    }
+    return 0;
+}
+
+void write_ahead_log::delete_log() {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    if (this->fd >= 0) close_log(this->fd);
+    this->fd = -1;
+    fs::remove(this->path);
+}
@@ -0,0 +1,139 @@
+/**
+ * @file write_ahead_log.hpp
+ */
+#ifndef WRITE_AHEAD_LOG_CLASS_H
+#define WRITE_AHEAD_LOG_CLASS_H
+
+#include "auxiliary.hpp"
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <json.hpp>
+using json = nlohmann::json;
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @class write_ahead_log
+     * @brief Durable log of the changes to a collection. Every record gets a log sequence number (lsn).
+     * Writers that log at the same time share a single write and fsync (group commit).
+     */
+    class write_ahead_log {
+    private:
+        /**
+         * @brief Path to the log file.
+         */
+        std::string path;
+
+        /**
+         * @brief File descriptor of the log file, -1 when closed.
+         */
+        int fd;
+
+        /**
+         * @brief Lsn given to the next record.
+         */
+        unsigned long long next_lsn;
+
+        /**
+         * @brief Highest lsn known to be on disk.
+         */
+        unsigned long long durable_lsn;
+
+        /**
+         * @brief Highest lsn of a batch that failed to be written.
+         */
+        unsigned long long failed_lsn;
+
+        /**
+         * @brief Records waiting for the next group commit.
+         */
+        std::string buffer;
+
+        /**
+         * @brief Highest lsn in the buffer.
+         */
+        unsigned long long buffered_lsn;
+
+        /**
+         * @brief Indicates whether a writer is currently flushing a batch.
+         */
+        bool flushing;
+
+        /**
+         * @brief Protects the buffer and the lsn counters.
+         */
+        std::mutex lock;
+
+        /**
+         * @brief Wakes up the writers waiting for a batch to be flushed.
+         */
+        std::condition_variable flushed;
+
+    public:
+
+        /**
+         * @param path Path to the log file.
+         * @brief Constructor for the write_ahead_log class.
+         */
+        write_ahead_log(const std::string &path);
+
+        /**
+         * @brief Destructor for the write_ahead_log class. Closes the log file.
+         */
+        ~write_ahead_log();
+
+        /**
+         * @param checkpoint_lsn Lsn of the last record applied to the collection. Older records are skipped.
+         * @param records Destination of the records that still have to be applied, in order.
+         * @brief Reads the records in the log file. A torn record at the end of the file (from a crash) is cut off.
+         * @return 0 on success and 1 otherwise.
+         */
+        int recover(unsigned long long checkpoint_lsn, std::vector<json> &records);
+
+        /**
+         * @param checkpoint_lsn Lsn of the last record applied to the collection.
+         * @brief Opens the log file for appending, creating it if it doesn't exist.
+         * @return 0 on success and 1 otherwise.
+         */
+        int open(unsigned long long checkpoint_lsn);
+
+        /**
+         * @param record Record to log. An "lsn" field is added to it.
+         * @brief Appends a record and waits until it is durable.
+         * @return The lsn of the record or 0 if it couldn't be written.
+         */
+        unsigned long long log(json record);
+
+        /**
+         * @param records Records to log, in order. An "lsn" field is added to each one.
+         * @brief Appends several records and waits until they are durable, with a single group commit.
+         * @return The lsn of the last record or 0 if they couldn't be written.
+         */
+        unsigned long long log(std::vector<json> records);
+
+        /**
+         * @brief Gets the lsn of the last record logged.
+         */
+        unsigned long long get_last_lsn();
+
+        /**
+         * @brief Empties the log file. Should be called once every record has been applied to the collection.
+         * @return 0 on success and 1 otherwise.
+         */
+        int truncate();
+
+        /**
+         * @brief Closes and deletes the log file.
+         */
+        void delete_log();
+    };
+
+} // namespace nosqlite
+
+#endif
@@ -0,0 +1,307 @@
+#include "zone_map.hpp"
+#include "auxiliary.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <filesystem>
+#include <mutex>
+#include <json.hpp>
+
+using namespace nosqlite;
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+// The file has the magic number, the fields as JSON and the number of zones. Each zone has its number and, for each field,
+// whether it has numbers, their minimum and maximum and the filters, each one with its capacity, its count and its bits.
+static const char zone_magic[8] = {'N', 'S', 'Q', 'Z', 'O', 'N', 'E', '1'};
+
+// Bits per distinct value and bits set per value, about 1% false positives.
+static const unsigned long long bits_per_value = 10;
+static const unsigned int hashes_per_value = 7;
+
+/**
+ * @brief Number of 64 bit words of a filter for a number of distinct values.
+ */
+static size_t filter_words(unsigned long long capacity) {
+    return std::max<unsigned long long>(1, (capacity * bits_per_value + 63) / 64);
+}
+
+/**
+ * @brief Hashes a value as its canonical JSON, so numbers that compare equal have the same hash.
+ */
+static uint64_t value_hash(const json &value) {
+    return std::hash<std::string>()(canonical_dump(value));
+}
+
+/**
+ * @brief Gets the position of the i-th bit of a value, by double hashing.
+ */
+static uint64_t bit_position(uint64_t hash, unsigned int i, uint64_t size) {
+    uint64_t step = ((hash >> 32 | hash << 32) * 0x9e3779b97f4a7c15ULL) | 1;
+    return (hash + i * step) % size;
+}
+
+
+zone_map::zone_map(const std::string &path, const std::vector<field_type> &fields) : path(path), fields(fields), dirty(false) {}
+
+std::vector<field_type> zone_map::get_fields() const {
+    return this->fields;
+}
+
+zone_map::bloom_filter zone_map::new_filter(unsigned long long capacity) {
+    return {capacity, 0, std::vector<uint64_t>(filter_words(capacity), 0)};
+}
+
+bool zone_map::filter_contains(const bloom_filter &filter, uint64_t hash) {
+    uint64_t size = filter.bits.size() * 64;
+    for (unsigned int i = 0; i < hashes_per_value; i++) {
+        uint64_t bit = bit_position(hash, i, size);
+        if (!(filter.bits[bit / 64] >> (bit % 64) & 1)) return false;
+    }
+    return true;
+}
+
+void zone_map::add_value(field_synopsis &synopsis, const json &value) {
+    // Conditions on arrays are checked on each element.
+    if (value.is_array()) {
+        for (const json &element : value) add_value(synopsis, element);
+        return;
+    }
+    // Objects are never looked up, equal objects can have different dumps.
+    if (value.is_object()) return;
+
+    if (value.is_number()) {
+        double number = value.get<double>();
+        synopsis.minimum = synopsis.has_numbers ? std::min(synopsis.minimum, number) : number;
+        synopsis.maximum = synopsis.has_numbers ? std::max(synopsis.maximum, number) : number;
+        synopsis.has_numbers = true;
+    }
+
+    uint64_t hash = value_hash(value);
+    for (const bloom_filter &filter : synopsis.filters) {
+        if (filter_contains(filter, hash)) return;
+    }
+    if (synopsis.filters.empty() || synopsis.filters.back().count >= synopsis.filters.back().capacity) {
+        synopsis.filters.push_back(new_filter(synopsis.filters.empty() ? first_filter_capacity : synopsis.filters.back().capacity * 2));
+    }
+    bloom_filter &filter = synopsis.filters.back();
+    uint64_t size = filter.bits.size() * 64;
+    for (unsigned int i = 0; i < hashes_per_value; i++) {
+        uint64_t bit = bit_position(hash, i, size);
+        filter.bits[bit / 64] |= 1ULL << (bit % 64);
+    }
+    filter.count++;
+}
+
+bool zone_map::may_satisfy(const field_synopsis &synopsis, const std::string &op, const json &value) {
+    if (op == "in") {
+        if (!value.is_array()) return false;
+        for (const json &element : value) {
+            if (may_satisfy(synopsis, "==", element)) return true;
+        }
+        return false;
+    }
+    if (op == "==") {
+        if (value.is_array() || value.is_object()) return true;
+        if (value.is_number()) {
+            double number = value.get<double>();
+            if (!synopsis.has_numbers || number < synopsis.minimum || number > synopsis.maximum) return false;
+        }
+        uint64_t hash = value_hash(value);
+        for (const bloom_filter &filter : synopsis.filters) {
+            if (filter_contains(filter, hash)) return true;
+        }
+        return false;
+    }
+    if (op == ">" || op == ">=" || op == "<" || op == "<=") {
+        // Range conditions only match numbers. The bounds are compared inclusively since large integers lose precision as doubles.
+        if (!value.is_number() || !synopsis.has_numbers) return false;
+        double number = value.get<double>();
+        if (op == ">" || op == ">=") return synopsis.maximum >= number;
+        return synopsis.minimum <= number;
+    }
+    return true;
+}
+
+void zone_map::clear() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    this->zones.clear();
+    this->dirty = true;
+}
+
+void zone_map::add(unsigned int zone, const json &document) {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    std::vector<field_synopsis> &synopses = this->zones[zone];
+    synopses.resize(this->fields.size());
+    for (size_t f = 0; f < this->fields.size(); f++) {
+        try {
+            add_value(synopses[f], access_nested_fields(document, this->fields[f]));
+        } catch (...) {
+            continue;
+        }
+    }
+    this->dirty = true;
+}
+
+bool zone_map::applies(const std::vector<condition_type> &conditions) const {
+    for (const condition_type &condition : conditions) {
+        if (std::find(this->fields.begin(), this->fields.end(), condition.field) != this->fields.end()) return true;
+    }
+    return false;
+}
+
+bool zone_map::may_match(unsigned int zone, const std::vector<condition_type> &conditions) const {
+    std::shared_lock<std::shared_mutex> shared(this->lock);
+    auto found = this->zones.find(zone);
+    if (found == this->zones.end()) return false;
+
+    for (const condition_type &condition : conditions) {
+        auto field = std::find(this->fields.begin(), this->fields.end(), condition.field);
+        if (field == this->fields.end()) continue;
+        if (!may_satisfy(found->second[field - this->fields.begin()], condition.op, condition.value)) return false;
+    }
+    return true;
+}
+
+double zone_map::matching_fraction(const std::vector<condition_type> &conditions) const {
+    std::vector<unsigned int> numbers;
+    {
+        std::shared_lock<std::shared_mutex> shared(this->lock);
+        if (this->zones.empty()) return 1;
+        for (const auto &[zone, synopses] : this->zones) numbers.push_back(zone);
+    }
+    size_t matching = 0;
+    for (unsigned int zone : numbers) matching += this->may_match(zone, conditions);
+    return (double) matching / numbers.size();
+}
+
+int zone_map::open() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+
+    fs::path path_to_file(this->path);
+    if (!fs::exists(path_to_file)) return 1;
+
+    std::ifstream file(path_to_file, std::ios::binary);
+    if (!file.is_open()) {
+        throw_failed_to_open_file(path_to_file);
+        return 1;
+    }
+    std::string buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+
+    // Every read checks that the bytes are there, a truncated file is invalid.
+    size_t at = sizeof(zone_magic);
+    bool valid = buffer.size() >= at && std::memcmp(buffer.data(), zone_magic, sizeof(zone_magic)) == 0;
+    auto read = [&](void *destination, size_t size) {
+        if (!valid || buffer.size() - at < size) {
+            valid = false;
+            return;
+        }
+        std::memcpy(destination, buffer.data() + at, size);
+        at += size;
+    };
+
+    // Synopses written for other fields are out of date.
+    unsigned int fields_size = 0;
+    unsigned long long zone_count = 0;
+    read(&fields_size, sizeof(fields_size));
+    std::string fields_json(valid && buffer.size() - at >= fields_size ? fields_size : 0, '\0');
+    read(fields_json.data(), fields_size);
+    read(&zone_count, sizeof(zone_count));
+    if (valid && fields_json != json(this->fields).dump()) return 1;
+    size_t field_count = this->fields.size();
+
+    std::map<unsigned int, std::vector<field_synopsis>> loaded;
+    for (unsigned long long z = 0; z < zone_count && valid; z++) {
+        unsigned int zone = 0;
+        read(&zone, sizeof(zone));
+        std::vector<field_synopsis> &synopses = loaded[zone];
+        synopses.resize(field_count);
+        for (field_synopsis &synopsis : synopses) {
+            unsigned char has_numbers = 0;
+            unsigned int filter_count = 0;
+            read(&has_numbers, sizeof(has_numbers));
+            read(&synopsis.minimum, sizeof(synopsis.minimum));
+            read(&synopsis.maximum, sizeof(synopsis.maximum));
+            read(&filter_count, sizeof(filter_count));
+            synopsis.has_numbers = has_numbers != 0;
+            for (unsigned int i = 0; i < filter_count && valid; i++) {
+                unsigned long long capacity = 0, count = 0;
+                read(&capacity, sizeof(capacity));
+                read(&count, sizeof(count));
+                if (!valid || capacity == 0 || filter_words(capacity) > (buffer.size() - at) / sizeof(uint64_t)) {
+                    valid = false;
+                    break;
+                }
+                bloom_filter filter = new_filter(capacity);
+                filter.count = count;
+                read(filter.bits.data(), filter.bits.size() * sizeof(uint64_t));
+                synopsis.filters.push_back(std::move(filter));
+            }
+        }
+    }
+    if (!valid || at != buffer.size()) {
+        std::cerr << "Error: Invalid zone map file: " << path_to_file << "." << std::endl;
+        return 1;
+    }
+
+    this->zones.swap(loaded);
+    this->dirty = false;
+    return 0;
+}
+
+int zone_map::sync() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    if (!this->dirty) return 0;
+
+    std::string buffer(zone_magic, sizeof(zone_magic));
+    auto write = [&](const void *source, size_t size) { buffer.append(reinterpret_cast<const char*>(source), size); };
+    std::string fields_json = json(this->fields).dump();
+    unsigned int fields_size = fields_json.size();
+    unsigned long long zone_count = this->zones.size();
+    write(&fields_size, sizeof(fields_size));
+    write(fields_json.data(), fields_json.size());
+    write(&zone_count, sizeof(zone_count));
+    for (const auto &[zone, synopses] : this->zones) {
+        write(&zone, sizeof(zone));
+        for (const field_synopsis &synopsis : synopses) {
+            unsigned char has_numbers = synopsis.has_numbers;
+            unsigned int filter_count = synopsis.filters.size();
+            write(&has_numbers, sizeof(has_numbers));
+            write(&synopsis.minimum, sizeof(synopsis.minimum));
+            write(&synopsis.maximum, sizeof(synopsis.maximum));
+            write(&filter_count, sizeof(filter_count));
+            for (const bloom_filter &filter : synopsis.filters) {
+                write(&filter.capacity, sizeof(filter.capacity));
+                write(&filter.count, sizeof(filter.count));
+                write(filter.bits.data(), filter.bits.size() * sizeof(uint64_t));
+            }
+        }
+    }
+
+    // The new file replaces the old one in a single rename so a crash leaves one of them whole.
+    fs::path path_to_file(this->path);
+    fs::path temporary = path_to_file.string() + ".tmp";
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw_failed_to_create_file(temporary);
+        return 1;
+    }
+    file.write(buffer.data(), buffer.size());
+    file.close();
+    if (file.fail() || sync_file(temporary) != 0) return 1;
+
+    fs::rename(temporary, path_to_file);
+    if (sync_file(path_to_file.parent_path().empty() ? fs::path(".") : path_to_file.parent_path()) != 0) return 1;
+    this->dirty = false;
+    return 0;
+}
+
+void zone_map::delete_file() {
+    std::unique_lock<std::shared_mutex> exclusive(this->lock);
+    this->zones.clear();
+    this->dirty = false;
+    fs::remove(this->path);
+}
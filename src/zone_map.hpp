@@ -0,0 +1,175 @@
+/**
+ * @file zone_map.hpp
+ */
+#ifndef ZONE_MAP_CLASS_H
+#define ZONE_MAP_CLASS_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <shared_mutex>
+#include <json.hpp>
+#include "auxiliary.hpp"
+using json = nlohmann::json;
+
+
+/**
+ * @namespace Namespace for NoSQLite
+ */
+namespace nosqlite {
+
+    /**
+     * @class zone_map
+     * @brief Synopses of the stored documents of a collection, one per zone: a segment with SEGMENT_STORAGE and a top level directory with HASHED_STORAGE.
+     * For each chosen field a zone keeps a Bloom filter of its values and the minimum and maximum of its numbers, so scans skip the zones that can't have a document satisfying the conditions.
+     * Synopses only grow: values of deleted or updated documents stay in them until they are rebuilt, which never makes a scan miss a document.
+     * The synopses are kept in memory and written to zone_map.bin inside the collection directory when they are synced.
+     */
+    class zone_map {
+    private:
+
+        /**
+         * @brief Bloom filter sized for a number of distinct values. Zones that outgrow their filters get new ones twice as large.
+         */
+        struct bloom_filter {
+            unsigned long long capacity;
+            unsigned long long count;
+            std::vector<uint64_t> bits;
+        };
+
+        /**
+         * @brief Synopsis of a field in a zone.
+         */
+        struct field_synopsis {
+            std::vector<bloom_filter> filters;
+            bool has_numbers = false;
+            double minimum = 0;
+            double maximum = 0;
+        };
+
+        /**
+         * @brief Path to the synopses file.
+         */
+        std::string path;
+
+        /**
+         * @brief Fields with synopses.
+         */
+        std::vector<field_type> fields;
+
+        /**
+         * @brief Synopses of each zone, one per field in the order of the fields. Zones without documents have none.
+         */
+        std::map<unsigned int, std::vector<field_synopsis>> zones;
+
+        /**
+         * @brief Indicates whether the synopses changed since they were last written.
+         */
+        bool dirty;
+
+        /**
+         * @brief Scans check the synopses in parallel, changes need exclusive access.
+         */
+        mutable std::shared_mutex lock;
+
+        /**
+         * @param capacity Number of distinct values.
+         * @brief Creates an empty filter with about 10 bits per value.
+         */
+        static bloom_filter new_filter(unsigned long long capacity);
+
+        /**
+         * @param filter Filter.
+         * @param hash Hash of the value.
+         * @brief Checks if a value may be in a filter.
+         */
+        static bool filter_contains(const bloom_filter &filter, uint64_t hash);
+
+        /**
+         * @param synopsis Synopsis of a field in a zone.
+         * @param value Value of a field, arrays are added element by element.
+         * @brief Adds a value to a synopsis.
+         */
+        static void add_value(field_synopsis &synopsis, const json &value);
+
+        /**
+         * @param synopsis Synopsis of a field in a zone.
+         * @param op Comparison operator.
+         * @param value Value compared against.
+         * @brief Checks if a document summarized by the synopsis may satisfy a condition.
+         */
+        static bool may_satisfy(const field_synopsis &synopsis, const std::string &op, const json &value);
+
+    public:
+
+        /**
+         * @brief Number of distinct values of the first filter of a field in a zone.
+         */
+        static const unsigned long long first_filter_capacity = 1024;
+
+        /**
+         * @param path Path to the synopses file.
+         * @param fields Fields with synopses.
+         * @brief Constructor for the zone_map class.
+         */
+        zone_map(const std::string &path, const std::vector<field_type> &fields);
+
+        /**
+         * @brief Getter for the fields with synopses.
+         */
+        std::vector<field_type> get_fields() const;
+
+        /**
+         * @brief Reads the synopses from the file.
+         * @return 0 on success and 1 if the file is missing, invalid or has other fields.
+         */
+        int open();
+
+        /**
+         * @brief Removes the synopses of every zone.
+         */
+        void clear();
+
+        /**
+         * @param zone Zone where the document is stored.
+         * @param document Stored document.
+         * @brief Adds the values of a document to the synopses of its zone.
+         */
+        void add(unsigned int zone, const json &document);
+
+        /**
+         * @param conditions Conditions of a query.
+         * @brief Checks if any condition can be checked against the synopses.
+         */
+        bool applies(const std::vector<condition_type> &conditions) const;
+
+        /**
+         * @param zone Zone.
+         * @param conditions Conditions of a query.
+         * @brief Checks if a document of the zone may satisfy all of the conditions. Zones without documents never do.
+         */
+        bool may_match(unsigned int zone, const std::vector<condition_type> &conditions) const;
+
+        /**
+         * @param conditions Conditions of a query.
+         * @brief Gets the fraction of the zones with documents that may satisfy all of the conditions, 1 if no zone has documents.
+         */
+        double matching_fraction(const std::vector<condition_type> &conditions) const;
+
+        /**
+         * @brief Writes the synopses to the file if they changed, replacing it at once.
+         * @return 0 on success and 1 otherwise.
+         */
+        int sync();
+
+        /**
+         * @brief Deletes the synopses file.
+         */
+        void delete_file();
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,66 @@
+#include <iostream>
+#include <string>
+#include <json.hpp>
+#include "auxiliary.hpp"
+#include "collection.hpp"
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+using namespace nosqlite;
+using json = nlohmann::json;
+
+static int failures = 0;
+
+static void check(bool condition, const std::string &storage, const std::string &message) {
+    if (condition) return;
+    std::cerr << "FAILED (" << storage << "): " << message << std::endl;
+    failures++;
+}
+
+/**
+ * @param path Path of the collection.
+ * @param storage Layout of the collection.
+ * @brief Documents added and deleted before a checkpoint never reach the storage, the checkpoint still has to succeed and empty the log.
+ */
+static void insert_delete_checkpoint(const fs::path &path, storage_type storage) {
+    std::string name = storage_type_to_string(storage);
+    {
+        collection documents(path.string(), storage);
+        check(documents.build_from_scratch("") == 0, name, "create the collection");
+        for (int i = 0; i < 5; i++) documents.create_document({{"year", 1990 + i}});
+        check(documents.delete_with_conditions({{{"year"}, "==", 1992}}) == 1, name, "delete one document");
+        check(documents.checkpoint() == 0, name, "checkpoint after an insert and a delete");
+        check(fs::file_size(path / "wal.log") == 0, name, "empty log after the checkpoint");
+
+        // The other conditions are checked when a document is found by id.
+        check(documents.delete_with_conditions({{{"id"}, "==", 4}, {{"year"}, "==", 1900}}) == 0, name, "delete by id with a condition it doesn't satisfy");
+        check(documents.delete_with_conditions({{{"id"}, "==", 99}}) == 0, name, "delete a missing id");
+        check(documents.create_index({{"year"}}, HASH_INDEX) == 0, name, "create an index, which checkpoints");
+    }
+
+    collection reopened(path.string());
+    check(reopened.build_from_existing() == 0, name, "reopen the collection");
+    check(reopened.count({}) == 4, name, "documents after reopening");
+    check(reopened.read_with_conditions({{{"year"}, "==", 1992}}).empty(), name, "deleted document after reopening");
+    check(reopened.read_with_conditions({{{"id"}, "==", 4}}).size() == 1, name, "document deleted by id with an unsatisfied condition");
+
+    // Reads through a cursor find documents by id the same way.
+    read_options limited;
+    limited.limit = 10;
+    check(reopened.read_with_conditions({{{"id"}, "==", 4}, {{"year"}, "==", 1900}}, nullptr, limited).empty(), name, "cursor read by id with an unsatisfied condition");
+    check(reopened.read_with_conditions({{{"id"}, "==", 99}}, nullptr, limited).empty(), name, "cursor read of a missing id");
+    check(reopened.read_with_conditions({{{"id"}, "==", 4}}, nullptr, limited).size() == 1, name, "cursor read by id");
+}
+
+int main() {
+    fs::path root = fs::temp_directory_path() / ("nosqlite-checkpoint-test-" + std::to_string(getpid()));
+    fs::remove_all(root);
+    fs::create_directories(root);
+
+    insert_delete_checkpoint(root / "hashed", HASHED_STORAGE);
+    insert_delete_checkpoint(root / "segment", SEGMENT_STORAGE);
+
+    fs::remove_all(root);
+    if (failures == 0) std::cout << "All checkpoint tests passed." << std::endl;
+    return failures == 0 ? 0 : 1;
+}